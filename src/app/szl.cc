@@ -39,6 +39,7 @@
 #include "public/commandlineflags.h"
 #include "public/logging.h"
 #include "public/recordio.h"
+#include "public/columnarinput.h"
 
 #include "utilities/strutils.h"
 #include "fmt/fmt.h"
@@ -73,6 +74,13 @@ DEFINE_bool(print_code, false, "print generated code");
 DEFINE_bool(trace_files, false, "trace input files");
 DEFINE_bool(trace_input, false, "trace input records");
 DEFINE_bool(use_recordio, false, "use record I/O to read input files");
+DEFINE_bool(use_columnar_input, false, "read input files written by "
+            "sawzall::ColumnarInputWriter, decoding only the input fields "
+            "the program reads");
+DEFINE_bool(decompress_input, true, "decompress input files compressed with "
+            "gzip, zlib or compress");
+DEFINE_int32(input_threads, 0, "number of threads used to decompress gzip "
+             "input files (0 => one per CPU)");
 DEFINE_bool(ignore_undefs, false,
             "silently ignore undefined variables/statements");
 DEFINE_bool(info, false, "print Sawzall version information");
@@ -98,6 +106,8 @@ DEFINE_string(gen_elf, "",
               "generate ELF file representing generated native code");
 DEFINE_string(table_output, "", "comma-separated list of table names or * to "
               "display the aggregated output for.");
+DEFINE_int32(table_batch_size, 1, "number of emits buffered per aggregating "
+             "table before they are added to the table entries (1 => none)");
 
 #ifdef OS_LINUX
 DEFINE_int32(memory_limit, 0,
@@ -120,20 +130,22 @@ static void TraceBinaryInput(uint64 record_number, const void* input, size_t siz
 static void ApplyToRecords(sawzall::Process* process, const char* file_name,
                            uint64 begin, uint64 end) {
   // TODO: support sequence file input
-  assert(false);
   sawzall::RecordReader* reader = sawzall::RecordReader::Open(file_name);
   if (reader != NULL) {
-    uint64 record_number = 0;
+    // Indexed files go straight to the first record; the record numbers
+    // come from the file, so they stay right if corrupt blocks are skipped.
     char* record_ptr;
     size_t record_size;
-    while (record_number < end && reader->Read(&record_ptr, &record_size)) {
-      if (begin <= record_number) {
+    if (begin < end && reader->SeekToRecord(begin)) {
+      while (reader->Read(&record_ptr, &record_size)) {
+        uint64 record_number = reader->record_number();
+        if (record_number >= end)
+          break;
         if (FLAGS_trace_input)
           TraceBinaryInput(record_number, record_ptr, record_size);
         string key = StringPrintf("%"PRIu64, record_number);
         process->RunOrDie(record_ptr, record_size, key.data(), key.size());
       }
-      record_number++;
     }
     if (!reader->error_message().empty())
       fprintf(stderr, "error reading file: %s: %s\n",
@@ -147,6 +159,40 @@ static void ApplyToRecords(sawzall::Process* process, const char* file_name,
 }
 
 
+// Like ApplyToRecords, for columnar input files.  If tags is not NULL, only
+// the fields with these tags are read.
+static void ApplyToColumns(sawzall::Process* process, const vector<int>* tags,
+                           const char* file_name, uint64 begin, uint64 end) {
+  string error;
+  sawzall::ColumnarInputReader* reader =
+      sawzall::ColumnarInputReader::Open(file_name, &error);
+  if (reader == NULL) {
+    fprintf(stderr, "can't open file: %s\n", error.c_str());
+    return;
+  }
+  if (tags != NULL)
+    reader->SelectFields(*tags);
+  const char* record_ptr;
+  size_t record_size;
+  if (begin < end && reader->SeekToRecord(begin)) {
+    while (reader->Read(&record_ptr, &record_size)) {
+      uint64 record_number = reader->record_number();
+      if (record_number >= end)
+        break;
+      if (FLAGS_trace_input)
+        TraceBinaryInput(record_number, record_ptr, record_size);
+      string key = StringPrintf("%"PRIu64, record_number);
+      process->RunOrDie(record_ptr, record_size, key.data(), key.size());
+    }
+  }
+  if (!reader->error_message().empty())
+    fprintf(stderr, "error reading file: %s: %s\n",
+                    file_name,
+                    reader->error_message().c_str());
+  delete reader;
+}
+
+
 static bool Execute(const char* program, const char* cmd,
                     int argc, char* argv[], uint64 begin, uint64 end) {
   sawzall::Executable exe(program, cmd, ExecMode());
@@ -192,12 +238,18 @@ static bool Execute(const char* program, const char* cmd,
     Fmt::fmtfdinit(&fmt, 1, buf, sizeof buf);
 
     // register backend emitters for tables
-    SzlEmitterFactory emitter_factory(&fmt, TableOutput(&process));
+    SzlEmitterFactory emitter_factory(&fmt, TableOutput(&process),
+                                      FLAGS_table_batch_size);
     process.set_emitter_factory(&emitter_factory);
     sawzall::RegisterEmitters(&process);
 
     process.InitializeOrDie();
 
+    // columnar input supplies only the fields of the input proto
+    // that the program reads, if that is all it looks at
+    vector<int> input_tags;
+    const bool prune_input = exe.GetReferencedInputFieldTags(&input_tags);
+
     // run for each input line, if any
     if (argc > 0) {
       // we have an input file
@@ -209,7 +261,10 @@ static bool Execute(const char* program, const char* cmd,
         } else {
           if (FLAGS_trace_files)
             printf("%d. processing %s\n", i, file_name);
-          if (FLAGS_use_recordio)
+          if (FLAGS_use_columnar_input)
+            ApplyToColumns(&process, prune_input ? &input_tags : NULL,
+                           file_name, begin, end);
+          else if (FLAGS_use_recordio)
             ApplyToRecords(&process, file_name, begin, end);
           else
             ApplyToLines(&process, file_name, begin, end);
@@ -37,8 +37,9 @@
 #include "app/printemitter.h"
 
 
-SzlEmitterFactory::SzlEmitterFactory(Fmt::State* f, string vocal_szl_emitters):
-    f_(f) {
+SzlEmitterFactory::SzlEmitterFactory(Fmt::State* f, string vocal_szl_emitters,
+                                     int batch_size):
+    batch_size_(batch_size), f_(f) {
   if (vocal_szl_emitters == "") {
     all_print_emitters_ = true;
   } else {
@@ -76,10 +77,14 @@ sawzall::Emitter* SzlEmitterFactory::NewSzlEmitter(
                                  &type_error)) {
     SzlTabWriter* tab_writer = SzlTabWriter::CreateSzlTabWriter(szl_type,
                                                                 &type_error);
-    if (tab_writer != NULL && tab_writer->WritesToMill())
-      emitter = new SzlEmitter(name, tab_writer, is_vocal_szl_emitter(name));
-    else if (type_error.empty())
+    if (tab_writer != NULL && tab_writer->WritesToMill()) {
+      SzlEmitter* szl_emitter =
+          new SzlEmitter(name, tab_writer, is_vocal_szl_emitter(name));
+      szl_emitter->set_batch_size(batch_size_);
+      emitter = szl_emitter;
+    } else if (type_error.empty()) {
       emitter = new PrintEmitter(name, f_, is_vocal_szl_emitter(name));
+    }
   }
   if (emitter == NULL) {
     CHECK(!type_error.empty());
@@ -22,7 +22,9 @@ class SzlEmitterFactory : public sawzall::EmitterFactory {
   // vocal_szl_emitters is a comma-separated list of tables that require
   // szl emitters with enabled display of aggregated totals; if the list is
   // empty, print emitters are to be created for all tables.
-  SzlEmitterFactory(Fmt::State* f, string vocal_szl_emitters);
+  // batch_size is the number of emits each szl emitter buffers before
+  // adding them to its table; see SzlEmitter::set_batch_size().
+  SzlEmitterFactory(Fmt::State* f, string vocal_szl_emitters, int batch_size);
   ~SzlEmitterFactory();
 
   // If the factory is configured to create all print emitters, returns a print
@@ -41,6 +43,7 @@ class SzlEmitterFactory : public sawzall::EmitterFactory {
   vector<string> vocal_szl_emitters_;  // these will display aggregated totals
 
   bool all_print_emitters_;
+  int batch_size_;
   vector<sawzall::Emitter*> emitters_;
 
   Fmt::State* f_;
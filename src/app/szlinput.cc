@@ -0,0 +1,555 @@
+// Copyright 2010 Google Inc.
+// 
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+// 
+//      http://www.apache.org/licenses/LICENSE-2.0
+// 
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ------------------------------------------------------------------------
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <string.h>
+#include <unistd.h>
+#include <zlib.h>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#include "public/porting.h"
+#include "public/logging.h"
+
+#include "utilities/strutils.h"
+#include "utilities/lzw.h"
+#include "utilities/blockgzip.h"
+#include "utilities/spscqueue.h"
+
+#include "public/sawzall.h"
+#include "app/szlinput.h"
+
+
+// ----------------------------------------------------------------------------
+// SzlInputStream
+
+SzlInputStream::SzlInputStream(int fd, bool close_fd, vector<char>* block,
+                               int size)
+    : fd_(fd), close_fd_(close_fd), pos_(0), end_(size) {
+  buffer_.swap(*block);
+  buffer_.resize(kBlockSize);
+}
+
+
+SzlInputStream::~SzlInputStream() {
+  if (close_fd_)
+    close(fd_);
+}
+
+
+int SzlInputStream::ReadFile(char* buffer, int size) {
+  int n;
+  do {
+    n = read(fd_, buffer, size);
+  } while (n < 0 && errno == EINTR);
+  if (n < 0)
+    return Fail(strerror(errno));
+  return n;
+}
+
+
+bool SzlInputStream::Fill() {
+  if (pos_ > 0) {
+    memmove(&buffer_[0], &buffer_[pos_], end_ - pos_);
+    end_ -= pos_;
+    pos_ = 0;
+  }
+  if (end_ == kBlockSize)
+    return true;
+  int n = ReadFile(&buffer_[end_], kBlockSize - end_);
+  if (n <= 0)
+    return false;
+  end_ += n;
+  return true;
+}
+
+
+int SzlInputStream::Fail(const string& error) {
+  if (error_.empty())
+    error_ = error;
+  return -1;
+}
+
+
+namespace {
+
+// An uncompressed file.
+class PlainStream : public SzlInputStream {
+ public:
+  PlainStream(int fd, bool close_fd, vector<char>* block, int size)
+      : SzlInputStream(fd, close_fd, block, size)  { }
+
+  virtual int Read(char* buffer, int size) {
+    if (available() == 0)
+      return ReadFile(buffer, size);
+    int n = min(size, available());
+    memcpy(buffer, next(), n);
+    Consume(n);
+    return n;
+  }
+
+  virtual const char* format() const  { return "plain"; }
+};
+
+
+// A file compressed with gzip or in the zlib format, decompressed with
+// zlib.  A gzip file may consist of several members, each a complete
+// gzip stream, which are decompressed one after the other.
+class ZlibStream : public SzlInputStream {
+ public:
+  ZlibStream(int fd, bool close_fd, vector<char>* block, int size,
+             bool gzip)
+      : SzlInputStream(fd, close_fd, block, size),
+        gzip_(gzip), in_stream_(false), done_(false) {
+    memset(&zstream_, 0, sizeof zstream_);
+    // 16 added to the window bits selects the gzip format
+    CHECK_EQ(Z_OK, inflateInit2(&zstream_, MAX_WBITS + (gzip ? 16 : 0)));
+  }
+  virtual ~ZlibStream()  { inflateEnd(&zstream_); }
+
+  virtual int Read(char* buffer, int size) {
+    if (done_)
+      return 0;
+    zstream_.next_out = reinterpret_cast<Bytef*>(buffer);
+    zstream_.avail_out = size;
+    while (zstream_.avail_out == static_cast<uInt>(size)) {
+      if (available() == 0 && !Fill()) {
+        done_ = true;
+        if (!error_.empty())
+          return -1;
+        if (in_stream_)
+          return Fail("unexpected end of compressed data");
+        break;
+      }
+      zstream_.next_in =
+          reinterpret_cast<Bytef*>(const_cast<char*>(next()));
+      zstream_.avail_in = available();
+      int status = inflate(&zstream_, Z_NO_FLUSH);
+      Consume(available() - zstream_.avail_in);
+      if (status == Z_STREAM_END) {
+        in_stream_ = false;
+        if (!NextMember()) {
+          done_ = true;
+          if (!error_.empty())
+            return -1;
+          break;
+        }
+        inflateReset(&zstream_);
+      } else if (status == Z_OK || status == Z_BUF_ERROR) {
+        in_stream_ = true;
+      } else {
+        done_ = true;
+        return Fail(zstream_.msg != NULL ? zstream_.msg
+                                         : "corrupt compressed data");
+      }
+    }
+    return size - zstream_.avail_out;
+  }
+
+  virtual const char* format() const  { return gzip_ ? "gzip" : "zlib"; }
+
+ private:
+  // At the end of a gzip member: returns whether another member follows.
+  // Anything else after the member is ignored, as gzip does.
+  bool NextMember() {
+    if (!gzip_)
+      return false;
+    if (available() < 2)
+      Fill();
+    return available() >= 2 &&
+           static_cast<uint8>(next()[0]) == 0x1f &&
+           static_cast<uint8>(next()[1]) == 0x8b;
+  }
+
+  z_stream zstream_;
+  const bool gzip_;
+  bool in_stream_;  // inside a compressed stream
+  bool done_;
+};
+
+
+// A gzip file decompressed a buffer at a time on several threads: by
+// BlockGzipInflate if it is a block gzip file, by a SpeculativeGunzip
+// otherwise.
+class ParallelGzipStream : public SzlInputStream {
+ public:
+  ParallelGzipStream(int fd, bool close_fd, vector<char>* block, int size,
+                     int num_threads)
+      : SzlInputStream(fd, close_fd, block, size),
+        num_threads_(num_threads),
+        blocks_(IsBlockGzip(next(), available())),
+        gunzip_(num_threads),
+        output_pos_(0),
+        at_end_(false) {
+  }
+
+  virtual int Read(char* buffer, int size) {
+    while (output_pos_ == output_.size()) {
+      // Report an error only after the output that preceded it.
+      if (!decompress_error_.empty())
+        return Fail(decompress_error_);
+      if (at_end_ && (blocks_ ? available() == 0 : gunzip_.done()))
+        return 0;
+      Decompress();
+    }
+    int n = min(size, static_cast<int>(output_.size() - output_pos_));
+    memcpy(buffer, output_.data() + output_pos_, n);
+    output_pos_ += n;
+    return n;
+  }
+
+  virtual const char* format() const  {
+    return blocks_ ? "block gzip" : "gzip";
+  }
+
+ private:
+  // Fills the buffer, as there is a piece of work for each thread in a
+  // full buffer, and decompresses what it can of it into output_.
+  void Decompress() {
+    while (!at_end_ && available() < kBlockSize) {
+      if (!Fill())
+        at_end_ = true;
+    }
+    if (!error_.empty()) {
+      decompress_error_ = error_;
+      return;
+    }
+    output_.clear();
+    output_pos_ = 0;
+    int n;
+    if (blocks_) {
+      n = BlockGzipInflate(next(), available(), num_threads_, &output_,
+                           &decompress_error_);
+      if (n == 0 && at_end_ && available() > 0)
+        decompress_error_ = "unexpected end of compressed data";
+    } else {
+      n = gunzip_.Decompress(next(), available(), at_end_, &output_,
+                             &decompress_error_);
+    }
+    if (n == 0 && output_.empty() && available() == kBlockSize)
+      decompress_error_ = "corrupt compressed data";
+    if (n > 0)
+      Consume(n);
+  }
+
+  const int num_threads_;
+  const bool blocks_;
+  SpeculativeGunzip gunzip_;
+  string output_;    // decompressed data
+  int output_pos_;   // next byte of output_ to return
+  bool at_end_;      // the whole file has been read
+  string decompress_error_;
+};
+
+
+// A file compressed with compress (.Z), decompressed by LZWInflate.
+class CompressStream : public SzlInputStream {
+ public:
+  // The block starts with the 3 byte header, whose last byte holds flags
+  // giving the maximum code size and the block mode.
+  CompressStream(int fd, bool close_fd, vector<char>* block, int size)
+      : SzlInputStream(fd, close_fd, block, size),
+        inflater_(next()[2] & kMaxBitsMask, (next()[2] & kBlockModeFlag) != 0),
+        done_(false) {
+    Consume(kHeaderSize);
+  }
+
+  static const int kHeaderSize = 3;
+  static const int kMaxBitsMask = 0x1f;
+  static const int kBlockModeFlag = 0x80;
+
+  virtual int Read(char* buffer, int size) {
+    while (!done_) {
+      // Codes that straddle the end of the buffer are left unconsumed.
+      inflater_.Input(next(), available());
+      int n = inflater_.Inflate(buffer, size);
+      Consume(available() - inflater_.Tell());
+      if (n > 0)
+        return n;
+      if (!Fill())
+        done_ = true;
+    }
+    return error_.empty() ? 0 : -1;
+  }
+
+  virtual const char* format() const  { return "compress"; }
+
+ private:
+  LZWInflate inflater_;
+  bool done_;
+};
+
+
+// Returns whether the data starts with a valid zlib header and the
+// beginning of a valid zlib stream; plain text can start with the two
+// bytes of a zlib header.
+bool IsZlib(const char* data, int size) {
+  if (size < 2)
+    return false;
+  const int cmf = static_cast<uint8>(data[0]);
+  const int flg = static_cast<uint8>(data[1]);
+  // deflate with a window of at most 32K, no preset dictionary
+  if ((cmf & 0x0f) != Z_DEFLATED || (cmf >> 4) > 7 ||
+      (cmf * 256 + flg) % 31 != 0 || (flg & 0x20) != 0)
+    return false;
+  z_stream zstream;
+  memset(&zstream, 0, sizeof zstream);
+  if (inflateInit(&zstream) != Z_OK)
+    return false;
+  char out[4096];
+  zstream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data));
+  zstream.avail_in = size;
+  zstream.next_out = reinterpret_cast<Bytef*>(out);
+  zstream.avail_out = sizeof out;
+  int status = inflate(&zstream, Z_NO_FLUSH);
+  inflateEnd(&zstream);
+  return status == Z_OK || status == Z_STREAM_END || status == Z_BUF_ERROR;
+}
+
+}  // namespace
+
+
+SzlInputStream* SzlInputStream::Open(const char* file_name, bool decompress,
+                                     int num_threads, string* error) {
+  // As with fopen, /dev/stdin may not be openable when it is connected to
+  // a unix domain socket, so use the already open descriptor.
+  const bool is_stdin = strcmp(file_name, "/dev/stdin") == 0;
+  int fd = is_stdin ? STDIN_FILENO : open(file_name, O_RDONLY);
+  if (fd < 0) {
+    *error = StringPrintf("%s: %s", file_name, strerror(errno));
+    return NULL;
+  }
+#ifdef POSIX_FADV_SEQUENTIAL
+  // Ask for aggressive readahead; this fails harmlessly on pipes.
+  posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+
+  // Read the first block, or at least enough of it to recognize the format.
+  vector<char> block(kBlockSize);
+  int size = 0;
+  while (size < 3) {
+    int n = read(fd, &block[size], kBlockSize - size);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n < 0) {
+      *error = StringPrintf("%s: %s", file_name, strerror(errno));
+      if (!is_stdin)
+        close(fd);
+      return NULL;
+    }
+    if (n == 0)
+      break;
+    size += n;
+  }
+
+  const uint8* magic = reinterpret_cast<const uint8*>(&block[0]);
+  if (num_threads <= 0)
+    num_threads = max(1L, sysconf(_SC_NPROCESSORS_ONLN));
+  if (decompress && size >= 2 && magic[0] == 0x1f && magic[1] == 0x8b) {
+    if (num_threads > 1)
+      return new ParallelGzipStream(fd, !is_stdin, &block, size, num_threads);
+    return new ZlibStream(fd, !is_stdin, &block, size, true);
+  }
+  if (decompress && size >= 3 && magic[0] == 0x1f && magic[1] == 0x9d)
+    return new CompressStream(fd, !is_stdin, &block, size);
+  if (decompress && IsZlib(&block[0], size))
+    return new ZlibStream(fd, !is_stdin, &block, size, false);
+  return new PlainStream(fd, !is_stdin, &block, size);
+}
+
+
+// ----------------------------------------------------------------------------
+// SzlInputPipeline
+
+SzlInputPipeline::SzlInputPipeline(SzlInputStream* stream,
+                                   uint64 begin, uint64 end)
+    : stream_(stream),
+      begin_(begin),
+      end_(end),
+      record_number_(0),
+      cancel_(false),
+      ready_(kQueueCapacity),
+      free_(kQueueCapacity + 2),
+      num_batches_(0),
+      current_(NULL),
+      done_(false) {
+  CHECK_EQ(0, pthread_create(&thread_, NULL, ReaderThread, this));
+}
+
+
+SzlInputPipeline::~SzlInputPipeline() {
+  cancel_ = true;
+  CHECK_EQ(0, pthread_join(thread_, NULL));
+  Batch* batch;
+  while (ready_.TryPop(&batch))
+    delete batch;
+  while (free_.TryPop(&batch))
+    delete batch;
+  delete current_;
+  delete stream_;
+}
+
+
+const SzlInputPipeline::Batch* SzlInputPipeline::Next() {
+  if (done_)
+    return NULL;
+  if (current_ != NULL)
+    free_.Push(current_);  // never full: it can hold all the batches
+  ready_.Pop(&current_);
+  if (current_ == NULL)
+    done_ = true;
+  return current_;
+}
+
+
+void* SzlInputPipeline::ReaderThread(void* arg) {
+  static_cast<SzlInputPipeline*>(arg)->ReadBatches();
+  return NULL;
+}
+
+
+SzlInputPipeline::Batch* SzlInputPipeline::NewBatch() {
+  Batch* batch;
+  for (int attempts = 0; !free_.TryPop(&batch); attempts++) {
+    if (num_batches_ < kQueueCapacity + 2) {
+      num_batches_++;
+      return new Batch;
+    }
+    if (cancel_)
+      return NULL;
+    SPSCQueue<Batch*>::Wait(attempts);
+  }
+  return batch;
+}
+
+
+bool SzlInputPipeline::Send(Batch* batch) {
+  for (int attempts = 0; !ready_.TryPush(batch); attempts++) {
+    if (cancel_)
+      return false;
+    SPSCQueue<Batch*>::Wait(attempts);
+  }
+  return true;
+}
+
+
+void SzlInputPipeline::ReadBatches() {
+  // The incomplete line at the end of the previous batch.
+  vector<char> carry;
+  bool at_end = record_number_ >= end_;
+  while (!at_end) {
+    Batch* batch = NewBatch();
+    if (batch == NULL)
+      return;
+    batch->records.clear();
+    batch->keys.clear();
+    batch->key_ends.clear();
+    // The records point into the text, so it must never be reallocated
+    // while the batch is filled: reserve its maximum size.
+    vector<char>* text = &batch->text;
+    text->reserve(kBatchSize + kReadSize + kMaxLineSize);
+    text->assign(carry.begin(), carry.end());
+    int pos = 0;
+    for (;;) {
+      const int size = text->size();
+      text->resize(size + kReadSize);
+      int n = stream_->Read(&(*text)[size], kReadSize);
+      if (n < 0)
+        error_ = stream_->error();
+      text->resize(size + max(n, 0));
+      at_end = n <= 0;
+      AddRecords(batch, &pos, at_end);
+      if (record_number_ >= end_)
+        at_end = true;
+      if (at_end || text->size() >= kBatchSize ||
+          (n < kReadSize && !batch->records.empty()))
+        break;
+    }
+    carry.assign(text->begin() + pos, text->end());
+
+    if (batch->records.empty()) {
+      delete batch;
+      num_batches_--;
+      continue;
+    }
+    const char* keys = batch->keys.data();
+    for (int i = 0, key_begin = 0; i < batch->records.size(); i++) {
+      batch->records[i].key_ptr = keys + key_begin;
+      batch->records[i].key_size = batch->key_ends[i] - key_begin;
+      key_begin = batch->key_ends[i];
+    }
+    if (!Send(batch)) {
+      delete batch;
+      return;
+    }
+  }
+  Send(NULL);
+}
+
+
+// Appends the decimal digits of n to s.
+static void AppendDecimal(uint64 n, string* s) {
+  char digits[20];
+  int i = sizeof digits;
+  do {
+    digits[--i] = '0' + n % 10;
+    n /= 10;
+  } while (n != 0);
+  s->append(digits + i, sizeof digits - i);
+}
+
+
+void SzlInputPipeline::AddRecords(Batch* batch, int* pos, bool at_end) {
+  const char* text = &batch->text[0];
+  const int size = batch->text.size();
+  const int kMaxLength = kMaxLineSize - 1;
+  while (*pos < size && record_number_ < end_) {
+    const char* line = text + *pos;
+    const int available = size - *pos;
+    const char* newline = static_cast<const char*>(
+        memchr(line, '\n', min(available, kMaxLength)));
+    int length;
+    int consumed;
+    if (newline != NULL) {
+      length = newline - line;
+      consumed = length + 1;
+    } else if (available >= kMaxLength || at_end) {
+      length = consumed = min(available, kMaxLength);
+    } else {
+      break;  // incomplete line
+    }
+    const char* nul = static_cast<const char*>(memchr(line, '\0', length));
+    if (nul != NULL)
+      length = nul - line;
+
+    if (record_number_ >= begin_) {
+      if (batch->records.empty())
+        batch->first_record = record_number_;
+      sawzall::RecordSpan record;
+      record.input_ptr = line;
+      record.input_size = length;
+      record.key_ptr = NULL;  // set once all the keys are in place
+      record.key_size = 0;
+      batch->records.push_back(record);
+      AppendDecimal(record_number_, &batch->keys);
+      batch->key_ends.push_back(batch->keys.size());
+    }
+    record_number_++;
+    *pos += consumed;
+  }
+}
@@ -0,0 +1,162 @@
+// Copyright 2010 Google Inc.
+// 
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+// 
+//      http://www.apache.org/licenses/LICENSE-2.0
+// 
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ------------------------------------------------------------------------
+
+// Input for szl: a stream that reads an input file and decompresses it
+// if needed, and a pipeline that reads a stream on a background thread,
+// splits it into lines and hands batches of records to the thread that
+// runs the Sawzall program.
+
+#ifndef _APP_SZLINPUT_H__
+#define _APP_SZLINPUT_H__
+
+#include <pthread.h>
+#include <string>
+#include <vector>
+
+#include "utilities/spscqueue.h"
+
+
+// The bytes of an input file.  Files compressed with gzip (including
+// concatenated gzip members), zlib or compress (.Z) are recognized by
+// their magic numbers and decompressed.  Gzip files are decompressed on
+// several threads where their structure allows it; see
+// utilities/blockgzip.h.
+class SzlInputStream {
+ public:
+  // Size of the blocks read from the file.
+  static const int kBlockSize = 1 << 20;
+
+  // Opens file_name; "/dev/stdin" reads the standard input.  If
+  // decompress is false, the file is read as is.  Gzip files are
+  // decompressed on up to num_threads threads; 0 means one per CPU.
+  // Returns NULL and sets *error on failure.
+  static SzlInputStream* Open(const char* file_name, bool decompress,
+                              int num_threads, string* error);
+
+  virtual ~SzlInputStream();
+
+  // Reads up to size bytes into buffer.  Returns the number of bytes
+  // read, which may be less than size, for instance when reading from a
+  // pipe; 0 at the end of the input; or -1 on error.
+  virtual int Read(char* buffer, int size) = 0;
+
+  // The format of the file: "plain", "gzip", "block gzip", "zlib" or
+  // "compress".
+  virtual const char* format() const = 0;
+
+  const string& error() const  { return error_; }
+
+ protected:
+  // Takes over fd and the first block read from it, the first size
+  // bytes of *block.
+  SzlInputStream(int fd, bool close_fd, vector<char>* block, int size);
+
+  // Reads more of the file into the buffer, after the bytes that have not
+  // been consumed yet.  Returns false at the end of the file or on error;
+  // returns true without reading if the buffer is full.
+  bool Fill();
+
+  // Reads directly into buffer, bypassing the buffer of the stream.
+  int ReadFile(char* buffer, int size);
+
+  // The bytes of the buffer that have not been consumed yet.
+  const char* next() const  { return &buffer_[pos_]; }
+  int available() const  { return end_ - pos_; }
+  void Consume(int n)  { pos_ += n; }
+
+  // Records an error; returns -1 for use by Read.
+  int Fail(const string& error);
+
+  string error_;
+
+ private:
+  int fd_;
+  bool close_fd_;
+  vector<char> buffer_;
+  int pos_;
+  int end_;
+};
+
+
+// Reads the lines of a stream on a background thread.  Lines are split
+// the way fgets with a buffer of kMaxLineSize bytes splits them: a line
+// longer than kMaxLineSize - 1 bytes becomes several records.  A record
+// ends at its first NUL byte, if any.  The key of each record is its
+// record number in decimal.
+class SzlInputPipeline {
+ public:
+  static const int kMaxLineSize = 4096;
+
+  // A batch of consecutive records.
+  struct Batch {
+    vector<sawzall::RecordSpan> records;
+    uint64 first_record;   // record number of records[0]
+    vector<char> text;     // the lines; records point into it
+    string keys;           // the keys; records point into it
+    vector<int> key_ends;  // end of each record's key in keys
+  };
+
+  // Starts reading the records numbered [begin, end) from stream, which
+  // the pipeline owns.
+  SzlInputPipeline(SzlInputStream* stream, uint64 begin, uint64 end);
+  // Stops the reader thread, after any read from the stream in progress.
+  ~SzlInputPipeline();
+
+  // Returns the next batch of records, or NULL after the last one.  The
+  // batch is valid until the next call.
+  const Batch* Next();
+
+  // After Next returned NULL: a description of the read error that ended
+  // the input early, or empty if all the input was read.
+  const string& error() const  { return error_; }
+
+ private:
+  // Maximum number of batches that are ready for the consumer.
+  static const int kQueueCapacity = 4;
+  // Size of the reads from the stream.
+  static const int kReadSize = SzlInputStream::kBlockSize / 4;
+  // A batch is passed on once its text reaches this size, or earlier if a
+  // read from the stream comes up short.
+  static const int kBatchSize = SzlInputStream::kBlockSize;
+
+  static void* ReaderThread(void* arg);
+  void ReadBatches();
+
+  // Producer side: gets a batch to fill, or NULL if the pipeline is being
+  // destroyed; passes a filled batch, or NULL for the end of the input,
+  // to the consumer.
+  Batch* NewBatch();
+  bool Send(Batch* batch);
+
+  // Splits the complete lines of batch->text, starting at *pos, into
+  // records; at the end of the input the last line need not be complete.
+  void AddRecords(Batch* batch, int* pos, bool at_end);
+
+  SzlInputStream* stream_;
+  const uint64 begin_;
+  const uint64 end_;
+  uint64 record_number_;  // producer only
+  string error_;          // set by the producer before it sends NULL
+  volatile bool cancel_;
+
+  SPSCQueue<Batch*> ready_;  // filled batches, to the consumer
+  SPSCQueue<Batch*> free_;   // used batches, back to the producer
+  int num_batches_;          // allocated by the producer
+  Batch* current_;           // held by the consumer
+  bool done_;                // the consumer has received the end
+  pthread_t thread_;
+};
+
+#endif  // _APP_SZLINPUT_H__
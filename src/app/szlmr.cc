@@ -0,0 +1,802 @@
+// Copyright 2010 Google Inc.
+// 
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+// 
+//      http://www.apache.org/licenses/LICENSE-2.0
+// 
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ------------------------------------------------------------------------
+
+// szl-mr: runs a Sawzall program as a map-reduce on the local machine.
+//
+//   szl-mr [flags] program.szl input...
+//
+// The parent compiles the program and forks --mappers mapper processes,
+// each of which runs the program over its share of the input lines.
+// Mapper i gets the lines that start in the i-th of --mappers equal byte
+// ranges of each input file; the key of a line is its byte offset.
+//
+// Mill tables are aggregated in the mappers as in szl and flushed when the
+// mapper's tables grow beyond --mr_emitter_memory_mb.  The flushed values
+// are partitioned among the --reducers reducers by the table's shard
+// fingerprint (see SzlTabWriter::FilterKey) or by the key's fingerprint,
+// buffered per reducer and spilled to --mr_tmpdir as sorted runs.  Unless
+// --nomr_combine is given, the values of each key in a spilled buffer are
+// first combined (see szlmrcombiner.h), which undoes the repetition of
+// keys that are flushed many times by a mapper under memory pressure.  Each
+// reducer merges its runs and combines the values of each key with
+// SzlTabEntry::Merge, spilling partial results of hot keys to disk (see
+// szlmrreducer.h), and the parent merges the reducers' results.
+//
+// The output is the standard output of the mappers, in mapper order,
+// followed by the results of all mill tables, in table order and then in
+// key order, in the format used by szl --table_output.  Emits to tables
+// that szl does not aggregate (e.g. text) are printed by the mappers.
+
+// We need PRId64, which is only defined if we explicitly ask for it.
+#define __STDC_FORMAT_MACROS
+#include <inttypes.h>
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#include "public/porting.h"
+#include "public/commandlineflags.h"
+#include "public/logging.h"
+#include "public/hashutils.h"
+
+#include "utilities/strutils.h"
+#include "fmt/fmt.h"
+
+#include "public/szltype.h"
+#include "public/szlvalue.h"
+#include "public/szlencoder.h"
+#include "public/szldecoder.h"
+#include "public/sawzall.h"
+#include "public/emitterinterface.h"
+#include "public/szlemitter.h"
+#include "public/szltabentry.h"
+
+#include "app/printemitter.h"
+#include "app/szlmrshuffle.h"
+#include "app/szlmrcombiner.h"
+#include "app/szlmrreducer.h"
+
+
+DEFINE_int32(mappers, 4, "number of mapper processes");
+DEFINE_int32(reducers, 4, "number of reducer processes");
+DEFINE_string(mr_tmpdir, "/tmp", "directory for the shuffle files");
+DEFINE_int32(mr_sort_buffer_mb, 64, "memory in MB for the map output of each "
+             "mapper; the output is spilled to a sorted run when it is full");
+DEFINE_int32(mr_emitter_memory_mb, 64, "memory in MB for the tables of each "
+             "mapper; the tables are flushed to the map output when full");
+DEFINE_bool(mr_combine, true, "combine the map output of aggregating tables "
+            "before it is shuffled");
+DEFINE_int32(mr_combiner_memory_mb, 16, "memory in MB for combining the "
+             "values of one key; the combined value is written out when full");
+DEFINE_bool(mr_combiner_stats, false, "print the reduction of the map output "
+            "by the combiner for each table");
+DEFINE_int32(mr_reducer_memory_mb, 64, "memory in MB for merging the values "
+             "of one key in a reducer; partial results are spilled when full");
+DEFINE_int32(mr_merge_fan_in, 64, "maximum number of runs a reducer merges "
+             "at once; more runs are first merged in passes");
+DEFINE_bool(mr_keep_files, false, "do not remove the shuffle files");
+DEFINE_bool(native, true,
+            "generate native code instead of interpreted byte code");
+DEFINE_bool(ignore_undefs, false,
+            "silently ignore undefined variables/statements");
+DEFINE_int32(table_batch_size, 1, "number of emits buffered per aggregating "
+             "table before they are added to the table entries (1 => none)");
+
+
+static string RunPrefix(const string& dir, int reducer) {
+  return StringPrintf("%s/run-r%05d-", dir.c_str(), reducer);
+}
+
+
+// ----------------------------------------------------------------------------
+// The job description shared by the parent and its children.
+
+struct MapReduceJob {
+  MapReduceJob() : exe(NULL)  { }
+  ~MapReduceJob() {
+    for (int i = 0; i < writers.size(); i++)
+      delete writers[i];
+  }
+
+  sawzall::Executable* exe;
+  vector<string> inputs;
+  vector<int64> input_sizes;
+  string dir;                     // the shuffle directory
+  int num_mappers;
+  int num_reducers;
+  // For each table, the writer used to shard and merge its values, or NULL
+  // if the table does not write to the mill.
+  vector<SzlTabWriter*> writers;
+};
+
+
+// Creates a writer for the type of a table.  Returns NULL with *error
+// empty if the table does not write to the mill, and NULL with *error set
+// if the type is bad.
+static SzlTabWriter* NewMillWriter(sawzall::TableInfo* table_info,
+                                   string* error) {
+  SzlType szl_type(SzlType::VOID);
+  if (!szl_type.ParseFromSzlArray(table_info->type_string().data(),
+                                  table_info->type_string().size(), error))
+    return NULL;
+  SzlTabWriter* writer = SzlTabWriter::CreateSzlTabWriter(szl_type, error);
+  if (writer != NULL && !writer->WritesToMill()) {
+    delete writer;
+    writer = NULL;
+  }
+  return writer;
+}
+
+
+// ----------------------------------------------------------------------------
+// Map side.
+
+// The map output of a mapper: one sort buffer per reducer, spilled to
+// sorted runs named run-r<reducer>-m<mapper>-<sequence>.  If there is a
+// combiner, the spilled records go through it.
+class MapOutput {
+ public:
+  MapOutput(const MapReduceJob* job, int mapper, int64 memory_limit,
+            SzlMrCombiner* combiner)
+      : job_(job), mapper_(mapper), buffers_(job->num_reducers),
+        sequence_(job->num_reducers, 0),
+        memory_limit_(memory_limit / job->num_reducers),
+        combiner_(combiner)  { }
+
+  // Adds a value for a reducer, spilling the reducer's buffer when full.
+  bool Add(int reducer, const string& key, const string& value) {
+    SzlMrSortBuffer* buffer = &buffers_[reducer];
+    buffer->Add(key, value);
+    if (buffer->memory() >= memory_limit_)
+      return Spill(reducer);
+    return true;
+  }
+
+  // Spills all nonempty buffers.
+  bool Finish() {
+    for (int r = 0; r < buffers_.size(); r++) {
+      if (!buffers_[r].empty() && !Spill(r))
+        return false;
+    }
+    return true;
+  }
+
+  const string& error() const  { return error_; }
+
+ private:
+  bool Spill(int reducer) {
+    string path = StringPrintf("%sm%05d-%05d",
+                               RunPrefix(job_->dir, reducer).c_str(),
+                               mapper_, sequence_[reducer]++);
+    SzlMrRunWriter writer;
+    if (!writer.Open(path, &error_))
+      return false;
+    if (combiner_ != NULL) {
+      combiner_->Begin(&writer);
+      buffers_[reducer].ForEachSorted(combiner_);
+      combiner_->End();
+      if (!combiner_->ok()) {
+        error_ = combiner_->error();
+        return false;
+      }
+    } else {
+      buffers_[reducer].WriteRun(&writer);
+    }
+    if (!writer.Close()) {
+      error_ = StringPrintf("error writing %s", path.c_str());
+      return false;
+    }
+    return true;
+  }
+
+  const MapReduceJob* job_;
+  const int mapper_;
+  vector<SzlMrSortBuffer> buffers_;
+  vector<int> sequence_;
+  const int64 memory_limit_;   // per reducer
+  SzlMrCombiner* combiner_;
+  string error_;
+};
+
+
+// The emitter of a mill table in a mapper: aggregates like a SzlEmitter and
+// writes the flushed values to the map output.
+class MapEmitter : public SzlEmitter {
+ public:
+  MapEmitter(const string& name, const SzlTabWriter* writer, int table,
+             int num_reducers, MapOutput* output)
+      : SzlEmitter(name, writer, false),
+        table_(table), num_reducers_(num_reducers), output_(output),
+        next_reducer_(0), counter_(0), failed_(false)  { }
+
+  // Flushes the table; returns false if the map output failed.
+  bool Flush() {
+    Flusher();
+    return !failed_;
+  }
+
+  // Flushes the table and, for an mrcounter, sends the mapper's total.
+  bool Finish() {
+    if (!Flush())
+      return false;
+    if (writer_->IsMrCounter()) {
+      SzlEncoder total;
+      total.PutInt(counter_);
+      Output(0, "", total.data());
+    }
+    return !failed_;
+  }
+
+ private:
+  virtual void WriteValue(const string& key, const string& value);
+  void Output(int reducer, const string& key, const string& value);
+
+  const int table_;
+  const int num_reducers_;
+  MapOutput* output_;
+  int next_reducer_;   // for unindexed non-aggregating tables
+  int64 counter_;      // for mrcounter tables
+  bool failed_;
+  string key_;
+};
+
+
+void MapEmitter::WriteValue(const string& key, const string& value) {
+  int reducer;
+  if (writer_->IsMrCounter()) {
+    // Counters are summed in the mapper and in the reducer.
+    SzlDecoder dec(value.data(), value.size());
+    int64 i = 0;
+    CHECK(dec.GetInt(&i)) << "mrcounter expected an int";
+    counter_ += i;
+    return;
+  } else if (!writer_->HasIndices() && !writer_->Aggregates()) {
+    // Spread unindexed non-aggregating tables over the reducers.
+    reducer = next_reducer_;
+    next_reducer_ = (next_reducer_ + 1) % num_reducers_;
+  } else if (writer_->Filters()) {
+    string fkey;
+    uint64 shardfp;
+    writer_->FilterKey(key, &fkey, &shardfp);
+    reducer = shardfp % num_reducers_;
+  } else {
+    reducer = FingerprintString(key.data(), key.size()) % num_reducers_;
+  }
+  Output(reducer, key, value);
+}
+
+
+void MapEmitter::Output(int reducer, const string& key, const string& value) {
+  key_.clear();
+  SzlMrAppendTableIndex(table_, &key_);
+  key_.append(key);
+  if (!failed_ && !output_->Add(reducer, key_, value))
+    failed_ = true;
+}
+
+
+class MapEmitterFactory : public sawzall::EmitterFactory {
+ public:
+  MapEmitterFactory(const MapReduceJob* job, MapOutput* output,
+                    Fmt::State* f)
+      : job_(job), output_(output), f_(f)  { }
+  ~MapEmitterFactory() {
+    for (int i = 0; i < emitters_.size(); i++)
+      delete emitters_[i];
+  }
+
+  sawzall::Emitter* NewEmitter(sawzall::TableInfo* table_info, string* error);
+
+  // Returns the memory estimate of all mill tables.
+  int64 GetMemoryEstimate() const {
+    int64 memory = 0;
+    for (int i = 0; i < map_emitters_.size(); i++)
+      memory += map_emitters_[i]->GetMemoryEstimate();
+    return memory;
+  }
+
+  // Flushes all mill tables; returns false if the map output failed.
+  bool Flush() {
+    for (int i = 0; i < map_emitters_.size(); i++) {
+      if (!map_emitters_[i]->Flush())
+        return false;
+    }
+    return true;
+  }
+
+  // Flushes all mill tables at the end of the map.
+  bool Finish() {
+    for (int i = 0; i < map_emitters_.size(); i++) {
+      if (!map_emitters_[i]->Finish())
+        return false;
+    }
+    return true;
+  }
+
+ private:
+  const MapReduceJob* job_;
+  MapOutput* output_;
+  Fmt::State* f_;
+  vector<sawzall::Emitter*> emitters_;
+  vector<MapEmitter*> map_emitters_;
+};
+
+
+sawzall::Emitter* MapEmitterFactory::NewEmitter(sawzall::TableInfo* table_info,
+                                                string* error) {
+  const vector<sawzall::TableInfo*>* tables = job_->exe->tableinfo();
+  int table = 0;
+  while (table < tables->size() &&
+         strcmp((*tables)[table]->name(), table_info->name()) != 0)
+    table++;
+  CHECK_LT(table, tables->size()) << "unknown table " << table_info->name();
+
+  sawzall::Emitter* emitter;
+  if (job_->writers[table] != NULL) {
+    SzlTabWriter* writer = NewMillWriter(table_info, error);
+    CHECK(writer != NULL) << *error;
+    MapEmitter* map_emitter = new MapEmitter(table_info->name(), writer, table,
+                                             job_->num_reducers, output_);
+    map_emitter->set_batch_size(FLAGS_table_batch_size);
+    map_emitters_.push_back(map_emitter);
+    emitter = map_emitter;
+  } else {
+    emitter = new PrintEmitter(table_info->name(), f_, true);
+  }
+  emitters_.push_back(emitter);
+  return emitter;
+}
+
+
+// Runs the program over the lines of file that start in [begin, end).
+static void MapLines(sawzall::Process* process, MapEmitterFactory* factory,
+                     const char* file_name, int64 begin, int64 end,
+                     int64 emitter_memory, string* error) {
+  FILE* f = fopen(file_name, "r");
+  if (f == NULL) {
+    *error = StringPrintf("can't open %s: %s", file_name, strerror(errno));
+    return;
+  }
+  // Skip the line that straddles begin; it belongs to the previous mapper.
+  if (begin > 0) {
+    CHECK_EQ(fseeko(f, begin - 1, SEEK_SET), 0);
+    int c;
+    while ((c = getc(f)) != EOF && c != '\n')
+      ;
+  }
+  char* line = NULL;
+  size_t capacity = 0;
+  for (int64 offset = ftello(f); offset < end; offset = ftello(f)) {
+    ssize_t length = getline(&line, &capacity, f);
+    if (length < 0)
+      break;
+    if (length > 0 && line[length - 1] == '\n')
+      line[--length] = '\0';
+    string key = StringPrintf("%" PRId64, offset);
+    process->RunOrDie(line, length, key.data(), key.size());
+    if (factory->GetMemoryEstimate() >= emitter_memory && !factory->Flush())
+      break;
+  }
+  if (ferror(f))
+    *error = StringPrintf("error reading %s: %s", file_name, strerror(errno));
+  free(line);
+  fclose(f);
+}
+
+
+static string CombinerStatsPath(const MapReduceJob* job, int mapper) {
+  return StringPrintf("%s/combiner-%05d.stats", job->dir.c_str(), mapper);
+}
+
+
+// Writes the combiner statistics of a mapper, one line per table.
+static void WriteCombinerStats(const MapReduceJob* job, int mapper,
+                               const vector<SzlMrCombiner::Stats>& stats,
+                               string* error) {
+  string path = CombinerStatsPath(job, mapper);
+  FILE* f = fopen(path.c_str(), "w");
+  if (f == NULL) {
+    *error = StringPrintf("can't create %s: %s", path.c_str(), strerror(errno));
+    return;
+  }
+  for (int i = 0; i < stats.size(); i++) {
+    fprintf(f, "%" PRId64 " %" PRId64 " %" PRId64 " %" PRId64 "\n",
+            stats[i].records_in, stats[i].bytes_in,
+            stats[i].records_out, stats[i].bytes_out);
+  }
+  if (fclose(f) != 0)
+    *error = StringPrintf("error writing %s", path.c_str());
+}
+
+
+// The body of mapper process number mapper.  Its standard output has been
+// redirected to a file.  Returns the exit status.
+static int RunMapper(const MapReduceJob* job, int mapper) {
+  sawzall::Process process(job->exe, NULL);
+  Fmt::State fmt;
+  char buf[1024];
+  Fmt::fmtfdinit(&fmt, 1, buf, sizeof buf);
+
+  SzlMrCombiner combiner(job->writers,
+                         FLAGS_mr_combiner_memory_mb * (1LL << 20));
+  MapOutput output(job, mapper, FLAGS_mr_sort_buffer_mb * (1LL << 20),
+                   FLAGS_mr_combine ? &combiner : NULL);
+  const int64 emitter_memory = FLAGS_mr_emitter_memory_mb * (1LL << 20);
+  string error;
+  {
+    MapEmitterFactory factory(job, &output, &fmt);
+    process.set_emitter_factory(&factory);
+    sawzall::RegisterEmitters(&process);
+    process.InitializeOrDie();
+
+    if (job->inputs.empty()) {
+      // Without input the program runs once, in the first mapper.
+      if (mapper == 0)
+        process.RunOrDie("", 0, "", 0);
+    }
+    for (int i = 0; i < job->inputs.size() && error.empty(); i++) {
+      const char* file_name = job->inputs[i].c_str();
+      const int64 size = job->input_sizes[i];
+      MapLines(&process, &factory, file_name,
+               size * mapper / job->num_mappers,
+               size * (mapper + 1) / job->num_mappers,
+               emitter_memory, &error);
+    }
+    if (error.empty() && !factory.Finish())
+      error = output.error();
+    process.Epilog(true);
+  }
+  if (error.empty() && !output.Finish())
+    error = output.error();
+  if (error.empty() && FLAGS_mr_combine)
+    WriteCombinerStats(job, mapper, combiner.stats(), &error);
+  Fmt::fmtfdflush(&fmt);
+  fflush(stdout);
+  if (!error.empty()) {
+    fprintf(stderr, "szl-mr: mapper %d: %s\n", mapper, error.c_str());
+    return 1;
+  }
+  return 0;
+}
+
+
+// ----------------------------------------------------------------------------
+// Reduce side.
+
+// Returns the names of the files in dir that start with prefix, sorted.
+static bool ListFiles(const string& dir, const string& prefix,
+                      vector<string>* paths, string* error) {
+  DIR* d = opendir(dir.c_str());
+  if (d == NULL) {
+    *error = StringPrintf("can't read %s: %s", dir.c_str(), strerror(errno));
+    return false;
+  }
+  struct dirent* entry;
+  while ((entry = readdir(d)) != NULL) {
+    string path = dir + "/" + entry->d_name;
+    if (path.compare(0, prefix.size(), prefix) == 0)
+      paths->push_back(path);
+  }
+  closedir(d);
+  sort(paths->begin(), paths->end());
+  return true;
+}
+
+
+// Formats a result the way szl --table_output does.
+static string FormatResult(const char* table_name, const string& index,
+                           const string& value) {
+  SzlDecoder key_decoder(index.data(), index.size());
+  SzlDecoder value_decoder(value.data(), value.size());
+  return StringPrintf("%s[%s] = %s\n", table_name,
+                      key_decoder.PPrint().c_str(),
+                      value_decoder.PPrint().c_str());
+}
+
+
+// Writes the results of a reducer, formatted and keyed like the map output,
+// to a run.
+class ReduceOutput : public SzlMrReducer::Output {
+ public:
+  ReduceOutput(const vector<sawzall::TableInfo*>* tables,
+               SzlMrRunWriter* output)
+      : tables_(tables), output_(output)  { }
+
+  virtual void WriteResult(int table, const string& key, const string& value) {
+    output_->Write(key, FormatResult((*tables_)[table]->name(),
+                                     key.substr(kSzlMrTableIndexSize), value));
+  }
+
+ private:
+  const vector<sawzall::TableInfo*>* tables_;
+  SzlMrRunWriter* output_;
+};
+
+
+// The body of reducer process number reducer: merges the runs of the
+// reducer, combines the values of each key and writes the formatted
+// results to the run reduce-<reducer>.  Returns the exit status.
+static int RunReducer(const MapReduceJob* job, int reducer) {
+  string error;
+  vector<string> runs;
+  SzlMrMerger merger;
+  SzlMrRunWriter output;
+  bool ok = ListFiles(job->dir, RunPrefix(job->dir, reducer), &runs, &error);
+  if (ok) {
+    ok = SzlMrMergeRuns(&runs, max(FLAGS_mr_merge_fan_in, 2),
+                        StringPrintf("%s/merge-r%05d-", job->dir.c_str(),
+                                     reducer),
+                        &error);
+  }
+  for (int i = 0; ok && i < runs.size(); i++)
+    ok = merger.AddRun(runs[i], &error);
+  if (ok) {
+    ok = output.Open(StringPrintf("%s/reduce-%05d", job->dir.c_str(), reducer),
+                     &error);
+  }
+  if (ok) {
+    SzlMrReducer reducer_state(
+        job->writers, FLAGS_mr_reducer_memory_mb * (1LL << 20),
+        StringPrintf("%s/spill-%05d", job->dir.c_str(), reducer));
+    ReduceOutput reduce_output(job->exe->tableinfo(), &output);
+    ok = reducer_state.Reduce(&merger, &reduce_output);
+    if (!ok)
+      error = reducer_state.error();
+  }
+  if (ok && !output.Close()) {
+    error = "error writing the reduce output";
+    ok = false;
+  }
+  if (!ok) {
+    fprintf(stderr, "szl-mr: reducer %d: %s\n", reducer, error.c_str());
+    return 1;
+  }
+  return 0;
+}
+
+
+// ----------------------------------------------------------------------------
+// The parent.
+
+// Forks n children running body(job, i) and waits for them.
+// Returns false if any of them failed.
+static bool RunChildren(const MapReduceJob* job, int n, const char* kind,
+                        int (*body)(const MapReduceJob*, int),
+                        bool redirect_stdout) {
+  fflush(stdout);
+  fflush(stderr);
+  vector<pid_t> pids;
+  bool ok = true;
+  for (int i = 0; i < n; i++) {
+    pid_t pid = fork();
+    if (pid < 0) {
+      fprintf(stderr, "szl-mr: can't fork %s: %s\n", kind, strerror(errno));
+      ok = false;
+      break;
+    }
+    if (pid == 0) {
+      int status = 1;
+      if (redirect_stdout) {
+        string path = StringPrintf("%s/%s-%05d.out", job->dir.c_str(), kind, i);
+        int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666);
+        if (fd < 0 || dup2(fd, 1) < 0) {
+          fprintf(stderr, "szl-mr: can't create %s: %s\n",
+                  path.c_str(), strerror(errno));
+          _exit(status);
+        }
+        close(fd);
+      }
+      status = body(job, i);
+      _exit(status);
+    }
+    pids.push_back(pid);
+  }
+  for (int i = 0; i < pids.size(); i++) {
+    int status;
+    while (waitpid(pids[i], &status, 0) < 0 && errno == EINTR)
+      ;
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+      fprintf(stderr, "szl-mr: %s %d failed\n", kind, i);
+      ok = false;
+    }
+  }
+  return ok;
+}
+
+
+// Copies the mapper outputs and the merged reducer results to stdout.
+static bool WriteOutput(const MapReduceJob* job) {
+  for (int i = 0; i < job->num_mappers; i++) {
+    string path = StringPrintf("%s/mapper-%05d.out", job->dir.c_str(), i);
+    FILE* f = fopen(path.c_str(), "r");
+    if (f == NULL) {
+      fprintf(stderr, "szl-mr: can't open %s: %s\n",
+              path.c_str(), strerror(errno));
+      return false;
+    }
+    char buf[1 << 16];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof buf, f)) > 0)
+      fwrite(buf, 1, n, stdout);
+    fclose(f);
+  }
+
+  SzlMrMerger merger;
+  string error;
+  for (int i = 0; i < job->num_reducers; i++) {
+    if (!merger.AddRun(StringPrintf("%s/reduce-%05d", job->dir.c_str(), i),
+                       &error)) {
+      fprintf(stderr, "szl-mr: %s\n", error.c_str());
+      return false;
+    }
+  }
+  string key, value;
+  while (merger.Next(&key, &value))
+    fwrite(value.data(), 1, value.size(), stdout);
+  if (!merger.error().empty()) {
+    fprintf(stderr, "szl-mr: %s\n", merger.error().c_str());
+    return false;
+  }
+  return fflush(stdout) == 0;
+}
+
+
+// Sums the combiner statistics of the mappers and prints, for each
+// aggregating table, how much the combiner reduced its map output.
+static bool PrintCombinerStats(const MapReduceJob* job) {
+  const vector<sawzall::TableInfo*>* tables = job->exe->tableinfo();
+  vector<SzlMrCombiner::Stats> total(tables->size());
+  for (int m = 0; m < job->num_mappers; m++) {
+    string path = CombinerStatsPath(job, m);
+    FILE* f = fopen(path.c_str(), "r");
+    if (f == NULL) {
+      fprintf(stderr, "szl-mr: can't open %s: %s\n",
+              path.c_str(), strerror(errno));
+      return false;
+    }
+    for (int i = 0; i < total.size(); i++) {
+      SzlMrCombiner::Stats stats;
+      if (fscanf(f, "%" SCNd64 " %" SCNd64 " %" SCNd64 " %" SCNd64,
+                 &stats.records_in, &stats.bytes_in,
+                 &stats.records_out, &stats.bytes_out) != 4) {
+        fprintf(stderr, "szl-mr: bad combiner statistics in %s\n",
+                path.c_str());
+        fclose(f);
+        return false;
+      }
+      total[i].records_in += stats.records_in;
+      total[i].bytes_in += stats.bytes_in;
+      total[i].records_out += stats.records_out;
+      total[i].bytes_out += stats.bytes_out;
+    }
+    fclose(f);
+  }
+  for (int i = 0; i < total.size(); i++) {
+    const SzlTabWriter* writer = job->writers[i];
+    if (writer == NULL || !writer->Aggregates() || writer->IsMrCounter() ||
+        total[i].records_in == 0)
+      continue;
+    fprintf(stderr, "szl-mr: combiner: %s: %" PRId64 " -> %" PRId64 " records, "
+            "%" PRId64 " -> %" PRId64 " bytes (%.1fx)\n", (*tables)[i]->name(),
+            total[i].records_in, total[i].records_out,
+            total[i].bytes_in, total[i].bytes_out,
+            static_cast<double>(total[i].bytes_in) /
+                max(total[i].bytes_out, static_cast<int64>(1)));
+  }
+  return true;
+}
+
+
+static void RemoveDirectory(const string& dir) {
+  vector<string> paths;
+  string error;
+  if (ListFiles(dir, dir + "/", &paths, &error)) {
+    for (int i = 0; i < paths.size(); i++)
+      unlink(paths[i].c_str());
+  }
+  rmdir(dir.c_str());
+}
+
+
+static bool MapReduce(const char* program, int argc, char* argv[]) {
+  sawzall::Mode mode = sawzall::kNormal;
+  if (FLAGS_ignore_undefs)
+    mode = static_cast<sawzall::Mode>(mode | sawzall::kIgnoreUndefs);
+  if (FLAGS_native)
+    mode = static_cast<sawzall::Mode>(mode | sawzall::kNative);
+  sawzall::Executable exe(program, NULL, mode);
+  if (!exe.is_executable())
+    return false;
+
+  MapReduceJob job;
+  job.exe = &exe;
+  for (int i = 0; i < argc; i++) {
+    // The inputs are split by size, so they must be regular files.
+    struct stat st;
+    if (stat(argv[i], &st) != 0 || !S_ISREG(st.st_mode)) {
+      fprintf(stderr, "szl-mr: %s is not a regular file\n", argv[i]);
+      return false;
+    }
+    job.inputs.push_back(argv[i]);
+    job.input_sizes.push_back(st.st_size);
+  }
+  job.num_mappers = job.inputs.empty() ? 1 : FLAGS_mappers;
+  job.num_reducers = FLAGS_reducers;
+  const vector<sawzall::TableInfo*>* tables = exe.tableinfo();
+  if (tables->size() > kSzlMrMaxTables) {
+    fprintf(stderr, "szl-mr: too many tables\n");
+    return false;
+  }
+  for (int i = 0; i < tables->size(); i++) {
+    string error;
+    SzlTabWriter* writer = NewMillWriter((*tables)[i], &error);
+    if (writer == NULL && !error.empty()) {
+      fprintf(stderr, "szl-mr: failed to create emitter for table %s: %s\n",
+              (*tables)[i]->name(), error.c_str());
+      return false;
+    }
+    job.writers.push_back(writer);
+  }
+
+  string dir_template = FLAGS_mr_tmpdir + "/szl-mr.XXXXXX";
+  vector<char> dir(dir_template.begin(), dir_template.end());
+  dir.push_back('\0');
+  if (mkdtemp(&dir[0]) == NULL) {
+    fprintf(stderr, "szl-mr: can't create a directory in %s: %s\n",
+            FLAGS_mr_tmpdir.c_str(), strerror(errno));
+    return false;
+  }
+  job.dir = &dir[0];
+
+  bool ok = RunChildren(&job, job.num_mappers, "mapper", RunMapper, true) &&
+            (!FLAGS_mr_combine || !FLAGS_mr_combiner_stats ||
+             PrintCombinerStats(&job)) &&
+            RunChildren(&job, job.num_reducers, "reducer", RunReducer, false) &&
+            WriteOutput(&job);
+
+  if (FLAGS_mr_keep_files)
+    fprintf(stderr, "szl-mr: shuffle files kept in %s\n", job.dir.c_str());
+  else
+    RemoveDirectory(job.dir);
+  return ok;
+}
+
+
+int main(int argc, char* argv[]) {
+  ProcessCommandLineArguments(argc, argv);
+  InitializeAllModules();
+  sawzall::RegisterStandardTableTypes();
+
+  if (FLAGS_mappers < 1 || FLAGS_reducers < 1) {
+    fprintf(stderr, "szl-mr: --mappers and --reducers must be positive\n");
+    return 1;
+  }
+  if (argc < 2) {
+    fprintf(stderr, "usage: szl-mr [flags] program.szl [input...]\n");
+    return 1;
+  }
+  return MapReduce(argv[1], argc - 2, argv + 2) ? 0 : 1;
+}
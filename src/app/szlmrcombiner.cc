@@ -0,0 +1,106 @@
+// Copyright 2010 Google Inc.
+// 
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+// 
+//      http://www.apache.org/licenses/LICENSE-2.0
+// 
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ------------------------------------------------------------------------
+
+// Implementation of the szl-mr combiner.
+
+#include <string>
+#include <vector>
+
+#include "public/porting.h"
+#include "public/logging.h"
+
+#include "utilities/strutils.h"
+
+#include "public/szltabentry.h"
+
+#include "app/szlmrshuffle.h"
+#include "app/szlmrcombiner.h"
+
+
+SzlMrCombiner::SzlMrCombiner(const vector<SzlTabWriter*>& writers,
+                             int64 memory_budget)
+    : writers_(writers), memory_budget_(memory_budget), output_(NULL),
+      stats_(writers.size()), entry_(NULL), table_(-1) {
+}
+
+
+SzlMrCombiner::~SzlMrCombiner() {
+  delete entry_;
+}
+
+
+void SzlMrCombiner::Begin(SzlMrRunWriter* output) {
+  CHECK(entry_ == NULL);
+  output_ = output;
+}
+
+
+void SzlMrCombiner::Write(int table, const string& key, const string& value) {
+  output_->Write(key, value);
+  stats_[table].records_out++;
+  stats_[table].bytes_out += key.size() + value.size();
+}
+
+
+void SzlMrCombiner::FlushEntry() {
+  if (entry_ == NULL)
+    return;
+  value_.clear();
+  entry_->Flush(&value_);
+  if (!value_.empty())
+    Write(table_, key_, value_);
+  delete entry_;
+  entry_ = NULL;
+}
+
+
+void SzlMrCombiner::Add(const char* key, int key_size,
+                        const char* value, int value_size) {
+  CHECK_GE(key_size, kSzlMrTableIndexSize);
+  const int table = SzlMrTableIndex(key);
+  Stats* stats = &stats_[table];
+  stats->records_in++;
+  stats->bytes_in += key_size + value_size;
+
+  const SzlTabWriter* writer = writers_[table];
+  if (!writer->Aggregates() || writer->IsMrCounter()) {
+    FlushEntry();
+    key_.assign(key, key_size);
+    value_.assign(value, value_size);
+    Write(table, key_, value_);
+    return;
+  }
+  if (entry_ != NULL &&
+      (table != table_ || key_.compare(0, string::npos, key, key_size) != 0))
+    FlushEntry();
+  if (entry_ == NULL) {
+    table_ = table;
+    key_.assign(key, key_size);
+    entry_ = writer->CreateEntry(key_.substr(kSzlMrTableIndexSize));
+  }
+  value_.assign(value, value_size);
+  if (entry_->Merge(value_) != SzlTabEntry::MergeOk && error_.empty()) {
+    // Keep going so that the run stays well-formed; the caller fails.
+    error_ = StringPrintf("merge failed for table %d", table);
+  }
+  if (entry_->Memory() >= memory_budget_)
+    FlushEntry();
+}
+
+
+void SzlMrCombiner::End() {
+  FlushEntry();
+  output_ = NULL;
+}
@@ -0,0 +1,103 @@
+// Copyright 2010 Google Inc.
+// 
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+// 
+//      http://www.apache.org/licenses/LICENSE-2.0
+// 
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ------------------------------------------------------------------------
+
+// The combiner of szl-mr: combines the map output of aggregating tables
+// before it is written to the shuffle, so that a key flushed several
+// times by a mapper is shuffled once per run.
+//
+// Map output keys start with the index of their table as a 2-byte
+// big-endian number, followed by the table's encoded index.
+
+#ifndef _APP_SZLMRCOMBINER_H__
+#define _APP_SZLMRCOMBINER_H__
+
+#include <string>
+#include <vector>
+
+
+class SzlTabEntry;
+class SzlTabWriter;
+class SzlMrRunWriter;
+
+const int kSzlMrTableIndexSize = 2;
+const int kSzlMrMaxTables = 1 << (8 * kSzlMrTableIndexSize);
+
+inline void SzlMrAppendTableIndex(int table, string* key) {
+  key->push_back(static_cast<char>(table >> 8));
+  key->push_back(static_cast<char>(table));
+}
+
+inline int SzlMrTableIndex(const char* key) {
+  return (static_cast<uint8>(key[0]) << 8) | static_cast<uint8>(key[1]);
+}
+
+
+class SzlMrCombiner {
+ public:
+  // The records and bytes of one table going into and out of the combiner.
+  struct Stats {
+    Stats() : records_in(0), bytes_in(0), records_out(0), bytes_out(0)  { }
+    int64 records_in;
+    int64 bytes_in;
+    int64 records_out;
+    int64 bytes_out;
+  };
+
+  // writers holds the writer of each table, or NULL for tables without
+  // map output; the combiner does not take ownership.  The values of a key
+  // are combined into a single entry until the entry uses memory_budget
+  // bytes, at which point it is written out and a new entry is started.
+  SzlMrCombiner(const vector<SzlTabWriter*>& writers, int64 memory_budget);
+  ~SzlMrCombiner();
+
+  // Starts a run written to output.
+  void Begin(SzlMrRunWriter* output);
+
+  // Adds a record; the records of a run must come in key order.  Records of
+  // aggregating tables with equal keys are merged, others are copied.
+  void Add(const char* key, int key_size, const char* value, int value_size);
+  void operator()(const char* key, int key_size,
+                  const char* value, int value_size) {
+    Add(key, key_size, value, value_size);
+  }
+
+  // Writes out the last combined entry of the run.
+  void End();
+
+  // Returns false if a value could not be merged.
+  bool ok() const  { return error_.empty(); }
+  const string& error() const  { return error_; }
+
+  // The statistics of each table.
+  const vector<Stats>& stats() const  { return stats_; }
+
+ private:
+  void Write(int table, const string& key, const string& value);
+  void FlushEntry();
+
+  const vector<SzlTabWriter*>& writers_;
+  const int64 memory_budget_;
+  SzlMrRunWriter* output_;
+  vector<Stats> stats_;
+  // The entry being combined, and its table and key.
+  SzlTabEntry* entry_;
+  int table_;
+  string key_;
+  string value_;   // scratch
+  string error_;
+};
+
+
+#endif  // _APP_SZLMRCOMBINER_H__
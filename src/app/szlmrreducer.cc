@@ -0,0 +1,182 @@
+// Copyright 2010 Google Inc.
+// 
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+// 
+//      http://www.apache.org/licenses/LICENSE-2.0
+// 
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ------------------------------------------------------------------------
+
+// Implementation of the szl-mr reducer.
+
+#include <unistd.h>
+#include <string>
+#include <vector>
+
+#include "public/porting.h"
+#include "public/logging.h"
+
+#include "utilities/strutils.h"
+
+#include "public/szlencoder.h"
+#include "public/szldecoder.h"
+#include "public/szltabentry.h"
+
+#include "app/szlmrshuffle.h"
+#include "app/szlmrcombiner.h"
+#include "app/szlmrreducer.h"
+
+
+SzlMrReducer::SzlMrReducer(const vector<SzlTabWriter*>& writers,
+                           int64 memory_budget, const string& spill_path)
+    : writers_(writers), memory_budget_(memory_budget),
+      spill_path_(spill_path), entry_(NULL), spill_(NULL), spill_file_(0),
+      spill_count_(0), spilled_keys_(0), spilled_values_(0) {
+}
+
+
+SzlMrReducer::~SzlMrReducer() {
+  delete entry_;
+  if (spill_ != NULL) {
+    delete spill_;
+    unlink(SpillPath(spill_file_).c_str());
+  }
+}
+
+
+string SzlMrReducer::SpillPath(int file) const {
+  return StringPrintf("%s.%d", spill_path_.c_str(), file);
+}
+
+
+bool SzlMrReducer::Add(const SzlTabWriter* writer, const string& index,
+                       const string& value, bool bounded) {
+  if (entry_ == NULL)
+    entry_ = writer->CreateEntry(index);
+  if (entry_->Merge(value) != SzlTabEntry::MergeOk) {
+    error_ = "merge failed";
+    return false;
+  }
+  if (bounded && entry_->Memory() >= memory_budget_)
+    return Spill();
+  return true;
+}
+
+
+bool SzlMrReducer::Spill() {
+  if (spill_ == NULL) {
+    spill_ = new SzlMrRunWriter;
+    if (!spill_->Open(SpillPath(spill_file_), &error_))
+      return false;
+  }
+  partial_.clear();
+  entry_->Flush(&partial_);
+  delete entry_;
+  entry_ = NULL;
+  if (!partial_.empty()) {
+    spill_->Write("", partial_);
+    spill_count_++;
+    spilled_values_++;
+  }
+  return true;
+}
+
+
+bool SzlMrReducer::FinishKey(const SzlTabWriter* writer, int table,
+                             const string& key, Output* output) {
+  const string index = key.substr(kSzlMrTableIndexSize);
+  if (spill_ != NULL)
+    spilled_keys_++;
+  int64 previous_count = kint64max;
+  while (spill_ != NULL) {
+    // Add the current entry to the spilled values and merge them again,
+    // into the other spill file.
+    if (entry_ != NULL && !Spill())
+      return false;
+    const bool closed = spill_->Close();
+    delete spill_;
+    spill_ = NULL;
+    const string path = SpillPath(spill_file_);
+    if (!closed) {
+      error_ = StringPrintf("error writing %s", path.c_str());
+      unlink(path.c_str());
+      return false;
+    }
+    const bool bounded = spill_count_ < previous_count;
+    previous_count = spill_count_;
+    spill_count_ = 0;
+    spill_file_ = 1 - spill_file_;
+
+    SzlMrRunReader reader;
+    if (!reader.Open(path, &error_))
+      return false;
+    string unused, value;
+    bool ok = true;
+    while (ok && reader.Next(&unused, &value))
+      ok = Add(writer, index, value, bounded);
+    reader.Close();
+    unlink(path.c_str());
+    if (!ok)
+      return false;
+    if (!reader.error().empty()) {
+      error_ = reader.error();
+      return false;
+    }
+  }
+
+  if (entry_ != NULL) {
+    vector<string> results;
+    entry_->FlushForDisplay(&results);
+    for (int i = 0; i < results.size(); i++)
+      output->WriteResult(table, key, results[i]);
+    delete entry_;
+    entry_ = NULL;
+  }
+  return true;
+}
+
+
+bool SzlMrReducer::Reduce(SzlMrMerger* input, Output* output) {
+  string key, value, next_key;
+  bool more = input->Next(&key, &value);
+  while (more) {
+    CHECK_GE(key.size(), kSzlMrTableIndexSize);
+    const int table = SzlMrTableIndex(key.data());
+    const SzlTabWriter* writer = writers_[table];
+    if (writer->IsMrCounter()) {
+      int64 total = 0;
+      do {
+        SzlDecoder dec(value.data(), value.size());
+        int64 i = 0;
+        CHECK(dec.GetInt(&i)) << "mrcounter expected an int";
+        total += i;
+      } while ((more = input->Next(&next_key, &value)) && next_key == key);
+      SzlEncoder enc;
+      enc.PutInt(total);
+      output->WriteResult(table, key, enc.data());
+    } else if (writer->Aggregates()) {
+      const string index = key.substr(kSzlMrTableIndexSize);
+      do {
+        if (!Add(writer, index, value, true))
+          return false;
+      } while ((more = input->Next(&next_key, &value)) && next_key == key);
+      if (!FinishKey(writer, table, key, output))
+        return false;
+    } else {
+      output->WriteResult(table, key, value);
+      more = input->Next(&next_key, &value);
+    }
+    key.swap(next_key);
+  }
+  if (!input->error().empty()) {
+    error_ = input->error();
+    return false;
+  }
+  return true;
+}
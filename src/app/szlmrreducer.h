@@ -0,0 +1,103 @@
+// Copyright 2010 Google Inc.
+// 
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+// 
+//      http://www.apache.org/licenses/LICENSE-2.0
+// 
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ------------------------------------------------------------------------
+
+// The reducer of szl-mr: reads the merged map output of a reducer in key
+// order and produces the final results of each key.
+//
+// The values of a key of an aggregating table are merged one at a time
+// into a single SzlTabEntry, so that a key never needs all its values in
+// memory.  When the entry reaches the memory budget, its partial value is
+// flushed to a spill file and a new entry is started; at the end of the
+// key the spilled partial values are merged again, in as many passes as
+// needed, until they fit into one entry.  A pass that does not reduce the
+// number of partial values (because a single value exceeds the budget)
+// is followed by a final pass without a bound.
+
+#ifndef _APP_SZLMRREDUCER_H__
+#define _APP_SZLMRREDUCER_H__
+
+#include <string>
+#include <vector>
+
+
+class SzlTabEntry;
+class SzlTabWriter;
+class SzlMrMerger;
+class SzlMrRunWriter;
+
+class SzlMrReducer {
+ public:
+  // Receives the results.
+  class Output {
+   public:
+    virtual ~Output()  { }
+    // key is the map output key, starting with the table index (see
+    // szlmrcombiner.h); value is an encoded result: one of the results
+    // of SzlTabEntry::FlushForDisplay, a value of a non-aggregating table
+    // or the total of an mrcounter.
+    virtual void WriteResult(int table, const string& key,
+                             const string& value) = 0;
+  };
+
+  // writers holds the writer of each table, or NULL for tables without
+  // map output; the reducer does not take ownership.  Spill files are
+  // named spill_path followed by a suffix.
+  SzlMrReducer(const vector<SzlTabWriter*>& writers, int64 memory_budget,
+               const string& spill_path);
+  ~SzlMrReducer();
+
+  // Reduces the records of input, which come in key order.  Returns false
+  // and sets error() on failure.
+  bool Reduce(SzlMrMerger* input, Output* output);
+
+  const string& error() const  { return error_; }
+
+  // The number of keys that were spilled, and the number of partial
+  // values written to spill files.
+  int64 spilled_keys() const  { return spilled_keys_; }
+  int64 spilled_values() const  { return spilled_values_; }
+
+ private:
+  // Merges value into the current entry; if bounded, spills the entry
+  // when it reaches the memory budget.
+  bool Add(const SzlTabWriter* writer, const string& index,
+           const string& value, bool bounded);
+
+  // Writes the partial value of the current entry to the spill file.
+  bool Spill();
+
+  // Merges the spilled values of the current key and writes its results.
+  bool FinishKey(const SzlTabWriter* writer, int table, const string& key,
+                 Output* output);
+
+  string SpillPath(int file) const;
+
+  const vector<SzlTabWriter*>& writers_;
+  const int64 memory_budget_;
+  const string spill_path_;
+  // The entry of the key being reduced, and its spill file: one of two
+  // files, alternately read and written by the passes over the spills.
+  SzlTabEntry* entry_;
+  SzlMrRunWriter* spill_;
+  int spill_file_;
+  int64 spill_count_;      // values in the spill file
+  string partial_;         // scratch
+  int64 spilled_keys_;
+  int64 spilled_values_;
+  string error_;
+};
+
+
+#endif  // _APP_SZLMRREDUCER_H__
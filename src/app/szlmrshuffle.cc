@@ -0,0 +1,342 @@
+// Copyright 2010 Google Inc.
+// 
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+// 
+//      http://www.apache.org/licenses/LICENSE-2.0
+// 
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ------------------------------------------------------------------------
+
+// Implementation of the szl-mr shuffle: run files and their merge.
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#include "public/porting.h"
+#include "public/logging.h"
+#include "public/varint.h"
+
+#include "utilities/strutils.h"
+
+#include "app/szlmrshuffle.h"
+
+
+// Size of the I/O buffers of run readers and writers.
+static const int kRunBufferSize = 256 << 10;
+
+
+bool SzlMrRunWriter::Open(const string& path, string* error) {
+  CHECK(file_ == NULL);
+  file_ = fopen(path.c_str(), "w");
+  if (file_ == NULL) {
+    *error = StringPrintf("can't create %s: %s", path.c_str(), strerror(errno));
+    return false;
+  }
+  buffer_.resize(kRunBufferSize);
+  setvbuf(file_, &buffer_[0], _IOFBF, buffer_.size());
+  write_error_ = false;
+  records_ = 0;
+  bytes_ = 0;
+  return true;
+}
+
+
+void SzlMrRunWriter::Write(const char* key, int key_size,
+                           const char* value, int value_size) {
+  char header[2 * sawzall::kMaxUnsignedVarint32Length];
+  char* p = sawzall::EncodeUnsignedVarint32(header, key_size);
+  p = sawzall::EncodeUnsignedVarint32(p, value_size);
+  if (fwrite(header, 1, p - header, file_) != p - header ||
+      fwrite(key, 1, key_size, file_) != key_size ||
+      fwrite(value, 1, value_size, file_) != value_size)
+    write_error_ = true;
+  records_++;
+  bytes_ += (p - header) + key_size + value_size;
+}
+
+
+bool SzlMrRunWriter::Close() {
+  if (file_ == NULL)
+    return !write_error_;
+  if (fclose(file_) != 0)
+    write_error_ = true;
+  file_ = NULL;
+  return !write_error_;
+}
+
+
+bool SzlMrRunReader::Open(const string& path, string* error) {
+  CHECK_LT(fd_, 0);
+  fd_ = open(path.c_str(), O_RDONLY);
+  if (fd_ < 0) {
+    *error = StringPrintf("can't open %s: %s", path.c_str(), strerror(errno));
+    return false;
+  }
+  path_ = path;
+  buffer_.resize(kRunBufferSize);
+  pos_ = end_ = 0;
+  eof_ = false;
+  error_.clear();
+  return true;
+}
+
+
+void SzlMrRunReader::Close() {
+  if (fd_ >= 0)
+    close(fd_);
+  fd_ = -1;
+}
+
+
+bool SzlMrRunReader::Fill(int n) {
+  if (end_ - pos_ >= n)
+    return true;
+  // Move the unread bytes to the front, growing the buffer for big records.
+  memmove(&buffer_[0], &buffer_[pos_], end_ - pos_);
+  end_ -= pos_;
+  pos_ = 0;
+  if (buffer_.size() < n)
+    buffer_.resize(max(n, 2 * static_cast<int>(buffer_.size())));
+  while (end_ < n && !eof_) {
+    ssize_t count = read(fd_, &buffer_[end_], buffer_.size() - end_);
+    if (count < 0) {
+      if (errno == EINTR)
+        continue;
+      error_ = StringPrintf("error reading %s: %s",
+                            path_.c_str(), strerror(errno));
+      eof_ = true;
+    } else if (count == 0) {
+      eof_ = true;
+    } else {
+      end_ += count;
+    }
+  }
+  return end_ >= n;
+}
+
+
+bool SzlMrRunReader::Next(string* key, string* value) {
+  if (!error_.empty())
+    return false;
+  // Get the two lengths; a varint may be cut off at the end of the buffer.
+  if (!Fill(2 * sawzall::kMaxUnsignedVarint32Length) && end_ == pos_)
+    return false;  // clean end of the run, unless there was a read error
+  uint32 key_size, value_size;
+  const char* start = &buffer_[pos_];
+  const char* p = sawzall::DecodeUnsignedVarint32(start, &key_size);
+  if (p != NULL && p - start < end_ - pos_)
+    p = sawzall::DecodeUnsignedVarint32(p, &value_size);
+  if (p == NULL || p - start > end_ - pos_ ||
+      key_size > kint32max - value_size) {
+    if (error_.empty())
+      error_ = StringPrintf("corrupt record in %s", path_.c_str());
+    return false;
+  }
+  const int header_size = p - start;
+  const int record_size = header_size + key_size + value_size;
+  if (!Fill(record_size)) {
+    if (error_.empty())
+      error_ = StringPrintf("truncated record in %s", path_.c_str());
+    return false;
+  }
+  const char* data = &buffer_[pos_ + header_size];
+  key->assign(data, key_size);
+  value->assign(data + key_size, value_size);
+  pos_ += record_size;
+  return true;
+}
+
+
+class SzlMrSortBuffer::RecordLess {
+ public:
+  explicit RecordLess(const char* data) : data_(data)  { }
+  bool operator()(const Record& a, const Record& b) const {
+    if (a.prefix != b.prefix)
+      return a.prefix < b.prefix;
+    // The first 8 bytes (or all of a shorter key) are equal.
+    if (a.key_size <= 8 || b.key_size <= 8)
+      return a.key_size < b.key_size;
+    const int n = min(a.key_size, b.key_size) - 8;
+    int c = memcmp(data_ + a.offset + 8, data_ + b.offset + 8, n);
+    if (c != 0)
+      return c < 0;
+    return a.key_size < b.key_size;
+  }
+ private:
+  const char* data_;
+};
+
+
+void SzlMrSortBuffer::Add(const char* key, int key_size,
+                          const char* value, int value_size) {
+  Record r;
+  r.prefix = 0;
+  for (int i = 0; i < 8; i++) {
+    r.prefix <<= 8;
+    if (i < key_size)
+      r.prefix |= static_cast<uint8>(key[i]);
+  }
+  r.offset = data_.size();
+  r.key_size = key_size;
+  r.value_size = value_size;
+  data_.append(key, key_size);
+  data_.append(value, value_size);
+  records_.push_back(r);
+}
+
+
+void SzlMrSortBuffer::Sort() {
+  stable_sort(records_.begin(), records_.end(), RecordLess(data_.data()));
+}
+
+
+void SzlMrSortBuffer::WriteRun(SzlMrRunWriter* writer) {
+  Sort();
+  for (int i = 0; i < records_.size(); i++) {
+    const Record& r = records_[i];
+    const char* key = data_.data() + r.offset;
+    writer->Write(key, r.key_size, key + r.key_size, r.value_size);
+  }
+  data_.clear();
+  records_.clear();
+}
+
+
+// Orders heads so that the heap top is the smallest key, and of equal
+// keys the one from the earliest run.
+class SzlMrMerger::HeadGreater {
+ public:
+  bool operator()(const Head* a, const Head* b) const {
+    int c = a->key.compare(b->key);
+    if (c != 0)
+      return c > 0;
+    return a->run > b->run;
+  }
+};
+
+
+SzlMrMerger::~SzlMrMerger() {
+  for (int i = 0; i < heap_.size(); i++)
+    delete heap_[i];
+  for (int i = 0; i < runs_.size(); i++)
+    delete runs_[i];
+}
+
+
+bool SzlMrMerger::AddRun(const string& path, string* error) {
+  CHECK(!started_);
+  SzlMrRunReader* reader = new SzlMrRunReader;
+  if (!reader->Open(path, error)) {
+    delete reader;
+    return false;
+  }
+  runs_.push_back(reader);
+  return true;
+}
+
+
+bool SzlMrMerger::Refill(Head* head) {
+  SzlMrRunReader* reader = runs_[head->run];
+  if (!reader->Next(&head->key, &head->value)) {
+    if (!reader->error().empty())
+      error_ = reader->error();
+    reader->Close();
+    return false;
+  }
+  heap_.push_back(head);
+  push_heap(heap_.begin(), heap_.end(), HeadGreater());
+  return true;
+}
+
+
+bool SzlMrMerger::Next(string* key, string* value) {
+  if (!started_) {
+    started_ = true;
+    for (int i = 0; i < runs_.size(); i++) {
+      Head* head = new Head;
+      head->run = i;
+      if (!Refill(head))
+        delete head;
+    }
+  }
+  if (!error_.empty() || heap_.empty())
+    return false;
+  pop_heap(heap_.begin(), heap_.end(), HeadGreater());
+  Head* head = heap_.back();
+  heap_.pop_back();
+  key->swap(head->key);
+  value->swap(head->value);
+  if (!Refill(head))
+    delete head;
+  return error_.empty();
+}
+
+
+// Merges runs into a new run at path.
+static bool MergeGroup(const vector<string>& runs, const string& path,
+                       string* error) {
+  SzlMrMerger merger;
+  for (int i = 0; i < runs.size(); i++) {
+    if (!merger.AddRun(runs[i], error))
+      return false;
+  }
+  SzlMrRunWriter writer;
+  if (!writer.Open(path, error))
+    return false;
+  string key, value;
+  while (merger.Next(&key, &value))
+    writer.Write(key, value);
+  if (!merger.error().empty()) {
+    *error = merger.error();
+    return false;
+  }
+  if (!writer.Close()) {
+    *error = StringPrintf("error writing %s", path.c_str());
+    return false;
+  }
+  return true;
+}
+
+
+bool SzlMrMergeRuns(vector<string>* runs, int max_open, const string& prefix,
+                    string* error) {
+  CHECK_GE(max_open, 2);
+  vector<bool> made(runs->size(), false);  // by an earlier pass
+  for (int pass = 0; runs->size() > max_open; pass++) {
+    vector<string> merged;
+    vector<bool> merged_made;
+    for (int start = 0; start < runs->size(); start += max_open) {
+      const int end = min(start + max_open, static_cast<int>(runs->size()));
+      if (end - start == 1) {
+        merged.push_back((*runs)[start]);
+        merged_made.push_back(made[start]);
+        continue;
+      }
+      vector<string> group(runs->begin() + start, runs->begin() + end);
+      string path = StringPrintf("%s%d-%05d", prefix.c_str(), pass,
+                                 start / max_open);
+      if (!MergeGroup(group, path, error))
+        return false;
+      for (int i = start; i < end; i++) {
+        if (made[i])
+          unlink((*runs)[i].c_str());
+      }
+      merged.push_back(path);
+      merged_made.push_back(true);
+    }
+    runs->swap(merged);
+    made.swap(merged_made);
+  }
+  return true;
+}
@@ -0,0 +1,196 @@
+// Copyright 2010 Google Inc.
+// 
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+// 
+//      http://www.apache.org/licenses/LICENSE-2.0
+// 
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ------------------------------------------------------------------------
+
+// Support for the shuffle of szl-mr, the local map-reduce runner: sorted
+// runs of (key, value) records on local disk and their k-way merge.
+//
+// A run file is a sequence of records, each a varint key length, a varint
+// value length, the key and the value, in increasing key order.  Keys are
+// compared as byte strings.
+
+#ifndef _APP_SZLMRSHUFFLE_H__
+#define _APP_SZLMRSHUFFLE_H__
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+
+// Writes a run file.
+class SzlMrRunWriter {
+ public:
+  SzlMrRunWriter()
+      : file_(NULL), write_error_(false), records_(0), bytes_(0)  { }
+  ~SzlMrRunWriter()  { Close(); }
+
+  // Creates the file; returns false and sets *error on failure.
+  bool Open(const string& path, string* error);
+
+  // Appends a record; the caller supplies the records in key order.
+  void Write(const char* key, int key_size, const char* value, int value_size);
+  void Write(const string& key, const string& value) {
+    Write(key.data(), key.size(), value.data(), value.size());
+  }
+
+  // Flushes and closes the file; returns false if any write failed.
+  bool Close();
+
+  int64 records() const  { return records_; }
+  int64 bytes() const  { return bytes_; }
+
+ private:
+  FILE* file_;
+  vector<char> buffer_;  // stdio buffer
+  bool write_error_;
+  int64 records_;
+  int64 bytes_;
+};
+
+
+// Reads a run file sequentially.
+class SzlMrRunReader {
+ public:
+  SzlMrRunReader() : fd_(-1), pos_(0), end_(0), eof_(false)  { }
+  ~SzlMrRunReader()  { Close(); }
+
+  // Opens the file; returns false and sets *error on failure.
+  bool Open(const string& path, string* error);
+  void Close();
+
+  // Reads the next record.  Returns false at the end of the run or on
+  // error; error() is empty in the first case.
+  bool Next(string* key, string* value);
+
+  const string& error() const  { return error_; }
+
+ private:
+  // Make at least n bytes available at buffer_[pos_], unless the file
+  // ends first.  Returns false if it does.
+  bool Fill(int n);
+
+  string path_;
+  int fd_;
+  vector<char> buffer_;
+  int pos_;
+  int end_;
+  bool eof_;
+  string error_;
+};
+
+
+// Accumulates records in memory and writes them out as a sorted run.
+// Records with equal keys stay in the order in which they were added.
+class SzlMrSortBuffer {
+ public:
+  SzlMrSortBuffer()  { }
+
+  void Add(const char* key, int key_size, const char* value, int value_size);
+  void Add(const string& key, const string& value) {
+    Add(key.data(), key.size(), value.data(), value.size());
+  }
+
+  int size() const  { return records_.size(); }
+  bool empty() const  { return records_.empty(); }
+
+  // An estimate of the memory used by the records in the buffer.  The
+  // storage is kept when the buffer is cleared, so this drops to zero after
+  // each run while the capacity stays.
+  int64 memory() const {
+    return data_.size() + records_.size() * sizeof(Record);
+  }
+
+  // Sorts the records, writes them to writer and clears the buffer.
+  void WriteRun(SzlMrRunWriter* writer);
+
+  // Sorts the records and calls f(key, key_size, value, value_size) for
+  // each in order, then clears the buffer.
+  template <class F> void ForEachSorted(F* f);
+
+ private:
+  struct Record {
+    uint64 prefix;     // the first 8 key bytes, big-endian, zero padded
+    int64 offset;      // of the key in data_; the value follows it
+    int key_size;
+    int value_size;
+  };
+  class RecordLess;
+
+  void Sort();
+
+  string data_;
+  vector<Record> records_;
+};
+
+
+template <class F> void SzlMrSortBuffer::ForEachSorted(F* f) {
+  Sort();
+  for (int i = 0; i < records_.size(); i++) {
+    const Record& r = records_[i];
+    const char* key = data_.data() + r.offset;
+    (*f)(key, r.key_size, key + r.key_size, r.value_size);
+  }
+  data_.clear();
+  records_.clear();
+}
+
+
+// Merges sorted runs into a single stream in key order.  Records with
+// equal keys come in the order of their runs, and within a run in their
+// order in the run.
+class SzlMrMerger {
+ public:
+  SzlMrMerger() : started_(false)  { }
+  ~SzlMrMerger();
+
+  // Adds a run; returns false and sets *error if it cannot be opened.
+  // All runs must be added before the first call to Next.
+  bool AddRun(const string& path, string* error);
+
+  // Reads the next record in key order.  Returns false at the end of all
+  // runs or on error; error() is empty in the first case.
+  bool Next(string* key, string* value);
+
+  const string& error() const  { return error_; }
+
+ private:
+  struct Head {
+    string key;
+    string value;
+    int run;
+  };
+  class HeadGreater;
+
+  // Reads the next record of head's run into head and puts it on the heap.
+  // Returns false at the end of the run or on error.
+  bool Refill(Head* head);
+
+  vector<SzlMrRunReader*> runs_;
+  vector<Head*> heap_;   // a min-heap of the current record of each run
+  bool started_;
+  string error_;
+};
+
+
+// Merges groups of up to max_open consecutive runs into new runs named
+// prefix<pass>-<group>, pass after pass, until at most max_open runs are
+// left; *runs is replaced by them.  This bounds the number of files a
+// merger opens at once.  Records with equal keys keep their order.  Runs
+// made by an earlier pass are removed once merged again.  Returns false
+// and sets *error on failure.
+bool SzlMrMergeRuns(vector<string>* runs, int max_open, const string& prefix,
+                    string* error);
+
+
+#endif  // _APP_SZLMRSHUFFLE_H__
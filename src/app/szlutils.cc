@@ -28,6 +28,7 @@
 
 #include "public/sawzall.h"
 #include "public/emitterinterface.h"
+#include "app/szlinput.h"
 #include "app/szlutils.h"
 
 
@@ -35,6 +36,8 @@ DECLARE_string(table_output);
 DECLARE_string(undefok);
 DECLARE_string(explain);
 DECLARE_bool(trace_input);
+DECLARE_bool(decompress_input);
+DECLARE_int32(input_threads);
 DECLARE_bool(print_source);
 DECLARE_bool(print_code);
 DECLARE_bool(print_histogram);
@@ -69,41 +72,37 @@ void TraceStringInput(uint64 record_number, const char* input, size_t size) {
 
 void ApplyToLines(sawzall::Process* process, const char* file_name,
                          uint64 begin, uint64 end) {
-  // process file
-  FILE* f;
-
-  // This special case for /dev/stdin is necessary because if szl is invoked
-  // via as a subprocess our stdin may be connected to a unix domain socket
-  // rather than a pipe.
-  // While we can access this through the already-opened stdin, we cannot
-  // fopen("/dev/stdin") when it is mapped to a unix domain socket.
-
-  if (strcmp(file_name, "/dev/stdin") == 0) {
-    f = stdin;
-  } else {
-    f = fopen(file_name, "r");
+  string error;
+  SzlInputStream* stream =
+      SzlInputStream::Open(file_name, FLAGS_decompress_input,
+                           FLAGS_input_threads, &error);
+  if (stream == NULL) {
+    fprintf(stderr, "can't open non-RecordIO file: %s\n", error.c_str());
+    return;
   }
-  if (f != NULL) {
-    char line[4096];
-    uint64 record_number = 0;
-    while (record_number < end && fgets(line, sizeof line, f) != NULL) {
-      // 0-terminate if neccessary
-      char* p = strchr(line, '\n');
-      if (p != NULL)
-        *p = '\0';
-      if (begin <= record_number) {
-        if (FLAGS_trace_input)
-          TraceStringInput(record_number, line, strlen(line));
-        string key = StringPrintf("%lld", record_number);
-        process->RunOrDie(line, strlen(line), key.data(), key.size());
+
+  // A background thread reads, decompresses and splits the input while
+  // the records are run here, a batch at a time.
+  SzlInputPipeline pipeline(stream, begin, end);
+  const SzlInputPipeline::Batch* batch;
+  while ((batch = pipeline.Next()) != NULL) {
+    const sawzall::RecordSpan* records = &batch->records[0];
+    const int n = batch->records.size();
+    if (FLAGS_trace_input) {
+      // Run each record right after tracing it, so that the trace still
+      // precedes the output for the record.
+      for (int i = 0; i < n; i++) {
+        string line(records[i].input_ptr, records[i].input_size);
+        TraceStringInput(batch->first_record + i, line.c_str(), line.size());
+        process->RunBatchOrDie(&records[i], 1, NULL);
       }
-      record_number++;
+    } else {
+      process->RunBatchOrDie(records, n, NULL);
     }
-    fclose(f);
-  } else {
-    fprintf(stderr, "can't open non-RecordIO file: ");
-    perror(file_name);
   }
+  if (!pipeline.error().empty())
+    fprintf(stderr, "error reading file: %s: %s\n",
+                    file_name, pipeline.error().c_str());
 }
 
 
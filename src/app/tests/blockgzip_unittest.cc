@@ -0,0 +1,316 @@
+// Copyright 2010 Google Inc.
+// 
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+// 
+//      http://www.apache.org/licenses/LICENSE-2.0
+// 
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ------------------------------------------------------------------------
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <zlib.h>
+#include <string>
+#include <vector>
+
+#include "public/porting.h"
+#include "public/commandlineflags.h"
+#include "public/logging.h"
+
+#include "utilities/strutils.h"
+#include "utilities/gzipwrapper.h"
+#include "utilities/blockgzip.h"
+
+#include "app/tests/testfiles.h"
+
+
+// Tests of block gzip files and of the parallel decompression of gzip
+// streams.
+
+// Text that compresses somewhat, like real input.
+static string TestText(int size) {
+  string text;
+  for (int i = 0; text.size() < size; i++)
+    StringAppendF(&text, "%d %x line %s\n", i, i * 7919,
+                  string(i % 23, 'x').c_str());
+  text.resize(size);
+  return text;
+}
+
+
+// Compresses text into a gzip stream with a full flush every flush_size
+// bytes of text, as pigz -i does.
+static string GzipWithFlushes(const string& text, int flush_size) {
+  z_stream zstream;
+  memset(&zstream, 0, sizeof zstream);
+  // 16 added to the window bits selects the gzip format
+  CHECK_EQ(Z_OK, deflateInit2(&zstream, Z_DEFAULT_COMPRESSION, Z_DEFLATED,
+                              MAX_WBITS + 16, 8, Z_DEFAULT_STRATEGY));
+  vector<char> buffer(deflateBound(&zstream, text.size()) +
+                      6 * (text.size() / flush_size + 1));
+  zstream.next_out = reinterpret_cast<Bytef*>(&buffer[0]);
+  zstream.avail_out = buffer.size();
+  for (int pos = 0; pos < text.size(); pos += flush_size) {
+    const int n = min(flush_size, static_cast<int>(text.size() - pos));
+    zstream.next_in =
+        reinterpret_cast<Bytef*>(const_cast<char*>(text.data() + pos));
+    zstream.avail_in = n;
+    const bool last = pos + n == text.size();
+    CHECK_EQ(last ? Z_STREAM_END : Z_OK,
+             deflate(&zstream, last ? Z_FINISH : Z_FULL_FLUSH));
+  }
+  string gzipped(&buffer[0], zstream.total_out);
+  deflateEnd(&zstream);
+  return gzipped;
+}
+
+
+static void TestBlocks() {
+  const string text = TestText(1 << 20);
+  string blocks;
+  for (int pos = 0; pos < text.size(); pos += kBlockGzipMaxInput) {
+    const int n = min(kBlockGzipMaxInput, static_cast<int>(text.size() - pos));
+    const int offset = blocks.size();
+    CHECK(BlockGzipCompress(text.data() + pos, n, Z_DEFAULT_COMPRESSION,
+                            &blocks));
+    CHECK_EQ(blocks.size() - offset,
+             BlockGzipBlockSize(blocks.data() + offset,
+                                blocks.size() - offset));
+    CHECK_EQ(-1, BlockGzipBlockSize(blocks.data() + offset, 10));
+  }
+  BlockGzipAppendEof(&blocks);
+  CHECK(IsBlockGzip(blocks.data(), blocks.size()));
+
+  // Any gzip reader can read the blocks.
+  string output;
+  CHECK(GunzipString(reinterpret_cast<const unsigned char*>(blocks.data()),
+                     blocks.size(), &output));
+  CHECK(output == text);
+
+  string error;
+  for (int num_threads = 1; num_threads <= 4; num_threads++) {
+    output = "garbage";
+    CHECK_EQ(blocks.size(), BlockGzipInflate(blocks.data(), blocks.size(),
+                                             num_threads, &output, &error))
+        << error;
+    CHECK(output == text);
+  }
+
+  // An incomplete block is left for later.
+  int n = BlockGzipInflate(blocks.data(), blocks.size() / 2, 4, &output,
+                           &error);
+  CHECK_GT(n, 0);
+  CHECK_LT(n, blocks.size() / 2);
+  CHECK(output == text.substr(0, output.size()));
+
+  // Ordinary gzip data and corrupt blocks are rejected.
+  string gzipped;
+  CHECK(GzipString(reinterpret_cast<const unsigned char*>(text.data()),
+                   text.size(), &gzipped));
+  CHECK(!IsBlockGzip(gzipped.data(), gzipped.size()));
+  CHECK_EQ(-1, BlockGzipInflate(gzipped.data(), gzipped.size(), 4, &output,
+                                &error));
+  string corrupt = blocks;
+  corrupt[100] ^= 1;
+  CHECK_EQ(-1, BlockGzipInflate(corrupt.data(), corrupt.size(), 4, &output,
+                                &error));
+  CHECK(!error.empty());
+}
+
+
+static void TestWriterAndIndex() {
+  const string text = TestText(500000);
+  const string path = TempPath("gz");
+  const string index_path = TempPath("gz.gzi");
+  string error;
+  BlockGzipWriter writer;
+  CHECK(writer.Open(path, index_path, Z_BEST_SPEED, &error)) << error;
+  // Write in pieces that do not line up with the blocks.
+  for (int pos = 0; pos < text.size(); pos += 12345)
+    writer.Write(text.substr(pos, 12345));
+  CHECK(writer.Close());
+
+  const string blocks = ReadFile(path);
+  string output;
+  CHECK_EQ(blocks.size(), BlockGzipInflate(blocks.data(), blocks.size(), 3,
+                                           &output, &error));
+  CHECK(output == text);
+
+  BlockGzipIndex index;
+  CHECK(index.Read(index_path, &error)) << error;
+  const int num_blocks = (text.size() + kBlockGzipMaxInput - 1) /
+                         kBlockGzipMaxInput;
+  CHECK_EQ(num_blocks, index.entries().size());
+  CHECK(index.entries().size() == writer.index().entries().size());
+  for (int i = 0; i < num_blocks; i++) {
+    const BlockGzipIndex::Entry& entry = index.entries()[i];
+    CHECK_EQ(i * kBlockGzipMaxInput, entry.uncompressed_offset);
+    CHECK_EQ(writer.index().entries()[i].compressed_offset,
+             entry.compressed_offset);
+  }
+
+  // Reading from the block found through the index gives the data at the
+  // offset.
+  const uint64 offset = 300000;
+  const BlockGzipIndex::Entry& entry = index.Find(offset);
+  CHECK_LE(entry.uncompressed_offset, offset);
+  CHECK_GT(entry.uncompressed_offset + kBlockGzipMaxInput, offset);
+  const int block_size =
+      BlockGzipBlockSize(blocks.data() + entry.compressed_offset,
+                         blocks.size() - entry.compressed_offset);
+  CHECK_EQ(block_size,
+           BlockGzipInflate(blocks.data() + entry.compressed_offset,
+                            block_size, 1, &output, &error));
+  CHECK(output.substr(offset - entry.uncompressed_offset, 100) ==
+        text.substr(offset, 100));
+  CHECK(&index.Find(0) == &index.entries()[0]);
+
+  unlink(path.c_str());
+  unlink(index_path.c_str());
+  CHECK(!index.Read(index_path, &error));
+}
+
+
+// Decompresses data with a SpeculativeGunzip, passing it in chunks of
+// chunk_size bytes.
+static bool SpeculativeGunzipString(const string& data, int chunk_size,
+                                    string* output,
+                                    SpeculativeGunzip* gunzip) {
+  string error;
+  string pending;
+  output->clear();
+  for (int pos = 0; pos < data.size() || !pending.empty(); ) {
+    const int n = min(chunk_size, static_cast<int>(data.size() - pos));
+    pending.append(data, pos, n);
+    pos += n;
+    const bool at_end = pos == data.size();
+    int consumed = gunzip->Decompress(pending.data(), pending.size(), at_end,
+                                      output, &error);
+    if (consumed < 0)
+      return false;
+    pending.erase(0, consumed);
+    if (at_end && !pending.empty())
+      return false;
+  }
+  return gunzip->done();
+}
+
+
+static void TestSpeculativeGunzip() {
+  const string text = TestText(3 << 20);
+  const int half = text.size() / 2 + 7;
+  string gzipped;
+  CHECK(GzipString(reinterpret_cast<const unsigned char*>(text.data()),
+                   text.size(), &gzipped));
+  const string flushed = GzipWithFlushes(text, 128 << 10);
+  const string members = GzipWithFlushes(text.substr(0, half), 100 << 10) +
+                         GzipWithFlushes(text.substr(half), 100 << 10);
+
+  string output;
+  for (int num_threads = 1; num_threads <= 4; num_threads += 3) {
+    for (int chunk_size = 1 << 20; chunk_size >= 1000; chunk_size /= 37) {
+      SpeculativeGunzip plain_gunzip(num_threads);
+      CHECK(SpeculativeGunzipString(gzipped, chunk_size,
+                                    &output, &plain_gunzip));
+      CHECK(output == text);
+      CHECK_EQ(0, plain_gunzip.pieces_used());
+
+      SpeculativeGunzip flushed_gunzip(num_threads);
+      CHECK(SpeculativeGunzipString(flushed, chunk_size,
+                                    &output, &flushed_gunzip));
+      CHECK(output == text);
+      if (num_threads > 1 && chunk_size == 1 << 20)
+        CHECK_GT(flushed_gunzip.pieces_used(), 0);
+
+      SpeculativeGunzip members_gunzip(num_threads);
+      CHECK(SpeculativeGunzipString(members + "trailing garbage",
+                                    chunk_size, &output,
+                                    &members_gunzip));
+      CHECK(output == text);
+    }
+  }
+
+  // Corrupt and truncated data are detected.
+  string corrupt = flushed;
+  corrupt[corrupt.size() / 2] ^= 0x10;
+  SpeculativeGunzip corrupt_gunzip(4);
+  CHECK(!SpeculativeGunzipString(corrupt, 1 << 20, &output,
+                                 &corrupt_gunzip));
+  SpeculativeGunzip truncated_gunzip(4);
+  CHECK(!SpeculativeGunzipString(flushed.substr(0, flushed.size() - 3),
+                                 1 << 20, &output, &truncated_gunzip));
+  SpeculativeGunzip text_gunzip(4);
+  CHECK(!SpeculativeGunzipString(text, 1 << 20, &output, &text_gunzip));
+}
+
+
+// Inflates blocks on four threads a few times; run by several threads at
+// once, which share the helper threads.
+struct InflateJob {
+  const string* blocks;
+  const string* text;
+};
+
+
+static void* InflateRepeatedly(void* arg) {
+  const InflateJob* job = static_cast<InflateJob*>(arg);
+  for (int i = 0; i < 5; i++) {
+    string output;
+    string error;
+    CHECK_EQ(job->blocks->size(),
+             BlockGzipInflate(job->blocks->data(), job->blocks->size(), 4,
+                              &output, &error)) << error;
+    CHECK(output == *job->text);
+  }
+  return NULL;
+}
+
+
+static void TestConcurrentInflate() {
+  const string text = TestText(1 << 20);
+  string blocks;
+  for (int pos = 0; pos < text.size(); pos += kBlockGzipMaxInput) {
+    const int n = min(kBlockGzipMaxInput, static_cast<int>(text.size() - pos));
+    CHECK(BlockGzipCompress(text.data() + pos, n, Z_DEFAULT_COMPRESSION,
+                            &blocks));
+  }
+  InflateJob job = { &blocks, &text };
+  pthread_t threads[3];
+  for (int t = 0; t < 3; t++)
+    CHECK_EQ(0, pthread_create(&threads[t], NULL, InflateRepeatedly, &job));
+  InflateRepeatedly(&job);
+  for (int t = 0; t < 3; t++)
+    CHECK_EQ(0, pthread_join(threads[t], NULL));
+
+  // gunzip() inflates big block gzip data on the threads it is given.
+  string output;
+  for (int num_threads = 0; num_threads <= 2; num_threads++) {
+    output.clear();
+    CHECK(GunzipString(reinterpret_cast<const unsigned char*>(blocks.data()),
+                       blocks.size(), &output, num_threads));
+    CHECK(output == text);
+  }
+}
+
+
+int main(int argc, char** argv) {
+  ProcessCommandLineArguments(argc, argv);
+  InitializeAllModules();
+
+  TestBlocks();
+  TestWriterAndIndex();
+  TestSpeculativeGunzip();
+  TestConcurrentInflate();
+
+  puts("PASS");
+  return 0;
+}
@@ -0,0 +1,364 @@
+// Copyright 2010 Google Inc.
+// 
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+// 
+//      http://www.apache.org/licenses/LICENSE-2.0
+// 
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ------------------------------------------------------------------------
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#include "public/porting.h"
+#include "public/commandlineflags.h"
+#include "public/logging.h"
+#include "public/varint.h"
+#include "public/columnarinput.h"
+
+#include "utilities/strutils.h"
+
+#include "app/tests/testfiles.h"
+
+
+// Tests of columnar input files.
+
+static string Varint(uint64 v) {
+  char buf[sawzall::kMaxUnsignedVarint64Length];
+  return string(buf, sawzall::EncodeUnsignedVarint64(buf, v) - buf);
+}
+
+
+// Wire-format fields.
+static string VarintField(int tag, uint64 v) {
+  return Varint(tag << 3 | 0) + Varint(v);
+}
+
+
+static string BytesField(int tag, const string& s) {
+  return Varint(tag << 3 | 2) + Varint(s.size()) + s;
+}
+
+
+static string Fixed64Field(int tag, uint64 v) {
+  string s = Varint(tag << 3 | 1);
+  for (int i = 0; i < 8; i++)
+    s += static_cast<char>(v >> (8 * i));
+  return s;
+}
+
+
+static string GroupField(int tag, const string& fields) {
+  return Varint(tag << 3 | 3) + fields + Varint(tag << 3 | 4);
+}
+
+
+// A record as its fields, each with its field number.
+typedef vector<pair<int, string> > Fields;
+
+
+static string Record(const Fields& fields, const vector<int>* tags) {
+  string record;
+  for (int i = 0; i < fields.size(); i++) {
+    if (tags == NULL ||
+        find(tags->begin(), tags->end(), fields[i].first) != tags->end())
+      record += fields[i].second;
+  }
+  return record;
+}
+
+
+// Log-like records: a few fields with few distinct values, some unique
+// ones, repeated fields, a nested message and a group, in increasing
+// order of field number as a serializer writes them.
+static void TestRecords(vector<Fields>* records) {
+  unsigned int seed = 42;
+  for (int i = 0; i < 5000; i++) {
+    Fields f;
+    f.push_back(make_pair(1, VarintField(1, 1000000 + i)));
+    f.push_back(make_pair(2, BytesField(2, StringPrintf("host%d",
+                                                        i % 7))));
+    if (i % 3 != 0)
+      f.push_back(make_pair(3, VarintField(3, rand_r(&seed) % 5)));
+    for (int j = 0; j < i % 4; j++)
+      f.push_back(make_pair(5, BytesField(5, StringPrintf("tag%d", j))));
+    string payload;
+    for (int j = rand_r(&seed) % 200; j > 0; j--)
+      payload += static_cast<char>(rand_r(&seed));
+    f.push_back(make_pair(9, BytesField(9, payload)));
+    f.push_back(make_pair(12, BytesField(12, VarintField(1, i) +
+                                             BytesField(2, "nested"))));
+    if (i % 10 == 0)
+      f.push_back(make_pair(20, GroupField(20, VarintField(1, i) +
+                                               GroupField(2, ""))));
+    f.push_back(make_pair(300, Fixed64Field(300, i * 0x0101010101ULL)));
+    records->push_back(f);
+  }
+  (*records)[17].clear();  // an empty record
+}
+
+
+static void WriteRecords(const string& path, int row_group_records,
+                         const vector<Fields>& records) {
+  string error;
+  sawzall::ColumnarInputWriter* writer = sawzall::ColumnarInputWriter::Open(
+      path.c_str(), row_group_records, &error);
+  CHECK(writer != NULL) << error;
+  for (int i = 0; i < records.size(); i++) {
+    const string record = Record(records[i], NULL);
+    CHECK(writer->Write(record.data(), record.size()))
+        << writer->error_message();
+  }
+  CHECK(writer->Close());
+  delete writer;
+}
+
+
+// Reads the rest of the file, checking the records against records
+// restricted to tags.  Returns the number of records read.
+static int ReadAndCheck(sawzall::ColumnarInputReader* reader,
+                        const vector<Fields>& records,
+                        const vector<int>* tags) {
+  const char* record_ptr;
+  size_t record_size;
+  int n = 0;
+  while (reader->Read(&record_ptr, &record_size)) {
+    const int64 i = reader->record_number();
+    CHECK_LT(i, records.size());
+    CHECK(string(record_ptr, record_size) == Record(records[i], tags)) << i;
+    n++;
+  }
+  CHECK(reader->error_message().empty()) << reader->error_message();
+  return n;
+}
+
+
+static void TestAllFields() {
+  vector<Fields> records;
+  TestRecords(&records);
+  const string path = TempPath("all");
+  WriteRecords(path, 1000, records);
+  string error;
+  sawzall::ColumnarInputReader* reader =
+      sawzall::ColumnarInputReader::Open(path.c_str(), &error);
+  CHECK(reader != NULL) << error;
+  CHECK_EQ(records.size(), reader->num_records());
+  CHECK_EQ(-1, reader->record_number());
+  CHECK_EQ(records.size(), ReadAndCheck(reader, records, NULL));
+  // Every chunk was read.
+  CHECK_LT(ReadFile(path).size() - reader->bytes_read(), 1000);
+  delete reader;
+  unlink(path.c_str());
+}
+
+
+static void TestSelectedFields() {
+  vector<Fields> records;
+  TestRecords(&records);
+  const string path = TempPath("selected");
+  WriteRecords(path, 1000, records);
+  const uint64 file_size = ReadFile(path).size();
+
+  // Fields 3 and 20 are missing from some records, field 5 is repeated,
+  // field 7 occurs in none.
+  static const int kTags[] = { 20, 2, 7, 5, 3 };
+  vector<int> tags(kTags, kTags + ARRAYSIZE(kTags));
+  string error;
+  sawzall::ColumnarInputReader* reader =
+      sawzall::ColumnarInputReader::Open(path.c_str(), &error);
+  CHECK(reader != NULL) << error;
+  reader->SelectFields(tags);
+  CHECK_EQ(records.size(), ReadAndCheck(reader, records, &tags));
+  // The large column of field 9 was skipped.
+  CHECK_LT(reader->bytes_read() * 10, file_size);
+  delete reader;
+
+  // No fields at all give empty records.
+  reader = sawzall::ColumnarInputReader::Open(path.c_str(), &error);
+  vector<int> none;
+  reader->SelectFields(none);
+  CHECK_EQ(records.size(), ReadAndCheck(reader, records, &none));
+  CHECK_EQ(0, reader->bytes_read());
+  delete reader;
+  unlink(path.c_str());
+}
+
+
+static void TestSeek() {
+  vector<Fields> records;
+  TestRecords(&records);
+  const string path = TempPath("seek");
+  WriteRecords(path, 700, records);
+  string error;
+  sawzall::ColumnarInputReader* reader =
+      sawzall::ColumnarInputReader::Open(path.c_str(), &error);
+  CHECK(reader != NULL) << error;
+  vector<int> tags(1, 5);
+  reader->SelectFields(tags);
+
+  // Seek to records in any order.
+  const int seeks[] = { 4999, 0, 700, 699, 17, 3000 };
+  for (int i = 0; i < ARRAYSIZE(seeks); i++) {
+    CHECK(reader->SeekToRecord(seeks[i]));
+    const char* record_ptr;
+    size_t record_size;
+    CHECK(reader->Read(&record_ptr, &record_size));
+    CHECK_EQ(seeks[i], reader->record_number());
+    CHECK(string(record_ptr, record_size) == Record(records[seeks[i]], &tags));
+  }
+  CHECK(reader->SeekToRecord(1234));
+  CHECK_EQ(records.size() - 1234, ReadAndCheck(reader, records, &tags));
+  CHECK(!reader->SeekToRecord(records.size()));
+  delete reader;
+  unlink(path.c_str());
+}
+
+
+static void TestFieldOrder() {
+  // The fields of a record come back in order of field number; the
+  // occurrences of a repeated field keep their order.
+  const string path = TempPath("order");
+  string error;
+  sawzall::ColumnarInputWriter* writer =
+      sawzall::ColumnarInputWriter::Open(path.c_str(), 10, &error);
+  CHECK(writer != NULL) << error;
+  const string record = VarintField(4, 1) + VarintField(2, 2) +
+                        VarintField(4, 3) + VarintField(1, 4);
+  CHECK(writer->Write(record.data(), record.size()));
+  CHECK(writer->Close());
+  delete writer;
+
+  sawzall::ColumnarInputReader* reader =
+      sawzall::ColumnarInputReader::Open(path.c_str(), &error);
+  CHECK(reader != NULL) << error;
+  const char* record_ptr;
+  size_t record_size;
+  CHECK(reader->Read(&record_ptr, &record_size));
+  CHECK(string(record_ptr, record_size) ==
+        VarintField(1, 4) + VarintField(2, 2) + VarintField(4, 1) +
+        VarintField(4, 3));
+  CHECK(!reader->Read(&record_ptr, &record_size));
+  delete reader;
+  unlink(path.c_str());
+}
+
+
+static void TestNotProto() {
+  const string path = TempPath("notproto");
+  string error;
+  sawzall::ColumnarInputWriter* writer =
+      sawzall::ColumnarInputWriter::Open(path.c_str(), 10, &error);
+  CHECK(writer != NULL) << error;
+  const string bad[] = {
+    "\xff",                                  // truncated varint
+    BytesField(1, "abc").substr(0, 4),       // truncated value
+    Varint(0 << 3 | 0) + Varint(1),          // field number 0
+    Varint(1 << 3 | 4),                      // unmatched end of group
+    Varint(1 << 3 | 3) + Varint(2 << 3 | 4),  // mismatched end of group
+    Varint(1 << 3 | 6),                      // unknown wire type
+  };
+  for (int i = 0; i < ARRAYSIZE(bad); i++) {
+    CHECK(!writer->Write(bad[i].data(), bad[i].size())) << i;
+    CHECK(!writer->error_message().empty());
+  }
+  const string good = VarintField(1, 1);
+  CHECK(writer->Write(good.data(), good.size()));
+  CHECK(writer->Close()) << writer->error_message();
+  delete writer;
+
+  sawzall::ColumnarInputReader* reader =
+      sawzall::ColumnarInputReader::Open(path.c_str(), &error);
+  CHECK(reader != NULL) << error;
+  CHECK_EQ(1, reader->num_records());
+  delete reader;
+  unlink(path.c_str());
+}
+
+
+// A row group that cannot be written fails the writer: later records are
+// refused and Close reports the failure instead of writing a footer.
+static void TestWriteError() {
+  string error;
+  sawzall::ColumnarInputWriter* writer =
+      sawzall::ColumnarInputWriter::Open("/dev/full", 1, &error);
+  if (writer == NULL)
+    return;  // no /dev/full here
+  // Random bytes do not deflate to something that fits the stdio buffer.
+  string data(1 << 20, 0);
+  srand(1);
+  for (int i = 0; i < data.size(); i++)
+    data[i] = rand();
+  const string big = BytesField(1, data);
+  CHECK(!writer->Write(big.data(), big.size()));
+  CHECK(!writer->error_message().empty());
+  const string small = VarintField(1, 1);
+  CHECK(!writer->Write(small.data(), small.size()));
+  CHECK(!writer->Close());
+  CHECK(!writer->Close());
+  delete writer;
+}
+
+
+static void TestCorrupt() {
+  vector<Fields> records;
+  TestRecords(&records);
+  const string path = TempPath("corrupt");
+  WriteRecords(path, 1000, records);
+  const string contents = ReadFile(path);
+  string error;
+
+  // A damaged chunk is detected when it is read.
+  string damaged = contents;
+  damaged[100] ^= 1;
+  WriteFile(path, damaged);
+  sawzall::ColumnarInputReader* reader =
+      sawzall::ColumnarInputReader::Open(path.c_str(), &error);
+  CHECK(reader != NULL) << error;
+  const char* record_ptr;
+  size_t record_size;
+  CHECK(!reader->Read(&record_ptr, &record_size));
+  CHECK(!reader->error_message().empty());
+  CHECK(!reader->Read(&record_ptr, &record_size));
+  delete reader;
+
+  // A damaged or truncated footer is detected when the file is opened.
+  damaged = contents;
+  damaged[contents.size() - 20] ^= 1;
+  WriteFile(path, damaged);
+  CHECK(sawzall::ColumnarInputReader::Open(path.c_str(), &error) == NULL);
+  CHECK(!error.empty());
+  for (int size = 0; size < 40; size += 7) {
+    WriteFile(path, contents.substr(0, size));
+    CHECK(sawzall::ColumnarInputReader::Open(path.c_str(), &error) == NULL);
+  }
+  WriteFile(path, contents.substr(0, contents.size() - 1));
+  CHECK(sawzall::ColumnarInputReader::Open(path.c_str(), &error) == NULL);
+  unlink(path.c_str());
+}
+
+
+int main(int argc, char** argv) {
+  ProcessCommandLineArguments(argc, argv);
+  InitializeAllModules();
+
+  TestAllFields();
+  TestSelectedFields();
+  TestSeek();
+  TestFieldOrder();
+  TestNotProto();
+  TestWriteError();
+  TestCorrupt();
+
+  puts("PASS");
+  return 0;
+}
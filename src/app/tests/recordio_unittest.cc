@@ -0,0 +1,277 @@
+// Copyright 2010 Google Inc.
+// 
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+// 
+//      http://www.apache.org/licenses/LICENSE-2.0
+// 
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ------------------------------------------------------------------------
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <string>
+#include <vector>
+
+#include "public/porting.h"
+#include "public/commandlineflags.h"
+#include "public/logging.h"
+#include "public/recordio.h"
+
+#include "utilities/strutils.h"
+#include "utilities/crc32c.h"
+
+#include "app/tests/testfiles.h"
+
+
+// Tests of plain and indexed record files.
+
+// Records of varying sizes, some compressible and some not, and one
+// larger than a block.
+static void TestRecords(vector<string>* records) {
+  unsigned int seed = 42;
+  for (int i = 0; i < 5000; i++) {
+    string record = StringPrintf("record %d ", i);
+    const int size = rand_r(&seed) % 100;
+    for (int j = 0; j < size; j++)
+      record += (i % 3 == 0) ? static_cast<char>(rand_r(&seed)) : 'x';
+    records->push_back(record);
+  }
+  (*records)[2500] = string(50000, 'y');
+  (*records)[10] = "";
+}
+
+
+static void WriteRecords(const string& path, int block_size,
+                         const vector<string>& records) {
+  sawzall::RecordWriter* writer =
+      block_size > 0
+          ? sawzall::RecordWriter::OpenIndexed(path.c_str(), block_size)
+          : sawzall::RecordWriter::Open(path.c_str());
+  CHECK(writer != NULL);
+  for (int i = 0; i < records.size(); i++)
+    CHECK(writer->Write(records[i].data(), records[i].size()));
+  CHECK(writer->Close());
+  delete writer;
+}
+
+
+// Reads the rest of the file, checking the records against records.
+// Returns the number of records read.
+static int ReadAndCheck(sawzall::RecordReader* reader,
+                        const vector<string>& records) {
+  char* record_ptr;
+  size_t record_size;
+  int n = 0;
+  while (reader->Read(&record_ptr, &record_size)) {
+    const int64 i = reader->record_number();
+    CHECK_LT(i, records.size());
+    CHECK(string(record_ptr, record_size) == records[i]) << i;
+    n++;
+  }
+  CHECK(reader->Eof());
+  return n;
+}
+
+
+static void TestCrc32c() {
+  CHECK_EQ(0xe3069283, Crc32c(0, "123456789", 9));
+  CHECK_EQ(0, Crc32c(0, "", 0));
+  // Continuing a checksum is the same as computing it in one go.
+  string data(1000, 'z');
+  for (int i = 0; i < data.size(); i++)
+    data[i] = i * 7;
+  for (int split = 0; split < 20; split++)
+    CHECK_EQ(Crc32c(0, data.data(), data.size()),
+             Crc32c(Crc32c(0, data.data(), split), data.data() + split,
+                    data.size() - split));
+}
+
+
+static void TestPlain() {
+  vector<string> records;
+  TestRecords(&records);
+  const string path = TempPath("plain");
+  WriteRecords(path, 0, records);
+  sawzall::RecordReader* reader = sawzall::RecordReader::Open(path.c_str());
+  CHECK(reader != NULL);
+  CHECK(!reader->indexed());
+  CHECK_EQ(-1, reader->record_number());
+  CHECK_EQ(-1, reader->num_records());
+  CHECK(reader->SeekToRecord(1234));
+  CHECK_EQ(records.size() - 1234, ReadAndCheck(reader, records));
+  CHECK(reader->error_message().empty());
+  CHECK(!reader->SeekToOffset(0));
+  delete reader;
+  unlink(path.c_str());
+}
+
+
+static void TestIndexed() {
+  vector<string> records;
+  TestRecords(&records);
+  const string path = TempPath("indexed");
+  WriteRecords(path, 4096, records);
+
+  sawzall::RecordReader* reader = sawzall::RecordReader::Open(path.c_str());
+  CHECK(reader != NULL);
+  CHECK(reader->indexed());
+  CHECK_EQ(records.size(), reader->num_records());
+  CHECK_EQ(records.size(), ReadAndCheck(reader, records));
+  CHECK(reader->error_message().empty());
+
+  // Seek to records in any order.
+  const int seeks[] = { 4999, 0, 2500, 2501, 17, 3000 };
+  for (int i = 0; i < ARRAYSIZE(seeks); i++) {
+    CHECK(reader->SeekToRecord(seeks[i]));
+    char* record_ptr;
+    size_t record_size;
+    CHECK(reader->Read(&record_ptr, &record_size));
+    CHECK_EQ(seeks[i], reader->record_number());
+    CHECK(string(record_ptr, record_size) == records[seeks[i]]);
+  }
+  CHECK(!reader->SeekToRecord(records.size()));
+  delete reader;
+
+  // Split the file among three readers by offset; each record is read
+  // exactly once.
+  const int64 size = ReadFile(path).size();
+  vector<int> seen(records.size(), 0);
+  for (int part = 0; part < 3; part++) {
+    const uint64 begin = size * part / 3;
+    const uint64 end = size * (part + 1) / 3;
+    reader = sawzall::RecordReader::Open(path.c_str());
+    CHECK(reader->SeekToOffset(begin));
+    char* record_ptr;
+    size_t record_size;
+    while (reader->Read(&record_ptr, &record_size) &&
+           reader->block_offset() < end) {
+      CHECK_GE(reader->block_offset(), begin);
+      CHECK(string(record_ptr, record_size) ==
+            records[reader->record_number()]);
+      seen[reader->record_number()]++;
+    }
+    delete reader;
+  }
+  CHECK(seen == vector<int>(records.size(), 1));
+  unlink(path.c_str());
+}
+
+
+static void TestCorrupt() {
+  vector<string> records;
+  TestRecords(&records);
+  const string path = TempPath("corrupt");
+  WriteRecords(path, 4096, records);
+  const string contents = ReadFile(path);
+
+  // A damaged byte in the middle loses only its block; the records after
+  // it keep their numbers.
+  string damaged = contents;
+  damaged[damaged.size() / 2] ^= 0x40;
+  WriteFile(path, damaged);
+  sawzall::RecordReader* reader = sawzall::RecordReader::Open(path.c_str());
+  const int n = ReadAndCheck(reader, records);
+  CHECK_LT(n, records.size());
+  CHECK_GT(n, records.size() - 200);
+  CHECK_EQ(records.size() - 1, reader->record_number());
+  CHECK_EQ(1, reader->corrupt_blocks());
+  CHECK(!reader->error_message().empty());
+  delete reader;
+
+  // Seeking to a record of the lost block goes on to the next good one.
+  reader = sawzall::RecordReader::Open(path.c_str());
+  vector<bool> present(records.size(), false);
+  char* record_ptr;
+  size_t record_size;
+  while (reader->Read(&record_ptr, &record_size))
+    present[reader->record_number()] = true;
+  int lost = 0;
+  while (present[lost])
+    lost++;
+  int next = lost;
+  while (!present[next])
+    next++;
+  const int lost_seeks[] = { lost, (lost + next) / 2, next - 1 };
+  for (int i = 0; i < ARRAYSIZE(lost_seeks); i++) {
+    CHECK(reader->SeekToRecord(lost_seeks[i]));
+    CHECK(reader->Read(&record_ptr, &record_size));
+    CHECK_EQ(next, reader->record_number());
+    CHECK(string(record_ptr, record_size) == records[next]);
+  }
+  CHECK(reader->SeekToRecord(next));
+  CHECK(reader->Read(&record_ptr, &record_size));
+  CHECK_EQ(next, reader->record_number());
+  delete reader;
+
+  // The same without the index, reading from the start.
+  WriteFile(path, damaged.substr(0, damaged.size() * 3 / 4));
+  reader = sawzall::RecordReader::Open(path.c_str());
+  CHECK_EQ(-1, reader->num_records());
+  CHECK(reader->SeekToRecord(lost + 1));
+  CHECK(reader->Read(&record_ptr, &record_size));
+  CHECK_EQ(next, reader->record_number());
+  CHECK(string(record_ptr, record_size) == records[next]);
+  delete reader;
+
+  // No good block follows a damaged last block.
+  uint64 index_offset = 0;
+  for (int i = 7; i >= 0; i--)
+    index_offset = (index_offset << 8) |
+                   static_cast<uint8>(contents[contents.size() - 16 + i]);
+  damaged = contents;
+  damaged[index_offset - 10] ^= 0x40;
+  WriteFile(path, damaged);
+  reader = sawzall::RecordReader::Open(path.c_str());
+  CHECK_EQ(records.size(), reader->num_records());
+  CHECK(!reader->SeekToRecord(records.size() - 1));
+  delete reader;
+
+  // Without its end, the file has no index, but its records can still be
+  // read and seeked to, slowly.
+  WriteFile(path, contents.substr(0, contents.size() * 3 / 4));
+  reader = sawzall::RecordReader::Open(path.c_str());
+  CHECK(reader->indexed());
+  CHECK_EQ(-1, reader->num_records());
+  CHECK(reader->SeekToRecord(100));
+  CHECK_GT(ReadAndCheck(reader, records), 3000);
+  CHECK_EQ(1, reader->corrupt_blocks());
+  delete reader;
+  unlink(path.c_str());
+}
+
+
+// A write error is reported with the system's message.
+static void TestWriteError() {
+  sawzall::RecordWriter* writer = sawzall::RecordWriter::Open("/dev/full");
+  if (writer == NULL)
+    return;  // no /dev/full here
+  const string record(1 << 20, 'x');
+  CHECK(!writer->Write(record.data(), record.size()));
+  CHECK(writer->error_message() == strerror(ENOSPC))
+      << writer->error_message();
+  delete writer;
+}
+
+
+int main(int argc, char** argv) {
+  ProcessCommandLineArguments(argc, argv);
+  InitializeAllModules();
+
+  TestCrc32c();
+  TestPlain();
+  TestIndexed();
+  TestCorrupt();
+  TestWriteError();
+
+  puts("PASS");
+  return 0;
+}
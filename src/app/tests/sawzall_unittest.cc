@@ -14,12 +14,17 @@
 // ------------------------------------------------------------------------
 
 #include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
 
 #include "public/porting.h"
 #include "public/logging.h"
 
 #include "public/sawzall.h"
 
+#include "utilities/strutils.h"
+
 
 // Verify that we can have several executables w/o scope conflicts;
 // e.g., doubly declared predefined identifiers - was bug
@@ -39,12 +44,88 @@ static int Test0() {
 }
 
 
+// Verify that RunBatch runs each record, reports undefined values per
+// record, and stops at the first record that fails.
+static int Test1() {
+  static const char* source =
+    "n: int = int(string(input), 10);\n"
+    "assert(n >= 0, \"negative\");\n";
+  sawzall::Executable exe("<batch>", source, sawzall::kIgnoreUndefs);
+  CHECK(exe.is_executable());
+  sawzall::Process process(&exe, NULL);
+  process.InitializeOrDie();
+
+  static const char* inputs[] = { "1", "x", "3", "-1", "5" };
+  const int n = sizeof inputs / sizeof inputs[0];
+  sawzall::RecordSpan records[n];
+  for (int i = 0; i < n; i++) {
+    records[i].input_ptr = inputs[i];
+    records[i].input_size = strlen(inputs[i]);
+    records[i].key_ptr = "";
+    records[i].key_size = 0;
+  }
+  uint64 undef_counts[n];
+  CHECK_EQ(3, process.RunBatch(records, 3, undef_counts));
+  CHECK(process.error_msg() == NULL);
+  CHECK_EQ(0, undef_counts[0]);
+  CHECK_EQ(1, undef_counts[1]);
+  CHECK_EQ(0, undef_counts[2]);
+  CHECK_EQ(1, process.ProcUndefCnt());
+
+  // The fourth record fails the assertion; the fifth is not run.
+  CHECK_EQ(0, process.RunBatch(records + 3, 2, NULL));
+  CHECK(process.error_msg() != NULL);
+  return 0;
+}
+
+
+// Verify that GetReferencedInputFieldTags finds the fields of the input
+// proto that are read, and only when input is used just as that proto.
+static int Test2() {
+  static const char* proto =
+    "type P = { a: int @ 1, b: bytes @ 2, c: array of int @ 5, "
+    "           d: { x: int @ 1, y: int @ 2 } @ 9, e: float @ 3 };\n";
+  static const struct {
+    const char* source;
+    bool result;
+    const char* tags;
+  } tests[] = {
+    { "p: P = input;\n"
+      "n: int = p.c[0] + len(p.b) + p.d.y;\n", true, "2 5 9" },
+    { "n: int = len(P(input).b);\n"
+      "q: P = input;\n"
+      "m: int = q.a;\n", true, "1 2" },
+    { "n: int = 0;\n", true, "" },
+    { "p: P = input;\n"
+      "n: int = p.a + len(input);\n", false, "" },
+    { "b: bytes = input;\n"
+      "p: P = b;\n"
+      "n: int = p.a;\n", false, "" },
+  };
+  for (int i = 0; i < sizeof tests / sizeof tests[0]; i++) {
+    string source = string(proto) + tests[i].source;
+    sawzall::Executable exe("<input fields>", source.c_str(),
+                            sawzall::kNormal);
+    CHECK(exe.is_executable()) << i;
+    vector<int> tags;
+    CHECK_EQ(tests[i].result, exe.GetReferencedInputFieldTags(&tags)) << i;
+    string s;
+    for (int j = 0; j < tags.size(); j++)
+      s += (j > 0 ? " " : "") + StringPrintf("%d", tags[j]);
+    CHECK_EQ(string(tests[i].tags), s) << i;
+  }
+  return 0;
+}
+
+
 int main(int argc, char *argv[]) {
   ProcessCommandLineArguments(argc, argv);
   InitializeAllModules();
 
   int errors = 0;
   errors += Test0();
+  errors += Test1();
+  errors += Test2();
   // ... more tests ...
 
   if (errors == 0)
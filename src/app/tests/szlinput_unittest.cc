@@ -0,0 +1,346 @@
+// Copyright 2010 Google Inc.
+// 
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+// 
+//      http://www.apache.org/licenses/LICENSE-2.0
+// 
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ------------------------------------------------------------------------
+
+#define __STDC_FORMAT_MACROS
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <zlib.h>
+#include <string>
+#include <vector>
+
+#include "public/porting.h"
+#include "public/commandlineflags.h"
+#include "public/logging.h"
+
+#include "utilities/strutils.h"
+#include "utilities/gzipwrapper.h"
+#include "utilities/spscqueue.h"
+#include "utilities/blockgzip.h"
+
+#include "public/sawzall.h"
+#include "app/szlinput.h"
+#include "app/tests/testfiles.h"
+
+
+// Tests of the input streams and the input pipeline used by szl.
+
+typedef pair<string, string> Record;  // input, key
+
+
+// The records that szl used to read from a file with fgets.
+static void ReadWithFgets(const string& path, uint64 begin, uint64 end,
+                          vector<Record>* records) {
+  FILE* f = fopen(path.c_str(), "r");
+  CHECK(f != NULL) << path;
+  char line[SzlInputPipeline::kMaxLineSize];
+  uint64 record_number = 0;
+  while (record_number < end && fgets(line, sizeof line, f) != NULL) {
+    char* p = strchr(line, '\n');
+    if (p != NULL)
+      *p = '\0';
+    if (begin <= record_number)
+      records->push_back(Record(line, StringPrintf("%" PRIu64, record_number)));
+    record_number++;
+  }
+  fclose(f);
+}
+
+
+// Reads the records of a file through the pipeline.
+static void ReadWithPipeline(const string& path, bool decompress,
+                             int num_threads, uint64 begin, uint64 end,
+                             const char* format, vector<Record>* records) {
+  string error;
+  SzlInputStream* stream =
+      SzlInputStream::Open(path.c_str(), decompress, num_threads, &error);
+  CHECK(stream != NULL) << error;
+  CHECK_EQ(string(format), stream->format());
+  SzlInputPipeline pipeline(stream, begin, end);
+  const SzlInputPipeline::Batch* batch;
+  while ((batch = pipeline.Next()) != NULL) {
+    CHECK(!batch->records.empty());
+    CHECK_EQ(begin + records->size(), batch->first_record);
+    for (int i = 0; i < batch->records.size(); i++) {
+      const sawzall::RecordSpan& r = batch->records[i];
+      records->push_back(Record(string(r.input_ptr, r.input_size),
+                                string(r.key_ptr, r.key_size)));
+    }
+  }
+  CHECK(pipeline.Next() == NULL);
+  CHECK(pipeline.error().empty()) << pipeline.error();
+}
+
+
+// Some text with empty lines, lines of and around the maximum line size,
+// a NUL byte and no newline at the end; large enough to fill several
+// batches.
+static string TestText() {
+  string text;
+  for (int i = 0; i < 200000; i++)
+    StringAppendF(&text, "%d line %s\n", i, string(i % 17, 'x').c_str());
+  text += "\n\n";
+  text += string(SzlInputPipeline::kMaxLineSize - 2, 'a') + "\n";
+  text += string(SzlInputPipeline::kMaxLineSize - 1, 'b') + "\n";
+  text += string(SzlInputPipeline::kMaxLineSize, 'c') + "\n";
+  text += string(3 * SzlInputPipeline::kMaxLineSize + 5, 'd') + "\n";
+  text += string("nul") + '\0' + "byte\n";
+  text += "no newline";
+  return text;
+}
+
+
+static string Gzip(const string& text) {
+  string gzipped;
+  CHECK(GzipString(reinterpret_cast<const unsigned char*>(text.data()),
+                   text.size(), &gzipped));
+  return gzipped;
+}
+
+
+static string Zlib(const string& text) {
+  vector<char> buffer(compressBound(text.size()));
+  uLongf size = buffer.size();
+  CHECK_EQ(Z_OK, compress2(reinterpret_cast<Bytef*>(&buffer[0]), &size,
+                           reinterpret_cast<const Bytef*>(text.data()),
+                           text.size(), Z_DEFAULT_COMPRESSION));
+  return string(&buffer[0], size);
+}
+
+
+static string BlockGzip(const string& text) {
+  string blocks;
+  for (int pos = 0; pos < text.size(); pos += kBlockGzipMaxInput) {
+    CHECK(BlockGzipCompress(text.data() + pos,
+                            min(kBlockGzipMaxInput,
+                                static_cast<int>(text.size() - pos)),
+                            Z_DEFAULT_COMPRESSION, &blocks));
+  }
+  BlockGzipAppendEof(&blocks);
+  return blocks;
+}
+
+
+// A gzip stream with full flushes, which can be inflated in pieces.
+static string GzipWithFlushes(const string& text) {
+  const int kFlushSize = 100 << 10;
+  z_stream zstream;
+  memset(&zstream, 0, sizeof zstream);
+  // 16 added to the window bits selects the gzip format
+  CHECK_EQ(Z_OK, deflateInit2(&zstream, Z_DEFAULT_COMPRESSION, Z_DEFLATED,
+                              MAX_WBITS + 16, 8, Z_DEFAULT_STRATEGY));
+  vector<char> buffer(deflateBound(&zstream, text.size()) +
+                      6 * (text.size() / kFlushSize + 1));
+  zstream.next_out = reinterpret_cast<Bytef*>(&buffer[0]);
+  zstream.avail_out = buffer.size();
+  for (int pos = 0; pos < text.size(); pos += kFlushSize) {
+    const int n = min(kFlushSize, static_cast<int>(text.size() - pos));
+    zstream.next_in =
+        reinterpret_cast<Bytef*>(const_cast<char*>(text.data() + pos));
+    zstream.avail_in = n;
+    const bool last = pos + n == text.size();
+    CHECK_EQ(last ? Z_STREAM_END : Z_OK,
+             deflate(&zstream, last ? Z_FINISH : Z_FULL_FLUSH));
+  }
+  string gzipped(&buffer[0], zstream.total_out);
+  deflateEnd(&zstream);
+  return gzipped;
+}
+
+
+static void TestFormats() {
+  const string text = TestText();
+  const string plain = TempPath("plain");
+  WriteFile(plain, text);
+  vector<Record> expected;
+  ReadWithFgets(plain, 0, kuint64max, &expected);
+
+  // Two gzip members, split in the middle of a line.
+  const int half = text.size() / 2 + 3;
+  const string gzipped = Gzip(text);
+  const string members = Gzip(text.substr(0, half)) + Gzip(text.substr(half));
+
+  // Gzip files are read by a different stream when several threads may
+  // decompress them.
+  struct {
+    const char* name;
+    string contents;
+    bool decompress;
+    const char* format;
+    const char* parallel_format;
+  } files[] = {
+    { "plain", text, true, "plain", "plain" },
+    { "gz", gzipped, true, "gzip", "gzip" },
+    { "members.gz", members, true, "gzip", "gzip" },
+    { "flushed.gz", GzipWithFlushes(text), true, "gzip", "gzip" },
+    { "bgz", BlockGzip(text), true, "gzip", "block gzip" },
+    { "zz", Zlib(text), true, "zlib", "zlib" },
+  };
+  for (int i = 0; i < ARRAYSIZE(files); i++) {
+    const string path = TempPath(files[i].name);
+    WriteFile(path, files[i].contents);
+    for (int num_threads = 1; num_threads <= 4; num_threads += 3) {
+      const char* format =
+          num_threads == 1 ? files[i].format : files[i].parallel_format;
+      vector<Record> records;
+      ReadWithPipeline(path, files[i].decompress, num_threads, 0, kuint64max,
+                       format, &records);
+      CHECK(records == expected) << files[i].name;
+
+      // A range of records in the middle.
+      records.clear();
+      ReadWithPipeline(path, files[i].decompress, num_threads, 1000, 150000,
+                       format, &records);
+      CHECK(records == vector<Record>(expected.begin() + 1000,
+                                     expected.begin() + 150000))
+          << files[i].name;
+    }
+    unlink(path.c_str());
+  }
+
+  // Without decompression, the gzip file is read as is.
+  const string gz = TempPath("gz");
+  WriteFile(gz, gzipped);
+  vector<Record> records;
+  ReadWithPipeline(gz, false, 4, 0, kuint64max, "plain", &records);
+  expected.clear();
+  ReadWithFgets(gz, 0, kuint64max, &expected);
+  CHECK(records == expected);
+  unlink(gz.c_str());
+  unlink(plain.c_str());
+}
+
+
+static void TestCompress() {
+  // "hello\nworld\nhello world\nhello hello hello\n", compressed by compress
+  static const unsigned char compressed[] = {
+    0x1f, 0x9d, 0x90, 0x68, 0xca, 0xb0, 0x61, 0xf3, 0x46, 0xc1, 0x9d,
+    0x37, 0x72, 0xd8, 0x90, 0x51, 0x10, 0x70, 0xe0, 0x1b, 0x10, 0x07,
+    0x13, 0x2e, 0x6c, 0x48, 0x10, 0x04, 0xc5, 0x87, 0x17, 0x15, 0x00,
+  };
+  const string path = TempPath("Z");
+  WriteFile(path, string(reinterpret_cast<const char*>(compressed),
+                         sizeof compressed));
+  vector<Record> records;
+  ReadWithPipeline(path, true, 1, 0, kuint64max, "compress", &records);
+  CHECK_EQ(4, records.size());
+  CHECK(records[0] == Record("hello", "0"));
+  CHECK(records[1] == Record("world", "1"));
+  CHECK(records[2] == Record("hello world", "2"));
+  CHECK(records[3] == Record("hello hello hello", "3"));
+  unlink(path.c_str());
+}
+
+
+static void TestNotZlib() {
+  // Text can start with a valid zlib header ("x^").
+  const string path = TempPath("text");
+  WriteFile(path, "x^2 + y^2\n");
+  vector<Record> records;
+  ReadWithPipeline(path, true, 1, 0, kuint64max, "plain", &records);
+  CHECK_EQ(1, records.size());
+  CHECK(records[0] == Record("x^2 + y^2", "0"));
+
+  // Empty files have no records.
+  WriteFile(path, "");
+  records.clear();
+  ReadWithPipeline(path, true, 1, 0, kuint64max, "plain", &records);
+  CHECK(records.empty());
+  unlink(path.c_str());
+}
+
+
+static void TestCorrupt() {
+  const string path = TempPath("truncated.gz");
+  string error;
+  const string text = TestText();
+  const string files[] = { Gzip(text), GzipWithFlushes(text), BlockGzip(text) };
+  for (int i = 0; i < ARRAYSIZE(files); i++) {
+    for (int num_threads = 1; num_threads <= 4; num_threads += 3) {
+      WriteFile(path, files[i].substr(0, files[i].size() / 2));
+      SzlInputStream* stream =
+          SzlInputStream::Open(path.c_str(), true, num_threads, &error);
+      CHECK(stream != NULL) << error;
+      SzlInputPipeline pipeline(stream, 0, kuint64max);
+      int records = 0;
+      const SzlInputPipeline::Batch* batch;
+      while ((batch = pipeline.Next()) != NULL)
+        records += batch->records.size();
+      CHECK_GT(records, 0);
+      CHECK(!pipeline.error().empty());
+    }
+  }
+  unlink(path.c_str());
+
+  CHECK(SzlInputStream::Open(path.c_str(), true, 1, &error) == NULL);
+  CHECK(!error.empty());
+}
+
+
+static void TestEarlyDestruction() {
+  const string path = TempPath("plain");
+  WriteFile(path, TestText());
+  string error;
+  SzlInputStream* stream =
+      SzlInputStream::Open(path.c_str(), true, 1, &error);
+  CHECK(stream != NULL) << error;
+  SzlInputPipeline pipeline(stream, 0, kuint64max);
+  CHECK(pipeline.Next() != NULL);
+  unlink(path.c_str());
+}
+
+
+const int kNumValues = 100000;
+
+static void* Producer(void* arg) {
+  SPSCQueue<int>* queue = static_cast<SPSCQueue<int>*>(arg);
+  for (int i = 0; i < kNumValues; i++)
+    queue->Push(i);
+  return NULL;
+}
+
+
+static void TestQueue() {
+  SPSCQueue<int> queue(3);
+  pthread_t thread;
+  CHECK_EQ(0, pthread_create(&thread, NULL, Producer, &queue));
+  for (int i = 0; i < kNumValues; i++) {
+    int value;
+    queue.Pop(&value);
+    CHECK_EQ(i, value);
+  }
+  CHECK_EQ(0, pthread_join(thread, NULL));
+  int value;
+  CHECK(!queue.TryPop(&value));
+}
+
+
+int main(int argc, char** argv) {
+  ProcessCommandLineArguments(argc, argv);
+  InitializeAllModules();
+
+  TestQueue();
+  TestFormats();
+  TestCompress();
+  TestNotZlib();
+  TestCorrupt();
+  TestEarlyDestruction();
+
+  puts("PASS");
+  return 0;
+}
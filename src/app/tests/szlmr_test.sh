@@ -0,0 +1,83 @@
+#!/bin/bash
+
+# Copyright 2010 Google Inc.
+# 
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+# 
+#      http://www.apache.org/licenses/LICENSE-2.0
+# 
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+# ------------------------------------------------------------------------
+
+# Runs a program under szl-mr and checks that its tables come out as they
+# do under szl.  The map output is flushed after every record and spilled
+# to many small runs, so each key goes through several rounds of flushing
+# and merging in the mappers, the combiner and the reducers.
+
+if [[ "$0" == */* ]] ; then
+  cd "${0%/*}/"
+fi
+
+if [ -z "$SZL" ] ; then
+  SZL="szl"
+fi
+
+if [ -z "$SZL_MR" ] ; then
+  SZL_MR="szl-mr"
+fi
+
+if [ -z "$SZL_TMP" ] ; then
+  SZL_TMP="."
+fi
+
+prefix="$SZL_TMP"/szlmr_test.$$
+rm -f "$prefix".*
+
+cat > "$prefix".szl <<'END'
+n: int = int(string(input), 10);
+key: string = format("%d", n % 50);
+count: table sum[string] of int;
+emit count[key] <- 1;
+top: table maximum(3)[string] of string weight int;
+emit top[key] <- format("%d", n) weight n;
+bottom: table minimum(3)[string] of string weight int;
+emit bottom[key] <- format("%d", n) weight n;
+END
+seq 1 20000 > "$prefix".input
+
+status=0
+"$SZL" --nonative --table_output=count,top,bottom \
+  "$prefix".szl "$prefix".input 2> "$prefix".err | sort > "$prefix".expected
+if [ ${PIPESTATUS[0]} -ne 0 ] ; then
+  echo "FAIL - szl failed:" >&2
+  cat "$prefix".err >&2
+  status=1
+fi
+
+for combine in --mr_combine --nomr_combine ; do
+  "$SZL_MR" --nonative --mappers=2 --reducers=2 $combine \
+    --mr_emitter_memory_mb=0 --mr_sort_buffer_mb=1 --mr_merge_fan_in=2 \
+    --mr_tmpdir="$SZL_TMP" "$prefix".szl "$prefix".input \
+    2> "$prefix".err | sort > "$prefix".output
+  if [ ${PIPESTATUS[0]} -ne 0 ] ; then
+    echo "FAIL - szl-mr $combine failed:" >&2
+    cat "$prefix".err >&2
+    status=1
+  elif ! cmp -s "$prefix".expected "$prefix".output ; then
+    echo "FAIL - szl-mr $combine output differs from szl:" >&2
+    diff "$prefix".expected "$prefix".output | head -20 >&2
+    status=1
+  fi
+done
+
+rm -f "$prefix".*
+if [ $status -eq 0 ] ; then
+  echo PASS
+fi
+exit $status
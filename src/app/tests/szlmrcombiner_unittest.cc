@@ -0,0 +1,264 @@
+// Copyright 2010 Google Inc.
+// 
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+// 
+//      http://www.apache.org/licenses/LICENSE-2.0
+// 
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ------------------------------------------------------------------------
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string>
+#include <vector>
+
+#include "public/porting.h"
+#include "public/commandlineflags.h"
+#include "public/logging.h"
+
+#include "utilities/strutils.h"
+
+#include "public/szltype.h"
+#include "public/szlvalue.h"
+#include "public/szlencoder.h"
+#include "public/szldecoder.h"
+#include "public/szltabentry.h"
+
+#include "app/szlmrshuffle.h"
+#include "app/szlmrcombiner.h"
+
+
+// Tests of the szl-mr combiner.
+
+static SzlTabWriter* NewWriter(const char* kind, SzlType::Kind element) {
+  SzlType type(SzlType::TABLE);
+  type.set_table(kind);
+  type.AddIndex("", SzlType::kString);
+  type.set_element("", SzlType(element));
+  string error;
+  SzlTabWriter* writer = SzlTabWriter::CreateSzlTabWriter(type, &error);
+  CHECK(writer != NULL) << error;
+  return writer;
+}
+
+
+static string Key(int table, const string& index) {
+  string key;
+  SzlMrAppendTableIndex(table, &key);
+  SzlEncoder enc;
+  enc.PutString(index.data(), index.size());
+  key.append(enc.data());
+  return key;
+}
+
+
+static string IntValue(int64 i) {
+  SzlEncoder enc;
+  enc.PutInt(i);
+  return enc.data();
+}
+
+
+// Runs records, which are in key order, through a combiner and returns
+// the run it writes.
+static void Combine(SzlMrCombiner* combiner,
+                    const vector<pair<string, string> >& records,
+                    vector<pair<string, string> >* output) {
+  string path = StringPrintf("%s/szlmrcombiner_unittest.%d",
+                             getenv("SZL_TMP") != NULL ? getenv("SZL_TMP")
+                                                       : "/tmp", getpid());
+  SzlMrRunWriter writer;
+  string error;
+  CHECK(writer.Open(path, &error)) << error;
+  combiner->Begin(&writer);
+  for (int i = 0; i < records.size(); i++) {
+    const string& key = records[i].first;
+    const string& value = records[i].second;
+    (*combiner)(key.data(), key.size(), value.data(), value.size());
+  }
+  combiner->End();
+  CHECK(combiner->ok()) << combiner->error();
+  CHECK(writer.Close());
+
+  SzlMrRunReader reader;
+  CHECK(reader.Open(path, &error)) << error;
+  string key, value;
+  while (reader.Next(&key, &value))
+    output->push_back(make_pair(key, value));
+  CHECK(reader.error().empty()) << reader.error();
+  unlink(path.c_str());
+}
+
+
+static int64 SumValue(const string& value) {
+  // A flushed sum of ints is the count of values followed by the sum.
+  SzlDecoder dec(value.data(), value.size());
+  int64 count, sum;
+  CHECK(dec.GetInt(&count));
+  CHECK(dec.GetInt(&sum));
+  return sum;
+}
+
+
+// The values of a sum table are combined per key, the values of a
+// collection table are copied.
+static void TestCombine() {
+  vector<SzlTabWriter*> writers;
+  writers.push_back(NewWriter("sum", SzlType::INT));
+  writers.push_back(NewWriter("collection", SzlType::INT));
+
+  // Map output, as flushed by an emitter: an entry holding one value.
+  vector<pair<string, string> > records;
+  for (int i = 0; i < 10; i++) {
+    SzlTabEntry* entry = writers[0]->CreateEntry("");
+    entry->AddElem(IntValue(i));
+    string value;
+    entry->Flush(&value);
+    delete entry;
+    records.push_back(make_pair(Key(0, "a"), value));
+  }
+  for (int i = 0; i < 3; i++) {
+    SzlTabEntry* entry = writers[0]->CreateEntry("");
+    entry->AddElem(IntValue(100));
+    string value;
+    entry->Flush(&value);
+    delete entry;
+    records.push_back(make_pair(Key(0, "b"), value));
+  }
+  for (int i = 0; i < 4; i++)
+    records.push_back(make_pair(Key(1, "c"), IntValue(i)));
+
+  SzlMrCombiner combiner(writers, 1 << 20);
+  vector<pair<string, string> > output;
+  Combine(&combiner, records, &output);
+  CHECK_EQ(6, output.size());
+  CHECK(output[0].first == Key(0, "a"));
+  CHECK_EQ(45, SumValue(output[0].second));
+  CHECK(output[1].first == Key(0, "b"));
+  CHECK_EQ(300, SumValue(output[1].second));
+  for (int i = 0; i < 4; i++) {
+    CHECK(output[2 + i].first == Key(1, "c"));
+    CHECK(output[2 + i].second == IntValue(i));
+  }
+
+  const vector<SzlMrCombiner::Stats>& stats = combiner.stats();
+  CHECK_EQ(13, stats[0].records_in);
+  CHECK_EQ(2, stats[0].records_out);
+  CHECK_LT(stats[0].bytes_out, stats[0].bytes_in);
+  CHECK_EQ(4, stats[1].records_in);
+  CHECK_EQ(4, stats[1].records_out);
+  CHECK_EQ(stats[1].bytes_in, stats[1].bytes_out);
+
+  // Without memory for combining, every value is written out.
+  SzlMrCombiner no_memory(writers, 0);
+  output.clear();
+  Combine(&no_memory, records, &output);
+  CHECK_EQ(records.size(), output.size());
+  int64 sum = 0;
+  for (int i = 0; i < 10; i++)
+    sum += SumValue(output[i].second);
+  CHECK_EQ(45, sum);
+
+  for (int i = 0; i < writers.size(); i++)
+    delete writers[i];
+}
+
+
+// A flushed maximum or minimum entry: the number of elements dropped from
+// it, and the elements it kept, heaviest (or lightest) first.
+static void HeapValue(const string& value, int64* dropped,
+                      vector<pair<string, int64> >* elems) {
+  SzlDecoder dec(value.data(), value.size());
+  int64 n;
+  CHECK(dec.GetInt(dropped));
+  CHECK(dec.GetInt(&n));
+  elems->clear();
+  for (int i = 0; i < n; i++) {
+    string s;
+    int64 weight;
+    CHECK(dec.GetBytes(&s));
+    CHECK(dec.GetInt(&weight));
+    elems->push_back(make_pair(s, weight));
+  }
+  CHECK(dec.done());
+}
+
+
+// The values of maximum and minimum tables survive being merged and
+// flushed again and again, counting the elements they drop.
+static void TestCombineMaximum() {
+  const char* kinds[] = { "maximum", "minimum" };
+  for (int k = 0; k < ARRAYSIZE(kinds); k++) {
+    SzlType type(SzlType::TABLE);
+    type.set_table(kinds[k]);
+    type.set_param(2);
+    type.AddIndex("", SzlType::kString);
+    type.set_element("", SzlType(SzlType::STRING));
+    type.set_weight("", SzlType(SzlType::INT));
+    string error;
+    vector<SzlTabWriter*> writers;
+    writers.push_back(SzlTabWriter::CreateSzlTabWriter(type, &error));
+    CHECK(writers[0] != NULL) << error;
+
+    // Five flushes of the key, of three elements each.
+    vector<pair<string, string> > records;
+    for (int i = 0; i < 5; i++) {
+      SzlTabEntry* entry = writers[0]->CreateEntry("");
+      for (int j = 0; j < 3; j++) {
+        SzlEncoder enc;
+        enc.PutString(StringPrintf("e%d", 3 * i + j).c_str());
+        entry->AddWeightedElem(enc.data(),
+                               SzlValue(static_cast<int64>(3 * i + j)));
+      }
+      string value;
+      entry->Flush(&value);
+      delete entry;
+      records.push_back(make_pair(Key(0, "a"), value));
+    }
+
+    // Without memory each value is merged into a new entry and flushed
+    // again on its own; then all of them are combined.
+    SzlMrCombiner no_memory(writers, 0);
+    vector<pair<string, string> > flushed;
+    Combine(&no_memory, records, &flushed);
+    CHECK(flushed == records);
+    SzlMrCombiner combiner(writers, 1 << 20);
+    vector<pair<string, string> > output;
+    Combine(&combiner, flushed, &output);
+    CHECK_EQ(1, output.size());
+
+    int64 dropped;
+    vector<pair<string, int64> > elems;
+    HeapValue(output[0].second, &dropped, &elems);
+    CHECK_EQ(13, dropped);
+    CHECK_EQ(2, elems.size());
+    const bool maximum = k == 0;
+    for (int i = 0; i < 2; i++) {
+      const int weight = maximum ? 14 - i : i;
+      SzlEncoder enc;
+      enc.PutString(StringPrintf("e%d", weight).c_str());
+      CHECK(elems[i].first == enc.data()) << kinds[k] << " " << i;
+      CHECK_EQ(weight, elems[i].second) << kinds[k] << " " << i;
+    }
+    delete writers[0];
+  }
+}
+
+
+int main(int argc, char** argv) {
+  ProcessCommandLineArguments(argc, argv);
+  InitializeAllModules();
+
+  TestCombine();
+  TestCombineMaximum();
+
+  puts("PASS");
+  return 0;
+}
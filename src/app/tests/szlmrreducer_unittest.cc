@@ -0,0 +1,227 @@
+// Copyright 2010 Google Inc.
+// 
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+// 
+//      http://www.apache.org/licenses/LICENSE-2.0
+// 
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ------------------------------------------------------------------------
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string>
+#include <vector>
+
+#include "public/porting.h"
+#include "public/commandlineflags.h"
+#include "public/logging.h"
+
+#include "utilities/strutils.h"
+
+#include "public/szltype.h"
+#include "public/szlvalue.h"
+#include "public/szlencoder.h"
+#include "public/szldecoder.h"
+#include "public/szltabentry.h"
+
+#include "app/szlmrshuffle.h"
+#include "app/szlmrcombiner.h"
+#include "app/szlmrreducer.h"
+#include "app/tests/testfiles.h"
+
+
+// Tests of the szl-mr reducer.
+
+// Collects the results of a reducer.
+class VectorOutput : public SzlMrReducer::Output {
+ public:
+  virtual void WriteResult(int table, const string& key, const string& value) {
+    results.push_back(make_pair(key, value));
+  }
+  vector<pair<string, string> > results;
+};
+
+
+static const int kNumKeys = 3;
+static const int kValuesPerKey = 1000;
+
+
+// Writes map output for two tables, such as a sum table (table 0) and a
+// top(3) table (table 1): for each of kNumKeys keys, kValuesPerKey
+// flushed entries of one emit each, spread over several runs.  The emits
+// of a weighted table are "v<i % 10>" with weight i, the others are i.
+static void WriteMapOutput(const vector<SzlTabWriter*>& writers,
+                           vector<string>* paths) {
+  const int kRuns = 4;
+  vector<SzlMrSortBuffer> buffers(kRuns);
+  for (int table = 0; table < 2; table++) {
+    for (int k = 0; k < kNumKeys; k++) {
+      string key;
+      SzlMrAppendTableIndex(table, &key);
+      key.push_back('a' + k);
+      for (int i = 0; i < kValuesPerKey; i++) {
+        SzlTabEntry* entry = writers[table]->CreateEntry("");
+        SzlEncoder elem;
+        if (!writers[table]->HasWeight()) {
+          elem.PutInt(i);
+          entry->AddElem(elem.data());
+        } else {
+          elem.PutString(StringPrintf("v%d", i % 10).c_str());
+          entry->AddWeightedElem(elem.data(), SzlValue(static_cast<int64>(i)));
+        }
+        string value;
+        entry->Flush(&value);
+        delete entry;
+        buffers[i % kRuns].Add(key, value);
+      }
+    }
+  }
+  for (int r = 0; r < kRuns; r++) {
+    paths->push_back(TempPath(StringPrintf("run%d", r).c_str()));
+    SzlMrRunWriter writer;
+    string error;
+    CHECK(writer.Open(paths->back(), &error)) << error;
+    buffers[r].WriteRun(&writer);
+    CHECK(writer.Close());
+  }
+}
+
+
+static void Reduce(const vector<SzlTabWriter*>& writers,
+                   const vector<string>& paths, int64 memory_budget,
+                   VectorOutput* output, int64* spilled_keys) {
+  SzlMrMerger merger;
+  string error;
+  for (int i = 0; i < paths.size(); i++)
+    CHECK(merger.AddRun(paths[i], &error)) << error;
+  SzlMrReducer reducer(writers, memory_budget, TempPath("spill"));
+  CHECK(reducer.Reduce(&merger, output)) << reducer.error();
+  *spilled_keys = reducer.spilled_keys();
+}
+
+
+// Spilling partial results does not change the results.
+static void TestSpill() {
+  vector<SzlTabWriter*> writers;
+  string error;
+  SzlType sum(SzlType::TABLE);
+  sum.set_table("sum");
+  sum.set_element("", SzlType::kInt);
+  writers.push_back(SzlTabWriter::CreateSzlTabWriter(sum, &error));
+  CHECK(writers.back() != NULL) << error;
+  SzlType top(SzlType::TABLE);
+  top.set_table("top");
+  top.set_param(3);
+  top.set_element("", SzlType::kString);
+  top.set_weight("", SzlType::kInt);
+  writers.push_back(SzlTabWriter::CreateSzlTabWriter(top, &error));
+  CHECK(writers.back() != NULL) << error;
+
+  vector<string> paths;
+  WriteMapOutput(writers, &paths);
+
+  VectorOutput in_memory;
+  int64 spilled_keys;
+  Reduce(writers, paths, 1 << 20, &in_memory, &spilled_keys);
+  CHECK_EQ(0, spilled_keys);
+  CHECK_EQ(kNumKeys + 3 * kNumKeys, in_memory.results.size());
+  for (int k = 0; k < kNumKeys; k++) {
+    SzlDecoder dec(in_memory.results[k].second.data(),
+                   in_memory.results[k].second.size());
+    int64 total;
+    CHECK(dec.GetInt(&total));
+    CHECK_EQ(kValuesPerKey * (kValuesPerKey - 1) / 2, total);
+  }
+
+  // Without memory every value is spilled, and then merged without a bound.
+  VectorOutput spilled;
+  Reduce(writers, paths, 0, &spilled, &spilled_keys);
+  CHECK_EQ(2 * kNumKeys, spilled_keys);
+  CHECK(spilled.results == in_memory.results);
+
+  // With a little memory only the top entries, which are larger than
+  // the sum entries, are spilled.
+  VectorOutput passes;
+  Reduce(writers, paths, 400, &passes, &spilled_keys);
+  CHECK_EQ(kNumKeys, spilled_keys);
+  CHECK(passes.results == in_memory.results);
+
+  for (int i = 0; i < paths.size(); i++)
+    unlink(paths[i].c_str());
+  CHECK(access(TempPath("spill.0").c_str(), F_OK) != 0);
+  CHECK(access(TempPath("spill.1").c_str(), F_OK) != 0);
+  for (int i = 0; i < writers.size(); i++)
+    delete writers[i];
+}
+
+
+// Maximum and minimum tables, whose flushed values count the elements
+// they dropped, merge the same from several runs whether or not their
+// partial results are spilled and merged again.
+static void TestMaximum() {
+  vector<SzlTabWriter*> writers;
+  const char* kinds[] = { "maximum", "minimum" };
+  for (int k = 0; k < ARRAYSIZE(kinds); k++) {
+    SzlType type(SzlType::TABLE);
+    type.set_table(kinds[k]);
+    type.set_param(3);
+    type.set_element("", SzlType::kString);
+    type.set_weight("", SzlType::kInt);
+    string error;
+    writers.push_back(SzlTabWriter::CreateSzlTabWriter(type, &error));
+    CHECK(writers.back() != NULL) << error;
+  }
+
+  vector<string> paths;
+  WriteMapOutput(writers, &paths);
+
+  VectorOutput in_memory;
+  int64 spilled_keys;
+  Reduce(writers, paths, 1 << 20, &in_memory, &spilled_keys);
+  CHECK_EQ(0, spilled_keys);
+  CHECK_EQ(2 * 3 * kNumKeys, in_memory.results.size());
+  for (int i = 0; i < in_memory.results.size(); i++) {
+    // The three heaviest or lightest of weights 0 .. kValuesPerKey - 1.
+    const bool maximum = i < 3 * kNumKeys;
+    const int weight = maximum ? kValuesPerKey - 1 - i % 3 : i % 3;
+    SzlEncoder expected;
+    expected.PutString(StringPrintf("v%d", weight % 10).c_str());
+    expected.PutInt(weight);
+    CHECK(in_memory.results[i].second == expected.data()) << i;
+  }
+
+  VectorOutput spilled;
+  Reduce(writers, paths, 0, &spilled, &spilled_keys);
+  CHECK_EQ(2 * kNumKeys, spilled_keys);
+  CHECK(spilled.results == in_memory.results);
+
+  // With a little memory a few values are merged before each spill.
+  VectorOutput passes;
+  Reduce(writers, paths, 200, &passes, &spilled_keys);
+  CHECK_EQ(2 * kNumKeys, spilled_keys);
+  CHECK(passes.results == in_memory.results);
+
+  for (int i = 0; i < paths.size(); i++)
+    unlink(paths[i].c_str());
+  for (int i = 0; i < writers.size(); i++)
+    delete writers[i];
+}
+
+
+int main(int argc, char** argv) {
+  ProcessCommandLineArguments(argc, argv);
+  InitializeAllModules();
+
+  TestSpill();
+  TestMaximum();
+
+  puts("PASS");
+  return 0;
+}
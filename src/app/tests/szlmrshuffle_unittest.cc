@@ -0,0 +1,277 @@
+// Copyright 2010 Google Inc.
+// 
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+// 
+//      http://www.apache.org/licenses/LICENSE-2.0
+// 
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ------------------------------------------------------------------------
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#include "public/porting.h"
+#include "public/commandlineflags.h"
+#include "public/logging.h"
+
+#include "utilities/strutils.h"
+
+#include "app/szlmrshuffle.h"
+#include "app/tests/testfiles.h"
+
+
+// Tests of the run files, the sort buffer and the merger used by szl-mr.
+
+static void WriteRun(const string& path,
+                     const vector<pair<string, string> >& records) {
+  SzlMrRunWriter writer;
+  string error;
+  CHECK(writer.Open(path, &error)) << error;
+  for (int i = 0; i < records.size(); i++)
+    writer.Write(records[i].first, records[i].second);
+  CHECK(writer.Close());
+  CHECK_EQ(records.size(), writer.records());
+}
+
+
+static void ReadRun(const string& path,
+                    vector<pair<string, string> >* records) {
+  SzlMrRunReader reader;
+  string error;
+  CHECK(reader.Open(path, &error)) << error;
+  string key, value;
+  while (reader.Next(&key, &value))
+    records->push_back(make_pair(key, value));
+  CHECK(reader.error().empty()) << reader.error();
+}
+
+
+// Records, including empty ones and ones larger than the I/O buffers,
+// come back unchanged.
+static void TestRunRoundTrip() {
+  vector<pair<string, string> > records;
+  records.push_back(make_pair(string(), string()));
+  records.push_back(make_pair(string("a"), string()));
+  records.push_back(make_pair(string("b\0c", 3), string("value")));
+  records.push_back(make_pair(string(300000, 'k'), string(700000, 'v')));
+  for (int i = 0; i < 10000; i++)
+    records.push_back(make_pair(StringPrintf("key%08d", i),
+                                string(i % 200, 'x')));
+  string path = TempPath("roundtrip");
+  WriteRun(path, records);
+  vector<pair<string, string> > read;
+  ReadRun(path, &read);
+  CHECK(read == records);
+  unlink(path.c_str());
+}
+
+
+// A truncated run is an error, not a short run.
+static void TestTruncatedRun() {
+  vector<pair<string, string> > records;
+  records.push_back(make_pair(string("key"), string("value")));
+  records.push_back(make_pair(string("key2"), string("value2")));
+  string path = TempPath("truncated");
+  WriteRun(path, records);
+  CHECK_EQ(truncate(path.c_str(), 15), 0);
+  SzlMrRunReader reader;
+  string error, key, value;
+  CHECK(reader.Open(path, &error)) << error;
+  CHECK(reader.Next(&key, &value));
+  CHECK(!reader.Next(&key, &value));
+  CHECK(!reader.error().empty());
+  unlink(path.c_str());
+}
+
+
+// Orders records by key only.
+struct KeyLess {
+  bool operator()(const pair<string, string>& a,
+                  const pair<string, string>& b) const {
+    return a.first < b.first;
+  }
+};
+
+
+// Collects the records passed to SzlMrSortBuffer::ForEachSorted.
+struct Collector {
+  void operator()(const char* key, int key_size,
+                  const char* value, int value_size) {
+    records.push_back(make_pair(string(key, key_size),
+                                string(value, value_size)));
+  }
+  vector<pair<string, string> > records;
+};
+
+
+// The sort buffer orders keys as byte strings, also when they share the
+// 8-byte prefix or differ only in length, and keeps equal keys in order.
+static void TestSortBuffer() {
+  vector<string> keys;
+  keys.push_back("");
+  keys.push_back(string("\0", 1));
+  keys.push_back(string("\0\0", 2));
+  keys.push_back("abcdefgh");
+  keys.push_back("abcdefghi");
+  keys.push_back("abcdefghj");
+  keys.push_back("abcdefghij");
+  keys.push_back("abcdefg");
+  keys.push_back("\xff");
+  keys.push_back("\x80zz");
+  for (int i = 0; i < 200; i++)
+    keys.push_back(StringPrintf("%c%d", 'a' + i % 7, i % 13));
+
+  SzlMrSortBuffer buffer;
+  vector<pair<string, string> > expected;
+  srand(1);
+  for (int n = 0; n < 5000; n++) {
+    const string& key = keys[rand() % keys.size()];
+    string value = StringPrintf("%d", n);
+    buffer.Add(key, value);
+    expected.push_back(make_pair(key, value));
+  }
+  CHECK_EQ(expected.size(), buffer.size());
+  // stable_sort keeps the values of a key in order.
+  stable_sort(expected.begin(), expected.end(), KeyLess());
+
+  Collector collector;
+  buffer.ForEachSorted(&collector);
+  CHECK(collector.records == expected);
+  CHECK(buffer.empty());
+}
+
+
+// The merger interleaves runs in key order, and gives records with equal
+// keys in the order of their runs.
+static void TestMerger() {
+  const int kRuns = 5;
+  vector<string> paths;
+  vector<pair<string, string> > expected;
+  for (int r = 0; r < kRuns; r++) {
+    SzlMrSortBuffer buffer;
+    for (int i = r; i < 1000; i += r + 1) {
+      string key = StringPrintf("%04d", i % 300);
+      string value = StringPrintf("%d.%d", r, i);
+      buffer.Add(key, value);
+      expected.push_back(make_pair(key, value));
+    }
+    paths.push_back(TempPath(StringPrintf("run%d", r).c_str()));
+    SzlMrRunWriter writer;
+    string error;
+    CHECK(writer.Open(paths.back(), &error)) << error;
+    buffer.WriteRun(&writer);
+    CHECK(writer.Close());
+  }
+  // An empty run.
+  paths.push_back(TempPath("empty"));
+  WriteRun(paths.back(), vector<pair<string, string> >());
+
+  stable_sort(expected.begin(), expected.end(), KeyLess());
+
+  SzlMrMerger merger;
+  string error;
+  for (int i = 0; i < paths.size(); i++)
+    CHECK(merger.AddRun(paths[i], &error)) << error;
+  vector<pair<string, string> > merged;
+  string key, value;
+  while (merger.Next(&key, &value))
+    merged.push_back(make_pair(key, value));
+  CHECK(merger.error().empty()) << merger.error();
+  CHECK(merged == expected);
+  CHECK(!merger.Next(&key, &value));
+
+  for (int i = 0; i < paths.size(); i++)
+    unlink(paths[i].c_str());
+  SzlMrMerger missing;
+  CHECK(!missing.AddRun(TempPath("missing"), &error));
+}
+
+
+// A sort buffer spilled whenever it reaches a memory limit, the way the
+// map output does, spills runs of many records each time, not just the
+// first; and the runs, merged in passes of a few at a time, come out like
+// a single merge.
+static void TestSpillsAndMergePasses() {
+  const int64 kMemoryLimit = 16 << 10;
+  SzlMrSortBuffer buffer;
+  vector<string> paths;
+  vector<int> run_sizes;
+  vector<pair<string, string> > expected;
+  srand(2);
+  for (int n = 0; n < 20000; n++) {
+    string key = StringPrintf("%05d", rand() % 5000);
+    string value = StringPrintf("%d", n);
+    buffer.Add(key, value);
+    expected.push_back(make_pair(key, value));
+    if (buffer.memory() >= kMemoryLimit) {
+      CHECK_GT(buffer.size(), 100);
+      run_sizes.push_back(buffer.size());
+      paths.push_back(TempPath(StringPrintf("spill%d", paths.size()).c_str()));
+      SzlMrRunWriter writer;
+      string error;
+      CHECK(writer.Open(paths.back(), &error)) << error;
+      buffer.WriteRun(&writer);
+      CHECK(writer.Close());
+      CHECK_EQ(0, buffer.memory());
+    }
+  }
+  CHECK_GT(paths.size(), 10);
+  // All but the last run hold about the same number of records.
+  for (int i = 1; i < run_sizes.size(); i++)
+    CHECK_LT(abs(run_sizes[i] - run_sizes[0]), run_sizes[0] / 10);
+  if (!buffer.empty()) {
+    paths.push_back(TempPath("spill-last"));
+    SzlMrRunWriter writer;
+    string error;
+    CHECK(writer.Open(paths.back(), &error)) << error;
+    buffer.WriteRun(&writer);
+    CHECK(writer.Close());
+  }
+  stable_sort(expected.begin(), expected.end(), KeyLess());
+
+  vector<string> runs = paths;
+  string error;
+  CHECK(SzlMrMergeRuns(&runs, 3, TempPath("merge-"), &error)) << error;
+  CHECK_LE(runs.size(), 3);
+  SzlMrMerger merger;
+  for (int i = 0; i < runs.size(); i++)
+    CHECK(merger.AddRun(runs[i], &error)) << error;
+  vector<pair<string, string> > merged;
+  string key, value;
+  while (merger.Next(&key, &value))
+    merged.push_back(make_pair(key, value));
+  CHECK(merger.error().empty()) << merger.error();
+  CHECK(merged == expected);
+
+  // The intermediate runs of earlier passes are gone.
+  for (int i = 0; i < runs.size(); i++)
+    unlink(runs[i].c_str());
+  for (int i = 0; i < paths.size(); i++)
+    unlink(paths[i].c_str());
+  CHECK_NE(0, access(TempPath("merge-0-00000").c_str(), F_OK));
+}
+
+
+int main(int argc, char** argv) {
+  ProcessCommandLineArguments(argc, argv);
+  InitializeAllModules();
+
+  TestRunRoundTrip();
+  TestTruncatedRun();
+  TestSortBuffer();
+  TestMerger();
+  TestSpillsAndMergePasses();
+
+  puts("PASS");
+  return 0;
+}
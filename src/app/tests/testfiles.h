@@ -0,0 +1,57 @@
+// Copyright 2010 Google Inc.
+// 
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+// 
+//      http://www.apache.org/licenses/LICENSE-2.0
+// 
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ------------------------------------------------------------------------
+
+// Files for the application tests, in $SZL_TMP (default /tmp).  Include
+// after public/porting.h, public/logging.h and utilities/strutils.h.
+
+#ifndef _APP_TESTS_TESTFILES_H__
+#define _APP_TESTS_TESTFILES_H__
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string>
+
+
+// A path for a temporary file called name, unique to the process.
+inline string TempPath(const char* name) {
+  const char* dir = getenv("SZL_TMP");
+  return StringPrintf("%s/szl_app_test.%d.%s",
+                      dir != NULL ? dir : "/tmp", getpid(), name);
+}
+
+
+inline string ReadFile(const string& path) {
+  FILE* f = fopen(path.c_str(), "r");
+  CHECK(f != NULL) << path;
+  string contents;
+  char buffer[4096];
+  int n;
+  while ((n = fread(buffer, 1, sizeof buffer, f)) > 0)
+    contents.append(buffer, n);
+  fclose(f);
+  return contents;
+}
+
+
+inline void WriteFile(const string& path, const string& contents) {
+  FILE* f = fopen(path.c_str(), "w");
+  CHECK(f != NULL) << path;
+  CHECK_EQ(contents.size(), fwrite(contents.data(), 1, contents.size(), f));
+  CHECK_EQ(0, fclose(f));
+}
+
+
+#endif  // _APP_TESTS_TESTFILES_H__
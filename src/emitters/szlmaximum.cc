@@ -67,7 +67,8 @@ class SzlMaximum: public SzlTabWriter {
   class SzlMaximumEntry : public SzlTabEntry {
    public:
     SzlMaximumEntry(const SzlOps& weight_ops, int param, const SzlValueCmp* cmp)
-      : weight_ops_(weight_ops), heap_(weight_ops, cmp, param)  { }
+      : weight_ops_(weight_ops), heap_(weight_ops, cmp, param),
+        tot_elems_(0)  { }
 
     virtual int AddElem(const string& elem) {
       return AddWeightedElem(elem, SzlValue(static_cast<int64>(1)));
@@ -323,6 +323,41 @@ int SzlQuantile::SzlQuantileEntry::AddElem(const string& elem) {
 }
 
 
+// Add a batch of elements.  Runs of elements that fit in buffer_[0] and
+// buffer_[1] are appended directly; an element that arrives when both
+// buffers are full goes through AddElem, which collapses them first.
+int SzlQuantile::SzlQuantileEntry::AddElems(
+    const vector<const string*>& elems) {
+  int memory_delta = 0;
+  int i = 0;
+  while (i < elems.size()) {
+    if (tot_elems_ % (2 * k_) == 0 || buffer_.size() < 2 ||
+        buffer_[0] == NULL || buffer_[1] == NULL) {
+      memory_delta += SzlQuantileEntry::AddElem(*elems[i++]);
+      continue;
+    }
+    int64 room = 2 * k_ - tot_elems_ % (2 * k_);
+    for (; room > 0 && i < elems.size(); --room, ++i) {
+      const string& elem = *elems[i];
+      if (elem < min_) {
+        memory_delta += elem.size() - min_.size();
+        min_ = elem;
+      } else if (max_ < elem) {
+        memory_delta += elem.size() - max_.size();
+        max_ = elem;
+      }
+      vector<string>* buf = buffer_[(buffer_[0]->size() < k_) ? 0 : 1];
+      int old_capacity = buf->capacity();
+      buf->push_back(elem);
+      memory_delta += elem.size()
+          + (buf->capacity() - old_capacity) * sizeof(string);
+      ++tot_elems_;
+    }
+  }
+  return memory_delta;
+}
+
+
 // Flush the state to "output".
 void SzlQuantile::SzlQuantileEntry::Flush(string* output) {
   SzlEncoder enc;
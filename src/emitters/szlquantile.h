@@ -53,6 +53,7 @@ class SzlQuantile : public SzlTabWriter {
     }
     virtual ~SzlQuantileEntry() { Clear(); }
     virtual int AddElem(const string& elem);
+    virtual int AddElems(const vector<const string*>& elems);
     virtual void Flush(string* output);
     virtual void FlushForDisplay(vector<string>* output);
     virtual SzlTabEntry::MergeStatus Merge(const string& val);
@@ -15,8 +15,10 @@
 
 #include <stdio.h>
 #include <string>
+#include <algorithm>
 
 #include "public/porting.h"
+#include "public/commandlineflags.h"
 #include "public/logging.h"
 #include "public/recordio.h"
 
@@ -27,8 +29,17 @@
 #include "emitvalues/szlxlate.h"
 
 
+DEFINE_bool(recordio_table_blocks, false,
+            "write recordio tables as indexed record files of checksummed "
+            "blocks; readers that predate the format cannot read them");
+
+
 namespace {
 
+// The smallest block of an indexed recordio table, so that the per-block
+// sync marker, header and index entry stay small next to the records.
+const int kMinBlockSize = 64 << 10;
+
 
 // Structure for storing data directly to a recordio file.
 class SzlRecordio: public SzlTabWriter {
@@ -134,10 +145,16 @@ bool SzlRecordio::Validate(const SzlType& type, string* error) {
 
 
 void SzlRecordio::CreateOutput(const string& filename) {
-  writer_ = sawzall::RecordWriter::Open(filename.c_str());
+  // Param gives the compression block size.  It is only used for indexed
+  // record files, which are written on request since older readers only
+  // read the plain format.
+  if (FLAGS_recordio_table_blocks)
+    writer_ = sawzall::RecordWriter::OpenIndexed(filename.c_str(),
+                                                 max(param(), kMinBlockSize));
+  else
+    writer_ = sawzall::RecordWriter::Open(filename.c_str());
   if (writer_ == NULL)
     LOG(ERROR) << "Can't open output for recordio table, file " << filename;
-  // Param gives the compression block size - not currently used.
 }
 
 
@@ -68,6 +68,7 @@ class SzlSample: public SzlTabWriter {
         random_(SzlACMRandom::HostnamePidTimeSeed())  { }
 
     virtual int AddElem(const string& elem);
+    virtual int AddElems(const vector<const string*>& elems);
     virtual void Flush(string* output);
     virtual void FlushForDisplay(vector<string>* output);
     virtual SzlTabEntry::MergeStatus Merge(const string& val);
@@ -108,6 +109,16 @@ int SzlSample::SzlSampleEntry::AddElem(const string& elem) {
 }
 
 
+int SzlSample::SzlSampleEntry::AddElems(const vector<const string*>& elems) {
+  tot_elems_ += elems.size();
+  int mem = 0;
+  for (int i = 0; i < elems.size(); i++)
+    mem += heap_.AddElem(*elems[i],
+                         SzlValue(static_cast<int64>(random_.Next())));
+  return mem;
+}
+
+
 // Produce the encoded string that represents the data in this entry. This
 // value is used for merge operations as it contains all information
 // needed for the merge.
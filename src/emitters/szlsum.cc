@@ -62,6 +62,7 @@ private:
     virtual ~SzlSumEntry()  { Clear(); }
 
     virtual int AddElem(const string& elem);
+    virtual int AddElems(const vector<const string*>& elems);
     virtual void Flush(string* output) ;
     virtual void FlushForDisplay(vector<string>* output);
     virtual SzlTabEntry::MergeStatus Merge(const string& val);
@@ -114,6 +115,31 @@ int SzlSum::SzlSumEntry::AddElem(const string& elem) {
 }
 
 
+// Add a batch of elements; the memory used by the sum is only
+// recomputed once for the whole batch.
+int SzlSum::SzlSumEntry::AddElems(const vector<const string*>& elems) {
+  if (elems.empty())
+    return 0;
+  int i = 0;
+  int64 mem = memory_;
+  if (tot_elems_ == 0) {
+    const string& first = *elems[i++];
+    CHECK(element_ops().ParseFromArray(first.data(), first.size(), &sum_));
+    mem = sizeof(SzlValue);
+  }
+  SzlValue elemv;
+  for (; i < elems.size(); i++) {
+    const string& elem = *elems[i];
+    CHECK(element_ops().ParseFromArray(elem.data(), elem.size(), &elemv));
+    element_ops().Add(elemv, &sum_);
+    element_ops().Clear(&elemv);
+  }
+  tot_elems_ += elems.size();
+  memory_ = element_ops().Memory(sum_);
+  return memory_ - mem;
+}
+
+
 void SzlSum::SzlSumEntry::Flush(string* output) {
   if (tot_elems_ == 0) {
     output->clear();
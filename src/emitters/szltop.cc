@@ -75,6 +75,9 @@ class SzlTop: public SzlTabWriter {
     }
 
     virtual int AddWeightedElem(const string& elem, const SzlValue& weight);
+    virtual int AddElems(const vector<const string*>& elems);
+    virtual int AddWeightedElems(const vector<const string*>& elems,
+                                 const vector<const SzlValue*>& weights);
     virtual void Flush(string* output);
     virtual void FlushForDisplay(vector<string>* output);
     virtual SzlTabEntry::MergeStatus Merge(const string& vals);
@@ -197,6 +200,26 @@ int SzlTop::SzlTopEntry::AddWeightedElem(const string& elem,
 }
 
 
+// Batched adds call AddWeightedElem directly, without virtual dispatch.
+int SzlTop::SzlTopEntry::AddElems(const vector<const string*>& elems) {
+  const SzlValue one(static_cast<int64>(1));
+  int mem = 0;
+  for (int i = 0; i < elems.size(); i++)
+    mem += SzlTopEntry::AddWeightedElem(*elems[i], one);
+  return mem;
+}
+
+
+int SzlTop::SzlTopEntry::AddWeightedElems(
+    const vector<const string*>& elems,
+    const vector<const SzlValue*>& weights) {
+  int mem = 0;
+  for (int i = 0; i < elems.size(); i++)
+    mem += SzlTopEntry::AddWeightedElem(*elems[i], *weights[i]);
+  return mem;
+}
+
+
 void SzlTop::SzlTopEntry::Flush(string* output) {
   if (tops_.nElems() == 0) {
     output->clear();
@@ -16,6 +16,7 @@
 #include <string>
 
 #include "public/porting.h"
+#include "public/commandlineflags.h"
 #include "public/logging.h"
 #include "public/recordio.h"
 
@@ -27,6 +28,8 @@
 #include "public/szlresults.h"
 
 
+DECLARE_bool(recordio_table_blocks);
+
 // Test filtering the value; since recordio doesn't support keys,
 // we check to make sure the output key is empty.
 static void TestFilter(const SzlTabWriter* wr, const string& value) {
@@ -90,17 +93,18 @@ static void TestRecordioOutput(SzlTabWriter* wr) {
   CHECK_EQ(string(record_ptr, record_size), a4k);
 
   CHECK(!reader->Read(&record_ptr, &record_size));
+  CHECK_EQ(FLAGS_recordio_table_blocks, reader->indexed());
   delete reader;
 }
 
 // Basic recordio output test.
-static void TestSzlRecordio() {
-  // out testing type: recordio(0) of goo: string
+static void TestSzlRecordio(int param) {
+  // out testing type: recordio(param) of goo: string
   SzlType tabty(SzlType::TABLE);
   tabty.set_table("recordio");
   SzlField tabtyelem("goo", SzlType::kString);
   tabty.set_element(&tabtyelem);
-  tabty.set_param(0);
+  tabty.set_param(param);
   string error;
   CHECK(tabty.Valid(&error)) << ": " << error;
 
@@ -126,7 +130,12 @@ int main(int argc, char* argv[]) {
   ProcessCommandLineArguments(argc, argv);
   InitializeAllModules();
 
-  TestSzlRecordio();
+  // Plain record files, whatever the parameter, unless indexed files are
+  // asked for.
+  TestSzlRecordio(0);
+  TestSzlRecordio(1000);
+  FLAGS_recordio_table_blocks = true;
+  TestSzlRecordio(1000);
 
   printf("PASS\n");
 
@@ -0,0 +1,574 @@
+// Copyright 2010 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ------------------------------------------------------------------------
+
+// Implementation of the SzlColumnWriter and SzlColumnReader classes.
+//
+// File layout: a header record holding kMagic and the format version,
+// followed by one record per block.  A block record is a compression byte
+// (kUncompressed or kZlib), the varint length of the uncompressed block
+// and the block data.  An uncompressed block holds, all counts and
+// lengths being varints:
+//   number of rows
+//   for each row: shared key prefix length, key suffix length, key suffix
+//   for each row: number of values (0 for a value stored whole)
+//   number of columns (column 0 holds the whole values)
+//   for each column: encoding byte, number of items, encoded items
+// Column encodings:
+//   kPlain:      for each item: length, bytes
+//   kDictionary: number of entries, each as length and bytes; then
+//                for each item: index of its entry
+//   kIntDelta:   for each item: zigzag encoded difference to the previous
+//                item's int value (0 for the first)
+
+#include <errno.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#include "public/hash_map.h"
+
+#include "public/porting.h"
+#include "public/logging.h"
+#include "public/recordio.h"
+#include "public/varint.h"
+
+#include "utilities/strutils.h"
+#include "utilities/zlibwrapper.h"
+
+#include "public/emitterinterface.h"
+#include "public/szltype.h"
+#include "public/szlvalue.h"
+#include "public/szlencoder.h"
+#include "public/szldecoder.h"
+#include "public/szlresults.h"
+#include "public/szlemitter.h"
+#include "public/szlcolumnfile.h"
+
+
+namespace {
+
+const char kMagic[] = "szlcolumnfile";
+const int kVersion = 1;
+
+// Blocks are also written when their keys and values reach this size.
+const int kMaxBlockBytes = 1 << 20;
+
+// Block compression.
+enum { kUncompressed = 0, kZlib = 1 };
+
+// Column encodings.
+enum { kPlain = 0, kDictionary = 1, kIntDelta = 2 };
+
+// An item of a column: a piece of a row's value.
+typedef pair<const char*, int> Item;
+
+
+void PutVarint(uint64 v, string* s) {
+  char buf[sawzall::kMaxUnsignedVarint64Length];
+  char* end = sawzall::EncodeUnsignedVarint64(buf, v);
+  s->append(buf, end - buf);
+}
+
+
+// Reads a varint from [*p, end); returns false if it does not fit.
+bool GetVarint(const char** p, const char* end, uint64* v) {
+  // Decode from a copy so that a truncated varint cannot run past end.
+  char buf[sawzall::kMaxUnsignedVarint64Length];
+  const int len = min<int64>(end - *p, sizeof(buf));
+  if (len <= 0)
+    return false;
+  memset(buf, 0, sizeof(buf));
+  memcpy(buf, *p, len);
+  const char* next = sawzall::DecodeUnsignedVarint64(buf, v);
+  if (next == NULL || next - buf > len)
+    return false;
+  *p += next - buf;
+  return true;
+}
+
+
+// Reads a length followed by that many bytes.
+bool GetBytes(const char** p, const char* end, string* s) {
+  uint64 len;
+  if (!GetVarint(p, end, &len) || len > end - *p)
+    return false;
+  s->assign(*p, len);
+  *p += len;
+  return true;
+}
+
+
+// Splits an encoded value into its top-level SzlEncoder values; an
+// array, map or tuple, with its markers, is a single value.
+// Returns false if the value is not a sequence of encoded values.
+bool SplitValue(const string& value, vector<Item>* items) {
+  items->clear();
+  SzlDecoder dec(value.data(), value.size());
+  const unsigned char* start = dec.position();
+  const unsigned char* item_start = start;
+  int depth = 0;
+  while (!dec.done()) {
+    SzlType::Kind kind = dec.peek();
+    if (dec.IsStart(kind)) {
+      depth++;
+    } else if (dec.IsEnd(kind)) {
+      if (--depth < 0)
+        return false;
+    }
+    if (!dec.Skip(kind))
+      return false;
+    if (depth == 0) {
+      items->push_back(Item(value.data() + (item_start - start),
+                            dec.position() - item_start));
+      item_start = dec.position();
+    }
+  }
+  return depth == 0 && !items->empty();
+}
+
+
+// Returns true and sets *v if item is exactly the current encoding of
+// an int, so that it can be re-encoded from *v.
+bool ItemAsInt(const Item& item, int64* v) {
+  SzlDecoder dec(item.first, item.second);
+  if (dec.peek() != SzlType::INT || !dec.GetInt(v) || !dec.done())
+    return false;
+  SzlEncoder enc;
+  enc.PutInt(*v);
+  return enc.data().size() == item.second &&
+         memcmp(enc.data().data(), item.first, item.second) == 0;
+}
+
+
+// Appends the encoding of a column to *block, choosing the encoding
+// that suits its items.
+void EncodeColumn(const vector<Item>& items, string* block) {
+  const int n = items.size();
+
+  // Dictionary encoding pays off if each distinct item occurs at least
+  // twice on average.
+  hash_map<string, int> dict;
+  vector<const Item*> entries;
+  for (int i = 0; i < n && entries.size() * 2 <= n; i++) {
+    string s(items[i].first, items[i].second);
+    if (dict.insert(make_pair(s, entries.size())).second)
+      entries.push_back(&items[i]);
+  }
+  if (entries.size() * 2 <= n) {
+    block->push_back(kDictionary);
+    PutVarint(n, block);
+    PutVarint(entries.size(), block);
+    for (int i = 0; i < entries.size(); i++) {
+      PutVarint(entries[i]->second, block);
+      block->append(entries[i]->first, entries[i]->second);
+    }
+    for (int i = 0; i < n; i++) {
+      string s(items[i].first, items[i].second);
+      PutVarint(dict[s], block);
+    }
+    return;
+  }
+
+  vector<int64> ints(n);
+  bool all_ints = true;
+  for (int i = 0; i < n && all_ints; i++)
+    all_ints = ItemAsInt(items[i], &ints[i]);
+  if (all_ints) {
+    block->push_back(kIntDelta);
+    PutVarint(n, block);
+    int64 prev = 0;
+    for (int i = 0; i < n; i++) {
+      // Wraps around on overflow, which the decoder undoes.
+      const uint64 delta = static_cast<uint64>(ints[i]) -
+                           static_cast<uint64>(prev);
+      PutVarint((delta << 1) ^ -(delta >> 63), block);
+      prev = ints[i];
+    }
+    return;
+  }
+
+  block->push_back(kPlain);
+  PutVarint(n, block);
+  for (int i = 0; i < n; i++) {
+    PutVarint(items[i].second, block);
+    block->append(items[i].first, items[i].second);
+  }
+}
+
+
+// Decodes a column written by EncodeColumn into *items.
+bool DecodeColumn(const char** p, const char* end, vector<string>* items) {
+  if (*p >= end)
+    return false;
+  const int encoding = *(*p)++;
+  uint64 n;
+  if (!GetVarint(p, end, &n) || n > end - *p)  // every item takes a byte
+    return false;
+  items->resize(n);
+  switch (encoding) {
+    case kPlain:
+      for (int i = 0; i < n; i++) {
+        if (!GetBytes(p, end, &(*items)[i]))
+          return false;
+      }
+      return true;
+    case kDictionary: {
+        uint64 num_entries;
+        if (!GetVarint(p, end, &num_entries) || num_entries > end - *p)
+          return false;
+        vector<string> entries(num_entries);
+        for (int i = 0; i < num_entries; i++) {
+          if (!GetBytes(p, end, &entries[i]))
+            return false;
+        }
+        for (int i = 0; i < n; i++) {
+          uint64 index;
+          if (!GetVarint(p, end, &index) || index >= num_entries)
+            return false;
+          (*items)[i] = entries[index];
+        }
+      }
+      return true;
+    case kIntDelta: {
+        uint64 prev = 0;
+        SzlEncoder enc;
+        for (int i = 0; i < n; i++) {
+          uint64 zigzag;
+          if (!GetVarint(p, end, &zigzag))
+            return false;
+          prev += (zigzag >> 1) ^ -(zigzag & 1);
+          enc.Reset();
+          enc.PutInt(static_cast<int64>(prev));
+          (*items)[i] = enc.data();
+        }
+      }
+      return true;
+    default:
+      return false;
+  }
+}
+
+}  // namespace
+
+
+SzlColumnWriter* SzlColumnWriter::Open(const char* filename, int block_rows,
+                                       string* error) {
+  sawzall::RecordWriter* file = sawzall::RecordWriter::Open(filename);
+  if (file == NULL) {
+    *error = StringPrintf("can't create %s: %s", filename, strerror(errno));
+    return NULL;
+  }
+  string header(kMagic);
+  PutVarint(kVersion, &header);
+  if (!file->Write(header.data(), header.size())) {
+    *error = StringPrintf("can't write %s: %s", filename,
+                          file->error_message().c_str());
+    delete file;
+    return NULL;
+  }
+  return new SzlColumnWriter(file, max(block_rows, 1));
+}
+
+
+SzlColumnWriter::SzlColumnWriter(sawzall::RecordWriter* file, int block_rows)
+    : file_(file),
+      block_rows_(block_rows),
+      num_rows_(0),
+      num_bytes_(0) {
+}
+
+
+SzlColumnWriter::~SzlColumnWriter() {
+  if (file_ != NULL)
+    Close();
+}
+
+
+bool SzlColumnWriter::Write(const string& key, const string& value) {
+  CHECK(file_ != NULL) << "write to a closed SzlColumnWriter";
+  if (num_rows_ == keys_.size()) {
+    keys_.resize(num_rows_ + 1);
+    values_.resize(num_rows_ + 1);
+  }
+  keys_[num_rows_] = key;
+  values_[num_rows_] = value;
+  num_rows_++;
+  num_bytes_ += key.size() + value.size();
+  if (num_rows_ == block_rows_ || num_bytes_ >= kMaxBlockBytes)
+    return WriteBlock();
+  return true;
+}
+
+
+bool SzlColumnWriter::Close() {
+  if (file_ == NULL)
+    return true;
+  bool ok = WriteBlock();
+  delete file_;  // flushes and closes the file
+  file_ = NULL;
+  return ok;
+}
+
+
+bool SzlColumnWriter::WriteBlock() {
+  if (num_rows_ == 0)
+    return true;
+  block_.clear();
+  PutVarint(num_rows_, &block_);
+
+  // Keys, delta encoded.
+  for (int i = 0; i < num_rows_; i++) {
+    const string& key = keys_[i];
+    int shared = 0;
+    if (i > 0) {
+      const string& prev = keys_[i - 1];
+      const int max_shared = min(key.size(), prev.size());
+      while (shared < max_shared && key[shared] == prev[shared])
+        shared++;
+    }
+    PutVarint(shared, &block_);
+    PutVarint(key.size() - shared, &block_);
+    block_.append(key, shared, string::npos);
+  }
+
+  // Value counts, and the values split into columns.
+  vector<vector<Item> > columns(1);
+  vector<Item> items;
+  for (int i = 0; i < num_rows_; i++) {
+    const string& value = values_[i];
+    if (SplitValue(value, &items)) {
+      PutVarint(items.size(), &block_);
+      if (columns.size() <= items.size())
+        columns.resize(items.size() + 1);
+      for (int j = 0; j < items.size(); j++)
+        columns[j + 1].push_back(items[j]);
+    } else {
+      PutVarint(0, &block_);
+      columns[0].push_back(Item(value.data(), value.size()));
+    }
+  }
+  PutVarint(columns.size(), &block_);
+  for (int i = 0; i < columns.size(); i++)
+    EncodeColumn(columns[i], &block_);
+
+  // Compress, unless that does not help.
+  compressed_.clear();
+  const int bufsize = ZLibMinCompressbufSize(block_.size());
+  unsigned char* buffer = new unsigned char[bufsize];
+  int compressed_len;
+  int res = ZLibCompress(false, buffer, bufsize, &compressed_len,
+                         reinterpret_cast<const unsigned char*>(block_.data()),
+                         block_.size());
+  if (res == Z_OK && compressed_len < block_.size()) {
+    compressed_.push_back(kZlib);
+    PutVarint(block_.size(), &compressed_);
+    compressed_.append(reinterpret_cast<char*>(buffer), compressed_len);
+  } else {
+    compressed_.push_back(kUncompressed);
+    PutVarint(block_.size(), &compressed_);
+    compressed_.append(block_);
+  }
+  delete[] buffer;
+
+  num_rows_ = 0;
+  num_bytes_ = 0;
+  if (!file_->Write(compressed_.data(), compressed_.size())) {
+    error_message_ = file_->error_message();
+    return false;
+  }
+  return true;
+}
+
+
+SzlColumnReader* SzlColumnReader::Open(const char* filename, string* error) {
+  sawzall::RecordReader* file = sawzall::RecordReader::Open(filename);
+  if (file == NULL) {
+    *error = StringPrintf("can't open %s: %s", filename, strerror(errno));
+    return NULL;
+  }
+  char* record;
+  size_t size;
+  const int magic_size = strlen(kMagic);
+  uint64 version = 0;
+  if (file->Read(&record, &size) && size > magic_size &&
+      memcmp(record, kMagic, magic_size) == 0) {
+    const char* p = record + magic_size;
+    if (!GetVarint(&p, record + size, &version))
+      version = 0;
+  }
+  if (version != kVersion) {
+    *error = StringPrintf("%s is not a szl column file", filename);
+    delete file;
+    return NULL;
+  }
+  return new SzlColumnReader(file);
+}
+
+
+SzlColumnReader::SzlColumnReader(sawzall::RecordReader* file)
+    : file_(file),
+      num_rows_(0),
+      next_row_(0) {
+}
+
+
+SzlColumnReader::~SzlColumnReader() {
+  delete file_;
+}
+
+
+bool SzlColumnReader::Next(string* key, string* value) {
+  while (next_row_ == num_rows_) {
+    if (!ReadBlock())
+      return false;
+  }
+  key->swap(keys_[next_row_]);
+  value->swap(values_[next_row_]);
+  next_row_++;
+  return true;
+}
+
+
+bool SzlColumnReader::NextResults(string* key, SzlResults* results) {
+  if (!Next(key, &value_))
+    return false;
+  if (!results->ParseFromStringWithIndex(*key, value_)) {
+    error_message_ = "can't parse table value";
+    return false;
+  }
+  return true;
+}
+
+
+bool SzlColumnReader::ReadBlock() {
+  num_rows_ = 0;
+  next_row_ = 0;
+  char* record;
+  size_t size;
+  if (!file_->Read(&record, &size)) {
+    error_message_ = file_->error_message();
+    return false;
+  }
+
+  // Uncompress.
+  const char* p = record;
+  const char* end = record + size;
+  block_.clear();
+  uint64 block_size;
+  const int compression = (size > 0) ? *p++ : -1;
+  if (compression < 0 || !GetVarint(&p, end, &block_size)) {
+    error_message_ = "corrupt block header";
+    return false;
+  }
+  if (compression == kZlib) {
+    int res = ZLibUncompress(false, block_size, &block_,
+                             reinterpret_cast<const unsigned char*>(p),
+                             end - p);
+    if (res != Z_OK || block_.size() != block_size) {
+      error_message_ = "corrupt compressed block";
+      return false;
+    }
+  } else if (compression == kUncompressed && end - p == block_size) {
+    block_.assign(p, end - p);
+  } else {
+    error_message_ = "corrupt block header";
+    return false;
+  }
+
+  // Keys.
+  p = block_.c_str();
+  end = p + block_.size();
+  uint64 num_rows;
+  if (!GetVarint(&p, end, &num_rows) || num_rows > end - p) {
+    error_message_ = "corrupt block";
+    return false;
+  }
+  keys_.resize(num_rows);
+  values_.resize(num_rows);
+  for (int i = 0; i < num_rows; i++) {
+    uint64 shared, suffix;
+    if (!GetVarint(&p, end, &shared) || !GetVarint(&p, end, &suffix) ||
+        (i == 0 ? shared != 0 : shared > keys_[i - 1].size()) ||
+        suffix > end - p) {
+      error_message_ = "corrupt block keys";
+      return false;
+    }
+    if (i > 0)
+      keys_[i].assign(keys_[i - 1], 0, shared);
+    else
+      keys_[i].clear();
+    keys_[i].append(p, suffix);
+    p += suffix;
+  }
+
+  // Value counts and columns.
+  vector<uint64> counts(num_rows);
+  for (int i = 0; i < num_rows; i++) {
+    if (!GetVarint(&p, end, &counts[i])) {
+      error_message_ = "corrupt block values";
+      return false;
+    }
+  }
+  uint64 num_columns;
+  if (!GetVarint(&p, end, &num_columns) || num_columns < 1 ||
+      num_columns > end - p) {
+    error_message_ = "corrupt block values";
+    return false;
+  }
+  vector<vector<string> > columns(num_columns);
+  for (int i = 0; i < num_columns; i++) {
+    if (!DecodeColumn(&p, end, &columns[i])) {
+      error_message_ = "corrupt block column";
+      return false;
+    }
+  }
+  if (p != end) {
+    error_message_ = "corrupt block values";
+    return false;
+  }
+
+  // Reassemble the values.
+  vector<int> next(num_columns);
+  for (int i = 0; i < num_rows; i++) {
+    string* value = &values_[i];
+    value->clear();
+    const int count = counts[i];
+    const int column = (count == 0) ? 0 : 1;
+    const int last = (count == 0) ? 0 : count;
+    if (last >= num_columns) {
+      error_message_ = "corrupt block values";
+      return false;
+    }
+    for (int j = column; j <= last; j++) {
+      if (next[j] == columns[j].size()) {
+        error_message_ = "corrupt block values";
+        return false;
+      }
+      value->append(columns[j][next[j]++]);
+    }
+  }
+  num_rows_ = num_rows;
+  return true;
+}
+
+
+void SzlColumnEmitter::WriteValue(const string& key, const string& value) {
+  if (!output_->Write(key, value)) {
+    LOG(ERROR) << "can't write table " << name() << ": "
+               << output_->error_message();
+    errors_detected_ = true;
+  }
+}
@@ -20,6 +20,7 @@
 #include <assert.h>
 #include <string>
 #include <vector>
+#include <algorithm>
 
 #include "public/hash_map.h"
 
@@ -35,6 +36,9 @@
 #include "public/szldecoder.h"
 #include "public/sawzall.h"
 #include "public/szltabentry.h"
+#include "public/varint.h"
+
+#include "utilities/radixsort.h"
 
 
 
@@ -51,12 +55,17 @@ SzlEmitter::SzlEmitter(const string& name, const SzlTabWriter* writer,
       display_(display),
       depth_(0),
       weight_(new SzlValue),
-      errors_detected_(false) {
+      errors_detected_(false),
+      flush_order_(UNSORTED),
+      batch_size_(1),
+      batch_len_(0) {
 }
 
 
 SzlEmitter::~SzlEmitter() {
   Clear();
+  for (int i = 0; i < batch_weights_.size(); i++)
+    weight_ops_.Clear(&batch_weights_[i]);
   delete table_;
   delete writer_;
   delete key_;
@@ -65,7 +74,14 @@ SzlEmitter::~SzlEmitter() {
 }
 
 
+void SzlEmitter::set_batch_size(int batch_size) {
+  AddBatch();
+  batch_size_ = max(batch_size, 1);
+}
+
+
 void SzlEmitter::Clear() {
+  AddBatch();
   if (display_)
     DisplayResults();
 
@@ -136,37 +152,7 @@ void SzlEmitter::Begin(GroupType type, int len) {
 void SzlEmitter::End(GroupType type, int len) {
   if (type == EMIT) {
     assert(encoder_ == NULL && depth_ == 0);
-
-    // At this point we have a complete emit.
-    // Stash it away in the appropriate aggregation table or add it to the
-    // output if we aren't aggregating results during the map phase.
-    assert((weight_pos_ > 0) == (writer_->HasWeight()));
-    const string& k = key_->data();
-    if (writer_->Aggregates()) {
-      SzlTabEntry* table_entry = NULL;
-      SzlTabEntryMap::iterator it = table_->find(k);
-      if (it == table_->end()) {
-        table_entry = writer_->CreateEntry(k);
-        table_->insert(SzlTabEntryMap::value_type(k, table_entry));
-      } else {
-        table_entry = it->second;
-      }
-      const string& v = value_->data();
-      if (weight_pos_ > 0) {
-        memory_estimate_ += table_entry->AddWeightedElem(v, *weight_);
-      } else {
-        memory_estimate_ += table_entry->AddElem(v);
-      }
-    } else {
-      assert(!writer_->HasWeight());
-      // Optional value filtering.
-      string value;
-      if (writer_->Filters())
-        writer_->FilterValue(value_->data(), &value);
-      else
-        value_->Swap(&value);
-      WriteValue(k, value);
-    }
+    AddEmit();
     return;
   }
 
@@ -190,6 +176,52 @@ void SzlEmitter::End(GroupType type, int len) {
 }
 
 
+void SzlEmitter::AddEmit() {
+  // At this point we have a complete emit.
+  // Stash it away in the appropriate aggregation table or add it to the
+  // output if we aren't aggregating results during the map phase.
+  assert((weight_pos_ > 0) == (writer_->HasWeight()));
+  const string& k = key_->data();
+  if (writer_->Aggregates() && batch_size_ > 1) {
+    // Buffer the emit.  The encoders take over the storage of an already
+    // consumed batch slot; reset them since unindexed tables never
+    // start an INDEX group.
+    if (batch_len_ == batch_keys_.size()) {
+      batch_keys_.resize(batch_len_ + 1);
+      batch_values_.resize(batch_len_ + 1);
+      if (weight_pos_ > 0)
+        batch_weights_.resize(batch_len_ + 1);
+    }
+    memory_estimate_ += k.size() + value_->data().size();
+    key_->Swap(&batch_keys_[batch_len_]);
+    value_->Swap(&batch_values_[batch_len_]);
+    key_->Reset();
+    value_->Reset();
+    if (weight_pos_ > 0)
+      weight_ops_.Assign(*weight_, &batch_weights_[batch_len_]);
+    if (++batch_len_ == batch_size_)
+      AddBatch();
+  } else if (writer_->Aggregates()) {
+    SzlTabEntry* table_entry = FindOrCreateEntry(k);
+    const string& v = value_->data();
+    if (weight_pos_ > 0) {
+      memory_estimate_ += table_entry->AddWeightedElem(v, *weight_);
+    } else {
+      memory_estimate_ += table_entry->AddElem(v);
+    }
+  } else {
+    assert(!writer_->HasWeight());
+    // Optional value filtering.
+    string value;
+    if (writer_->Filters())
+      writer_->FilterValue(value_->data(), &value);
+    else
+      value_->Swap(&value);
+    WriteValue(k, value);
+  }
+}
+
+
 void SzlEmitter::PutBool(bool b) {
   if (in_weight_) {
     assert(encoder_ == NULL);
@@ -289,23 +321,115 @@ void SzlEmitter::EmitFloat(double f) {
   End(EMIT, 1);
 }
 
+bool SzlEmitter::AcceptsEncodedEmits() const {
+  return !writer_->HasWeight();
+}
+
+
+void SzlEmitter::EmitEncoded(const char* key, int key_len,
+                             const char* value, int value_len) {
+  assert(encoder_ == NULL && depth_ == 0);
+  key_->Reset();
+  key_->AppendEncoding(key, key_len);
+  value_->Reset();
+  value_->AppendEncoding(value, value_len);
+  weight_pos_ = -1;
+  AddEmit();
+}
+
+
 bool SzlEmitter::Merge(const string& index, const string& val) {
-  SzlTabEntry* table_entry = NULL;
-  SzlTabEntryMap::iterator it = table_->find(index);
-  if (it == table_->end()) {
-    table_entry = writer_->CreateEntry(index);
-    table_->insert(SzlTabEntryMap::value_type(index, table_entry));
-  } else {
-    table_entry = it->second;
+  AddBatch();
+  SzlTabEntry* table_entry = FindOrCreateEntry(index);
+  return (table_entry->Merge(val) == SzlTabEntry::MergeOk);
+}
+
+
+SzlTabEntry* SzlEmitter::FindOrCreateEntry(const string& key) {
+  SzlTabEntryMap::iterator it = table_->find(key);
+  if (it != table_->end())
+    return it->second;
+  SzlTabEntry* table_entry = writer_->CreateEntry(key);
+  table_->insert(SzlTabEntryMap::value_type(key, table_entry));
+  return table_entry;
+}
+
+
+// Orders batch slots by key, keeping emits to the same key in emit order.
+namespace {
+struct BatchKeyLess {
+  explicit BatchKeyLess(const vector<string>* keys) : keys_(keys)  { }
+  bool operator()(int a, int b) const  { return (*keys_)[a] < (*keys_)[b]; }
+  const vector<string>* keys_;
+};
+}  // namespace
+
+
+// Add the buffered emits to the table.  The emits are grouped by key so
+// that each key is looked up once, and all of its elements are handed to
+// the entry in one AddElems or AddWeightedElems call.
+void SzlEmitter::AddBatch() {
+  if (batch_len_ == 0)
+    return;
+  vector<int> order(batch_len_);
+  for (int i = 0; i < batch_len_; i++) {
+    order[i] = i;
+    memory_estimate_ -= batch_keys_[i].size() + batch_values_[i].size();
   }
+  stable_sort(order.begin(), order.end(), BatchKeyLess(&batch_keys_));
+
+  const bool weighted = writer_->HasWeight();
+  vector<const string*> elems;
+  vector<const SzlValue*> weights;
+  for (int i = 0; i < batch_len_; ) {
+    const string& k = batch_keys_[order[i]];
+    elems.clear();
+    weights.clear();
+    do {
+      elems.push_back(&batch_values_[order[i]]);
+      if (weighted)
+        weights.push_back(&batch_weights_[order[i]]);
+      ++i;
+    } while (i < batch_len_ && batch_keys_[order[i]] == k);
+
+    SzlTabEntry* table_entry = FindOrCreateEntry(k);
+    if (weighted)
+      memory_estimate_ += table_entry->AddWeightedElems(elems, weights);
+    else
+      memory_estimate_ += table_entry->AddElems(elems);
+  }
+  batch_len_ = 0;
+}
 
-  return (table_entry->Merge(val) == SzlTabEntry::MergeOk);
+
+bool SzlEmitter::ExpandKey(const string& compressed, string* key) {
+  const char* p = compressed.c_str();
+  const char* end = p + compressed.size();
+  uint32 shared;
+  p = sawzall::DecodeUnsignedVarint32(p, &shared);
+  if (p == NULL || p > end || shared > key->size())
+    return false;
+  key->resize(shared);
+  key->append(p, end - p);
+  return true;
 }
 
 
 // Displays the table contents after all the records have been processed.
 // Note that this calls WriteValue, which can be overridden.
 void SzlEmitter::DisplayResults() {
+  AddBatch();
+  if (flush_order_ != UNSORTED) {
+    vector<SzlTabEntryMap::value_type*> entries;
+    SortedEntries(&entries);
+    for (int i = 0; i < entries.size(); i++) {
+      vector<string> buffer;
+      entries[i]->second->FlushForDisplay(&buffer);
+      for (int j = 0; j < buffer.size(); j++)
+        WriteValue(entries[i]->first, buffer[j]);
+    }
+    return;
+  }
   for (SzlTabEntryMap::const_iterator it = table_->begin();
        it != table_->end(); ++it) {
     vector<string> buffer;
@@ -316,13 +440,58 @@ void SzlEmitter::DisplayResults() {
 }
 
 
+// Sort the entries by their encoded keys.  Since the keys of a table are
+// distinct, the order is fully determined.
+void SzlEmitter::SortedEntries(vector<SzlTabEntryMap::value_type*>* entries) {
+  vector<RadixSortElement> elements;
+  elements.reserve(table_->size());
+  for (SzlTabEntryMap::iterator it = table_->begin();
+       it != table_->end(); ++it) {
+    RadixSortElement e = { it->first.data(), it->first.size(), &*it };
+    elements.push_back(e);
+  }
+  if (!elements.empty())
+    RadixSort(&elements[0], elements.size());
+  entries->resize(elements.size());
+  for (int i = 0; i < elements.size(); i++)
+    (*entries)[i] = static_cast<SzlTabEntryMap::value_type*>(elements[i].value);
+}
+
+
 // Flush the current table contents.
 // This is for use with mapreduce; if used with the default WriteValue,
 // all the values associated with a key will be printed together, unlike
 // DisplayResults() which prints each value on a separate line,
 // with duplication of key values.
 void SzlEmitter::Flusher() {
-  if (table_ != NULL) {
+  AddBatch();
+  if (table_ != NULL && flush_order_ != UNSORTED) {
+    vector<SzlTabEntryMap::value_type*> entries;
+    SortedEntries(&entries);
+    string prev_key, compressed_key, v;
+    for (int i = 0; i < entries.size(); i++) {
+      v.clear();
+      entries[i]->second->Flush(&v);
+      if (v.empty())
+        continue;
+      const string& k = entries[i]->first;
+      if (flush_order_ == SORTED_PREFIX_COMPRESSED) {
+        int shared = 0;
+        const int max_shared = min(k.size(), prev_key.size());
+        while (shared < max_shared && k[shared] == prev_key[shared])
+          shared++;
+        char buf[sawzall::kMaxUnsignedVarint32Length];
+        char* end = sawzall::EncodeUnsignedVarint32(buf, shared);
+        compressed_key.assign(buf, end - buf);
+        compressed_key.append(k, shared, string::npos);
+        prev_key = k;
+        WriteValue(compressed_key, v);
+      } else {
+        WriteValue(k, v);
+      }
+    }
+    table_->clear();
+  } else if (table_ != NULL) {
     string k, v;
     for (SzlTabEntryMap::iterator it = table_->begin();
          it != table_->end(); ++it) {
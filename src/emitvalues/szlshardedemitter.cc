@@ -0,0 +1,332 @@
+// Copyright 2010 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ------------------------------------------------------------------------
+
+// Implementation of the SzlShardedTable and SzlShardedEmitter classes.
+
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#include "public/hash_map.h"
+
+#include "public/porting.h"
+#include "public/logging.h"
+#include "public/hashutils.h"
+
+#include "utilities/szlmutex.h"
+
+#include "public/emitterinterface.h"
+#include "public/szltype.h"
+#include "public/szlvalue.h"
+#include "public/szlemitter.h"
+#include "public/szltabentry.h"
+#include "public/szlshardedemitter.h"
+
+
+// A shard of the table.  Shards are padded to a cache line so that the
+// locks of neighboring shards do not share one.
+struct SzlShardedTable::Shard {
+  Shard() : memory_estimate(0)  { }
+
+  SzlMutex mutex;
+  SzlEmitter::SzlTabEntryMap table;
+  int memory_estimate;
+  char pad[64];
+};
+
+
+SzlShardedTable* SzlShardedTable::Create(const SzlType& type, int num_shards,
+                                         string* error) {
+  if (num_shards < 1) {
+    *error = "a sharded table needs at least one shard";
+    return NULL;
+  }
+  SzlTabWriter* writer = SzlTabWriter::CreateSzlTabWriter(type, error);
+  if (writer == NULL)
+    return NULL;
+  if (!writer->Aggregates() || !writer->WritesToMill()) {
+    *error = "only aggregating tables can be sharded";
+    delete writer;
+    return NULL;
+  }
+  return new SzlShardedTable(type, writer, num_shards);
+}
+
+
+SzlShardedTable::SzlShardedTable(const SzlType& type, SzlTabWriter* writer,
+                                 int num_shards)
+    : type_(new SzlType(type)),
+      writer_(writer),
+      num_shards_(num_shards),
+      shards_(new Shard[num_shards]) {
+}
+
+
+SzlShardedTable::~SzlShardedTable() {
+  Clear();
+  delete[] shards_;
+  delete writer_;
+  delete type_;
+}
+
+
+SzlTabWriter* SzlShardedTable::NewWriter() const {
+  string error;
+  SzlTabWriter* writer = SzlTabWriter::CreateSzlTabWriter(*type_, &error);
+  CHECK(writer != NULL) << "failed to recreate table writer: " << error;
+  return writer;
+}
+
+
+int SzlShardedTable::ShardForKey(const string& key) const {
+  if (num_shards_ == 1)
+    return 0;
+  return Hash32StringWithSeed(key.data(), key.size(), kHashSeed32) %
+         num_shards_;
+}
+
+
+void SzlShardedTable::LockShard(int shard) {
+  shards_[shard].mutex.Lock();
+}
+
+
+void SzlShardedTable::UnlockShard(int shard) {
+  shards_[shard].mutex.Unlock();
+}
+
+
+SzlTabEntry* SzlShardedTable::FindOrCreateEntry(int shard, const string& key) {
+  SzlEmitter::SzlTabEntryMap* table = &shards_[shard].table;
+  SzlEmitter::SzlTabEntryMap::iterator it = table->find(key);
+  if (it != table->end())
+    return it->second;
+  SzlTabEntry* table_entry = writer_->CreateEntry(key);
+  table->insert(SzlEmitter::SzlTabEntryMap::value_type(key, table_entry));
+  return table_entry;
+}
+
+
+void SzlShardedTable::AddMemoryEstimate(int shard, int delta) {
+  shards_[shard].memory_estimate += delta;
+}
+
+
+bool SzlShardedTable::Merge(const string& key, const string& val) {
+  int shard = ShardForKey(key);
+  SzlMutexLock lock(&shards_[shard].mutex);
+  return FindOrCreateEntry(shard, key)->Merge(val) == SzlTabEntry::MergeOk;
+}
+
+
+void SzlShardedTable::Flusher(Output* output) {
+  string v;
+  for (int i = 0; i < num_shards_; i++) {
+    SzlEmitter::SzlTabEntryMap* table = &shards_[i].table;
+    for (SzlEmitter::SzlTabEntryMap::iterator it = table->begin();
+         it != table->end(); ++it) {
+      v.clear();
+      it->second->Flush(&v);
+      if (!v.empty())
+        output->WriteValue(it->first, v);
+    }
+  }
+  Clear();
+}
+
+
+void SzlShardedTable::DisplayResults(Output* output) {
+  for (int i = 0; i < num_shards_; i++) {
+    SzlEmitter::SzlTabEntryMap* table = &shards_[i].table;
+    for (SzlEmitter::SzlTabEntryMap::const_iterator it = table->begin();
+         it != table->end(); ++it) {
+      vector<string> buffer;
+      it->second->FlushForDisplay(&buffer);
+      for (int j = 0; j < buffer.size(); j++)
+        output->WriteValue(it->first, buffer[j]);
+    }
+  }
+}
+
+
+void SzlShardedTable::Clear() {
+  for (int i = 0; i < num_shards_; i++) {
+    SzlEmitter::SzlTabEntryMap* table = &shards_[i].table;
+    for (SzlEmitter::SzlTabEntryMap::iterator it = table->begin();
+         it != table->end(); ++it) {
+      delete it->second;
+    }
+    table->clear();
+    shards_[i].memory_estimate = 0;
+  }
+}
+
+
+int SzlShardedTable::GetTupleCount() const {
+  int tuple_count = 0;
+  for (int i = 0; i < num_shards_; i++) {
+    const SzlEmitter::SzlTabEntryMap& table = shards_[i].table;
+    for (SzlEmitter::SzlTabEntryMap::const_iterator it = table.begin();
+         it != table.end(); ++it) {
+      tuple_count += it->second->TupleCount();
+    }
+  }
+  return tuple_count;
+}
+
+
+int SzlShardedTable::GetMemoryUsage() const {
+  int memory_used = 0;
+  for (int i = 0; i < num_shards_; i++) {
+    const SzlEmitter::SzlTabEntryMap& table = shards_[i].table;
+    for (SzlEmitter::SzlTabEntryMap::const_iterator it = table.begin();
+         it != table.end(); ++it) {
+      memory_used += it->second->Memory();
+    }
+  }
+  return memory_used;
+}
+
+
+int SzlShardedTable::GetMemoryEstimate() const {
+  int memory_estimate = 0;
+  for (int i = 0; i < num_shards_; i++)
+    memory_estimate += shards_[i].memory_estimate;
+  return memory_estimate;
+}
+
+
+// Orders batch slots by shard and then by key, keeping emits to the same
+// key in emit order.
+namespace {
+struct ShardKeyLess {
+  ShardKeyLess(const vector<int>* shards, const vector<string>* keys)
+      : shards_(shards), keys_(keys)  { }
+  bool operator()(int a, int b) const {
+    if ((*shards_)[a] != (*shards_)[b])
+      return (*shards_)[a] < (*shards_)[b];
+    return (*keys_)[a] < (*keys_)[b];
+  }
+  const vector<int>* shards_;
+  const vector<string>* keys_;
+};
+}  // namespace
+
+
+SzlShardedEmitter::SzlShardedEmitter(const string& name,
+                                     SzlShardedTable* table)
+    : SzlEmitter(name, table->NewWriter(), false),
+      shared_(table) {
+  set_batch_size(kDefaultBatchSize);
+}
+
+
+SzlShardedEmitter::~SzlShardedEmitter() {
+  // Drain here: the SzlEmitter destructor would add the staged emits
+  // to its own (unused) table.
+  AddBatch();
+}
+
+
+void SzlShardedEmitter::set_batch_size(int batch_size) {
+  SzlEmitter::set_batch_size(max(batch_size, 2));
+}
+
+
+class SzlShardedEmitter::TableOutput : public SzlShardedTable::Output {
+ public:
+  explicit TableOutput(SzlShardedEmitter* emitter) : emitter_(emitter)  { }
+  virtual void WriteValue(const string& key, const string& value) {
+    emitter_->WriteValue(key, value);
+  }
+
+ private:
+  SzlShardedEmitter* emitter_;
+};
+
+
+bool SzlShardedEmitter::Merge(const string& index, const string& val) {
+  AddBatch();
+  return shared_->Merge(index, val);
+}
+
+
+void SzlShardedEmitter::DisplayResults() {
+  AddBatch();
+  TableOutput output(this);
+  shared_->DisplayResults(&output);
+}
+
+
+void SzlShardedEmitter::Flusher() {
+  AddBatch();
+  TableOutput output(this);
+  shared_->Flusher(&output);
+  memory_estimate_ = 0;
+}
+
+
+int SzlShardedEmitter::GetTupleCount() const {
+  return shared_->GetTupleCount();
+}
+
+
+int SzlShardedEmitter::GetMemoryUsage() const {
+  return shared_->GetMemoryUsage();
+}
+
+
+void SzlShardedEmitter::AddBatch() {
+  if (batch_len_ == 0)
+    return;
+  vector<int> order(batch_len_);
+  vector<int> shards(batch_len_);
+  for (int i = 0; i < batch_len_; i++) {
+    order[i] = i;
+    shards[i] = shared_->ShardForKey(batch_keys_[i]);
+    memory_estimate_ -= batch_keys_[i].size() + batch_values_[i].size();
+  }
+  stable_sort(order.begin(), order.end(), ShardKeyLess(&shards, &batch_keys_));
+
+  const bool weighted = writer_->HasWeight();
+  vector<const string*> elems;
+  vector<const SzlValue*> weights;
+  for (int i = 0; i < batch_len_; ) {
+    // Hold the shard's lock for all the keys of the batch that it owns.
+    const int shard = shards[order[i]];
+    shared_->LockShard(shard);
+    int memory_delta = 0;
+    do {
+      const string& k = batch_keys_[order[i]];
+      elems.clear();
+      weights.clear();
+      do {
+        elems.push_back(&batch_values_[order[i]]);
+        if (weighted)
+          weights.push_back(&batch_weights_[order[i]]);
+        ++i;
+      } while (i < batch_len_ && batch_keys_[order[i]] == k);
+
+      SzlTabEntry* table_entry = shared_->FindOrCreateEntry(shard, k);
+      if (weighted)
+        memory_delta += table_entry->AddWeightedElems(elems, weights);
+      else
+        memory_delta += table_entry->AddElems(elems);
+    } while (i < batch_len_ && shards[order[i]] == shard);
+    shared_->AddMemoryEstimate(shard, memory_delta);
+    shared_->UnlockShard(shard);
+  }
+  batch_len_ = 0;
+}
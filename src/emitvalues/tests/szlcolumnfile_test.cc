@@ -0,0 +1,206 @@
+// Copyright 2010 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ------------------------------------------------------------------------
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <string>
+#include <vector>
+
+#include "public/porting.h"
+#include "public/logging.h"
+
+#include "utilities/strutils.h"
+
+#include "public/szlencoder.h"
+#include "public/szldecoder.h"
+#include "public/szlvalue.h"
+#include "public/szlresults.h"
+#include "public/emitterinterface.h"
+#include "public/szlemitter.h"
+#include "public/szltabentry.h"
+#include "public/szlcolumnfile.h"
+
+
+static string TestFileName(const char* name) {
+  const char* tmpdir = getenv("SZL_TMP");
+  if (tmpdir == NULL)
+    tmpdir = "/tmp";
+  return StringPrintf("%s/szlcolumnfile.test.%s.%d", tmpdir, name, getpid());
+}
+
+
+// Writes rows of several shapes across several blocks and checks that
+// they are read back unchanged.
+static void TestRoundTrip() {
+  vector<string> keys, values;
+  SzlEncoder enc;
+  const int kNumRows = 1000;
+  for (int i = 0; i < kNumRows; i++) {
+    enc.Reset();
+    enc.PutString(StringPrintf("key%d", i / 10).c_str());
+    enc.PutInt(i % 10 - 5);
+    keys.push_back(enc.data());
+
+    enc.Reset();
+    switch (i % 4) {
+      case 0:  // like a sum table: count, int, float
+        enc.PutInt(i / 3);
+        enc.PutInt(i * 1000003LL - 500);
+        enc.PutFloat(i * 0.5);
+        values.push_back(enc.data());
+        break;
+      case 1:  // few distinct strings
+        enc.PutString(i % 3 == 0 ? "red" : "green");
+        values.push_back(enc.data());
+        break;
+      case 2:  // not SzlEncoder values
+        values.push_back(StringPrintf("\xff%d\xfe", i));
+        break;
+      case 3:  // empty and array values
+        if (i % 8 == 3) {
+          values.push_back("");
+        } else {
+          enc.Start(SzlType::ARRAY);
+          enc.PutInt(i);
+          enc.PutString("x");
+          enc.End(SzlType::ARRAY);
+          values.push_back(enc.data());
+        }
+        break;
+    }
+  }
+
+  string filename = TestFileName("roundtrip");
+  string error;
+  SzlColumnWriter* writer = SzlColumnWriter::Open(filename.c_str(), 100,
+                                                  &error);
+  CHECK(writer != NULL) << error;
+  for (int i = 0; i < kNumRows; i++)
+    CHECK(writer->Write(keys[i], values[i])) << writer->error_message();
+  CHECK(writer->Close()) << writer->error_message();
+  delete writer;
+
+  SzlColumnReader* reader = SzlColumnReader::Open(filename.c_str(), &error);
+  CHECK(reader != NULL) << error;
+  string key, value;
+  for (int i = 0; i < kNumRows; i++) {
+    CHECK(reader->Next(&key, &value)) << "row " << i << ": "
+                                      << reader->error_message();
+    CHECK(key == keys[i]) << "Bad key in row " << i;
+    CHECK(value == values[i]) << "Bad value in row " << i;
+  }
+  CHECK(!reader->Next(&key, &value));
+  CHECK(reader->error_message().empty()) << reader->error_message();
+  delete reader;
+  unlink(filename.c_str());
+}
+
+
+// Flushes a sum table through a SzlColumnEmitter and reads it back with
+// a SzlResults.
+static void TestEmitterOutput() {
+  SzlType type(SzlType::TABLE);
+  type.set_table("sum");
+  type.AddIndex("", SzlType::kInt);
+  type.set_element("", SzlType::kInt);
+  string error;
+  SzlTabWriter* tab_writer = SzlTabWriter::CreateSzlTabWriter(type, &error);
+  CHECK(tab_writer != NULL) << error;
+
+  string filename = TestFileName("emitter");
+  SzlColumnWriter* writer = SzlColumnWriter::Open(
+      filename.c_str(), SzlColumnWriter::kDefaultBlockRows, &error);
+  CHECK(writer != NULL) << error;
+  SzlColumnEmitter emitter("UnitTest", tab_writer, writer);
+  emitter.set_flush_order(SzlEmitter::SORTED);
+  const int kNumKeys = 500;
+  const int kNumEmits = 20000;
+  for (int i = 0; i < kNumEmits; i++) {
+    emitter.Begin(SzlEmitter::EMIT, 1);
+    emitter.Begin(SzlEmitter::INDEX, 1);
+    emitter.PutInt(i % kNumKeys);
+    emitter.End(SzlEmitter::INDEX, 1);
+    emitter.Begin(SzlEmitter::ELEMENT, 1);
+    emitter.PutInt(i);
+    emitter.End(SzlEmitter::ELEMENT, 1);
+    emitter.End(SzlEmitter::EMIT, 1);
+  }
+  emitter.Flusher();
+  CHECK(writer->Close()) << writer->error_message();
+  CHECK(!emitter.ErrorsDetected());
+
+  // The sorted, repetitive output should compress well.
+  struct stat st;
+  CHECK_EQ(0, stat(filename.c_str(), &st));
+  CHECK_LT(st.st_size, kNumKeys * 4) << "Output is not compressed.";
+
+  SzlResults* results = SzlResults::CreateSzlResults(type, &error);
+  CHECK(results != NULL) << error;
+  SzlColumnReader* reader = SzlColumnReader::Open(filename.c_str(), &error);
+  CHECK(reader != NULL) << error;
+  string key;
+  for (int k = 0; k < kNumKeys; k++) {
+    CHECK(reader->NextResults(&key, results)) << reader->error_message();
+    SzlDecoder key_dec(key.data(), key.size());
+    int64 index;
+    CHECK(key_dec.GetInt(&index));
+    CHECK_EQ(k, index) << "Keys are not in order.";
+
+    int64 sum = 0;
+    for (int i = k; i < kNumEmits; i += kNumKeys)
+      sum += i;
+    CHECK_EQ(kNumEmits / kNumKeys, results->TotElems());
+    CHECK_EQ(1, results->Results()->size());
+    const string& result = (*results->Results())[0];
+    SzlDecoder dec(result.data(), result.size());
+    int64 value;
+    CHECK(dec.GetInt(&value));
+    CHECK_EQ(sum, value);
+  }
+  CHECK(!reader->NextResults(&key, results));
+  CHECK(reader->error_message().empty()) << reader->error_message();
+  delete reader;
+  delete results;
+  delete writer;
+  unlink(filename.c_str());
+}
+
+
+static void TestRejectsOtherFiles() {
+  string filename = TestFileName("other");
+  FILE* file = fopen(filename.c_str(), "w");
+  CHECK(file != NULL);
+  fputs("not a column file\n", file);
+  fclose(file);
+  string error;
+  CHECK(SzlColumnReader::Open(filename.c_str(), &error) == NULL);
+  CHECK(!error.empty());
+  unlink(filename.c_str());
+}
+
+
+int main(int argc, char** argv) {
+  ProcessCommandLineArguments(argc, argv);
+  InitializeAllModules();
+
+  TestRoundTrip();
+  TestEmitterOutput();
+  TestRejectsOtherFiles();
+
+  puts("PASS");
+  return 0;
+}
@@ -14,6 +14,7 @@
 // ------------------------------------------------------------------------
 
 #include <stdio.h>
+#include <algorithm>
 
 #include "public/porting.h"
 #include "public/logging.h"
@@ -90,6 +91,9 @@ class SzlEmitterTest {
   void AddsStringsCorrectly();
   void AddsTimeCorrectly();
   void ClearsEmitterCorrectly();
+  void BatchesEmitsCorrectly();
+  void AcceptsEncodedEmits();
+  void FlushesInKeyOrder();
 
 
   void SignalEmitIndex(SzlEmitter* emitter) {
@@ -648,6 +652,156 @@ void SzlEmitterTest::ClearsEmitterCorrectly() {
 }
 
 
+void SzlEmitterTest::BatchesEmitsCorrectly() {
+  SzlField element("", SzlType::kInt);
+  test_table.set_element(&element);
+  vector<KeyValuePair> unbatched_result;
+  SzlEmitter* unbatched_emitter = new SzlEmitterTestEmitter(
+      "UnitTest", SzlTabWriter::CreateSzlTabWriter(test_table, &error),
+      &unbatched_result);
+  vector<KeyValuePair> batched_result;
+  SzlEmitter* batched_emitter = new SzlEmitterTestEmitter(
+      "UnitTest", SzlTabWriter::CreateSzlTabWriter(test_table, &error),
+      &batched_result);
+  batched_emitter->set_batch_size(4);
+  CHECK_EQ(4, batched_emitter->batch_size());
+
+  // Interleave emits to a few indices so that batches are split by key,
+  // and use more emits than the batch size so that a partial batch is
+  // left for Flusher().
+  const int64 kIndices[] = { kIndex1, kIndex2, kIndex1, kIndex3, kIndex1,
+                             kIndex2, kIndex3 };
+  const int64 kValues[] = { kInt1, kInt2, kInt3, kInt1, kInt2, kInt3, kInt1 };
+  SzlEmitter* emitters[] = { unbatched_emitter, batched_emitter };
+  for (int e = 0; e < ARRAYSIZE(emitters); e++) {
+    for (int i = 0; i < ARRAYSIZE(kIndices); i++) {
+      SignalEmitIndex(emitters[e]);
+      emitters[e]->PutInt(kIndices[i]);
+      emitters[e]->End(SzlEmitter::INDEX, 0);
+      emitters[e]->Begin(SzlEmitter::ELEMENT, 0);
+      emitters[e]->PutInt(kValues[i]);
+      SignalEndElement(emitters[e]);
+    }
+  }
+  // The counts leave out buffered emits until they are added.
+  batched_emitter->AddBatch();
+  CHECK_EQ(unbatched_emitter->GetTupleCount(),
+           batched_emitter->GetTupleCount());
+
+  unbatched_emitter->Flusher();
+  batched_emitter->Flusher();
+  sort(unbatched_result.begin(), unbatched_result.end());
+  sort(batched_result.begin(), batched_result.end());
+  CHECK_EQ(3, batched_result.size()) << "Incorrect number of indices.";
+  CHECK(unbatched_result == batched_result)
+      << "Batched emits produced different results.";
+
+  delete unbatched_emitter;
+  delete batched_emitter;
+  // The SzlEmitter destructor deletes the writer.
+}
+
+
+void SzlEmitterTest::AcceptsEncodedEmits() {
+  SzlField element("", SzlType::kInt);
+  test_table.set_element(&element);
+  vector<KeyValuePair> put_result;
+  SzlEmitter* put_emitter = new SzlEmitterTestEmitter(
+      "UnitTest", SzlTabWriter::CreateSzlTabWriter(test_table, &error),
+      &put_result);
+  vector<KeyValuePair> encoded_result;
+  SzlEmitter* encoded_emitter = new SzlEmitterTestEmitter(
+      "UnitTest", SzlTabWriter::CreateSzlTabWriter(test_table, &error),
+      &encoded_result);
+  CHECK(encoded_emitter->AcceptsEncodedEmits());
+
+  const int64 kIndices[] = { kIndex1, kIndex2, kIndex1, kIndex3 };
+  const int64 kValues[] = { kInt1, kInt2, kInt3, kInt1 };
+  for (int i = 0; i < ARRAYSIZE(kIndices); i++) {
+    SignalEmitIndex(put_emitter);
+    put_emitter->PutInt(kIndices[i]);
+    put_emitter->End(SzlEmitter::INDEX, 0);
+    put_emitter->Begin(SzlEmitter::ELEMENT, 0);
+    put_emitter->PutInt(kValues[i]);
+    SignalEndElement(put_emitter);
+
+    SzlEncoder key;
+    key.PutInt(kIndices[i]);
+    SzlEncoder value;
+    value.PutInt(kValues[i]);
+    encoded_emitter->EmitEncoded(key.data().data(), key.data().size(),
+                                 value.data().data(), value.data().size());
+  }
+
+  put_emitter->Flusher();
+  encoded_emitter->Flusher();
+  sort(put_result.begin(), put_result.end());
+  sort(encoded_result.begin(), encoded_result.end());
+  CHECK_EQ(3, encoded_result.size()) << "Incorrect number of indices.";
+  CHECK(put_result == encoded_result)
+      << "Encoded emits produced different results.";
+
+  delete put_emitter;
+  delete encoded_emitter;
+}
+
+
+void SzlEmitterTest::FlushesInKeyOrder() {
+  SzlField element("", SzlType::kInt);
+  test_table.set_element(&element);
+  vector<KeyValuePair> sorted_result;
+  SzlEmitter* sorted_emitter = new SzlEmitterTestEmitter(
+      "UnitTest", SzlTabWriter::CreateSzlTabWriter(test_table, &error),
+      &sorted_result);
+  sorted_emitter->set_flush_order(SzlEmitter::SORTED);
+  vector<KeyValuePair> compressed_result;
+  SzlEmitter* compressed_emitter = new SzlEmitterTestEmitter(
+      "UnitTest", SzlTabWriter::CreateSzlTabWriter(test_table, &error),
+      &compressed_result);
+  compressed_emitter->set_flush_order(SzlEmitter::SORTED_PREFIX_COMPRESSED);
+
+  // Use enough keys of varying encoded lengths and signs that the
+  // radix sort has to split several levels deep.
+  const int kNumKeys = 1000;
+  SzlEmitter* emitters[] = { sorted_emitter, compressed_emitter };
+  for (int e = 0; e < ARRAYSIZE(emitters); e++) {
+    for (int i = 0; i < kNumKeys; i++) {
+      int64 index = (i * 7919) % kNumKeys - kNumKeys / 2;
+      index *= (i % 3 == 0) ? 1000003 : 1;
+      SignalEmitIndex(emitters[e]);
+      emitters[e]->PutInt(index);
+      emitters[e]->End(SzlEmitter::INDEX, 0);
+      emitters[e]->Begin(SzlEmitter::ELEMENT, 0);
+      emitters[e]->PutInt(i);
+      SignalEndElement(emitters[e]);
+    }
+    emitters[e]->Flusher();
+  }
+
+  CHECK_EQ(kNumKeys, sorted_result.size()) << "Incorrect number of indices.";
+  CHECK_EQ(kNumKeys, compressed_result.size())
+      << "Incorrect number of indices.";
+  int64 prev_index = 0;
+  string key;
+  for (int i = 0; i < kNumKeys; i++) {
+    SzlDecoder dec(sorted_result[i].first.data(),
+                   sorted_result[i].first.size());
+    int64 index;
+    CHECK(dec.GetInt(&index));
+    if (i > 0)
+      CHECK_LT(prev_index, index) << "Keys are not sorted.";
+    prev_index = index;
+
+    CHECK(SzlEmitter::ExpandKey(compressed_result[i].first, &key));
+    CHECK(key == sorted_result[i].first) << "Bad prefix compressed key.";
+    CHECK(compressed_result[i].second == sorted_result[i].second);
+  }
+
+  delete sorted_emitter;
+  delete compressed_emitter;
+}
+
+
 int main(int argc, char** argv) {
   ProcessCommandLineArguments(argc, argv);
   InitializeAllModules();
@@ -661,6 +815,9 @@ int main(int argc, char** argv) {
   SzlEmitterTest().AddsStringsCorrectly();
   SzlEmitterTest().AddsTimeCorrectly();
   SzlEmitterTest().ClearsEmitterCorrectly();
+  SzlEmitterTest().BatchesEmitsCorrectly();
+  SzlEmitterTest().AcceptsEncodedEmits();
+  SzlEmitterTest().FlushesInKeyOrder();
 
   puts(fail ? "FAIL" : "PASS");
   return 0;
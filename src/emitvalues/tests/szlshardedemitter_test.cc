@@ -0,0 +1,243 @@
+// Copyright 2010 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ------------------------------------------------------------------------
+
+#include <stdio.h>
+#include <pthread.h>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "public/porting.h"
+#include "public/logging.h"
+
+#include "public/szlencoder.h"
+#include "public/szldecoder.h"
+#include "public/szlvalue.h"
+#include "public/szlnamedtype.h"
+#include "public/emitterinterface.h"
+#include "public/szlemitter.h"
+#include "public/szltabentry.h"
+#include "public/szlshardedemitter.h"
+
+
+const int kNumThreads = 4;
+const int kNumShards = 7;
+const int kNumKeys = 100;
+const int kEmitsPerThread = 20000;
+
+
+// Collects the flushed table contents in a map.
+class MapOutput : public SzlShardedTable::Output {
+ public:
+  virtual void WriteValue(const string& key, const string& value) {
+    CHECK(values_.find(key) == values_.end()) << "Duplicate key in output.";
+    values_[key] = value;
+  }
+  const map<string, string>& values() const  { return values_; }
+
+ private:
+  map<string, string> values_;
+};
+
+
+struct EmitterThreadArgs {
+  SzlShardedTable* table;
+  int thread;
+};
+
+
+// Emits kEmitsPerThread values to a sum table indexed by int, i.e.
+//   emit t[i % kNumKeys] <- i
+// for i in [0, kEmitsPerThread).
+static void* EmitterThread(void* arg) {
+  EmitterThreadArgs* args = static_cast<EmitterThreadArgs*>(arg);
+  SzlShardedEmitter emitter("UnitTest", args->table);
+  // Use a batch size that does not divide the number of emits,
+  // so that a partial batch is drained by the destructor.
+  emitter.set_batch_size(64 + args->thread);
+  for (int i = 0; i < kEmitsPerThread; i++) {
+    emitter.Begin(SzlEmitter::EMIT, 1);
+    emitter.Begin(SzlEmitter::INDEX, 1);
+    emitter.PutInt(i % kNumKeys);
+    emitter.End(SzlEmitter::INDEX, 1);
+    emitter.Begin(SzlEmitter::ELEMENT, 1);
+    emitter.PutInt(i);
+    emitter.End(SzlEmitter::ELEMENT, 1);
+    emitter.End(SzlEmitter::EMIT, 1);
+  }
+  return NULL;
+}
+
+
+static void TestConcurrentSum() {
+  SzlType type(SzlType::TABLE);
+  type.set_table("sum");
+  type.AddIndex("", SzlType::kInt);
+  type.set_element("", SzlType::kInt);
+  string error;
+  SzlShardedTable* table = SzlShardedTable::Create(type, kNumShards, &error);
+  CHECK(table != NULL) << error;
+
+  pthread_t threads[kNumThreads];
+  EmitterThreadArgs args[kNumThreads];
+  for (int t = 0; t < kNumThreads; t++) {
+    args[t].table = table;
+    args[t].thread = t;
+    CHECK_EQ(0, pthread_create(&threads[t], NULL, EmitterThread, &args[t]));
+  }
+  for (int t = 0; t < kNumThreads; t++)
+    CHECK_EQ(0, pthread_join(threads[t], NULL));
+
+  CHECK_EQ(kNumKeys, table->GetTupleCount());
+  MapOutput output;
+  table->Flusher(&output);
+  CHECK_EQ(0, table->GetTupleCount());
+  CHECK_EQ(kNumKeys, output.values().size()) << "Incorrect number of keys.";
+
+  for (int k = 0; k < kNumKeys; k++) {
+    SzlEncoder key;
+    key.PutInt(k);
+    map<string, string>::const_iterator it = output.values().find(key.data());
+    CHECK(it != output.values().end()) << "Missing key " << k;
+
+    // Each thread emitted k, k + kNumKeys, k + 2 * kNumKeys, ...
+    int64 count = 0;
+    int64 sum = 0;
+    for (int i = k; i < kEmitsPerThread; i += kNumKeys) {
+      count++;
+      sum += i;
+    }
+    SzlDecoder dec(it->second.data(), it->second.size());
+    int64 flushed_count, flushed_sum;
+    CHECK(dec.GetInt(&flushed_count));
+    CHECK(dec.GetInt(&flushed_sum));
+    CHECK_EQ(kNumThreads * count, flushed_count);
+    CHECK_EQ(kNumThreads * sum, flushed_sum);
+  }
+  delete table;
+}
+
+
+// An emitter that collects its flushed output in a map.
+class MapEmitter : public SzlShardedEmitter {
+ public:
+  MapEmitter(const string& name, SzlShardedTable* table)
+    : SzlShardedEmitter(name, table)  { }
+  const map<string, string>& values() const  { return values_; }
+
+ protected:
+  virtual void WriteValue(const string& key, const string& value) {
+    values_[key] = value;
+  }
+
+ private:
+  map<string, string> values_;
+};
+
+
+static void EmitInt(SzlEmitter* emitter, int index, int value) {
+  emitter->Begin(SzlEmitter::EMIT, 1);
+  emitter->Begin(SzlEmitter::INDEX, 1);
+  emitter->PutInt(index);
+  emitter->End(SzlEmitter::INDEX, 1);
+  emitter->Begin(SzlEmitter::ELEMENT, 1);
+  emitter->PutInt(value);
+  emitter->End(SzlEmitter::ELEMENT, 1);
+  emitter->End(SzlEmitter::EMIT, 1);
+}
+
+
+// The table methods inherited from SzlEmitter act on the shared table.
+static void TestEmitterTableMethods() {
+  SzlType type(SzlType::TABLE);
+  type.set_table("sum");
+  type.AddIndex("", SzlType::kInt);
+  type.set_element("", SzlType::kInt);
+  string error;
+  SzlShardedTable* table = SzlShardedTable::Create(type, kNumShards, &error);
+  CHECK(table != NULL) << error;
+
+  MapEmitter first("UnitTest", table);
+  MapEmitter second("UnitTest", table);
+  first.set_batch_size(2 * kNumKeys);
+  second.set_batch_size(2 * kNumKeys);
+  for (int i = 0; i < kNumKeys; i++) {
+    EmitInt(&first, i, 1);
+    EmitInt(&second, i, 2);
+  }
+  // Both emitters still hold their emits; draining one is seen by both.
+  CHECK_EQ(0, first.GetTupleCount());
+  second.AddBatch();
+  CHECK_EQ(kNumKeys, first.GetTupleCount());
+  CHECK_EQ(kNumKeys, second.GetTupleCount());
+  CHECK_GT(first.GetMemoryUsage(), 0);
+  CHECK_EQ(first.GetMemoryUsage(), second.GetMemoryUsage());
+
+  // Merge the encoded state of a sum of 7, as flushed by another table.
+  SzlEncoder key;
+  key.PutInt(kNumKeys);
+  SzlEncoder state;
+  state.PutInt(1);
+  state.PutInt(7);
+  CHECK(first.Merge(key.data(), state.data()));
+  CHECK_EQ(kNumKeys + 1, second.GetTupleCount());
+
+  // Flusher drains the first emitter's emits and writes the whole table.
+  first.Flusher();
+  CHECK_EQ(0, table->GetTupleCount());
+  CHECK_EQ(0, second.values().size());
+  CHECK_EQ(kNumKeys + 1, first.values().size());
+  for (int k = 0; k <= kNumKeys; k++) {
+    SzlEncoder key;
+    key.PutInt(k);
+    map<string, string>::const_iterator it = first.values().find(key.data());
+    CHECK(it != first.values().end()) << "Missing key " << k;
+    SzlDecoder dec(it->second.data(), it->second.size());
+    int64 count, sum;
+    CHECK(dec.GetInt(&count));
+    CHECK(dec.GetInt(&sum));
+    if (k < kNumKeys) {
+      CHECK_EQ(2, count);
+      CHECK_EQ(3, sum);
+    } else {
+      CHECK_EQ(1, count);
+      CHECK_EQ(7, sum);
+    }
+  }
+  delete table;
+}
+
+
+static void TestRejectsNonAggregatingTable() {
+  SzlType type(SzlType::TABLE);
+  type.set_table("collection");
+  type.set_element("", SzlType::kString);
+  string error;
+  CHECK(SzlShardedTable::Create(type, kNumShards, &error) == NULL);
+  CHECK(!error.empty());
+}
+
+
+int main(int argc, char** argv) {
+  ProcessCommandLineArguments(argc, argv);
+  InitializeAllModules();
+
+  TestConcurrentSum();
+  TestEmitterTableMethods();
+  TestRejectsNonAggregatingTable();
+
+  puts("PASS");
+  return 0;
+}
@@ -1003,7 +1003,7 @@ void CodeGen::DoCall(Call* x) {
     // special cases - match*() has precompiled pattern (or NULL)
     if (fun->kind() == Intrinsic::MATCH) {
       emit_op(match);
-      emit_ptr(CompiledRegexp(args->at(0), proc_, &error_count_));
+      emit_ptr(CompiledMatchRegexp(args->at(0), proc_, &error_count_));
 
     } else if (fun->kind() == Intrinsic::MATCHPOSNS) {
       emit_op(matchposns);
@@ -1517,6 +1517,31 @@ void CodeGen::DoTypeDecl(TypeDecl* x) {
 }
 
 
+// Values of a static variable of type t can be shared read-only by the
+// Procs of several Processes (see SharedStatics) unless they can contain
+// closures, which refer to the frames of the Proc that created them.
+static bool IsShareable(Type* t, List<TupleType*>* visited) {
+  if (t->is_function())
+    return false;
+  if (t->is_array())
+    return IsShareable(t->as_array()->elem_type(), visited);
+  if (t->is_map())
+    return IsShareable(t->as_map()->index_type(), visited) &&
+           IsShareable(t->as_map()->elem_type(), visited);
+  if (t->is_tuple()) {
+    TupleType* tuple = t->as_tuple();
+    if (visited->IndexOf(tuple) >= 0)
+      return true;  // recursive type, already being checked
+    visited->Append(tuple);
+    List<Field*>* fields = tuple->fields();
+    for (int i = 0; i < fields->length(); i++)
+      if (!IsShareable(fields->at(i)->type(), visited))
+        return false;
+  }
+  return true;
+}
+
+
 void CodeGen::DoVarDecl(VarDecl* x) {
   Trace t(&tlevel_, "(VarDecl %s", x->name());
   // either do all statics or all locals
@@ -1549,6 +1574,16 @@ void CodeGen::DoVarDecl(VarDecl* x) {
     } else if (x->init() != NULL) {
       Comment(proc_->PrintString("initialize %s", x->name()));
       BLabel exit(proc_);
+      if (do_statics() && (proc_->mode() & Proc::kShareStatics) != 0) {
+        List<TupleType*> visited(proc_);
+        if (IsShareable(x->type(), &visited) && emit_ok()) {
+          // skip the initializer if the value is shared
+          SetBP(x->level());
+          emit_op(shareS);
+          emit_int16(var_index(x->offset()));
+          emit_pcoff(exit.offset(emit_offset(), stack_height_));
+        }
+      }
       // static variables don't have a defined bit - don't provide
       // the variable information; also traps are never silent here -
       // non-static variables are silently initialized always (i.e.,
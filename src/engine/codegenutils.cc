@@ -20,7 +20,10 @@
 #include "engine/globals.h"
 #include "public/logging.h"
 
+#include "public/hash_map.h"
+
 #include "utilities/strutils.h"
+#include "utilities/literalset.h"
 
 #include "engine/memory.h"
 #include "engine/utils.h"
@@ -402,6 +405,14 @@ void* CompiledRegexp(Expr* x, Proc* proc, int* error_count) {
 }
 
 
+void* CompiledMatchRegexp(Expr* x, Proc* proc, int* error_count) {
+  void* r = CompiledRegexp(x, proc, error_count);
+  if (r != NULL)
+    proc->AddMatchPattern(r, x->as_string()->cpp_str(proc).c_str());
+  return r;
+}
+
+
 // Returns the pattern for regex x, if possible (returns "" otherwise)
 const char* RegexPattern(Regex* x, Proc* proc, int* error_count) {
   if (x->arg()->is_int()) {  // hex or octal or decimal
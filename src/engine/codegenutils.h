@@ -52,6 +52,10 @@ Opcode MappedValue(MapType* map_type, bool is_load, bool is_lhs, int delta,
 // Returns the compiled regex for pattern x, if possible (returns NULL otherwise)
 void* CompiledRegexp(Expr* x, Proc* proc, int* error_count);
 
+// Like CompiledRegexp, for the pattern of match(); also adds the pattern
+// to the Proc's MatchSet (see Proc::AddMatchPattern).
+void* CompiledMatchRegexp(Expr* x, Proc* proc, int* error_count);
+
 // Returns the pattern for regex x, if possible (returns "" otherwise)
 const char* RegexPattern(Regex* x, Proc* proc, int* error_count);
 
@@ -438,8 +438,9 @@ Expr* ConstantFoldingVisitor::VisitCall(Call* x) {
   if (intrinsic->kind() == Intrinsic::MATCH) {
     // Compile the regular expression here and quietly fail to fold
     // if it does not compile - the code generator will emit an error later.
+    // The pattern is matched only once, so skip studying it.
     string s = args->at(0)->as_string()->cpp_str(proc_);
-    void* r = CompileRegexp(s.c_str(), &error);
+    void* r = CompileRegexp(s.c_str(), &error, false);
     if (r == NULL)
       return x;
     error = Intrinsics::Match(proc_, sp, r);
@@ -19,6 +19,8 @@
 #include <time.h>
 #include <errno.h>
 #include <assert.h>
+#include <float.h>
+#include <algorithm>
 
 #include "engine/globals.h"
 #include "public/logging.h"
@@ -444,11 +446,207 @@ inline const char* UInt2Fpr(Proc* proc, CvtArgs* args, Val* val, Val** result) {
 }
 
 
+// Fast paths for the common string to number conversions: a plain decimal
+// number with an optional sign and no surrounding white space.  They parse
+// the string in place instead of copying it to a NUL-terminated buffer for
+// strtoll and friends, and return false for anything else (other bases,
+// white space, overflow, errors), in which case the caller falls back to
+// the library, so results and error messages are unchanged.
+
+// The general conversions copy at most this many bytes, including the NUL.
+static const int kNumberBufSize = 64;
+
+#if SZL_BYTE_ORDER == SZL_LITTLE_ENDIAN
+// Returns whether the 8 bytes of the little-endian word w are all
+// ASCII digits.
+static inline bool IsEightDigits(uint64 w) {
+  return ((w & 0xF0F0F0F0F0F0F0F0ULL) |
+          (((w + 0x0606060606060606ULL) & 0xF0F0F0F0F0F0F0F0ULL) >> 4)) ==
+         0x3333333333333333ULL;
+}
+
+
+// Returns the value of the 8 ASCII digits in w, most significant first,
+// combining pairs, then quads, then the two halves with multiplies.
+static inline uint32 EightDigitsValue(uint64 w) {
+  const uint64 kMask = 0x000000FF000000FFULL;
+  const uint64 kMul1 = 100 + (1000000ULL << 32);
+  const uint64 kMul2 = 1 + (10000ULL << 32);
+  w -= 0x3030303030303030ULL;
+  w = (w * 10) + (w >> 8);
+  w = (((w & kMask) * kMul1) + (((w >> 16) & kMask) * kMul2)) >> 32;
+  return static_cast<uint32>(w);
+}
+#endif
+
+
+// Accumulates the decimal digits starting at p into *value, stopping at the
+// first non-digit or at end, and returns where it stopped.  The caller
+// bounds end - p so that *value cannot overflow.
+static inline const char* ScanDigits(const char* p, const char* end,
+                                     uint64* value) {
+  uint64 v = *value;
+#if SZL_BYTE_ORDER == SZL_LITTLE_ENDIAN
+  while (end - p >= 8) {
+    uint64 w;
+    memcpy(&w, p, sizeof w);
+    if (!IsEightDigits(w))
+      break;
+    v = v * 100000000 + EightDigitsValue(w);
+    p += 8;
+  }
+#endif
+  while (p < end && '0' <= *p && *p <= '9')
+    v = v * 10 + (*p++ - '0');
+  *value = v;
+  return p;
+}
+
+
+// Parses the magnitude of a decimal integer of at most 19 digits, which
+// always fits in a uint64.  With base 0 a leading 0 means octal or hex,
+// which is left to the library.
+static inline bool ParseDecimalMagnitude(const char* p, const char* end,
+                                         int base, uint64* value) {
+  if (base != 10 && base != 0)
+    return false;
+  const int ndigits = end - p;
+  if (ndigits == 0 || ndigits > 19)
+    return false;
+  if (base == 0 && *p == '0' && ndigits > 1)
+    return false;
+  *value = 0;
+  return ScanDigits(p, end, value) == end;
+}
+
+
+static bool ParseInt(const char* p, int length, int base, szl_int* result) {
+  const char* end = p + length;
+  bool negative = false;
+  if (p < end && (*p == '-' || *p == '+'))
+    negative = (*p++ == '-');
+  uint64 v;
+  if (!ParseDecimalMagnitude(p, end, base, &v))
+    return false;
+  if (v > static_cast<uint64>(kint64max) + negative)
+    return false;
+  *result = static_cast<szl_int>(negative ? -v : v);
+  return true;
+}
+
+
+static bool ParseUInt(const char* p, int length, int base, szl_uint* result) {
+  // strtoull negates a value with a leading '-'; leave that to it.
+  const char* end = p + length;
+  if (p < end && *p == '+')
+    p++;
+  uint64 v;
+  if (!ParseDecimalMagnitude(p, end, base, &v))
+    return false;
+  *result = v;
+  return true;
+}
+
+
+// Powers of ten that are exactly representable as doubles.
+static const double kExactPowersOfTen[] = {
+  1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+  1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+
+// Parses [+-]digits[.digits][(e|E)[+-]digits].  Succeeds only when the
+// significant digits form an integer m <= 2^53 and the decimal exponent e
+// satisfies |e| <= 22: then m and 10^|e| are exact doubles and a single
+// multiply or divide gives the correctly rounded result, the same as
+// strtod (Clinger's fast path).  Longer mantissas and larger exponents
+// go to strtod.
+static bool ParseFloat(const char* p, int length, szl_float* result) {
+#if defined(FLT_EVAL_METHOD) && FLT_EVAL_METHOD == 0
+  if (length >= kNumberBufSize)
+    return false;  // the general path truncates; keep its behavior
+  const char* end = p + length;
+  bool negative = false;
+  if (p < end && (*p == '-' || *p == '+'))
+    negative = (*p++ == '-');
+  const int kMaxDigits = 19;  // significant digits that fit in a uint64
+  uint64 mantissa = 0;
+  int ndigits = 0;
+  int exponent = 0;
+  bool any_digits = false;
+  // Integer part; leading zeros are not significant.
+  const char* q = p;
+  while (p < end && *p == '0')
+    p++;
+  any_digits = (p > q);
+  q = p;
+  p = ScanDigits(p, q + min(static_cast<int>(end - q), kMaxDigits), &mantissa);
+  ndigits = p - q;
+  any_digits |= (ndigits > 0);
+  if (p < end && '0' <= *p && *p <= '9')
+    return false;
+  // Fraction.
+  if (p < end && *p == '.') {
+    p++;
+    if (ndigits == 0) {
+      q = p;
+      while (p < end && *p == '0')
+        p++;
+      exponent -= p - q;
+      any_digits |= (p > q);
+    }
+    q = p;
+    p = ScanDigits(p, q + min(static_cast<int>(end - q), kMaxDigits - ndigits),
+                   &mantissa);
+    exponent -= p - q;
+    ndigits += p - q;
+    any_digits |= (p > q);
+    if (p < end && '0' <= *p && *p <= '9')
+      return false;
+  }
+  if (!any_digits)
+    return false;
+  // Exponent.
+  if (p < end && (*p == 'e' || *p == 'E')) {
+    p++;
+    bool negative_exponent = false;
+    if (p < end && (*p == '-' || *p == '+'))
+      negative_exponent = (*p++ == '-');
+    q = p;
+    int e = 0;
+    while (p < end && p - q < 4 && '0' <= *p && *p <= '9')
+      e = e * 10 + (*p++ - '0');
+    if (p == q || (p < end && '0' <= *p && *p <= '9'))
+      return false;
+    exponent += negative_exponent ? -e : e;
+  }
+  if (p != end)
+    return false;
+  if (mantissa > (1ULL << 53) || exponent < -22 || exponent > 22)
+    return false;
+  double d = static_cast<double>(mantissa);
+  if (exponent < 0)
+    d /= kExactPowersOfTen[-exponent];
+  else
+    d *= kExactPowersOfTen[exponent];
+  *result = negative ? -d : d;
+  return true;
+#else
+  return false;  // excess precision would round twice
+#endif
+}
+
+
 static const char* Str2Float(Proc* proc, CvtArgs* args, Val* val,
                              Val** result) {
   StringVal* str = val->as_string();
+  szl_float f;
+  if (ParseFloat(str->base(), str->length(), &f)) {
+    *result = Factory::NewFloat(proc, f);
+    return NULL;
+  }
   // Create NUL-terminated string
-  char buf[64];
+  char buf[kNumberBufSize];
   char* p = str->c_str(buf, sizeof buf);
   errno = 0;
   double d = strtod(buf, &p);
@@ -469,8 +667,13 @@ static const char* Str2Float(Proc* proc, CvtArgs* args, Val* val,
 
 static const char* Str2Int(Proc* proc, CvtArgs* args, Val* val, Val** result) {
   StringVal* str = val->as_string();
+  szl_int value;
+  if (ParseInt(str->base(), str->length(), args->base_, &value)) {
+    *result = Factory::NewInt(proc, value);
+    return NULL;
+  }
   // Create NUL-terminated string
-  char buf[64];
+  char buf[kNumberBufSize];
   char* p = str->c_str(buf, sizeof buf);
   errno = 0;
   assert(args->base_ == 0 || (2 <= args->base_ && args->base_ <= 36));
@@ -488,8 +691,13 @@ static const char* Str2Int(Proc* proc, CvtArgs* args, Val* val, Val** result) {
 
 static const char* Str2UInt(Proc* proc, CvtArgs* args, Val* val, Val** result) {
   StringVal* str = val->as_string();
+  szl_uint value;
+  if (ParseUInt(str->base(), str->length(), args->base_, &value)) {
+    *result = Factory::NewUInt(proc, value);
+    return NULL;
+  }
   // Create NUL-terminated string
-  char buf[64];
+  char buf[kNumberBufSize];
   char* p = str->c_str(buf, sizeof buf);
   errno = 0;
   assert(args->base_ == 0 || (2 <= args->base_ && args->base_ <= 36));
@@ -1170,6 +1378,79 @@ const char* ConvOp::ConvertBasic(Proc* proc, ConversionOp op, Val**& sp,
 }
 
 
+// Bulk kernels for converting whole arrays of strings to numbers.  Each
+// element goes through the in-place parser directly; only the elements it
+// rejects take the general per-element conversion.
+struct IntParser {
+  static bool Parse(Proc* proc, CvtArgs* args, Val* val, Val** result) {
+    StringVal* str = val->as_string();
+    szl_int i;
+    if (!ParseInt(str->base(), str->length(), args->base_, &i))
+      return false;
+    *result = Factory::NewInt(proc, i);
+    return true;
+  }
+};
+
+
+struct UIntParser {
+  static bool Parse(Proc* proc, CvtArgs* args, Val* val, Val** result) {
+    StringVal* str = val->as_string();
+    szl_uint ui;
+    if (!ParseUInt(str->base(), str->length(), args->base_, &ui))
+      return false;
+    *result = Factory::NewUInt(proc, ui);
+    return true;
+  }
+};
+
+
+struct FloatParser {
+  static bool Parse(Proc* proc, CvtArgs* args, Val* val, Val** result) {
+    StringVal* str = val->as_string();
+    szl_float f;
+    if (!ParseFloat(str->base(), str->length(), &f))
+      return false;
+    *result = Factory::NewFloat(proc, f);
+    return true;
+  }
+};
+
+
+// Used for all other conversions.
+struct NoParser {
+  static bool Parse(Proc* proc, CvtArgs* args, Val* val, Val** result) {
+    return false;
+  }
+};
+
+
+// Converts the elements of a into result, which has the same length.
+template <class Parser>
+static const char* ConvertElements(Proc* proc, CvtArgs* args,
+                                   ConversionAttributes* attributes,
+                                   ArrayVal* a, ArrayVal* result,
+                                   bool free_elements) {
+  const int len = a->length();
+  const char* error = NULL;
+  ConversionAttributes::Convert convert = attributes->convert;
+  // Make sure every element is set, even if just to undefined.
+  for (int i = 0; i < len; i++) {
+    Val*& element = a->at(i);
+    if (!error && !Parser::Parse(proc, args, element, &result->at(i)))
+      error = (*convert)(proc, args, element, &result->at(i));
+    if (error)
+      result->at(i) = NULL;
+    assert(error == NULL || attributes->can_fail);
+    if (free_elements) {
+      element->dec_ref();
+      element = NULL;
+    }
+  }
+  return error;
+}
+
+
 const char* ConvOp::ConvertArray(Proc* proc, ConversionOp op, Val**& sp,
                                  ArrayType* type) {
   ArrayVal* a = Engine::pop_array(sp);
@@ -1194,20 +1475,23 @@ const char* ConvOp::ConvertArray(Proc* proc, ConversionOp op, Val**& sp,
   }
 
   ArrayVal* result = result_type->form()->NewVal(proc, len);
-  error = NULL;
-  ConversionAttributes::Convert convert = attributes->convert;
-  // Make sure every element is set, even if just to undefined.
-  for (int i = 0; i < len; i++) {
-    Val*& element = a->at(i);
-    if (!error)
-      error = (*convert)(proc, &args, element, &result->at(i));
-    if (error)
-      result->at(i) = NULL;
-    assert(error == NULL || attributes->can_fail);
-    if (free_elements) {
-      element->dec_ref();
-      element = NULL;
-    }
+  switch (op) {
+    case str2int:
+      error = ConvertElements<IntParser>(proc, &args, attributes, a, result,
+                                         free_elements);
+      break;
+    case str2uint:
+      error = ConvertElements<UIntParser>(proc, &args, attributes, a, result,
+                                          free_elements);
+      break;
+    case str2float:
+      error = ConvertElements<FloatParser>(proc, &args, attributes, a, result,
+                                           free_elements);
+      break;
+    default:
+      error = ConvertElements<NoParser>(proc, &args, attributes, a, result,
+                                        free_elements);
+      break;
   }
 
   a->dec_ref();
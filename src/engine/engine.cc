@@ -54,6 +54,7 @@
 #include "engine/val.h"
 #include "engine/factory.h"
 #include "engine/gctrigger.h"
+#include "engine/sharedstatics.h"
 #include "engine/engine.h"
 
 
@@ -598,6 +599,20 @@ Proc::Status Engine::Execute(Proc* proc, int max_steps, int* num_steps,
           }
           break;
 
+        case shareS:
+          { // the static variable was initialized by SharedStatics;
+            // use its read-only value and skip the initializer
+            int var_i = var_index(pc);
+            int offs = Code::pcoff_at(pc);
+            if (proc->shared_statics() != NULL) {
+              Val* v = proc->shared_statics()->at(var_i);
+              v->inc_ref();
+              bp->at(var_i) = v;
+              pc += offs;
+            }
+          }
+          break;
+
         case fstoreV:
           { TupleVal* t = pop_tuple(sp);
             t->dec_ref();
@@ -1718,6 +1733,8 @@ Proc::Status Engine::Execute(Proc* proc, int max_steps, int* num_steps,
         case callc:
           { // use a temporary so we don't force sp into memory
             Val** tmp = sp;
+            // frames pushed by Proc::CallClosure link to this one
+            proc->state_.fp_ = fp;
             proc->trap_info_ = (*(Intrinsic::CFunctionCanFail)
                                 Code::ptr_at(pc))(proc, tmp);
             sp = tmp;
@@ -1766,8 +1783,10 @@ Proc::Status Engine::Execute(Proc* proc, int max_steps, int* num_steps,
             if (pc == NULL) {
               // The return address can be null even for a
               // value-returning function, if the value-returning
-              // function is being invoked by Proc::DoCall.
-              CHECK(proc->mode_ & kDoCalls)
+              // function is being invoked by Proc::DoCall or
+              // Proc::CallClosure.
+              CHECK((proc->mode_ & kDoCalls) ||
+                    proc->closure_call_depth() > 0)
                   << "return address of a value-returning function "
                   << "unexpectedly null";
               SAVE_STATE(Proc::TERMINATED, -cycle_count);
@@ -73,6 +73,11 @@ void Form::Delete(Proc* proc, Val* v) {
 }
 
 
+void Form::Freeze(Proc* proc, Val* v) {
+  v->set_readonly();
+}
+
+
 // ----------------------------------------------------------------------------
 // Implementation of BoolForm
 
@@ -473,6 +478,19 @@ BytesVal* BytesForm::NewValInit(Proc* proc, int length, const char* x) {
 }
 
 
+BytesVal* BytesForm::NewMappedVal(Proc* proc, int fd, int length) {
+  BytesVal* v = static_cast<BytesVal*>(
+      proc->heap()->AllocMapped(fd, length, sizeof(BytesVal)));
+  if (v == NULL)
+    return NULL;
+  v->form_ = this;
+  v->ref_ = 1;
+  v->SetRange(0, length);
+  v->array_ = v;
+  return v;
+}
+
+
 // TODO: this is almost identical to the other NewSlices; fold them together
 BytesVal* BytesForm::NewSlice(Proc* proc, BytesVal* v, int origin, int length) {
   assert(v->ref() > 0);
@@ -516,6 +534,13 @@ void BytesForm::CheckHeapPtrs(Proc* proc, Val* v) {
 }
 
 
+void BytesForm::Freeze(Proc* proc, Val* v) {
+  BytesVal* b = v->as_bytes();
+  b->set_readonly();
+  b->array_->set_readonly();
+}
+
+
 int BytesForm::Format(Proc* proc, Fmt::State* f, Val* v) const {
   BytesVal* b = v->as_bytes();
   bool is_ascii = true;
@@ -728,14 +753,22 @@ void StringForm::AdjustHeapPtrs(Proc* proc, Val* v) {
 void StringForm::CheckHeapPtrs(Proc* proc, Val* v) {
   CHECK_GT(v->ref(), 0);
   StringVal* s = v->as_string();
-  if (s->is_slice()) {
-    CHECK(!v->is_readonly());
+  if (v->is_readonly())
+    return;  // frozen strings may be slices and have maps in another heap
+  if (s->is_slice())
     proc->heap()->CheckPtr(s->slice_.array);
-  }
-  if (s->map_ != NULL && s->map_ != &StringVal::ASCIIMap) {
-    CHECK(!v->is_readonly());
+  if (s->map_ != NULL && s->map_ != &StringVal::ASCIIMap)
     proc->heap()->CheckPtr(s->map_);
-  }
+}
+
+
+void StringForm::Freeze(Proc* proc, Val* v) {
+  StringVal* s = v->as_string();
+  // the offset map would otherwise be allocated by the Proc reading it
+  s->AllocateOffsetMap(proc);
+  s->set_readonly();
+  if (s->is_slice())
+    s->slice_.array->set_readonly();
 }
 
 
@@ -896,6 +929,18 @@ void ArrayForm::CheckHeapPtrs(Proc* proc, Val* v) {
 }
 
 
+void ArrayForm::Freeze(Proc* proc, Val* v) {
+  ArrayVal* av = v->as_array();
+  av->set_readonly();
+  if (av->array_ == av) {
+    for (int i = av->length(); i-- > 0; )
+      av->at(i)->Freeze(proc);
+  } else {
+    av->array_->Freeze(proc);
+  }
+}
+
+
 int ArrayForm::Format(Proc* proc, Fmt::State* f, Val* v) const {
   ArrayVal* a = v->as_array();
   const int n = a->length();
@@ -1024,6 +1069,13 @@ void MapForm::CheckHeapPtrs(Proc* proc, Val* v) {
 }
 
 
+void MapForm::Freeze(Proc* proc, Val* v) {
+  MapVal* mv = v->as_map();
+  mv->set_readonly();
+  mv->map_->Freeze();
+}
+
+
 int MapForm::Format(Proc* proc, Fmt::State* f, Val* v) const {
   return v->as_map()->map()->FmtMap(f);
 }
@@ -1035,7 +1087,7 @@ Val* MapForm::Uniq(Proc* proc, Val* v) const {
     // make a copy
     TRACE_REF("uniquing map", m);
     MapVal* newval = m->type()->as_map()->form()->NewVal(proc);
-    newval->set_map(m->map()->Clone());  // the implementation is in map.cc
+    newval->set_map(m->map()->Clone(proc));  // the implementation is in map.cc
     m->dec_ref();
     m = newval;
   }
@@ -1153,6 +1205,16 @@ void TupleForm::CheckHeapPtrs(Proc* proc, Val* v) {
 }
 
 
+void TupleForm::Freeze(Proc* proc, Val* v) {
+  TupleVal* t = v->as_tuple();
+  t->set_readonly();
+  Val** slots = t->base();
+  int nslots = t->type()->as_tuple()->nslots();
+  for (int i = 0; i < nslots; i++)
+    slots[i]->Freeze(proc);
+}
+
+
 int TupleForm::Format(Proc* proc, Fmt::State* f, Val* v) const {
   TupleVal* t = v->as_tuple();
   // Emit all fields, even if unreferenced.
@@ -45,6 +45,8 @@ class Form {
   virtual void Delete(Proc* proc, Val* v);
   virtual void AdjustHeapPtrs(Proc* proc, Val* v) {}
   virtual void CheckHeapPtrs(Proc* proc, Val* v) {}
+  // make v and the values it references read-only (see Val::Freeze())
+  virtual void Freeze(Proc* proc, Val* v);
 
   // 64-bit value of a basic64 Val
   virtual uint64 basic64(Val* v) const { ShouldNotReachHere(); return 0; }
@@ -199,11 +201,15 @@ class BytesForm: public Form {
   // allocation
   BytesVal* NewVal(Proc* proc, int length);
   BytesVal* NewValInit(Proc* proc, int length, const char* x);
+  // The contents are the first length bytes of the open file fd, mapped
+  // rather than copied; returns NULL if the file cannot be mapped.
+  BytesVal* NewMappedVal(Proc* proc, int fd, int length);
   // See ref count issues discussed below for StringForm::NewSlice().
   BytesVal* NewSlice(Proc* proc, BytesVal* v, int origin, int length);
   virtual void Delete(Proc* proc, Val* v);
   virtual void AdjustHeapPtrs(Proc* proc, Val* v);
   virtual void CheckHeapPtrs(Proc* proc, Val* v);
+  virtual void Freeze(Proc* proc, Val* v);
 
   // Val interface
   virtual bool IsEqual(Val* v1, Val* v2) const;
@@ -233,6 +239,7 @@ class StringForm: public Form {
   virtual void Delete(Proc* proc, Val* v);
   virtual void AdjustHeapPtrs(Proc* proc, Val* v);
   virtual void CheckHeapPtrs(Proc* proc, Val* v);
+  virtual void Freeze(Proc* proc, Val* v);
 
   // Val interface
   virtual bool IsEqual(Val* v1, Val* v2) const;
@@ -258,6 +265,7 @@ class ArrayForm: public Form {
   virtual void Delete(Proc* proc, Val* v);
   virtual void AdjustHeapPtrs(Proc* proc, Val* v);
   virtual void CheckHeapPtrs(Proc* proc, Val* v);
+  virtual void Freeze(Proc* proc, Val* v);
 
   // Val interface
   virtual bool IsEqual(Val* v1, Val* v2) const;
@@ -281,6 +289,7 @@ class MapForm: public Form {
   virtual void Delete(Proc* proc, Val* v);
   virtual void AdjustHeapPtrs(Proc* proc, Val* v);
   virtual void CheckHeapPtrs(Proc* proc, Val* v);
+  virtual void Freeze(Proc* proc, Val* v);
 
   // Val interface
   virtual bool IsEqual(Val* v1, Val* v2) const;
@@ -302,6 +311,7 @@ class TupleForm: public Form {
   virtual void Delete(Proc* proc, Val* v);
   virtual void AdjustHeapPtrs(Proc* proc, Val* v);
   virtual void CheckHeapPtrs(Proc* proc, Val* v);
+  virtual void Freeze(Proc* proc, Val* v);
 
   // Val interface
   virtual bool IsEqual(Val* v1, Val* v2) const;
@@ -27,12 +27,21 @@ GCTrigger::GCTrigger(Memory* heap, int* num_steps, int* cycle_count)
       num_steps_(num_steps),
       cycle_count_(cycle_count),
       stop_for_gc_(false) {
+  // If the interpreter was re-entered from an intrinsic (see
+  // Proc::CallClosure), the innermost loop runs the GC, taking over a
+  // GC the outer loop was stopping for; the intrinsic keeps its Vals on
+  // the stack, where compaction adjusts them.
+  outer_ = heap_->gctrigger();
   heap_->RegisterGCTrigger(this);
+  if (outer_ != NULL && outer_->stop_for_gc_) {
+    outer_->stop_for_gc_ = false;
+    SetupStopForGC();
+  }
 }
 
 
 GCTrigger::~GCTrigger() {
-  heap_->RegisterGCTrigger(NULL);
+  heap_->RegisterGCTrigger(outer_);
 }
 
 
@@ -34,6 +34,7 @@ class GCTrigger {
   int* num_steps_;    // interpreter loop counters that must be adjusted
   int* cycle_count_;
   bool stop_for_gc_;  // indicates we want to stop for GC
+  GCTrigger* outer_;  // trigger of an enclosing interpreter loop, if any
 };
 
 }  // end namespace sawzall
@@ -34,9 +34,11 @@
 #include "engine/globals.h"
 #include "public/logging.h"
 #include "public/hashutils.h"
+#include "public/hash_map.h"
 
 #include "utilities/strutils.h"
 #include "utilities/timeutils.h"
+#include "utilities/literalset.h"
 
 #include "engine/memory.h"
 #include "engine/utils.h"
@@ -56,6 +58,7 @@
 #include "engine/factory.h"
 #include "engine/engine.h"
 #include "engine/ir.h"
+#include "engine/matchset.h"
 
 namespace sawzall {
 
@@ -458,12 +461,12 @@ static const char* addday(Proc* proc, Val**& sp) {
   Engine::pop_c_str(proc, sp, tz, sizeof(tz));
   struct tm tm;
   int microsec;
-  if (!SzlTimeToLocalTime(time, tz, &tm, &microsec, NULL))
+  if (!proc->time_zone_cache()->ToLocalTime(time, tz, &tm, &microsec))
     return proc->PrintError("addday: invalid time or time zone %q "
                             "was not recognized", tz);
   tm.tm_mday += delta;
   szl_time t;
-  if (!LocalTimeToSzlTime(tm, microsec, tz, false, &t))
+  if (!proc->time_zone_cache()->ToSzlTime(tm, microsec, tz, &t))
     return proc->PrintError("addday: result time was out of range");
   Engine::push(sp, Factory::NewTime(proc, t));
   return NULL;
@@ -480,12 +483,12 @@ static const char* addmonth(Proc* proc, Val**& sp) {
   Engine::pop_c_str(proc, sp, tz, sizeof(tz));
   struct tm tm;
   int microsec;
-  if (!SzlTimeToLocalTime(time, tz, &tm, &microsec, NULL))
+  if (!proc->time_zone_cache()->ToLocalTime(time, tz, &tm, &microsec))
     return proc->PrintError("addmonth: invalid time or time zone %q "
                             "was not recognized", tz);
   tm.tm_mon += delta;
   szl_time t;
-  if (!LocalTimeToSzlTime(tm, microsec, tz, false, &t))
+  if (!proc->time_zone_cache()->ToSzlTime(tm, microsec, tz, &t))
     return proc->PrintError("addmonth: result time was out of range");
   Engine::push(sp, Factory::NewTime(proc, t));
   return NULL;
@@ -502,12 +505,12 @@ static const char* addweek(Proc* proc, Val**& sp) {
   Engine::pop_c_str(proc, sp, tz, sizeof(tz));
   struct tm tm;
   int microsec;
-  if (!SzlTimeToLocalTime(time, tz, &tm, &microsec, NULL))
+  if (!proc->time_zone_cache()->ToLocalTime(time, tz, &tm, &microsec))
     return proc->PrintError("addweek: invalid time or time zone %q "
                             "was not recognized", tz);
   tm.tm_mday += 7 * delta;
   szl_time t;
-  if (!LocalTimeToSzlTime(tm, microsec, tz, false, &t))
+  if (!proc->time_zone_cache()->ToSzlTime(tm, microsec, tz, &t))
     return proc->PrintError("addweek: result time was out of range");
   Engine::push(sp, Factory::NewTime(proc, t));
   return NULL;
@@ -524,12 +527,12 @@ static const char* addyear(Proc* proc, Val**& sp) {
   Engine::pop_c_str(proc, sp, tz, sizeof(tz));
   struct tm tm;
   int microsec;
-  if (!SzlTimeToLocalTime(time, tz, &tm, &microsec, NULL))
+  if (!proc->time_zone_cache()->ToLocalTime(time, tz, &tm, &microsec))
     return proc->PrintError("addyear: invalid time or time zone %q "
                             "was not recognized", tz);
   tm.tm_year += delta;
   szl_time t;
-  if (!LocalTimeToSzlTime(tm, microsec, tz, false, &t))
+  if (!proc->time_zone_cache()->ToSzlTime(tm, microsec, tz, &t))
     return proc->PrintError("addyear: result time was out of range");
   Engine::push(sp, Factory::NewTime(proc, t));
   return NULL;
@@ -545,7 +548,7 @@ static const char* dayofweek(Proc* proc, Val**& sp) {
   char tz[kMaxTimeZoneStringLen + 2];  // +2: prevent accidental matches
   Engine::pop_c_str(proc, sp, tz, sizeof(tz));
   struct tm tm;
-  if (!SzlTimeToLocalTime(time, tz, &tm, NULL, NULL))
+  if (!proc->time_zone_cache()->ToLocalTime(time, tz, &tm, NULL))
     return proc->PrintError("dayofweek: invalid time or time zone %q "
                             "was not recognized", tz);
   int day = tm.tm_wday;
@@ -566,7 +569,7 @@ static const char* dayofmonth(Proc* proc, Val**& sp) {
   char tz[kMaxTimeZoneStringLen + 2];  // +2: prevent accidental matches
   Engine::pop_c_str(proc, sp, tz, sizeof(tz));
   struct tm tm;
-  if (!SzlTimeToLocalTime(time, tz, &tm, NULL, NULL))
+  if (!proc->time_zone_cache()->ToLocalTime(time, tz, &tm, NULL))
     return proc->PrintError("dayofmonth: invalid time or time zone %q "
                             "was not recognized", tz);
   Engine::push_szl_int(sp, proc, tm.tm_mday); // already 1-indexed
@@ -583,7 +586,7 @@ static const char* dayofyear(Proc* proc, Val**& sp) {
   char tz[kMaxTimeZoneStringLen + 2];  // +2: prevent accidental matches
   Engine::pop_c_str(proc, sp, tz, sizeof(tz));
   struct tm tm;
-  if (!SzlTimeToLocalTime(time, tz, &tm, NULL, NULL))
+  if (!proc->time_zone_cache()->ToLocalTime(time, tz, &tm, NULL))
     return proc->PrintError("dayofyear: invalid time or time zone %q "
                             "was not recognized", tz);
   Engine::push_szl_int(sp, proc, tm.tm_yday + 1);
@@ -739,7 +742,7 @@ static const char* hourof(Proc* proc, Val**& sp) {
   char tz[kMaxTimeZoneStringLen + 2];  // +2: prevent accidental matches
   Engine::pop_c_str(proc, sp, tz, sizeof(tz));
   struct tm tm;
-  if (!SzlTimeToLocalTime(time, tz, &tm, NULL, NULL))
+  if (!proc->time_zone_cache()->ToLocalTime(time, tz, &tm, NULL))
     return proc->PrintError("hourof: invalid time or time zone %q "
                             "was not recognized", tz);
   Engine::push_szl_int(sp, proc, tm.tm_hour);
@@ -839,23 +842,107 @@ const char* FileContents(Proc* proc, const char* name, string* contents) {
 }
 
 
+// Make a bytes value holding the entire contents of a file.  Regular files
+// are mapped into the heap rather than copied; anything else (or a file that
+// cannot be mapped) is read.  Return value is error string.
+static const char* LoadFile(Proc* proc, const char* name, BytesVal** result) {
+  const char* security_error = CheckFileReadPermissions(proc, name);
+  if (security_error != NULL)
+    return security_error;
+  int fd = open(name, O_RDONLY);
+  if (fd < 0)
+    return proc->PrintError("can't open %s: %r", name);
+  struct stat status;
+  if (fstat(fd, &status) != 0) {
+    const char* error = proc->PrintError("can't stat %s: %r", name);
+    close(fd);
+    return error;
+  }
+  off_t size = status.st_size;
+  if (size > kint32max) {
+    close(fd);
+    return proc->PrintError("can't load %s: %lld bytes is too large",
+                            name, size);
+  }
+  BytesVal* v = NULL;
+  if (S_ISREG(status.st_mode))
+    v = SymbolTable::bytes_form()->NewMappedVal(proc, fd, size);
+  if (v == NULL) {
+    v = SymbolTable::bytes_form()->NewVal(proc, size);
+    off_t nbytes = 0;
+    while (nbytes < size) {
+      ssize_t n = read(fd, v->base() + nbytes, size - nbytes);
+      if (n <= 0)
+        break;
+      nbytes += n;
+    }
+    if (nbytes != size) {
+      v->dec_ref();
+      close(fd);
+      return proc->PrintError("short read on %s: expected %lld; read %lld\n",
+                              name, size, nbytes);
+    }
+  }
+  close(fd);
+  *result = v;
+  return NULL;
+}
+
+
 static const char load_doc[] =
   "Return the entire contents of the named file as an uninterpreted byte "
   "stream. Returns undef if the file cannot be opened or read";
 
 static const char* load(Proc* proc, Val**& sp) {
   string filename = Engine::pop_cpp_string(proc, sp);
-  string contents;
-  const char* err = FileContents(proc, filename.c_str(), &contents);
+  BytesVal* v;
+  const char* err = LoadFile(proc, filename.c_str(), &v);
   if (err != NULL)
     return err;
-  BytesVal *v = SymbolTable::bytes_form()->NewValInit(proc, contents.size(),
-                                                      contents.c_str());
   Engine::push(sp, v);
   return NULL;
 }
 
 
+static const char loadlines_doc[] =
+  "Return the lines of the named file as an array of uninterpreted byte "
+  "streams, without their terminating newlines. The lines share the "
+  "storage of the file contents. Returns undef if the file cannot be "
+  "opened or read";
+
+static const char* loadlines(Proc* proc, Val**& sp) {
+  string filename = Engine::pop_cpp_string(proc, sp);
+  BytesVal* contents;
+  const char* err = LoadFile(proc, filename.c_str(), &contents);
+  if (err != NULL)
+    return err;
+
+  // Find the line boundaries first, so the array can be allocated once.
+  const char* base = contents->base();
+  const int length = contents->length();
+  vector<int> ends;
+  for (int p = 0; p < length; ) {
+    const char* q =
+        static_cast<const char*>(memchr(base + p, '\n', length - p));
+    const int end = (q != NULL) ? q - base : length;
+    ends.push_back(end);
+    p = end + 1;
+  }
+
+  ArrayVal* lines = Factory::NewBytesArray(proc, ends.size());
+  int origin = 0;
+  for (size_t i = 0; i < ends.size(); i++) {
+    contents->inc_ref();  // NewSlice() calls dec_ref(), compensate for that.
+    lines->at(i) = SymbolTable::bytes_form()->NewSlice(proc, contents, origin,
+                                                       ends[i] - origin);
+    origin = ends[i] + 1;
+  }
+  contents->dec_ref();
+  Engine::push(sp, lines);
+  return NULL;
+}
+
+
 static const char lookup_doc[] =
   "Return the element of the map indexed by the key or, if there "
   "is no such element, the specified default value. Assuming the "
@@ -1033,7 +1120,24 @@ const char* Intrinsics::Match(Proc* proc, Val**& sp, void* pattern) {
     pattern = entry->compiled();
   }
   assert(pattern != NULL);
-  int result = SimpleExecRegexp(pattern, str->base(), str->length());
+  int result;
+  const MatchSet* match_set = proc->match_set();
+  MatchSet::Result prefilter = MatchSet::UNKNOWN;
+  if (match_set != NULL)
+    prefilter = match_set->Lookup(pattern, str->base(), str->length(),
+                                  proc->match_scan());
+  switch (prefilter) {
+    case MatchSet::NO_MATCH:
+      result = 0;
+      break;
+    case MatchSet::MATCH:
+      result = 1;
+      break;
+    default:
+      result = SimpleExecRegexp(pattern, str->base(), str->length(),
+                                proc->regexp_scratch());
+      break;
+  }
   if (entry != NULL)
     re_cache->Release(entry);
   if (result < 0) {  // a internal regexp engine error occured
@@ -1083,7 +1187,8 @@ const char* Intrinsics::Matchposns(Proc* proc, Val**& sp, void* pattern) {
   }
   // Make DualString so we can recover Rune offsets.
   DualString dual(str->base(), str->length(), str->num_runes());
-  nvec = DualExecRegexp(pattern, &dual, vecp, byte_vecp, nvec);
+  nvec = DualExecRegexp(pattern, &dual, vecp, byte_vecp, nvec,
+                        proc->regexp_scratch());
   if (entry != NULL)
     re_cache->Release(entry);
   if (nvec < 0) {  // a internal regexp engine error occured
@@ -1141,7 +1246,8 @@ const char* Intrinsics::Matchstrs(Proc* proc, Val**& sp, void* pattern) {
   }
   // Make DualString so we can recover Rune offsets.
   DualString dual(str->base(), str->length(), str->num_runes());
-  nvec = DualExecRegexp(pattern, &dual, vecp, byte_vecp, nvec);
+  nvec = DualExecRegexp(pattern, &dual, vecp, byte_vecp, nvec,
+                        proc->regexp_scratch());
   if (entry != NULL)
     re_cache->Release(entry);
   if (nvec < 0) { // a internal regexp engine error occured
@@ -1188,7 +1294,7 @@ static const char* minuteof(Proc* proc, Val**& sp) {
   char tz[kMaxTimeZoneStringLen + 2];  // +2: prevent accidental matches
   Engine::pop_c_str(proc, sp, tz, sizeof(tz));
   struct tm tm;
-  if (!SzlTimeToLocalTime(time, tz, &tm, NULL, NULL))
+  if (!proc->time_zone_cache()->ToLocalTime(time, tz, &tm, NULL))
     return proc->PrintError("minuteof: invalid time or time zone %q "
                             "was not recognized", tz);
   Engine::push_szl_int(sp, proc, tm.tm_min);
@@ -1205,7 +1311,7 @@ static const char* monthof(Proc* proc, Val**& sp) {
   char tz[kMaxTimeZoneStringLen + 2];  // +2: prevent accidental matches
   Engine::pop_c_str(proc, sp, tz, sizeof(tz));
   struct tm tm;
-  if (!SzlTimeToLocalTime(time, tz, &tm, NULL, NULL))
+  if (!proc->time_zone_cache()->ToLocalTime(time, tz, &tm, NULL))
     return proc->PrintError("monthof: invalid time or time zone %q "
                             "was not recognized", tz);
   Engine::push_szl_int(sp, proc, tm.tm_mon + 1);
@@ -1224,6 +1330,89 @@ static void now(Proc* proc, Val**& sp) {
 }
 
 
+// Write v in decimal, padded to width with pad.
+static char* PutPadded(char* p, int v, int width, char pad) {
+  char digits[16];
+  int n = 0;
+  do {
+    digits[n++] = '0' + v % 10;
+    v /= 10;
+  } while (v > 0);
+  for (int i = n; i < width; i++)
+    *p++ = pad;
+  while (n > 0)
+    *p++ = digits[--n];
+  return p;
+}
+
+
+// Format tm like strftime() if fmt uses only the numeric conversions
+// below, which depend neither on the locale nor on the time zone name.
+// Returns the length of the result, or -1 if strftime() is needed.
+static int FormatTimeFast(const char* fmt, const struct tm& tm,
+                          char* buf, int size) {
+  const int kMaxConversionLen = 16;  // longest output of one conversion
+  char* p = buf;
+  for (; *fmt != '\0'; fmt++) {
+    if (p + kMaxConversionLen > buf + size)
+      return -1;
+    if (*fmt != '%') {
+      *p++ = *fmt;
+      continue;
+    }
+    switch (*++fmt) {
+      case 'Y':
+        p = PutPadded(p, tm.tm_year + 1900, 1, '0');
+        break;
+      case 'y':
+        p = PutPadded(p, (tm.tm_year + 1900) % 100, 2, '0');
+        break;
+      case 'm':
+        p = PutPadded(p, tm.tm_mon + 1, 2, '0');
+        break;
+      case 'd':
+        p = PutPadded(p, tm.tm_mday, 2, '0');
+        break;
+      case 'e':
+        p = PutPadded(p, tm.tm_mday, 2, ' ');
+        break;
+      case 'j':
+        p = PutPadded(p, tm.tm_yday + 1, 3, '0');
+        break;
+      case 'H':
+        p = PutPadded(p, tm.tm_hour, 2, '0');
+        break;
+      case 'M':
+        p = PutPadded(p, tm.tm_min, 2, '0');
+        break;
+      case 'S':
+        p = PutPadded(p, tm.tm_sec, 2, '0');
+        break;
+      case 'F':  // %Y-%m-%d
+        p = PutPadded(p, tm.tm_year + 1900, 1, '0');
+        *p++ = '-';
+        p = PutPadded(p, tm.tm_mon + 1, 2, '0');
+        *p++ = '-';
+        p = PutPadded(p, tm.tm_mday, 2, '0');
+        break;
+      case 'T':  // %H:%M:%S
+        p = PutPadded(p, tm.tm_hour, 2, '0');
+        *p++ = ':';
+        p = PutPadded(p, tm.tm_min, 2, '0');
+        *p++ = ':';
+        p = PutPadded(p, tm.tm_sec, 2, '0');
+        break;
+      case '%':
+        *p++ = '%';
+        break;
+      default:
+        return -1;
+    }
+  }
+  return p - buf;
+}
+
+
 static const char formattime_doc[] =
   "Return a string containing the time argument formatted according to the "
   "format string fmt. The syntax of the format string is the same as in "
@@ -1236,12 +1425,17 @@ static const char* formattime(Proc* proc, Val**& sp) {
   Engine::pop_c_str(proc, sp, tz, sizeof(tz));
 
   struct tm ttm;
-  if (!SzlTimeToLocalTime(time, tz, &ttm, NULL, NULL))
-    return proc->PrintError("formattime: invalid time or time zone %q "
-                            "was not recognized", tz);
-
   char result[200];
-  size_t len = strftime(result, sizeof(result) - 1, afmt.c_str(), &ttm);
+  int len = -1;
+  if (proc->time_zone_cache()->ToLocalTime(time, tz, &ttm, NULL))
+    len = FormatTimeFast(afmt.c_str(), ttm, result, sizeof(result) - 1);
+  if (len < 0) {
+    // Other conversions need the fields only gmtime_r() fills in.
+    if (!SzlTimeToLocalTime(time, tz, &ttm, NULL, NULL))
+      return proc->PrintError("formattime: invalid time or time zone %q "
+                              "was not recognized", tz);
+    len = strftime(result, sizeof(result) - 1, afmt.c_str(), &ttm);
+  }
   if (len == 0)
     return proc->PrintError("formattime: result too long");
   StringVal* v = Factory::NewStringBytes(proc, len, result);
@@ -1297,7 +1491,7 @@ static const char* secondof(Proc* proc, Val**& sp) {
   char tz[kMaxTimeZoneStringLen + 2];  // +2: prevent accidental matches
   Engine::pop_c_str(proc, sp, tz, sizeof(tz));
   struct tm tm;
-  if (!SzlTimeToLocalTime(time, tz, &tm, NULL, NULL))
+  if (!proc->time_zone_cache()->ToLocalTime(time, tz, &tm, NULL))
     return proc->PrintError("secondof: invalid time or time zone %q "
                             "was not recognized", tz);
   Engine::push_szl_int(sp, proc, tm.tm_sec);
@@ -1596,14 +1790,14 @@ static const char* trunctoday(Proc* proc, Val**& sp) {
   char tz[kMaxTimeZoneStringLen + 2];  // +2: prevent accidental matches
   Engine::pop_c_str(proc, sp, tz, sizeof(tz));
   struct tm tm;
-  if (!SzlTimeToLocalTime(time, tz, &tm, NULL, NULL))
+  if (!proc->time_zone_cache()->ToLocalTime(time, tz, &tm, NULL))
     return proc->PrintError("trunctoday: invalid time or time zone %q "
                             "was not recognized", tz);
   tm.tm_sec = 0;
   tm.tm_min = 0;
   tm.tm_hour = 0;
   szl_time t;
-  if (!LocalTimeToSzlTime(tm, 0, tz, false, &t))
+  if (!proc->time_zone_cache()->ToSzlTime(tm, 0, tz, &t))
     return proc->PrintError("trunctoday: result time was out of range");
   Engine::push(sp, Factory::NewTime(proc, t));
   return NULL;
@@ -1618,13 +1812,13 @@ static const char* trunctohour(Proc* proc, Val**& sp) {
   char tz[kMaxTimeZoneStringLen + 2];  // +2: prevent accidental matches
   Engine::pop_c_str(proc, sp, tz, sizeof(tz));
   struct tm tm;
-  if (!SzlTimeToLocalTime(time, tz, &tm, NULL, NULL))
+  if (!proc->time_zone_cache()->ToLocalTime(time, tz, &tm, NULL))
     return proc->PrintError("trunctohour: invalid time or time zone %q "
                             "was not recognized", tz);
   tm.tm_sec = 0;
   tm.tm_min = 0;
   szl_time t;
-  if (!LocalTimeToSzlTime(tm, 0, tz, false, &t))
+  if (!proc->time_zone_cache()->ToSzlTime(tm, 0, tz, &t))
     return proc->PrintError("trunctohour: result time was out of range");
   Engine::push(sp, Factory::NewTime(proc, t));
   return NULL;
@@ -1639,12 +1833,12 @@ static const char* trunctominute(Proc* proc, Val**& sp) {
   char tz[kMaxTimeZoneStringLen + 2];  // +2: prevent accidental matches
   Engine::pop_c_str(proc, sp, tz, sizeof(tz));
   struct tm tm;
-  if (!SzlTimeToLocalTime(time, tz, &tm, NULL, NULL))
+  if (!proc->time_zone_cache()->ToLocalTime(time, tz, &tm, NULL))
     return proc->PrintError("trunctominute: invalid time or time zone %q "
                             "was not recognized", tz);
   tm.tm_sec = 0;
   szl_time t;
-  if (!LocalTimeToSzlTime(tm, 0, tz, false, &t))
+  if (!proc->time_zone_cache()->ToSzlTime(tm, 0, tz, &t))
     return proc->PrintError("trunctominute: result time was out of range");
   Engine::push(sp, Factory::NewTime(proc, t));
   return NULL;
@@ -1659,7 +1853,7 @@ static const char* trunctomonth(Proc* proc, Val**& sp) {
   char tz[kMaxTimeZoneStringLen + 2];  // +2: prevent accidental matches
   Engine::pop_c_str(proc, sp, tz, sizeof(tz));
   struct tm tm;
-  if (!SzlTimeToLocalTime(time, tz, &tm, NULL, NULL))
+  if (!proc->time_zone_cache()->ToLocalTime(time, tz, &tm, NULL))
     return proc->PrintError("trunctomonth: invalid time or time zone %q "
                             "was not recognized", tz);
   tm.tm_sec = 0;
@@ -1667,7 +1861,7 @@ static const char* trunctomonth(Proc* proc, Val**& sp) {
   tm.tm_hour = 0;
   tm.tm_mday = 1;
   szl_time t;
-  if (!LocalTimeToSzlTime(tm, 0, tz, false, &t))
+  if (!proc->time_zone_cache()->ToSzlTime(tm, 0, tz, &t))
     return proc->PrintError("trunctomonth: result time was out of range");
   Engine::push(sp, Factory::NewTime(proc, t));
   return NULL;
@@ -1694,7 +1888,7 @@ static const char* trunctoyear(Proc* proc, Val**& sp) {
   char tz[kMaxTimeZoneStringLen + 2];  // +2: prevent accidental matches
   Engine::pop_c_str(proc, sp, tz, sizeof(tz));
   struct tm tm;
-  if (!SzlTimeToLocalTime(time, tz, &tm, NULL, NULL))
+  if (!proc->time_zone_cache()->ToLocalTime(time, tz, &tm, NULL))
     return proc->PrintError("trunctoyear: invalid time or time zone %q "
                             "was not recognized", tz);
   tm.tm_sec = 0;
@@ -1703,7 +1897,7 @@ static const char* trunctoyear(Proc* proc, Val**& sp) {
   tm.tm_mday = 1;
   tm.tm_mon = 0;
   szl_time t;
-  if (!LocalTimeToSzlTime(tm, 0, tz, false, &t))
+  if (!proc->time_zone_cache()->ToSzlTime(tm, 0, tz, &t))
     return proc->PrintError("trunctoyear: result time was out of range");
   Engine::push(sp, Factory::NewTime(proc, t));
   return NULL;
@@ -1728,7 +1922,7 @@ static const char* yearof(Proc* proc, Val**& sp) {
   char tz[kMaxTimeZoneStringLen + 2];  // +2: prevent accidental matches
   Engine::pop_c_str(proc, sp, tz, sizeof(tz));
   struct tm tm;
-  if (!SzlTimeToLocalTime(time, tz, &tm, NULL, NULL))
+  if (!proc->time_zone_cache()->ToLocalTime(time, tz, &tm, NULL))
     return proc->PrintError("yearof: invalid time or time zone %q "
                             "was not recognized", tz);
   Engine::push_szl_int(sp, proc, tm.tm_year + 1900);
@@ -2229,6 +2423,12 @@ void Intrinsics::Initialize() {
     DEF(load, t, Intrinsic::kNormal);
   }
 
+  // signature: (string): array of bytes
+  { FunctionType* t = FunctionType::New(proc)->par("variable", string_type)->
+      res(SymbolTable::array_of_bytes_type());
+    DEF(loadlines, t, Intrinsic::kNormal);
+  }
+
   // signature: (string): string
   { FunctionType* t = FunctionType::New(proc)->par("s", string_type)->
       res(string_type);
@@ -2486,7 +2686,7 @@ const char* Intrinsics::Saw(Proc* proc, Val**& sp, int regex_count, void** cache
   Retry:
       // initialize match array and report end of string to search
       int nsub = DualExecRegexp(entry[j]->compiled(), &dual, vec, byte_vec,
-                                nvec);
+                                nvec, proc->regexp_scratch());
       if (nsub < 0) { // a internal regexp engine error occured
 
         rerror = proc->PrintError(
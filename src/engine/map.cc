@@ -18,6 +18,9 @@
 #include <unistd.h>
 #include <time.h>
 #include <assert.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 #include "engine/globals.h"
 #include "public/logging.h"
@@ -41,7 +44,8 @@ namespace sawzall {
 
 
 static const int kMinNCell = 16;  // initial number of cells allocated in a map
-static const int kHeadsPerCell = 4;  // number of head pointers per cell
+static const int kGroupSize = 16;  // number of control bytes probed at once
+static const uint8 kEmpty = 0x80;  // control byte of an unused slot
 
 // Maps are implemented as a hash table over an array of MapCells.
 // This makes them easy to implement on the heap; the usual
@@ -51,26 +55,30 @@ static const int kHeadsPerCell = 4;  // number of head pointers per cell
 
 // We allocate three items for each map:
 //   1. map, the Map structure itself, which contains:
-//   2. map.heads, an array of MapCell pointers, the heads of the
-//      hash chains pointing to elements of map.base.
-//   3. map.base, an array of MapCell structures, to hold the data.
+//   2. map.base, an array of MapCell structures, to hold the data.
+//   3. map.ctrl, the open-addressed index into map.base: an array
+//      of control bytes followed by an array of the same number of
+//      int32 cell indices (see slots()).
 // Rather than allocating buckets as we need them, which requires
 // a lot of calls to the allocator, we grab one block of MapCells
-// and use them up sequentially.  In other words, the hash chains
-// are threaded through the MapCell array, which is densely
-// allocated; the cells form an array from 0 <= i < occupancy.
+// and use them up sequentially; the cells form an array from
+// 0 <= i < occupancy, in insertion order, and that order is what
+// the index-based accessors and when() iteration see.
 // Lookup:
-// We hash the key, choose the hash head pointer, and follow the
-// chain through the cells.  By choosing many more heads (4X)
-// than cells, we keep occupancy really low in the hash heads and
-// only have to do 1.25 compares per lookup on average (see Knuth
-// Volume 3 2nd Edition page 545).
-// Experiments show comparable performance to linear chaining.
-// Linear chaining works well on modern machines due to cache
-// locality; the chaining used here jumps around more but does
-// fewer overall compares. At kHeadsPerCell=4 the result is a
-// wash but the memory consumption of the map data structure
-// is 40% less than with linear chaining.
+// The index has a power of two number of slots, at least twice the
+// number of cells, split into groups of kGroupSize.  The high bits of
+// the mixed hash choose the first group to probe and its low seven bits
+// are stored in the control byte of the slot used by the key; unused
+// slots hold kEmpty.  A probe compares the seven hash bits against a
+// whole group of control bytes at once (with SSE2 where available)
+// and only visits the cells whose bits match, checking the full hash
+// cached in the cell before comparing keys.  A group with an empty
+// slot ends the search; otherwise we move to the next group in a
+// triangular sequence, which visits every group.  Keys are never
+// removed from a map, so there are no tombstones.
+// Because each cell caches its hash, growing never rehashes or
+// compares keys: the cells are copied in one block and the index is
+// rebuilt from the cached hashes.
 
 class MapCell {
  public:
@@ -89,14 +97,11 @@ class MapCell {
     Unimplemented();
  }
   void set_value(Val* value)  { value_ = value; }
-  MapCell* next()  { return next_; }
-  void set_next(MapCell* cp)  { next_ = cp; }
   uint32 hash() const  { return hash_; }
 
  private:
   Val* key_;
   Val* value_;
-  MapCell *next_;
   uint32 hash_;
 
   friend void Map::AdjustHeapPtrs();
@@ -104,13 +109,60 @@ class MapCell {
 };
 
 
+// The slot position and control byte of a hash.  Form hashes are
+// not uniform in every bit, so mix them first.  The multiply carries
+// every input bit into the high bits of the product, so those pick
+// the group; the low bits, which only depend on the low input bits,
+// serve as the tag that is checked before the full hash.
+static inline uint32 MixHash(uint32 hash) {
+  return hash * 0x9E3779B1u;
+}
+
+
+// The first group to probe among num_groups, a power of two: the top
+// log2(num_groups) bits of the mixed hash.
+static inline uint32 FirstGroup(uint32 hash, uint32 num_groups) {
+  return (static_cast<uint64>(MixHash(hash)) * num_groups) >> 32;
+}
+
+
+static inline uint8 ControlByte(uint32 hash) {
+  return MixHash(hash) & 0x7F;
+}
+
+
+// Bit i of the result is set if the control byte i of the group
+// starting at ctrl equals c.
+static inline uint32 MatchGroup(const uint8* ctrl, uint8 c) {
+#ifdef __SSE2__
+  __m128i group = _mm_loadu_si128(reinterpret_cast<const __m128i*>(ctrl));
+  return _mm_movemask_epi8(_mm_cmpeq_epi8(group, _mm_set1_epi8(c)));
+#else
+  uint32 mask = 0;
+  for (int i = 0; i < kGroupSize; i++)
+    if (ctrl[i] == c)
+      mask |= 1 << i;
+  return mask;
+#endif
+}
+
+
+// Number of index slots for a map with space cells.
+static int IndexCapacity(int space) {
+  int capacity = kGroupSize;
+  while (capacity < 2 * space)
+    capacity <<= 1;
+  return capacity;
+}
+
+
 // Maps have a data structure, Map, stored by all clients.  That's the
 // thing that's ref-counted.  Internally, Maps allocate arrays of
-// MapCells.  These MapCell arrays are stored on the heap, always
+// MapCells and the index.  These are stored on the heap, always
 // have refcount 1 (only the Map knows about them), and are
 // reallocated when the array needs to grow.
 // There are doublings and powers of two in the allocation, but
-// the code throughout does not assume the sizes are powers of two.
+// the code does not assume the number of cells is a power of two.
 Map* Map::MakeMapMem(Proc* proc, int space, bool exact) {
   // If space==0, choose an appropriate initial size.
   // Otherwise we're initializing a map and we might as well
@@ -133,13 +185,12 @@ Map* Map::MakeMapMem(Proc* proc, int space, bool exact) {
   }
   Map* map = new (ALLOC(proc, void, sizeof(Map))) Map;
   memset(map, 0, sizeof(Map));
-  map->heads_ = ALLOC(proc, MapCell*, kHeadsPerCell * space * sizeof(MapCell*));
-  memset(map->heads_, 0, kHeadsPerCell * space * sizeof(MapCell*));
   map->base_ = ALLOC(proc, MapCell, space * sizeof(MapCell));
   memset(map->base_, 0, space * sizeof(MapCell));
   map->occupancy_ = 0;
   map->space_ = space;
   map->proc_ = proc;
+  map->AllocIndex(IndexCapacity(space));
   return map;
 }
 
@@ -157,42 +208,39 @@ void Map::Delete() {
     cellp->value()->dec_ref_and_check(proc_);
   }
   // Free the memory.
-  FREE(proc_, heads_);
+  FREE(proc_, ctrl_);
   FREE(proc_, base_);
   FREE(proc_, this);
 }
 
 
 void Map::AdjustHeapPtrs() {
-  // Note that we adjust pointers directly.  This approach could be used for
-  // Clone() as well, rather than using CopyCells to rehash.
+  // The index refers to cells by position, so only the block pointers
+  // and the stored values need adjusting.
   Memory* heap = proc_->heap();
   MapCell* endcell = &base_[occupancy_];
-  MapCell* new_base = heap->AdjustPtr(base_);
-  ptrdiff_t delta = reinterpret_cast<char*>(new_base) -
-                    reinterpret_cast<char*>(base_);
   for (MapCell* cellp = base_; cellp < endcell; cellp++) {
     cellp->key_ = heap->AdjustVal(cellp->key_);
     cellp->value_ = heap->AdjustVal(cellp->value_);
-    if (cellp->next_)
-      cellp->next_ = reinterpret_cast<MapCell*>(
-                       reinterpret_cast<char*>(cellp->next_) + delta);
   }
-  MapCell** endhead = heads_ + (kHeadsPerCell * space_);
-  for (MapCell** headp = heads_; headp < endhead; headp++) {
-    if (*headp)
-      *headp = reinterpret_cast<MapCell*>(
-                 reinterpret_cast<char*>(*headp) + delta);
-  }
-  heads_ = heap->AdjustPtr(heads_);
-  base_ = new_base;
+  ctrl_ = heap->AdjustPtr(ctrl_);
+  base_ = heap->AdjustPtr(base_);
 }
 
 
 void Map::CheckHeapPtrs() {
   Memory* heap = proc_->heap();
   heap->CheckPtr(base_);
-  heap->CheckPtr(heads_);
+  heap->CheckPtr(ctrl_);
+}
+
+
+void Map::Freeze() {
+  MapCell* endcell = &base_[occupancy_];
+  for (MapCell* cellp = base_; cellp < endcell; cellp++) {
+    cellp->key()->Freeze(proc_);
+    cellp->value()->Freeze(proc_);
+  }
 }
 
 
@@ -292,84 +340,106 @@ Val* Map::GetValueByIndex(int index) {
 // Replace MapCell array with a copy of itself, so modifications
 // will not affect other users of this map.  Used when ref > 1;
 // provides value semantics for maps.
-Map* Map::Clone() {
-  Map* map = MakeMapMem(proc_, space_, (space_ < occupancy_));
-  CopyCells(map->heads(), map->base(), map->space(),
-                            heads(), base(), occupancy(), true);
+Map* Map::Clone(Proc* proc) {
+  Map* map = MakeMapMem(proc, space_, (space_ < occupancy_));
+  MapCell* endcell = &base_[occupancy_];
+  for (MapCell* cellp = base_; cellp < endcell; cellp++) {
+    cellp->key()->inc_ref();
+    cellp->value()->inc_ref();
+  }
+  memcpy(map->base_, base_, occupancy_ * sizeof(MapCell));
   map->occupancy_ = occupancy_;
+  if (map->capacity_ == capacity_)
+    memcpy(map->ctrl_, ctrl_, capacity_ * (1 + sizeof(int32)));
+  else
+    map->RebuildIndex();
   return map;
 }
 
 
-// Copy cells from one MapCell array to another, rehashing.
-// The to_heads and to_base arrays must be empty when called;
-// they will be wiped.
-void Map::CopyCells(
-                    MapCell** to_heads, MapCell* to_base, int to_size,
-                    MapCell** from_heads, MapCell* from_base, int from_occupancy, bool inc) {
-  memset(to_heads, 0, kHeadsPerCell * to_size * sizeof(MapCell*));
-  memset(to_base, 0, to_size * sizeof(MapCell));
-  MapCell* endcell = &from_base[from_occupancy];
-  MapCell* newcellp = &to_base[0];
-  for (MapCell* cellp = from_base; cellp < endcell; cellp++, newcellp++) {
-    *newcellp = *cellp;
-    // ChainToNewLocation will fix up newcellp->next
-    ChainToNewLocation(to_heads, to_size, cellp->hash(), newcellp);
-    if (inc) {
-      cellp->key()->inc_ref();
-      cellp->value()->inc_ref();
+// Allocate an empty index with the given number of slots.
+void Map::AllocIndex(int capacity) {
+  capacity_ = capacity;
+  ctrl_ = ALLOC(proc_, uint8, capacity * (1 + sizeof(int32)));
+  memset(ctrl_, kEmpty, capacity);
+}
+
+
+// Enter the cells into an empty index using their cached hashes.
+void Map::RebuildIndex() {
+  memset(ctrl_, kEmpty, capacity_);
+  for (int32 i = 0; i < occupancy_; i++)
+    AddToIndex(base_[i].hash(), i);
+}
+
+
+// Record cell index in the first unused slot along the probe
+// sequence of hash.
+void Map::AddToIndex(uint32 hash, int32 index) {
+  const uint32 group_mask = capacity_ / kGroupSize - 1;
+  uint32 group = FirstGroup(hash, group_mask + 1);
+  for (int step = 1; ; step++) {
+    uint8* ctrl = ctrl_ + group * kGroupSize;
+    uint32 empty = MatchGroup(ctrl, kEmpty);
+    if (empty != 0) {
+      int slot = group * kGroupSize + __builtin_ctz(empty);
+      ctrl_[slot] = ControlByte(hash);
+      slots()[slot] = index;
+      return;
+    }
+    group = (group + step) & group_mask;
+  }
+}
+
+
+// Return index of cell with given key, or -1 if it's not present
+int32 Map::FindIndex(Val* key, uint32 hash) {
+  const uint32 group_mask = capacity_ / kGroupSize - 1;
+  const uint8 c = ControlByte(hash);
+  uint32 group = FirstGroup(hash, group_mask + 1);
+  for (int step = 1; ; step++) {
+    const uint8* ctrl = ctrl_ + group * kGroupSize;
+    const int32* slots = this->slots() + group * kGroupSize;
+    for (uint32 match = MatchGroup(ctrl, c); match != 0; match &= match - 1) {
+      int32 index = slots[__builtin_ctz(match)];
+      MapCell* cellp = &base_[index];
+      if (cellp->hash() == hash && cellp->key()->IsEqual(key))
+        return index;
     }
+    if (MatchGroup(ctrl, kEmpty) != 0)
+      return -1;
+    group = (group + step) & group_mask;
   }
 }
 
 
-// Given a cell we will be writing, see if we should grow the MapCell
-// array before installing a new entry.  If so, grow it and return the
-// new cell location. Grow by doubling in size, to keep reallocation
+// Add a cell for a new key and return its index, growing the MapCell
+// array if it is full.  Grow by doubling in size, to keep reallocation
 // cost n log n instead of n^2.
-MapCell* Map::GrowIfNeeded(MapCell* cellp, uint32 hash) {
-  if (cellp != NULL)  // object already in map
-    return cellp;
-  // new cell being created. do we need to grow?
+int32 Map::NewCell(uint32 hash) {
   if (occupancy_ == space_) {
-    // 100% full -> rehash
     int new_size = 2 * space_;
-    MapCell** new_heads = ALLOC(proc_, MapCell*, kHeadsPerCell * new_size * sizeof(MapCell*));
     MapCell* new_base = ALLOC(proc_, MapCell, new_size * sizeof(MapCell));
-    CopyCells(new_heads, new_base, new_size, heads(), base(), occupancy_, false);
-    FREE(proc_, heads_);
+    memcpy(new_base, base_, occupancy_ * sizeof(MapCell));
+    memset(new_base + occupancy_, 0, (new_size - occupancy_) * sizeof(MapCell));
     FREE(proc_, base_);
-    heads_ = new_heads;
     base_ = new_base;
     space_ = new_size;
+    int capacity = IndexCapacity(new_size);
+    if (capacity > capacity_) {
+      FREE(proc_, ctrl_);
+      AllocIndex(capacity);
+      RebuildIndex();
+    }
   }
-  return ChainToNewLocation(heads_, space_, hash, base_ + occupancy_++);
-}
-
-
-// Set up chain to point to newly created cell, and return pointer to that cell.
-MapCell* Map::ChainToNewLocation(MapCell** heads, int space, uint32 hash, MapCell* cellp) {
-  MapCell** headp = &heads[hash % (kHeadsPerCell*space)];
-  cellp->set_next(*headp);
-  *headp = cellp;
-  return cellp;
-}
-
-
-// Return index of cell with given key, or NULL if it's not present
-MapCell* Map::FindLocation(MapCell** heads, int space, Val* key, uint32 hash) {
-  MapCell* cellp = heads[hash % (kHeadsPerCell * space)];
-  while(cellp && !cellp->key()->IsEqual(key))
-    cellp = cellp->next();
-  return cellp;
+  int32 index = occupancy_++;
+  AddToIndex(hash, index);
+  return index;
 }
 
 
 int32 Map::Lookup(Val* key) {
-  MapCell* cellp = FindLocation(heads_, space_, key, key->form()->Hash(key));
-  if (cellp == NULL)
-    return -1;
-  return cellp - base();
+  return FindIndex(key, key->form()->Hash(key));
 }
 
 
@@ -392,14 +462,16 @@ void Map::SetValue(int32 index, Val* value) {
 
 int32 Map::InsertKey(Val* key) {
   uint32 hash = key->form()->Hash(key);
-  MapCell* cellp = FindLocation(heads_, space_, key, hash);
-  cellp = GrowIfNeeded(cellp, hash);
+  int32 index = FindIndex(key, hash);
+  if (index < 0)
+    index = NewCell(hash);
+  MapCell* cellp = &base()[index];
   // Don't inc_ref the value; we're transferring the reference from the stack
   // to the map cell.  But we must release the old reference.
   // (If the old and new values are the same we still go from two refs to one.)
   cellp->key()->dec_ref();
   cellp->set_key(hash, key);
-  return cellp - base();
+  return index;
 }
 
 
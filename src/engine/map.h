@@ -29,8 +29,11 @@ class Map {
   void AdjustHeapPtrs();
   // Check the validity of the contained heap pointers.
   void CheckHeapPtrs();
-  // Make a copy of the map; used by Uniq()
-  Map* Clone();
+  // Make the keys and values read-only (see Val::Freeze()).
+  void Freeze();
+  // Make a copy of the map in the heap of proc, which need not be the
+  // Proc owning this map (it may be shared); used by Uniq()
+  Map* Clone(Proc* proc);
   // Fill array with the keys in a map
   void GetKeys(ArrayVal* key_array);
   // Get a key by index; used internally by when() statements
@@ -55,22 +58,26 @@ class Map {
   int occupancy()  { return occupancy_; }
 
  private:
-  static MapCell* FindLocation(MapCell** heads, int space_, Val* key, uint32 hash);
-  static MapCell* ChainToNewLocation(MapCell** heads, int space, uint32 hash, MapCell* empty);
-  static void CopyCells(MapCell** to_heads, MapCell* to_base, int to_size,
-                        MapCell** from_heads, MapCell* from_base, int from_occupancy, bool inc);
-  // Once we know the location of a key, grow the Map if necessary
-  // to make space for that key if it's a new entry in the Map.
-  MapCell* GrowIfNeeded(MapCell* cellp, uint32 hash);
+  // Return the index of the cell holding key, or -1.
+  int32 FindIndex(Val* key, uint32 hash);
+  // Append a cell for a new key with the given hash, growing the
+  // MapCell array if necessary, and return its index.
+  int32 NewCell(uint32 hash);
+  // Maintenance of the open-addressed index over the cells.
+  void AllocIndex(int capacity);
+  void RebuildIndex();
+  void AddToIndex(uint32 hash, int32 index);
 
   // Access to array of MapCells
-  MapCell** heads()  { return heads_; }
   MapCell* base()  { return base_; }
   int space()  { return space_; }
+  // The cell indices of the index slots follow the control bytes.
+  int32* slots()  { return reinterpret_cast<int32*>(ctrl_ + capacity_); }
 
   int occupancy_;  // the number of cells occupied
   int space_;  // the allocated number of cells
-  MapCell** heads_;  // heads of the hash chains, and ...
+  int capacity_;  // the number of index slots, a power of two
+  uint8* ctrl_;  // control bytes and cell indices of the index, and ...
   MapCell* base_;  // ... the cells; both can be reallocated for growth
   Proc* proc_;  // TODO
 };
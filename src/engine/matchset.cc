@@ -0,0 +1,239 @@
+// Copyright 2010 Google Inc.
+// 
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+// 
+//      http://www.apache.org/licenses/LICENSE-2.0
+// 
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ------------------------------------------------------------------------
+
+#include <ctype.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+#include "engine/globals.h"
+#include "public/logging.h"
+#include "public/hash_map.h"
+
+#include "utilities/literalset.h"
+
+#include "engine/matchset.h"
+
+
+namespace sawzall {
+
+MatchSet::MatchSet()
+  : frozen_(false) {
+}
+
+
+MatchSet::~MatchSet() {
+}
+
+
+void MatchSet::Add(void* compiled, const char* pattern) {
+  CHECK(!frozen_) << "pattern added to a frozen MatchSet";
+  string literal;
+  Entry entry;
+  if (entries_.find(compiled) != entries_.end() ||
+      !RequiredLiteral(pattern, &literal, &entry.exact))
+    return;
+  entry.literal = literals_.Add(literal);
+  entries_[compiled] = entry;
+}
+
+
+void MatchSet::Freeze() {
+  literals_.Compile();
+  frozen_ = true;
+}
+
+
+MatchSet::Result MatchSet::Lookup(void* compiled, const char* s, int n,
+                                  MatchScan* scan) const {
+  assert(frozen_);
+  if (static_cast<int>(entries_.size()) < kMinPatterns)
+    return UNKNOWN;
+  hash_map<void*, Entry>::const_iterator it = entries_.find(compiled);
+  if (it == entries_.end())
+    return UNKNOWN;
+  if (!scan->scanned_ || n != scan->subject_.size() ||
+      memcmp(s, scan->subject_.data(), n) != 0) {
+    literals_.Search(s, n, &scan->found_);
+    scan->subject_.assign(s, n);
+    scan->scanned_ = true;
+  }
+  if (!scan->found_[it->second.literal])
+    return NO_MATCH;
+  return it->second.exact ? MATCH : UNKNOWN;
+}
+
+
+// Removes the last UTF-8 character of s.
+static void PopChar(string* s) {
+  while (!s->empty() && (((*s)[s->size() - 1] & 0xC0) == 0x80))
+    s->erase(s->size() - 1);
+  if (!s->empty())
+    s->erase(s->size() - 1);
+}
+
+
+// If p points at a counted repetition {n}, {n,} or {n,m}, returns its
+// length and sets *min to n; otherwise returns 0 (PCRE then treats the
+// brace as a literal).
+static int CountedRepetition(const char* p, int* min) {
+  const char* q = p + 1;
+  if (!isdigit(*q))
+    return 0;
+  *min = 0;
+  while (isdigit(*q))
+    *min = *min * 10 + (*q++ - '0');
+  if (*q == ',') {
+    q++;
+    while (isdigit(*q))
+      q++;
+  }
+  if (*q != '}')
+    return 0;
+  return q + 1 - p;
+}
+
+
+// The analysis is conservative: it collects runs of literal characters
+// outside of groups, treats everything else as breaking a run, and gives
+// up on top-level alternation, option settings and quoting.
+bool MatchSet::RequiredLiteral(const char* pattern, string* literal,
+                               bool* exact) {
+  string best;
+  string run;
+  bool meta = false;       // seen anything but literal characters
+  bool last_literal = false;  // last atom is the last character of run
+  int depth = 0;
+  const char* p = pattern;
+  while (*p != '\0') {
+    const char c = *p;
+    bool is_literal = false;
+    if (c == '*' || c == '?' || c == '+' || c == '{') {
+      int min = (c == '+') ? 1 : 0;
+      int length = 1;
+      if (c == '{') {
+        length = CountedRepetition(p, &min);
+        if (length == 0) {
+          is_literal = true;  // a literal '{'
+          length = 1;
+        }
+      }
+      if (!is_literal) {
+        // The repetition applies to the last atom; if that is a literal
+        // character it is required only if repeated at least once, and
+        // either way ends the run.
+        if (last_literal && min == 0)
+          PopChar(&run);
+        if (run.size() > best.size())
+          best = run;
+        run.clear();
+        meta = true;
+        last_literal = false;
+        p += length;
+        if (*p == '?' || *p == '+')  // lazy or possessive
+          p++;
+        continue;
+      }
+    }
+    switch (c) {
+      case '|':
+        if (depth == 0)
+          return false;
+        break;
+      case '(':
+        if (p[1] == '?' && p[2] != ':')
+          return false;
+        depth++;
+        break;
+      case ')':
+        depth--;
+        break;
+      case '[':
+        // Skip the character class.
+        p++;
+        if (*p == '^')
+          p++;
+        if (*p == ']')
+          p++;
+        while (*p != '\0' && *p != ']') {
+          if (*p == '\\' && p[1] != '\0') {
+            p++;
+          } else if (*p == '[' && p[1] == ':') {
+            const char* q = strstr(p, ":]");
+            if (q != NULL)
+              p = q + 1;
+          }
+          p++;
+        }
+        if (*p == '\0')
+          return false;
+        break;
+      case '.':
+      case '^':
+      case '$':
+        break;
+      case '\\':
+        p++;
+        if (*p == '\0' || *p == 'Q' || *p == 'k' || *p == 'g')
+          return false;
+        if (!isalnum(*p)) {
+          is_literal = true;
+        } else if (*p == 'x' && p[1] == '{') {
+          p = strchr(p, '}');
+          if (p == NULL)
+            return false;
+        } else if (*p == 'x') {
+          for (int i = 0; i < 2 && isxdigit(p[1]); i++)
+            p++;
+        } else if (*p == 'c' && p[1] != '\0') {
+          p++;
+        } else if (isdigit(*p)) {
+          while (isdigit(p[1]))
+            p++;
+        } else if ((*p == 'p' || *p == 'P') && p[1] == '{') {
+          p = strchr(p, '}');
+          if (p == NULL)
+            return false;
+        } else if (*p == 'p' || *p == 'P') {
+          if (p[1] != '\0')
+            p++;
+        }
+        break;
+      default:
+        is_literal = true;
+        break;
+    }
+    if (is_literal && depth == 0) {
+      run += *p;
+      last_literal = true;
+    } else {
+      if (run.size() > best.size())
+        best = run;
+      run.clear();
+      meta = true;
+      last_literal = false;
+    }
+    p++;
+  }
+  if (run.size() > best.size())
+    best = run;
+  if (best.empty())
+    return false;
+  *literal = best;
+  *exact = !meta;
+  return true;
+}
+
+}  // namespace sawzall
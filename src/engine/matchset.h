@@ -0,0 +1,89 @@
+// Copyright 2010 Google Inc.
+// 
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+// 
+//      http://www.apache.org/licenses/LICENSE-2.0
+// 
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ------------------------------------------------------------------------
+
+namespace sawzall {
+
+class MatchScan;
+
+// The constant patterns that a program passes to match(), collected by the
+// code generator so that most of those matches can be answered without
+// running the regular expression engine.  Programs often test one string
+// against a long chain of patterns; for each pattern the set keeps the
+// longest literal that every match of it must contain, and the first
+// match of a string against any pattern of the set finds which of the
+// literals the string contains in a single Aho-Corasick scan.  Until a
+// different string is matched, a pattern whose literal is absent fails
+// at once, and a pattern that is nothing but its literal succeeds or
+// fails by the literal's presence; other patterns are run as usual.
+// The set is built by the code generator and then frozen; the Procs
+// forked from the compiling Proc share it, each with its own MatchScan.
+class MatchSet {
+ public:
+  MatchSet();
+  ~MatchSet();
+
+  // Add a compiled pattern and its source.  Patterns without a required
+  // literal are not added.  Not allowed once the set is frozen.
+  void Add(void* compiled, const char* pattern);
+
+  // Makes the set read-only; Lookup() may then be called from several
+  // threads at once, each with its own MatchScan.
+  void Freeze();
+  bool frozen() const  { return frozen_; }
+
+  enum Result { NO_MATCH, MATCH, UNKNOWN };
+
+  // Returns whether compiled, which need not belong to the set, matches
+  // s[0..n), or UNKNOWN if the regular expression must be run.  scan
+  // remembers the literals found in the last string looked up with it.
+  // The set must be frozen.
+  Result Lookup(void* compiled, const char* s, int n, MatchScan* scan) const;
+
+  // Finds the longest literal that every match of pattern must contain,
+  // and whether the pattern matches exactly the strings containing it.
+  // Returns false if there is no such literal.  Exposed for testing.
+  static bool RequiredLiteral(const char* pattern, string* literal,
+                              bool* exact);
+
+ private:
+  struct Entry {
+    int literal;  // index in literals_
+    bool exact;   // pattern matches iff its literal occurs
+  };
+
+  // Below this many patterns, a scan does not pay for itself.
+  static const int kMinPatterns = 2;
+
+  hash_map<void*, Entry> entries_;
+  LiteralSet literals_;
+  bool frozen_;
+};
+
+
+// The last string a Proc looked up in a MatchSet and the literals found
+// in it.
+class MatchScan {
+ public:
+  MatchScan() : scanned_(false)  { }
+
+ private:
+  bool scanned_;
+  string subject_;
+  vector<bool> found_;
+
+  friend class MatchSet;
+};
+
+}  // namespace sawzall
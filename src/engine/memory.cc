@@ -16,6 +16,8 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
 #include <config.h>
 
 #ifdef HAVE_MALLINFO
@@ -163,12 +165,21 @@ void* Memory::Chunk::Alloc(size_t size) {
 // We use "uintptr_t" for size_and_flags so that the above requirements
 // are satisfied on both 32-bit and 64-bit machines.
 
+// A mapped block is a large block whose data ends in a file mapped with
+// mmap() rather than allocated with malloc().  The mapping starts at the
+// page containing the LargeBlock header; the file's pages start right after
+// the header Val, so the file contents look like the data of a normal
+// block.  The block size is the size of the whole mapping, and the block
+// is released with munmap() instead of free().
+
 // Indicates a small or large block is refcounted.
 const uintptr_t kRefCountFlag = (1 << 0);
 // Indicates a small or large block is free.
 const uintptr_t kAllocatedFlag = (1 << 1);
+// Indicates a large block is a mapped block.
+const uintptr_t kMappedFlag = (1 << 2);
 // All flags.
-const uintptr_t kAllFlags = (kRefCountFlag | kAllocatedFlag);
+const uintptr_t kAllFlags = (kRefCountFlag | kAllocatedFlag | kMappedFlag);
 
 struct Memory::SmallBlock {        // header of a small block
   uintptr_t size_and_flags;
@@ -204,6 +215,7 @@ struct Memory::LargeBlock {        // header of a large block
   }
   void clear_allocated() { size_and_flags &=
                              ~(kAllocatedFlag | kRefCountFlag); }
+  bool mapped() { return (size_and_flags & kMappedFlag) != 0; }
   size_t size() { return size_and_flags & ~kAllFlags; }
 };
 
@@ -343,11 +355,11 @@ Memory::~Memory() {
   delete free_list_;
   for (LargeBlock *large = large_premark_blocks_, *next; large; large = next) {
     next = large->next;
-    free(large);
+    FreeLargeBlock(large);
   }
   for (LargeBlock *large = large_postmark_blocks_, *next; large; large = next) {
     next = large->next;
-    free(large);
+    FreeLargeBlock(large);
   }
 #ifdef SZL_MEMORY_DEBUG
   VLOG(1) << "Destroying heap, max virtual process size = " <<
@@ -499,6 +511,61 @@ void Memory::Free(void* p) {
 }
 
 
+void* Memory::AllocMapped(int fd, size_t size, size_t header_size) {
+  // The header Val must fit in front of the file data without padding.
+  assert(Align(header_size, sizeof(void*)) == header_size);
+  const size_t page_size = getpagesize();
+  const size_t prefix = Align(sizeof(LargeBlock) + header_size, page_size);
+  const size_t map_size = prefix + size;
+  // The size must fit in ptrdiff_t (sign bit must be zero).
+  if (implicit_cast<ptrdiff_t>(map_size) < 0)
+    return NULL;
+  // Reserve the whole range, then map the file over all but the first page(s)
+  // so that the header and the file data are contiguous.
+  char* base = static_cast<char*>(mmap(NULL, map_size, PROT_READ | PROT_WRITE,
+                                       MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+  if (base == MAP_FAILED)
+    return NULL;
+  if (size > 0 &&
+      mmap(base + prefix, size, PROT_READ | PROT_WRITE,
+           MAP_PRIVATE | MAP_FIXED, fd, 0) == MAP_FAILED) {
+    munmap(base, map_size);
+    return NULL;
+  }
+  LargeBlock* large = reinterpret_cast<LargeBlock*>(
+      base + prefix - header_size - sizeof(LargeBlock));
+  // Rounding up to the alignment never crosses into the next page.
+  size_t block_size = Align(map_size, kAllocAlignment);
+  // Link it into the appropriate list; mapped memory is accounted for
+  // like a malloc'ed large block.
+  LargeBlock** link = post_mark_ ? &large_postmark_blocks_
+                                 : &large_premark_blocks_;
+  large->next = *link;
+  *link = large;
+  total_available_ += block_size;
+  total_allocated_ += block_size;
+  large->size_and_flags = block_size | kAllocatedFlag | kRefCountFlag |
+                          kMappedFlag;
+#ifdef SZL_MEMORY_DEBUG
+  if (post_mark_)
+    allocated_since_mark_++;
+#endif
+  return large + 1;
+}
+
+
+void Memory::FreeLargeBlock(LargeBlock* large) {
+  if (large->mapped()) {
+    const uintptr_t page_mask = getpagesize() - 1;
+    char* base = reinterpret_cast<char*>(
+        reinterpret_cast<uintptr_t>(large) & ~page_mask);
+    munmap(base, large->size());
+  } else {
+    free(large);
+  }
+}
+
+
 void Memory::FreeRefCounted(Val* v) {
   assert(!v->is_readonly());
 #ifdef SZL_MEMORY_DEBUG
@@ -584,7 +651,7 @@ void Memory::Release() {
   for (LargeBlock *p = large_postmark_blocks_, *next; p != NULL; p = next) {
     total_available_ -= p->size();
     next = p->next;
-    free(p);
+    FreeLargeBlock(p);
   }
   large_postmark_blocks_ = NULL;
 
@@ -811,7 +878,7 @@ int64 Memory::FreeUnusedLargeBlocks() {
       size_t size = large->size();
       total_available_ -= size;
       *link = large->next;
-      free(large);
+      FreeLargeBlock(large);
       large_freed += size;
     } else {
       // skip the block, advance link
@@ -1081,7 +1148,8 @@ void Memory::CheckVal(Val* v) {
 
 bool Memory::IsInHeap(void* ptr) {
   SmallBlock* block = static_cast<SmallBlock*>(ptr) - 1;
-  if (block->size() <= max_small_block_size_)
+  if (block->size() <= max_small_block_size_ &&
+      (block->size_and_flags & kMappedFlag) == 0)
     return IsInSmallBlocks(ptr);
   else
     return IsInLargeBlocks(ptr);
@@ -149,6 +149,13 @@ public:
   }
   void FreeNonRefCounted(void* p) { Free(p); }
   void FreeRefCounted(Val* v);
+  // Map the first size bytes of the open file fd into the heap as a large
+  // reference-counted block whose first header_size bytes hold the Val
+  // that owns the data; the file data immediately follows the header.
+  // The mapping is private: writes to the data never reach the file.
+  // The block is freed like any other when its Val's ref count drops to
+  // zero.  Returns NULL if the file cannot be mapped.
+  void* AllocMapped(int fd, size_t size, size_t header_size);
   // Check the heap for correctness; called by __heapcheck().  Very expensive.
   void Check();
 
@@ -172,6 +179,7 @@ public:
   void GarbageCollect(Frame* fp, Val** sp, Instr* pc);
   // Note the object used to trigger GC from the interpreter loop.
   void RegisterGCTrigger(GCTrigger* gctrigger) { gctrigger_ = gctrigger; }
+  GCTrigger* gctrigger() const  { return gctrigger_; }
   // Accessors / setters.
   size_t total_available() const { return total_available_; }
   size_t total_allocated() const { return total_allocated_; }
@@ -197,6 +205,8 @@ public:
   int64 FreeUnusedSmallBlocks(bool build_free_list, bool always_coalesce);
   // Free large blocks with zero reference counts.
   int64 FreeUnusedLargeBlocks();
+  // Return a large block to malloc or, if mapped, unmap it.
+  void FreeLargeBlock(LargeBlock* large);
   // Check whether a pointer falls within the heap (for debugging).
   bool IsInHeap(void* ptr);
   bool IsInSmallBlocks(void* ptr);
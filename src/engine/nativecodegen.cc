@@ -3563,7 +3563,10 @@ void NCodeGen::DoCall(Call* x) {
       // We push the args directly onto the interpreter stack, in reverse order.
       IPushReverseExprs(args, args->length());
 
-      Operand pattern_imm(AM_IMM, CompiledRegexp(args->at(0), proc_, &error_count_));
+      void* pattern = (fun->kind() == Intrinsic::MATCH)
+          ? CompiledMatchRegexp(args->at(0), proc_, &error_count_)
+          : CompiledRegexp(args->at(0), proc_, &error_count_);
+      Operand pattern_imm(AM_IMM, pattern);
       PushOperand(&pattern_imm);
 
       PushISPAddr(&isp);
@@ -89,6 +89,7 @@ static struct {
   { F(storeVi), "", -2 },
   { F(undefine), "v", 0 },
   { F(openO), "vh", -1},
+  { F(shareS), "vb", 0 },
   { F(fstoreV), "o", -2 },
   { F(fclearB), "i", -1 },
   { F(fsetB), "i", 0 },
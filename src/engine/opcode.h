@@ -86,6 +86,12 @@ enum Opcode {
             // ... param -> ...
             // (side effect: bp[var_index] = index)
 
+  // use shared static value
+  shareS,   // var_index: int16, pc offset: int32
+            // ... -> ...
+            // (if the Proc has shared statics: side effect:
+            // bp[var_index] = shared value, and branch)
+
   // field stores
   // ... v t -> ... (side effect: t.data()[slot_index] = v)
   // slot_index: int16
@@ -44,6 +44,7 @@
 #include "engine/engine.h"
 #include "public/emitterinterface.h"
 #include "public/sawzall.h"
+#include "public/szlencoder.h"
 #include "engine/outputter.h"
 
 namespace {
@@ -136,6 +137,9 @@ Outputter::Outputter(Proc* proc, TableInfo* table)
   : proc_(proc),
     table_(table),
     emitter_(NULL),
+    encoded_emits_(false),
+    key_encoder_(new SzlEncoder),
+    value_encoder_(new SzlEncoder),
     emit_count_(0),
     open_files_() {
 }
@@ -144,6 +148,16 @@ Outputter::Outputter(Proc* proc, TableInfo* table)
 Outputter::~Outputter() {
   for (int i = 0; i < open_files_.size(); i++)
     delete open_files_[i];
+  delete key_encoder_;
+  delete value_encoder_;
+}
+
+
+void Outputter::set_emitter(Emitter* emitter) {
+  emitter_ = emitter;
+  // weights are still passed through the Put interface
+  encoded_emits_ = emitter != NULL && type()->uses_emitter() &&
+                   type()->weight() == NULL && emitter->AcceptsEncodedEmits();
 }
 
 
@@ -267,6 +281,137 @@ void Outputter::PutValue(Type* type, Emitter* emitter, Val**& sp,
 }
 
 
+// Encode a value the way SzlEmitter encodes the corresponding Put calls:
+// tuples are flattened unless they are elements of an array or a map
+// (is_elem), and map entries are sorted by key.  The encoding is driven
+// by the static type of the value; the reference count of v is unchanged.
+void Outputter::EncodeValue(Type* type, Val* v, SzlEncoder* encoder,
+                            bool is_elem) {
+  assert(type != NULL);
+  if (type->is_basic()) {
+    BasicType* basic_type = type->as_basic();
+    switch (basic_type->kind()) {
+      case BasicType::BOOL:
+        encoder->PutBool(v->as_bool()->val() != 0);
+        break;
+      case BasicType::BYTES: {
+          BytesVal* a = v->as_bytes();
+          encoder->PutBytes(a->base(), a->length());
+        }
+        break;
+      case BasicType::INT:
+        encoder->PutInt(v->as_int()->val());
+        break;
+      case BasicType::UINT:
+        encoder->PutInt(v->as_uint()->val());
+        break;
+      case BasicType::FLOAT:
+        encoder->PutFloat(v->as_float()->val());
+        break;
+      case BasicType::FINGERPRINT:
+        encoder->PutFingerprint(v->as_fingerprint()->val());
+        break;
+      case BasicType::STRING: {
+          StringVal* a = v->as_string();
+          encoder->PutString(a->base(), a->length());
+        }
+        break;
+      case BasicType::TIME:
+        encoder->PutTime(v->as_time()->val());
+        break;
+      default:
+        ShouldNotReachHere();
+        break;
+    }
+
+  } else if (type->is_tuple()) {
+    TupleVal* t = v->as_tuple();
+    List<Field*>* fields = type->as_tuple()->fields();
+    const int n = fields->length();
+    if (is_elem)
+      encoder->Start(SzlType::TUPLE);
+    for (int i = 0; i < n; i++) {
+      Field* f = fields->at(i);
+      EncodeValue(f->type(), t->field_at(f), encoder, false);
+    }
+    if (is_elem)
+      encoder->End(SzlType::TUPLE);
+
+  } else if (type->is_array()) {
+    ArrayVal* a = v->as_array();
+    Type* elem_type = type->as_array()->elem_type();
+    const int n = a->length();
+    encoder->Start(SzlType::ARRAY);
+    for (int i = 0; i < n; i++)
+      EncodeValue(elem_type, a->at(i), encoder, true);
+    encoder->End(SzlType::ARRAY);
+
+  } else if (type->is_map()) {
+    Type* index_type = type->as_map()->index_type();
+    Type* elem_type = type->as_map()->elem_type();
+    Map* m = v->as_map()->map();
+    const int n = m->occupancy();
+
+    // Sort the elements by keys, as PutValue does.
+    vector<pair<Val *, int> > sorted_keys;
+    sorted_keys.reserve(n);
+    for (int i = 0; i < n; i++)
+      sorted_keys.push_back(make_pair(m->GetKeyByIndex(i), i));
+    sort(sorted_keys.begin(), sorted_keys.end(), MapKeySorter);
+
+    // The length is the total number of keys + values.
+    encoder->Start(SzlType::MAP);
+    encoder->PutInt(n * 2);
+    for (int i = 0; i < n; i++) {
+      int map_index = sorted_keys[i].second;
+      assert(map_index >= 0 && map_index < n);
+      EncodeValue(index_type, m->GetKeyByIndex(map_index), encoder, true);
+      EncodeValue(elem_type, m->GetValueByIndex(map_index), encoder, true);
+    }
+    encoder->End(SzlType::MAP);
+
+  } else if (type->is_function()) {
+    FatalError("emitting of functions is unimplemented");
+
+  } else {
+    ShouldNotReachHere();
+  }
+}
+
+
+// Emit to an emitter that accepts encoded emits: the indices and the
+// element are encoded here and passed on in a single EmitEncoded call.
+const char* Outputter::EmitEncoded(Val**& sp) {
+  const OutputType* type = this->type();
+  assert(encoded_emits_ && type->weight() == NULL);
+
+  key_encoder_->Reset();
+  List<VarDecl*>* index_decls = type->index_decls();
+  const int n = index_decls->length();
+  for (int i = 0; i < n; i++) {
+    Val* v = Engine::pop(sp);
+    EncodeValue(index_decls->at(i)->type(), v, key_encoder_, false);
+    v->dec_ref();
+  }
+
+  value_encoder_->Reset();
+  Val* v = Engine::pop(sp);
+  if (type->elem_format_args() != NULL) {
+    // formatted output
+    StringVal* s = v->as_string();
+    value_encoder_->PutString(s->base(), s->length());
+  } else {
+    EncodeValue(type->elem_type(), v, value_encoder_, false);
+  }
+  v->dec_ref();
+
+  const string& key = key_encoder_->data();
+  const string& value = value_encoder_->data();
+  emitter_->EmitEncoded(key.data(), key.size(), value.data(), value.size());
+  return error_msg_;
+}
+
+
 const char* Outputter::Emit(Val**& sp) {
   // we count all emits
   emit_count_++;
@@ -284,6 +429,10 @@ const char* Outputter::Emit(Val**& sp) {
     return error_msg_;
   }
 
+  // emitters that accept encoded emits get the whole emit in one call
+  if (encoded_emits_)
+    return EmitEncoded(sp);
+
   // special case common emits
   if (type->uses_emitter() && (type->elem_format_args() == NULL)  &&
       (type->elem_type()->is_basic()) && (type->weight() == NULL)) {
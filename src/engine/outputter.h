@@ -15,6 +15,8 @@
 
 #include <vector>
 
+class SzlEncoder;
+
 namespace sawzall {
 
 class EmitFile;  // The object returned by OpenFile
@@ -40,7 +42,7 @@ class Outputter {
 
   // emitter interface support
   Emitter* emitter() const { return emitter_; }
-  void set_emitter(Emitter* emitter)  { emitter_ = emitter; }
+  void set_emitter(Emitter* emitter);
 
   // profiling support
   int emit_count() const  { return emit_count_; }
@@ -57,6 +59,12 @@ class Outputter {
   // backend connection
   Emitter* emitter_;
 
+  // encoded emits (see Emitter::EmitEncoded); the encoders are reused
+  // across emits and Sawzall runs
+  bool encoded_emits_;
+  SzlEncoder* key_encoder_;
+  SzlEncoder* value_encoder_;
+
   // profiling support
   int emit_count_;
 
@@ -72,6 +80,8 @@ class Outputter {
   void Error(const char* error_msg);
   EmitFile* OpenFile(char* str, int len, bool is_proc);
   void PutValue(Type* type, Emitter* emitter, Val**& sp, bool on_stack);
+  void EncodeValue(Type* type, Val* v, SzlEncoder* encoder, bool is_elem);
+  const char* EmitEncoded(Val**& sp);
 };
 
 }  // namespace sawzall
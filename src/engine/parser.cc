@@ -56,6 +56,13 @@ DEFINE_bool(enable_proto_conversion_hack, false,
 namespace sawzall {
 
 
+// Is decl the "input" parameter to "main"?
+static bool IsInputParam(VarDecl* decl) {
+  return decl->is_param() && decl->owner()->level() == 1 &&
+         strcmp(decl->name(), "input") == 0;
+}
+
+
 Parser::Parser(Proc* proc, Source* source, SymbolTable* table)
   : proc_ (proc),
     table_(table),
@@ -1662,8 +1669,12 @@ bool Parser::CheckSortSig(Intrinsic* fun, List<Expr*>* args) {
     return false;
   }
 
-  Warning("%s: comparison function not implemented yet!",
+  // Native code cannot be re-entered from the sort intrinsic.
+  if (proc_->mode() & Proc::kNative) {
+    Error("%s: comparison functions are not supported in native mode",
           fun->name());
+    return false;
+  }
 
   return true;
 }
@@ -1976,6 +1987,8 @@ Expr* Parser::ParseOperand(Position* start, szl_string name,
     } else if (obj->AsVarDecl() != NULL) {
       VarDecl* decl = obj->AsVarDecl();
       Variable* var = Variable::New(proc_, Span(start), decl);
+      if (IsInputParam(decl))
+        table_->add_input_use();
       if (quants_.is_present(decl))
         Error("value of 'all' quantifier variable %s undefined in body of when statement", decl->name());
       return var;
@@ -3817,12 +3830,15 @@ void Parser::CheckForInputProtoConversion(Variable* var, TupleType* type) {
   // The first time this function is called with the "input" parameter to
   // "main" and with a named type, remember the type.  This is used to
   // determine the proto type of the input source.
-  if (table_->input_proto() == NULL && type->type_name() != NULL) {
-    if (var->is_param() && var->owner()->level() == 1 &&
-        strcmp(var->name(), "input") == 0) {
-      table_->set_input_proto(type);
-    }
-  }
+  if (!IsInputParam(var->var_decl()))
+    return;
+  if (table_->input_proto() == NULL && type->type_name() != NULL)
+    table_->set_input_proto(type);
+  // Remember the uses of "input" that are converted to that type, so that
+  // we can tell whether all uses are.
+  Variables* conversions = table_->input_proto_conversions();
+  if (type == table_->input_proto() && conversions->IndexOf(var) < 0)
+    conversions->Append(var);
 }
 
 
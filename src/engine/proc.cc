@@ -26,10 +26,13 @@
 #include "engine/globals.h"
 #include "public/logging.h"
 #include "public/hashutils.h"
+#include "public/hash_map.h"
 
 #include "utilities/strutils.h"
 #include "utilities/random_base.h"
 #include "utilities/acmrandom.h"
+#include "utilities/literalset.h"
+#include "utilities/timeutils.h"
 
 #include "engine/memory.h"
 #include "engine/utils.h"
@@ -57,6 +60,7 @@
 #include "engine/engine.h"
 #include "engine/debugger.h"
 #include "engine/compiler.h"
+#include "engine/matchset.h"
 
 namespace sawzall {
 
@@ -90,6 +94,7 @@ Proc::Proc(int mode, ErrorHandler* error_handler) {
   heap_ = new Memory(this);  // explicitly deallocated
   context_ = NULL;
   emitter_factory_ = NULL;
+  shared_statics_ = NULL;
   histo_ = ((mode & kHistogram) != 0) ? Histogram::New(this) : NULL;
   profile_ = NULL;
   debugger_ = NULL;
@@ -101,6 +106,11 @@ Proc::Proc(int mode, ErrorHandler* error_handler) {
   outputters_ = NULL;
   tuple_types_ = NULL;
   regexp_objects_ = NULL;
+  regexp_scratch_ = NULL;
+  match_set_ = NULL;
+  owns_match_set_ = false;
+  match_scan_ = NULL;
+  time_zone_cache_ = NULL;
   rand_ = new SzlACMRandom(SzlACMRandom::GoodSeed());
   undef_cnt_index_ = 0;
   undef_details_index_ = 0;
@@ -121,6 +131,7 @@ Proc::Proc(int mode, ErrorHandler* error_handler) {
   start_call_.fp_ = NULL;
   start_call_.bp_ = NULL;
   start_call_.fun_decl_ = NULL;
+  closure_call_depth_ = 0;
   szl_file_inodes_ = NULL;
   sszl_file_inodes_ = NULL;
   calls_getresourcestats_ = false;
@@ -147,6 +158,7 @@ Proc::Proc() {
   heap_ = new Memory(this);  // explicitly deallocated
   context_ = NULL;
   emitter_factory_ = NULL;
+  shared_statics_ = NULL;
   histo_ = NULL;
   profile_ = NULL;
   debugger_ = NULL;
@@ -158,6 +170,11 @@ Proc::Proc() {
   outputters_ = NULL;
   tuple_types_ = NULL;
   regexp_objects_ = NULL;
+  regexp_scratch_ = NULL;
+  match_set_ = NULL;
+  owns_match_set_ = false;
+  match_scan_ = NULL;
+  time_zone_cache_ = NULL;
   rand_ = new SzlACMRandom(SzlACMRandom::GoodSeed());
   undef_cnt_index_ = 0;
   undef_details_index_ = 0;
@@ -178,6 +195,7 @@ Proc::Proc() {
   start_call_.fp_ = NULL;
   start_call_.bp_ = NULL;
   start_call_.fun_decl_ = NULL;
+  closure_call_depth_ = 0;
   szl_file_inodes_ = NULL;
   sszl_file_inodes_ = NULL;
   calls_getresourcestats_ = false;
@@ -223,6 +241,11 @@ Proc::~Proc() {
     for (int i = 0; i < regexp_objects_->length(); i++)
       FreeRegexp(regexp_objects_->at(i));
   }
+  delete regexp_scratch_;
+  if (owns_match_set_)
+    delete match_set_;
+  delete match_scan_;
+  delete time_zone_cache_;
   // do not cleanup code_ here, not owner
   delete heap_;
   delete rand_;
@@ -261,6 +284,10 @@ Proc* Proc::Fork(int mode) const {
   p->set_code(code_);
   p->statics_size_ = statics_size_;
   p->context_ = context_;
+  p->shared_statics_ = shared_statics_;
+  // share the match() prefilter; it must not change any more
+  CHECK(match_set_ == NULL || match_set_->frozen());
+  p->match_set_ = match_set_;
   // forked process has a histogram, if the original process has one
   if (histo() != NULL)
     p->histo_ = Histogram::New(p);
@@ -413,6 +440,46 @@ Proc::Status Proc::Execute(int max_steps, int* num_steps) {
 }
 
 
+int Proc::RunBatch(const RecordSpan* records, int n, uint64* undef_counts) {
+  CHECK(is_initialized() && status_ == TERMINATED);
+  CHECK(!(mode_ & kDoCalls)) << "RunBatch cannot be used with kDoCalls";
+  assert(state_.gp_ != NULL);
+
+  // The previous run or the initialization terminated through
+  // FinishExecuteOrCall, which already cleared the additional inputs
+  // and the variable trap info, so unlike SetupRun we do not clear them
+  // before each record; everything else SetupRun does is done below.
+  BytesForm* bytes_form = SymbolTable::bytes_form();
+  Instr* main = code_->main();
+  Val** stack = state_.gp_->stack();
+  for (int i = 0; i < n; i++) {
+    const RecordSpan& record = records[i];
+    const uint64 undef_cnt = undef_cnt_;
+    heap()->Mark();
+    trap_info_ = NULL;
+    seen_undef_ = 0;
+    state_.fp_ = state_.gp_;
+    state_.sp_ = stack;
+    state_.pc_ = main;
+    // push parameters for main_(input: string, key: string), right to left
+    Engine::push(state_.sp_, bytes_form->NewValInit(this, record.key_size,
+                                                    record.key_ptr));
+    Engine::push(state_.sp_, bytes_form->NewValInit(this, record.input_size,
+                                                    record.input_ptr));
+    status_ = SUSPENDED;
+    while (Execute(kint32max, NULL) == SUSPENDED)
+      ;
+    if (undef_counts != NULL)
+      undef_counts[i] = undef_cnt_ - undef_cnt;
+    set_current_stats();
+    heap()->ResetCounters();
+    if (status_ != TERMINATED)
+      return i;
+  }
+  return n;
+}
+
+
 void Proc::FinishExecuteOrCall(bool do_cleanup, bool traps_are_fatal) {
   // handle current status
   switch (status_) {
@@ -710,6 +777,102 @@ void Proc::FinishCall() {
 }
 
 
+const char* Proc::CallClosure(ClosureVal* c, Val** sp, Val* args[],
+                              int num_args, Val** result) {
+  CHECK(!(mode_ & kNative))
+      << "Sorry, native execution mode not yet supported for CallClosure";
+  assert(status_ == RUNNING);
+  assert(sp >= limit_sp() && sp <= initial_sp());
+
+  // Save the execution state; the intrinsic's caller is still running
+  // in Engine::Execute and the current interpreter registers are not
+  // reflected in state_, except for fp, which callc stores so that the
+  // closure's frame links to the caller's for the garbage collector.
+  // The closure's frame is pushed below sp; its NULL return pc makes
+  // Execute terminate when the closure returns.  c may be moved by the
+  // garbage collector once the closure runs.
+  Instr* entry = c->entry();
+  Frame* saved_fp = state_.fp_;
+  Val** saved_sp = state_.sp_;
+  Instr* saved_pc = state_.pc_;
+  bool saved_cc = state_.cc_;
+
+  // Push the arguments, right-to-left.
+  state_.sp_ = sp;
+  for (int i = num_args - 1; i >= 0; i--) {
+    Val* v = args[i];
+    v->inc_ref();
+    Engine::push(state_.sp_, v);
+  }
+  state_.pc_ = entry;
+
+  closure_call_depth_++;
+  Status s = Engine::Execute(this, kint32max, NULL, c->context());
+  while (s == SUSPENDED ||
+         (s == TRAPPED && state_.pc_ != NULL)) {
+    if (s == TRAPPED) {
+      // A trap inside the closure: continue at the trap target,
+      // unless the trap is fatal.
+      HandleTrap(0, 0, false);
+      if (status_ == FAILED) {
+        s = FAILED;
+        break;
+      }
+      status_ = RUNNING;
+    }
+    s = Engine::Execute(this, kint32max, NULL);
+  }
+  closure_call_depth_--;
+
+  const char* error = NULL;
+  *result = NULL;
+  switch (s) {
+    case TERMINATED:
+      // the arguments have been consumed; a result, if any, is on the stack
+      if (state_.sp_ < sp)
+        *result = Engine::pop(state_.sp_);
+      assert(state_.sp_ == sp);
+      break;
+
+    case TRAPPED:
+      // the closure returned with an undefined result
+      { Function* fun = code_->FunctionForInstr(entry);
+        const char* name = (fun != NULL && fun->name() != NULL) ?
+                           fun->name() : "function";
+        // slot 0 holds the trap info for return values
+        const VarTrapinfo* info = &var_trapinfo_[0];
+        if (info->message != NULL)
+          error = PrintError("%s returned an undefined value due to an "
+                             "error at %s (%s)", name,
+                             info->trap_desc->comment(),
+                             info->message->base());
+        else
+          error = PrintError("%s returned an undefined value", name);
+      }
+      break;
+
+    case FAILED:
+      // print the stack trace while the closure's frames are still present
+      PrintStackTrace();
+      error = trap_info_ != NULL ? trap_info_ : "function call failed";
+      break;
+
+    default:
+      ShouldNotReachHere();
+  }
+
+  // Restore the execution state.  Execute stops the profiler when it
+  // returns, but the intrinsic's caller is still running.
+  state_.fp_ = saved_fp;
+  state_.sp_ = saved_sp;
+  state_.pc_ = saved_pc;
+  state_.cc_ = saved_cc;
+  if (profile_ != NULL)
+    profile_->Start();
+  return error;
+}
+
+
 char* Proc::PrintString(const char* fmt, ...) {
   Fmt::State f;
   va_list arg;
@@ -1170,6 +1333,42 @@ void Proc::RegisterRegexp(void* obj) {
   regexp_objects_->Append(obj);
 }
 
+
+RegexpScratch* Proc::regexp_scratch() {
+  if (regexp_scratch_ == NULL)
+    regexp_scratch_ = new RegexpScratch;
+  return regexp_scratch_;
+}
+
+
+void Proc::AddMatchPattern(void* compiled, const char* pattern) {
+  if (match_set_ == NULL) {
+    match_set_ = new MatchSet;
+    owns_match_set_ = true;
+  }
+  match_set_->Add(compiled, pattern);
+}
+
+
+void Proc::FreezeMatchSet() {
+  if (match_set_ != NULL && owns_match_set_)
+    match_set_->Freeze();
+}
+
+
+MatchScan* Proc::match_scan() {
+  if (match_scan_ == NULL)
+    match_scan_ = new MatchScan;
+  return match_scan_;
+}
+
+
+TimeZoneCache* Proc::time_zone_cache() {
+  if (time_zone_cache_ == NULL)
+    time_zone_cache_ = new TimeZoneCache;
+  return time_zone_cache_;
+}
+
 void Proc::SetRandomSeed(int32 seed) {
   // From acmrandom.h:  "If 'seed' is not in [1, 2^31-2], the range of numbers
   // normally generated, it will be silently set to 1."
@@ -18,13 +18,19 @@
 #include <vector>
 
 class SzlACMRandom;
+class RegexpScratch;
 
 namespace sawzall {
 
 typedef List<TableInfo*> OutputTables;
 class TrapDesc;
+class MatchSet;
+class MatchScan;
+class TimeZoneCache;
 class EmitterFactory;
 class ErrorHandler;
+class SharedStatics;
+struct RecordSpan;
 
 class ResourceStats {
   // Helper class to manage run-time statistics.
@@ -80,6 +86,7 @@ class Proc {
     kPipelinePrintSource = 1 << 10,  // print SuperSawzall source before inlining
     kSecure = 1 << 11,  // Disallow subprocesses and loading certain files
     kDoCalls = 1 << 12,  // support DoCalls
+    kShareStatics = 1 << 13,  // share static values between processes
   };
 
   // Has completed static initialization
@@ -135,6 +142,14 @@ class Proc {
   // max_steps; usually by one or a couple instructions at the most.
   Status Execute(int max_steps, int* num_steps);
 
+  // RunBatch() runs main to completion on each of n records, which is
+  // equivalent to SetupRun followed by Execute until the status is no
+  // longer SUSPENDED, once per record, but does the setup that does not
+  // depend on the record once.  Stops at the first record whose run
+  // fails, leaving the status FAILED.  Returns the number of records
+  // run successfully.  See Process::RunBatch for undef_counts.
+  int RunBatch(const RecordSpan* records, int n, uint64* undef_counts);
+
   // Looks up a global (static or non-static) function with the given
   // name, returning its VarDecl.  This VarDecl is suitable for being
   // passed in as the first argument of DoCall().  Returns NULL if the
@@ -199,6 +214,21 @@ class Proc {
   // Sawzall-related memory used between SetupCall() and FinishCall().
   void FinishCall();
 
+  // Calls the closure c from within an intrinsic, re-entering the
+  // interpreter on the stack below sp, the intrinsic's stack pointer.
+  // The arguments are passed as for DoCall(); on success the result
+  // (or NULL if the closure returns no result) is stored in *result,
+  // with a reference the caller must release, and NULL is returned.
+  // On failure an error message is returned, suitable as the result
+  // of a failing intrinsic; status() is FAILED if the error is fatal.
+  // The garbage collector may run during the call and move Vals, so
+  // the intrinsic must keep the Vals it still needs on the stack at or
+  // above sp, and reload them from there afterwards.  Only for
+  // intrinsics that can fail.  Not supported in native mode.
+  const char* CallClosure(ClosureVal* c, Val** sp, Val* args[], int num_args,
+                          Val** result);
+  int closure_call_depth() const  { return closure_call_depth_; }
+
   // Execution status
   void set_error()  { status_ = FAILED; }
   Status status() const  { return status_; }
@@ -241,6 +271,13 @@ class Proc {
     emitter_factory_ = factory;
   }
 
+  // Read-only static values computed once for all Processes of the
+  // Executable (see sharedstatics.h); NULL if not shared.
+  SharedStatics* shared_statics() const  { return shared_statics_; }
+  void set_shared_statics(SharedStatics* shared_statics) {
+    shared_statics_ = shared_statics;
+  }
+
   // Resources
   void set_code(Code* code);
   Code* code() const  { return code_; }
@@ -273,6 +310,30 @@ class Proc {
   // deleted.
   void RegisterRegexp(void* regexp);
 
+  // Space reused by the regular expression intrinsics, allocated on first
+  // use.  Having one per Proc lets Procs on different threads match
+  // concurrently.
+  RegexpScratch* regexp_scratch();
+
+  // Adds a constant pattern of match() to the prefilter of this Proc's
+  // code (see MatchSet); called by the code generator.
+  void AddMatchPattern(void* compiled, const char* pattern);
+
+  // Makes the prefilter read-only, so that forked Procs can share it;
+  // called once the code is generated.
+  void FreezeMatchSet();
+
+  // The prefilter of the constant patterns of match(), or NULL if there
+  // are none.  Forked Procs share the set of the Proc they were forked
+  // from, which must outlive them.
+  const MatchSet* match_set() const  { return match_set_; }
+
+  // This Proc's state for lookups in match_set(), allocated on first use.
+  MatchScan* match_scan();
+
+  // The time zones used by the time intrinsics, allocated on first use.
+  TimeZoneCache* time_zone_cache();
+
   // The PRNG used by the intrinsics.
   void SetRandomSeed(int32 seed);
   SzlACMRandom* rand() { return rand_; }
@@ -383,6 +444,9 @@ class Proc {
   // used to install missing emitters at run-time
   EmitterFactory* emitter_factory_;
 
+  // Shared static values (not owned)
+  SharedStatics* shared_statics_;
+
   // Profiling
   Histogram* histo_;
   Profile* profile_;
@@ -414,6 +478,18 @@ class Proc {
   // Objects allocated outside of the managed heap to be freed explicitly
   List<void*>* regexp_objects_;
 
+  // JIT stack and match vector for the regular expression intrinsics
+  RegexpScratch* regexp_scratch_;
+
+  // Literal prefilter for the constant patterns of match(), owned by
+  // the Proc that generated the code, and its lookup state
+  MatchSet* match_set_;
+  bool owns_match_set_;
+  MatchScan* match_scan_;
+
+  // Time zones resolved by the time intrinsics
+  TimeZoneCache* time_zone_cache_;
+
   // Pseudorandom numbers for the intrinsics that generate random numbers
   SzlACMRandom* rand_;
 
@@ -478,6 +554,7 @@ class Proc {
   } start_call_;
 
   Frame* saved_fp_;  // frame pointer of initial kDoCalls function call
+  int closure_call_depth_;  // number of active CallClosure() calls
 
   // For the creation of the initial proc (used to allocate memory from)
   Proc();
@@ -558,6 +635,7 @@ class Proc {
   friend class Memory;  // needs access to state_ and initial_sp()
   friend class NSupport;  // needs access to state_ and native_ and trap_pc_
   friend class ClosureVal;  // needs access to state_
+  friend class SharedStatics;  // needs access to state_ and initial_sp()
 };
 
 
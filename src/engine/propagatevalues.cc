@@ -799,6 +799,10 @@ void PropagateValuesVisitor::UndefinedVariableVisitor::DoCall(Call* x) {
       outer_->UpdateValue(var->var_decl(), NULL, Version::kUndefined);
     } else {
       x->VisitChildren(this);
+      // sort and sortx call their comparison function, if any.
+      if ((intrinsic->kind() == Intrinsic::SORT ||
+           intrinsic->kind() == Intrinsic::SORTX) && x->args()->length() > 1)
+        SetUnknownAtCall(current_fun());
     }
   } else {
     x->VisitChildren(this);
@@ -946,7 +950,9 @@ Expr* PropagateValuesVisitor::SubstitutionVisitor::VisitCall(Call* x) {
     // - Some intrinsics (def, __undefine, __addressof) take reference
     //   parameters and so we must not propagate values to their arguments.
     // - No intrinsics ever modify outer-scope variables and so we should
-    //   not mark any as having an unknown value because of this call.
+    //   not mark any as having an unknown value because of this call,
+    //   except for the comparison function of sort and sortx (see
+    //   UndefinedVariableVisitor::DoCall).
     Intrinsic::Kind kind = intrinsic->kind();
     if (kind == Intrinsic::DEF) {
       SubstitutionVisitor visitor(outer_);
@@ -980,7 +986,11 @@ Expr* PropagateValuesVisitor::SubstitutionVisitor::VisitCall(Call* x) {
   bool can_fail;
   if (intrinsic != NULL) {
     // For intrinsics, we know whether the result can be undefined.
+    // (sort and sortx fail only in calls of a comparison function.)
     can_fail = intrinsic->can_fail();
+    if ((intrinsic->kind() == Intrinsic::SORT ||
+         intrinsic->kind() == Intrinsic::SORTX) && x->args()->length() < 2)
+      can_fail = false;
   } else if (x->fun()->AsFunction() != NULL) {
     // For other functions we have merged state from the return statements.
     // (Except recursive calls, where we must assume undefined is possible.)
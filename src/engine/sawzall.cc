@@ -18,6 +18,7 @@
 #include <time.h>
 #include <vector>
 #include <string>
+#include <algorithm>
 
 #include "engine/globals.h"
 #include "public/commandlineflags.h"
@@ -56,6 +57,7 @@
 #include "engine/engine.h"
 #include "engine/profile.h"
 #include "engine/debugger.h"
+#include "engine/sharedstatics.h"
 
 
 DEFINE_bool(test_backend_type_conversion, false,
@@ -300,7 +302,16 @@ Executable::Executable(const char* file_name, const char* source, int mode,
   }
   proc_->set_code(compilation_->code());
   proc_->set_statics_size(compilation_->statics_size());
+  proc_->FreezeMatchSet();
   MakeTables();
+  shared_statics_ = NULL;
+  if ((mode & kShareStatics) != 0 && (mode & kNative) == 0 &&
+      is_executable()) {
+    // If initialization fails each Process runs it again and reports
+    // the error.
+    shared_statics_ = SharedStatics::New(proc_, compilation_->tables());
+    proc_->set_shared_statics(shared_statics_);
+  }
 }
 
 // Define pure virtual destructor for ErrorHandler to avoid linking issues.
@@ -310,6 +321,7 @@ Executable::~Executable() {
   // all objects associated with this executable were either
   // explicitly deleted before or have been allocated on the
   // proc_ heap and will be deleted when proc_ is deleted
+  delete shared_statics_;
   compilation_->Finalize();
   delete proc_;
   delete tableinfo_;
@@ -393,6 +405,32 @@ void Executable::GetReferencedTupleFieldNames(const string& tuple_name,
 }
 
 
+bool Executable::GetReferencedInputFieldTags(vector<int>* tags) const {
+  assert(is_executable());
+  tags->clear();
+  SymbolTable* table = compilation_->symbol_table();
+  if (table->input_uses() != table->input_proto_conversions()->length())
+    return false;
+  TupleType* input_proto = table->input_proto();
+  if (input_proto == NULL)
+    return true;  // "input" is not used
+  List<Field*>* fields = input_proto->fields();
+  for (int i = 0; i < fields->length(); i++) {
+    Field* field = fields->at(i);
+    if (field->read()) {
+      if (!field->has_tag()) {
+        tags->clear();
+        return false;
+      }
+      tags->push_back(field->tag());
+    }
+  }
+  sort(tags->begin(), tags->end());
+  tags->erase(unique(tags->begin(), tags->end()), tags->end());
+  return true;
+}
+
+
 void Executable::PrintCode() {
   assert(is_executable());
   compilation_->code()->Disassemble();
@@ -690,6 +728,18 @@ void Process::RunOrDie(const char* input_ptr, size_t input_size,
 }
 
 
+int Process::RunBatch(const RecordSpan* records, int n,
+                      uint64* undef_counts) {
+  return proc_->RunBatch(records, n, undef_counts);
+}
+
+
+void Process::RunBatchOrDie(const RecordSpan* records, int n,
+                            uint64* undef_counts) {
+  DieIfFalse(RunBatch(records, n, undef_counts) == n);
+}
+
+
 bool Process::InitializeDoCalls() {
   CHECK(do_call_state_ == UNINITIALIZED)
       << "calling InitializeDoCalls() after non-DoCalls() initialization";
@@ -0,0 +1,72 @@
+// Copyright 2010 Google Inc.
+// 
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+// 
+//      http://www.apache.org/licenses/LICENSE-2.0
+// 
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ------------------------------------------------------------------------
+
+#include <stdio.h>
+
+#include "engine/globals.h"
+#include "public/logging.h"
+
+#include "engine/memory.h"
+#include "engine/utils.h"
+#include "engine/opcode.h"
+#include "engine/map.h"
+#include "engine/scope.h"
+#include "engine/type.h"
+#include "engine/node.h"
+#include "engine/symboltable.h"
+#include "engine/frame.h"
+#include "public/sawzall.h"
+#include "engine/proc.h"
+#include "engine/taggedptrs.h"
+#include "engine/form.h"
+#include "engine/val.h"
+#include "engine/sharedstatics.h"
+
+
+namespace sawzall {
+
+SharedStatics* SharedStatics::New(Proc* proc, OutputTables* tables) {
+  CHECK((proc->mode() & Proc::kNative) == 0);
+  Proc* p = proc->Fork(proc->mode() & ~Proc::kPersistent);
+  p->set_name("Sawzall::SharedStatics");
+  p->set_executable(proc->executable());
+  p->AllocateOutputters(tables);
+  // p has no shared statics, so it runs all the initializers
+  p->set_shared_statics(NULL);
+  p->SetupInitialization();
+  while (p->Execute(kint32max, NULL) < Proc::TERMINATED)
+    ;
+  if (p->status() != Proc::TERMINATED) {
+    delete p;
+    return NULL;
+  }
+  // Make everything reachable from the static frame read-only; p does
+  // not run again, so its heap is never compacted.
+  for (Val** ptr = &p->state_.gp_->at(0); ptr < p->initial_sp(); ptr++)
+    (*ptr)->Freeze(p);
+  return new SharedStatics(p);
+}
+
+
+SharedStatics::~SharedStatics() {
+  delete proc_;
+}
+
+
+Val* SharedStatics::at(int var_index) const {
+  return proc_->state_.gp_->at(var_index);
+}
+
+}  // namespace sawzall
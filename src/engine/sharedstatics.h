@@ -0,0 +1,50 @@
+// Copyright 2010 Google Inc.
+// 
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+// 
+//      http://www.apache.org/licenses/LICENSE-2.0
+// 
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ------------------------------------------------------------------------
+
+namespace sawzall {
+
+class OutputTables;
+class Proc;
+class Val;
+
+// The values of the static variables of a program, computed once by an
+// internal Proc and shared by the Procs of all Processes running the
+// program (Executable mode kShareStatics).  The values are made read-only
+// (see Val::Freeze()), so the Procs using them never modify, move or free
+// them; the internal Proc owns their memory and never runs again.
+//
+// The code generator guards each static variable whose values can be
+// shared (they contain no closures) with a shareS instruction, which
+// loads the shared value and skips the initializer when the Proc has
+// shared statics.  Other static variables, including output tables,
+// are initialized by every Proc as usual.
+class SharedStatics {
+ public:
+  // Run the static initialization of a fork of proc, the Proc of an
+  // Executable, and freeze the results.  Returns NULL if initialization
+  // fails; the Processes then initialize all statics themselves.
+  static SharedStatics* New(Proc* proc, OutputTables* tables);
+  ~SharedStatics();
+
+  // The shared value of the static variable at var_index.
+  Val* at(int var_index) const;
+
+ private:
+  explicit SharedStatics(Proc* proc) : proc_(proc)  { }
+
+  Proc* proc_;  // initialized Proc owning the values
+};
+
+}  // namespace sawzall
@@ -272,6 +272,8 @@ void SymbolTable::Clear() {
   statics_.Clear();
   functions_.Clear();
   input_proto_ = NULL;
+  input_uses_ = 0;
+  input_proto_conversions_.Clear();
   proto_types_ = Scope::New(proc_);
 }
 
@@ -526,7 +528,8 @@ void SymbolTable::DefineCon(Literal* val) {
 SymbolTable::SymbolTable(Proc* proc)
   : proc_(proc),
     statics_(proc),
-    functions_(proc) {
+    functions_(proc),
+    input_proto_conversions_(proc) {
   Clear();
 }
 
@@ -18,6 +18,7 @@ namespace sawzall {
 // The list of static variable / function declarations.
 typedef List<VarDecl*> Statics;
 typedef List<Function*> Functions;
+typedef List<Variable*> Variables;
 
 // The SymbolTable keeps everything together. universe is the
 // predefined scope.
@@ -38,12 +39,18 @@ class SymbolTable {
   Block* program() const  { return program_; }
   Function* main_function() const  { return main_function_; }
   TupleType* input_proto() const  { return input_proto_; }
+  // The number of uses of "input", and those uses that are converted to
+  // input_proto().  If the two agree, the program only reads input
+  // through the fields of input_proto().
+  int input_uses() const  { return input_uses_; }
+  Variables* input_proto_conversions()  { return &input_proto_conversions_; }
 
   void add_static(VarDecl* decl);
   void add_function(Function* fun);
   void set_program(Block* program);
   void set_main_function(Function* fun)  { main_function_ = fun; }
   void set_input_proto(TupleType* proto) { input_proto_ = proto; }
+  void add_input_use()  { input_uses_++; }
 
   // Scopes
   static Scope* universe()  { return universe_; }
@@ -168,6 +175,8 @@ private:
   Statics statics_;
   Functions functions_;
   TupleType* input_proto_;  // deduced proto type of "input"
+  int input_uses_;
+  Variables input_proto_conversions_;
 
   // Frequently used types
   static BadType* bad_type_;
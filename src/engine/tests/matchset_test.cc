@@ -0,0 +1,175 @@
+// Copyright 2010 Google Inc.
+// 
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+// 
+//      http://www.apache.org/licenses/LICENSE-2.0
+// 
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ------------------------------------------------------------------------
+
+// Unit tests for the prefilter of constant match() patterns (MatchSet)
+// in Processes forked from one Executable.
+
+#include <stdio.h>
+#include <pthread.h>
+#include <string>
+
+#include "engine/globals.h"
+#include "public/logging.h"
+#include "public/hash_map.h"
+
+#include "utilities/literalset.h"
+
+#include "engine/memory.h"
+#include "engine/utils.h"
+#include "engine/proc.h"
+#include "engine/matchset.h"
+#include "public/sawzall.h"
+#include "public/value.h"
+
+
+// Source code embedded in the test, at the end to make code more readable.
+extern const char* test_match_szl;
+
+
+namespace sawzall {
+
+const int kNumThreads = 4;
+const int kCallsPerThread = 5000;
+
+
+struct Classification {
+  const char* url;
+  int64 category;
+};
+
+// The expected results of Classify in test_match_szl.
+static const Classification kClassifications[] = {
+  { "http://www.google.com/search?q=x", 1 },
+  { "http://www.youtube.com/watch?v=y", 2 },
+  { "https://mail.example.com/inbox", 3 },
+  { "http://mail.example.com/inbox", 0 },
+  { "http://en.wikipedia.org/wiki/Z", 4 },
+  { "http://wiki.org/", 5 },
+  { "http://example.com/news/today", 6 },
+  { "http://example.com/", 0 },
+  { "", 0 },
+};
+const int kNumClassifications =
+    sizeof(kClassifications) / sizeof(kClassifications[0]);
+
+
+static int64 Classify(Process* process, const char* url) {
+  CallContext* context = process->SetupCall();
+  const FunctionDecl* fun_decl = process->LookupFunction("Classify");
+  CHECK(fun_decl != NULL) << "no function Classify";
+  const Value* args[1] = { StringValue::New(context, url) };
+  const Value* result = process->DoCall(context, fun_decl, args, 1);
+  CHECK(process->error_msg() == NULL) << process->error_msg();
+  CHECK(result != NULL);
+  int64 category = result->as_int()->value();
+  process->FinishCall(context);
+  return category;
+}
+
+
+// A forked Process uses the prefilter of the Executable, and answers
+// matches as the patterns would, both for a string it has just scanned
+// and for a new one.
+static void TestForkedProcess(Executable* exe) {
+  Process process(exe, NULL);
+  CHECK(process.InitializeDoCalls());
+  Process other(exe, NULL);
+  const MatchSet* match_set = process.proc()->match_set();
+  CHECK(match_set != NULL);
+  CHECK(match_set->frozen());
+  CHECK_EQ(match_set, other.proc()->match_set());
+  for (int i = 0; i < kNumClassifications; i++) {
+    const Classification& c = kClassifications[i];
+    CHECK_EQ(c.category, Classify(&process, c.url)) << c.url;
+    CHECK_EQ(c.category, Classify(&process, c.url)) << c.url;
+  }
+}
+
+
+struct ClassifyThreadArgs {
+  Executable* exe;
+  int thread;
+  int errors;
+};
+
+
+static void* ClassifyThread(void* arg) {
+  ClassifyThreadArgs* args = static_cast<ClassifyThreadArgs*>(arg);
+  Process process(args->exe, NULL);
+  CHECK(process.InitializeDoCalls());
+  args->errors = 0;
+  for (int i = 0; i < kCallsPerThread; i++) {
+    const Classification& c =
+        kClassifications[(i + args->thread) % kNumClassifications];
+    if (Classify(&process, c.url) != c.category)
+      args->errors++;
+  }
+  return NULL;
+}
+
+
+// Processes on several threads share the prefilter of the Executable,
+// each matching different strings.
+static void TestConcurrentProcesses(Executable* exe) {
+  pthread_t threads[kNumThreads];
+  ClassifyThreadArgs args[kNumThreads];
+  for (int t = 0; t < kNumThreads; t++) {
+    args[t].exe = exe;
+    args[t].thread = t;
+    CHECK_EQ(0, pthread_create(&threads[t], NULL, ClassifyThread, &args[t]));
+  }
+  for (int t = 0; t < kNumThreads; t++) {
+    CHECK_EQ(0, pthread_join(threads[t], NULL));
+    CHECK_EQ(0, args[t].errors);
+  }
+}
+
+}  // namespace sawzall
+
+
+int main(int argc, char** argv) {
+  ProcessCommandLineArguments(argc, argv);
+  InitializeAllModules();
+
+  sawzall::Executable exe("<test_match.szl>", test_match_szl,
+                          sawzall::kDoCalls);
+  CHECK(exe.is_executable());
+  sawzall::TestForkedProcess(&exe);
+  sawzall::TestConcurrentProcesses(&exe);
+
+  puts("PASS");
+  return 0;
+}
+
+
+// ============================================================================
+
+const char* test_match_szl =
+  "Classify: function(url: string): int {\n"
+  "  if (match(\"google\", url))\n"
+  "    return 1;\n"
+  "  if (match(\"youtube\\\\.com\", url))\n"
+  "    return 2;\n"
+  "  if (match(\"^https://mail\", url))\n"
+  "    return 3;\n"
+  "  if (match(\"wiki[a-z]+\\\\.org\", url))\n"
+  "    return 4;\n"
+  "  if (match(\"wiki\", url))\n"
+  "    return 5;\n"
+  "  if (match(\"/news/\", url))\n"
+  "    return 6;\n"
+  "  return 0;\n"
+  "};\n"
+;
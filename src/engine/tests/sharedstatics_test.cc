@@ -0,0 +1,175 @@
+// Copyright 2010 Google Inc.
+// 
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+// 
+//      http://www.apache.org/licenses/LICENSE-2.0
+// 
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ------------------------------------------------------------------------
+
+// Unit tests for sharing static variables between Processes (kShareStatics).
+
+#include <stdio.h>
+#include <pthread.h>
+#include <string>
+
+#include "public/porting.h"
+#include "public/logging.h"
+
+#include "public/sawzall.h"
+#include "public/value.h"
+
+
+// Source code embedded in the test, at the end to make code more readable.
+extern const char* test_statics_szl;
+
+
+namespace sawzall {
+
+const int kNumThreads = 4;
+const int kLookupsPerThread = 20000;
+
+
+// Calls a function of the Process taking at most one string argument.
+static const Value* Call(Process* process, CallContext* context,
+                         const char* function_name, const char* arg) {
+  const FunctionDecl* fun_decl = process->LookupFunction(function_name);
+  CHECK(fun_decl != NULL) << "no function " << function_name;
+  const Value* args[1];
+  int num_args = 0;
+  if (arg != NULL)
+    args[num_args++] = StringValue::New(context, arg);
+  const Value* result = process->DoCall(context, fun_decl, args, num_args);
+  CHECK(process->error_msg() == NULL) << process->error_msg();
+  CHECK(result != NULL);
+  return result;
+}
+
+
+static int64 CallInt(Process* process, const char* function_name,
+                     const char* arg) {
+  CallContext* context = process->SetupCall();
+  int64 result = Call(process, context, function_name, arg)->as_int()->value();
+  process->FinishCall(context);
+  return result;
+}
+
+
+static double CallFloat(Process* process, const char* function_name) {
+  CallContext* context = process->SetupCall();
+  double result = Call(process, context, function_name, NULL)->
+                  as_float()->value();
+  process->FinishCall(context);
+  return result;
+}
+
+
+// Values computed by static initializers are the same in all Processes,
+// and copies of them can be modified without affecting the others.
+static void TestSharedValues(Executable* exe) {
+  Process p1(exe, NULL);
+  Process p2(exe, NULL);
+  CHECK(p1.InitializeDoCalls());
+  CHECK(p2.InitializeDoCalls());
+
+  // rand() ran once, in the shared initialization
+  CHECK_EQ(CallFloat(&p1, "Random"), CallFloat(&p2, "Random"));
+
+  CHECK_EQ(2, CallInt(&p1, "Lookup", "two"));
+  CHECK_EQ(3, CallInt(&p2, "Lookup", "three"));
+  CHECK_EQ(4, CallInt(&p1, "AddWord", "four"));
+  CHECK_EQ(3, CallInt(&p1, "Size", NULL));
+  CHECK_EQ(3, CallInt(&p2, "Size", NULL));
+
+  // statics holding closures are initialized by every Process
+  CHECK_EQ(49, CallInt(&p2, "Square", "7"));
+}
+
+
+struct LookupThreadArgs {
+  Executable* exe;
+  int64 sum;
+};
+
+
+static void* LookupThread(void* arg) {
+  LookupThreadArgs* args = static_cast<LookupThreadArgs*>(arg);
+  Process process(args->exe, NULL);
+  CHECK(process.InitializeDoCalls());
+  args->sum = 0;
+  for (int i = 0; i < kLookupsPerThread; i++)
+    args->sum += CallInt(&process, "Lookup", i % 2 == 0 ? "one" : "two");
+  return NULL;
+}
+
+
+// Processes on several threads read the shared values concurrently.
+static void TestConcurrentLookups(Executable* exe) {
+  pthread_t threads[kNumThreads];
+  LookupThreadArgs args[kNumThreads];
+  for (int t = 0; t < kNumThreads; t++) {
+    args[t].exe = exe;
+    CHECK_EQ(0, pthread_create(&threads[t], NULL, LookupThread, &args[t]));
+  }
+  for (int t = 0; t < kNumThreads; t++) {
+    CHECK_EQ(0, pthread_join(threads[t], NULL));
+    CHECK_EQ(kLookupsPerThread / 2 * 3, args[t].sum);
+  }
+}
+
+}  // namespace sawzall
+
+
+int main(int argc, char** argv) {
+  ProcessCommandLineArguments(argc, argv);
+  InitializeAllModules();
+
+  sawzall::Executable exe("<test_statics.szl>", test_statics_szl,
+                          sawzall::kDoCalls | sawzall::kShareStatics);
+  CHECK(exe.is_executable());
+  sawzall::TestSharedValues(&exe);
+  sawzall::TestConcurrentLookups(&exe);
+
+  puts("PASS");
+  return 0;
+}
+
+
+// ============================================================================
+
+const char* test_statics_szl =
+  "static kWords: map[string] of int = { \"one\": 1, \"two\": 2, \"three\": 3 };\n"
+  "static kRandom: float = rand();\n"
+  "static kSquare: function(s: string): int {\n"
+  "  x: int = int(s, 10);\n"
+  "  return x * x;\n"
+  "};\n"
+  "\n"
+  "Lookup: function(s: string): int {\n"
+  "  return kWords[s];\n"
+  "};\n"
+  "\n"
+  "AddWord: function(s: string): int {\n"
+  "  words := kWords;\n"
+  "  words[s] = len(words) + 1;\n"
+  "  return len(words);\n"
+  "};\n"
+  "\n"
+  "Size: function(): int {\n"
+  "  return len(kWords);\n"
+  "};\n"
+  "\n"
+  "Random: function(): float {\n"
+  "  return kRandom;\n"
+  "};\n"
+  "\n"
+  "Square: function(s: string): int {\n"
+  "  return kSquare(s);\n"
+  "};\n"
+;
@@ -65,6 +65,12 @@ int Val::ValFmt(Fmt::State* f) {
 }
 
 
+void Val::Freeze(Proc* proc) {
+  if (!is_readonly())
+    form()->Freeze(proc, this);
+}
+
+
 Val* Val::Uniq(Proc* proc) {
   return form()->Uniq(proc, this);
 }
@@ -148,6 +148,10 @@ class Val {
       return true;
     }
   }
+  // Make this value and all values reachable from it read-only, so that they
+  // can be shared by other Procs (see SharedStatics).  Uses proc, which must
+  // own the values, to pre-allocate lazily computed data.
+  void Freeze(Proc* proc);
 
   // equality
   bool IsEqual(Val* val);
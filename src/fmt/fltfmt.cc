@@ -165,6 +165,204 @@ xaddexp(char *p, int e)
 	*p++ = '\0';
 }
 
+/*
+ * 10^(CPSTEP*i) for CPMIN <= CPSTEP*i <= CPMAX, as in Grisu:
+ * a 64-bit mantissa (rounded to nearest) and a binary exponent.
+ */
+enum
+{
+	CPMIN	= -296,
+	CPMAX	= 344,
+	CPSTEP	= 8,
+	FASTSLOP	= 100	/* see xfastdigits */
+};
+
+static struct
+{
+	uvlong	mant;
+	int	exp;
+} cachedpows10[] =
+{
+	{ 0xd1476e2c07286faaULL, -1047 },	/* 1e-296 */
+	{ 0x9becce62836ac577ULL, -1020 },	/* 1e-288 */
+	{ 0xe858ad248f5c22caULL,  -994 },	/* 1e-280 */
+	{ 0xad1c8eab5ee43b67ULL,  -967 },	/* 1e-272 */
+	{ 0x80fa687f881c7f8eULL,  -940 },	/* 1e-264 */
+	{ 0xc0314325637a193aULL,  -914 },	/* 1e-256 */
+	{ 0x8f31cc0937ae58d3ULL,  -887 },	/* 1e-248 */
+	{ 0xd5605fcdcf32e1d7ULL,  -861 },	/* 1e-240 */
+	{ 0x9efa548d26e5a6e2ULL,  -834 },	/* 1e-232 */
+	{ 0xece53cec4a314ebeULL,  -808 },	/* 1e-224 */
+	{ 0xb080392cc4349dedULL,  -781 },	/* 1e-216 */
+	{ 0x8380dea93da4bc60ULL,  -754 },	/* 1e-208 */
+	{ 0xc3f490aa77bd60fdULL,  -728 },	/* 1e-200 */
+	{ 0x91ff83775423cc06ULL,  -701 },	/* 1e-192 */
+	{ 0xd98ddaee19068c76ULL,  -675 },	/* 1e-184 */
+	{ 0xa21727db38cb0030ULL,  -648 },	/* 1e-176 */
+	{ 0xf18899b1bc3f8ca2ULL,  -622 },	/* 1e-168 */
+	{ 0xb3f4e093db73a093ULL,  -595 },	/* 1e-160 */
+	{ 0x8613fd0145877586ULL,  -568 },	/* 1e-152 */
+	{ 0xc7caba6e7c5382c9ULL,  -542 },	/* 1e-144 */
+	{ 0x94db483840b717f0ULL,  -515 },	/* 1e-136 */
+	{ 0xddd0467c64bce4a1ULL,  -489 },	/* 1e-128 */
+	{ 0xa54394fe1eedb8ffULL,  -462 },	/* 1e-120 */
+	{ 0xf64335bcf065d37dULL,  -436 },	/* 1e-112 */
+	{ 0xb77ada0617e3bbcbULL,  -409 },	/* 1e-104 */
+	{ 0x88b402f7fd75539bULL,  -382 },	/* 1e-96 */
+	{ 0xcbb41ef979346bcaULL,  -356 },	/* 1e-88 */
+	{ 0x97c560ba6b0919a6ULL,  -329 },	/* 1e-80 */
+	{ 0xe2280b6c20dd5232ULL,  -303 },	/* 1e-72 */
+	{ 0xa87fea27a539e9a5ULL,  -276 },	/* 1e-64 */
+	{ 0xfb158592be068d2fULL,  -250 },	/* 1e-56 */
+	{ 0xbb127c53b17ec159ULL,  -223 },	/* 1e-48 */
+	{ 0x8b61313bbabce2c6ULL,  -196 },	/* 1e-40 */
+	{ 0xcfb11ead453994baULL,  -170 },	/* 1e-32 */
+	{ 0x9abe14cd44753b53ULL,  -143 },	/* 1e-24 */
+	{ 0xe69594bec44de15bULL,  -117 },	/* 1e-16 */
+	{ 0xabcc77118461cefdULL,   -90 },	/* 1e-8 */
+	{ 0x8000000000000000ULL,   -63 },	/* 1e0 */
+	{ 0xbebc200000000000ULL,   -37 },	/* 1e8 */
+	{ 0x8e1bc9bf04000000ULL,   -10 },	/* 1e16 */
+	{ 0xd3c21bcecceda100ULL,    16 },	/* 1e24 */
+	{ 0x9dc5ada82b70b59eULL,    43 },	/* 1e32 */
+	{ 0xeb194f8e1ae525fdULL,    69 },	/* 1e40 */
+	{ 0xaf298d050e4395d7ULL,    96 },	/* 1e48 */
+	{ 0x82818f1281ed44a0ULL,   123 },	/* 1e56 */
+	{ 0xc2781f49ffcfa6d5ULL,   149 },	/* 1e64 */
+	{ 0x90e40fbeea1d3a4bULL,   176 },	/* 1e72 */
+	{ 0xd7e77a8f87daf7fcULL,   202 },	/* 1e80 */
+	{ 0xa0dc75f1778e39d6ULL,   229 },	/* 1e88 */
+	{ 0xefb3ab16c59b14a3ULL,   255 },	/* 1e96 */
+	{ 0xb2977ee300c50fe7ULL,   282 },	/* 1e104 */
+	{ 0x850fadc09923329eULL,   309 },	/* 1e112 */
+	{ 0xc646d63501a1511eULL,   335 },	/* 1e120 */
+	{ 0x93ba47c980e98ce0ULL,   362 },	/* 1e128 */
+	{ 0xdc21a1171d42645dULL,   388 },	/* 1e136 */
+	{ 0xa402b9c5a8d3a6e7ULL,   415 },	/* 1e144 */
+	{ 0xf46518c2ef5b8cd1ULL,   441 },	/* 1e152 */
+	{ 0xb616a12b7fe617aaULL,   468 },	/* 1e160 */
+	{ 0x87aa9aff79042287ULL,   495 },	/* 1e168 */
+	{ 0xca28a291859bbf93ULL,   521 },	/* 1e176 */
+	{ 0x969eb7c47859e744ULL,   548 },	/* 1e184 */
+	{ 0xe070f78d3927556bULL,   574 },	/* 1e192 */
+	{ 0xa738c6bebb12d16dULL,   601 },	/* 1e200 */
+	{ 0xf92e0c3537826146ULL,   627 },	/* 1e208 */
+	{ 0xb9a74a0637ce2ee1ULL,   654 },	/* 1e216 */
+	{ 0x8a5296ffe33cc930ULL,   681 },	/* 1e224 */
+	{ 0xce1de40642e3f4b9ULL,   707 },	/* 1e232 */
+	{ 0x9991a6f3d6bf1766ULL,   734 },	/* 1e240 */
+	{ 0xe4d5e82392a40515ULL,   760 },	/* 1e248 */
+	{ 0xaa7eebfb9df9de8eULL,   787 },	/* 1e256 */
+	{ 0xfe0efb53d30dd4d8ULL,   813 },	/* 1e264 */
+	{ 0xbd49d14aa79dbc82ULL,   840 },	/* 1e272 */
+	{ 0x8d07e33455637eb3ULL,   867 },	/* 1e280 */
+	{ 0xd226fc195c6a2f8cULL,   893 },	/* 1e288 */
+	{ 0x9c935e00d4b9d8d2ULL,   920 },	/* 1e296 */
+	{ 0xe950df20247c83fdULL,   946 },	/* 1e304 */
+	{ 0xadd57a27d29339f6ULL,   973 },	/* 1e312 */
+	{ 0x81842f29f2cce376ULL,  1000 },	/* 1e320 */
+	{ 0xc0fe908895cf3b44ULL,  1026 },	/* 1e328 */
+	{ 0x8fcac257558ee4e6ULL,  1053 },	/* 1e336 */
+	{ 0xd6444e39c3db9b0aULL,  1079 },	/* 1e344 */
+};
+
+static uvlong smallpows10[CPSTEP] =
+{
+	1ULL, 10ULL, 100ULL, 1000ULL, 10000ULL, 100000ULL, 1000000ULL, 10000000ULL,
+};
+
+#ifdef __SIZEOF_INT128__
+/*
+ * 10^p as *mant * 2^(return value), *mant normalized to 64 bits,
+ * with a relative error below 2^-62.
+ */
+static int
+xpow10mant(int p, uvlong *mant)
+{
+	unsigned __int128 m;
+	int i, e;
+
+	i = (p - CPMIN) / CPSTEP;
+	m = (unsigned __int128)cachedpows10[i].mant * smallpows10[(p - CPMIN) % CPSTEP];
+	e = cachedpows10[i].exp;
+	while(m >> 64){
+		m >>= 1;
+		e++;
+	}
+	*mant = (uvlong)m;
+	return e;
+}
+#endif
+
+/*
+ * fast path for xdodtoa: compute the NSIGNIF digits of f > 0
+ * with one 64x64-bit multiply by a cached power of ten.  the
+ * digits xdodtoa computes with strtod are only known to be within
+ * a few units in the last place of the true value, and it then
+ * rounds them to prec digits.  if no rounding boundary (or power
+ * of ten) is within FASTSLOP units of the true value, that
+ * rounding gives the same answer for any digits in that range,
+ * and we return them; otherwise return 0 to take the slow path.
+ */
+static int
+xfastdigits(char *s1, double f, int chr, int prec, int *ep)
+{
+#ifdef __SIZEOF_INT128__
+	unsigned __int128 prod;
+	uvlong m, p10, x, unit, r;
+	int e2, e, p, s, n, i;
+
+	if(f == 0){
+		/* the slow path also gives all zeros and e = 0 */
+		memset(s1, '0', NSIGNIF);
+		s1[NSIGNIF] = 0;
+		*ep = 0;
+		return 1;
+	}
+	m = (uvlong)ldexp(frexp(f, &e2), 53);
+	/* f = m * 2^(e2-53); the first guess of floor(log10(f)) may be 1 low */
+	e = (int)floor((e2 - 1) * .301029995663981195);
+	for(;;){
+		p = NSIGNIF - 1 - e;
+		if(p < CPMIN || p >= CPMAX + CPSTEP)
+			return 0;
+		s = 53 - e2 - xpow10mant(p, &p10);
+		if(s <= 0 || s >= 128)
+			return 0;
+		prod = (unsigned __int128)m * p10;
+		x = (uvlong)(prod >> s) + (uvlong)((prod >> (s-1)) & 1);
+		if(x < 100000000000000000ULL)
+			break;
+		e++;
+	}
+	if(x < 10000000000000000ULL + FASTSLOP
+	|| x > 100000000000000000ULL - FASTSLOP)
+		return 0;
+	n = prec + 1;
+	if(chr == 'f')
+		n += e;
+	if(n >= NSIGNIF-2)
+		return 0;
+	if(n >= 0){
+		unit = 1;
+		for(i = n; i < NSIGNIF; i++)
+			unit *= 10;
+		r = x % unit;
+		if(r > unit/2 - FASTSLOP && r < unit/2 + FASTSLOP)
+			return 0;
+	}
+	for(i = NSIGNIF-1; i >= 0; i--){
+		s1[i] = x % 10 + '0';
+		x /= 10;
+	}
+	s1[NSIGNIF] = 0;
+	*ep = e;
+	return 1;
+#else
+	return 0;
+#endif
+}
+
 static char*
 xdodtoa(char *s1, double f, int chr, int prec, int *decpt, int *rsign)
 {
@@ -197,6 +395,11 @@ xdodtoa(char *s1, double f, int chr, int prec, int *decpt, int *rsign)
 		return &s1[3];
 	}
 
+	if(xfastdigits(s1, f, chr, prec, &e)) {
+		oerr = errno;
+		goto found;
+	}
+
 	e = 0;
 	g = f;
 	if(g != 0) {
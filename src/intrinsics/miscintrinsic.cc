@@ -45,8 +45,19 @@
 namespace sawzall {
 
 
-// Helper, defined later.
-static void SplitCSVLine(char* line, vector<char*>* cols);
+// A field found by SplitCSVLine: the bytes [origin, origin + length) of
+// the line, less the second quote of each escaped quote pair if escaped.
+struct CSVField {
+  int origin;
+  int length;
+  bool escaped;
+};
+
+
+// Helpers, defined later.
+static void SplitCSVLine(const char* line, int length, vector<CSVField>* cols);
+static BytesVal* NewCSVField(Proc* proc, BytesVal* line, const CSVField& f,
+                             BytesVal** empty);
 
 
 // returns a value x such that 0.0 < x < 1.0
@@ -152,16 +163,12 @@ static const char *frombase64(Proc *proc, Val**& sp) {
 }
 
 
-// Copy the data from an ArrayDesc into a newly allocated
-// char[], and zero-terminate it.
-// Return the new array, and store the length
-// in the location given by len unless it is NULL.
-static char* SaveCharArray(BytesVal* arr) {
-  int32 n = arr->length();
-  char* line = new char[n+1];  // explicitly deallocated by clients of SaveCharArray
-  memmove(line, arr->base(), n);
-  line[n] = '\0';
-  return line;
+// The CSV intrinsics treat their argument as a C string, ignoring
+// everything from the first NUL byte on.
+static int CSVLength(BytesVal* b) {
+  const char* nul =
+    static_cast<const char*>(memchr(b->base(), '\0', b->length()));
+  return nul != NULL ? nul - b->base() : b->length();
 }
 
 
@@ -173,46 +180,48 @@ static const char splitcsvline_doc[] =
 static void splitcsvline(Proc* proc, Val**& sp) {
   BytesVal* aline = Engine::pop_bytes(sp);
 
-  vector<char*> values;
-  char* line = SaveCharArray(aline);
-  SplitCSVLine(line, &values);
+  vector<CSVField> values;
+  SplitCSVLine(aline->base(), CSVLength(aline), &values);
 
   ArrayVal* strs = Factory::NewBytesArray(proc, values.size());
+  BytesVal* empty = NULL;
   for (int i = 0; i < values.size(); i++)
-    strs->at(i) = Factory::NewBytesC(proc, values[i]);
+    strs->at(i) = NewCSVField(proc, aline, values[i], &empty);
 
-  delete[] line;
+  if (empty != NULL)
+    empty->dec_ref();
   aline->dec_ref();
   Engine::push(sp, strs);
 }
 
-// Try to save a pointer to the start of field n (1 indexed).
+// Try to save field n (1 indexed) of a line starting at line_origin.
 // Return true iff we were able to.
-static bool SaveField(int n, char* line, vector<char*> *fields, vector<char*> *results) {
+static bool SaveField(int n, int line_origin, const vector<CSVField>& fields,
+                      vector<CSVField>* results) {
   if (n < 0) {
     return false;
   } else if (n == 0) {
     // It would be consistent with matchstrs to use field 0 to
-    // refer to the entire line, but by the time we get here
-    // the original has been destroyed by SplitCSVLine
-    // (quotes removed, contents shifted) so we can't easily do it.
+    // refer to the entire line, but the fields of a line are not
+    // contiguous in it once quotes are removed, so we don't do it.
     // I'll leave this as a placeholder, in case we want to
     // make it work someday.
-    //  results->push_back(line);
     return false;
-  } else if (n > fields->size()) {
+  } else if (n > fields.size()) {
     // There are two possible behaviors here...
     if (false) {
       // in this mode an out of bounds field makes the result undefined.
       return false;
     } else {
       // in this mode an out of bounds field returns an empty string.
-      static char empty[] = "";
+      CSVField empty = { 0, 0, false };
       results->push_back(empty);
       return true;
     }
   } else {
-    results->push_back((*fields)[n-1]);
+    CSVField f = fields[n-1];
+    f.origin += line_origin;
+    results->push_back(f);
     return true;
   }
   return false;  // not reached
@@ -232,40 +241,42 @@ static const char* splitcsv(Proc* proc, Val**& sp) {
   BytesVal* astr = Engine::pop_bytes(sp);
   ArrayVal* aflds = Engine::pop_array(sp);
 
-  // Make a copy so we can nul terminate it,
-  // and allow SplitCSVLine to destroy it.
-
-  char* str = SaveCharArray(astr);
-  int len = astr->length();
-  char* end = str + len;
-
   // Walk the csv string, and split out the fields of each
   // line.  We do that instead of handling it all at once
-  // (which SplitCSVLine can do) so that we can make sure
-  // the right number of fields are present.
-
-  vector<char*> values;
-  char* p = str;
-  while (p < end) {
-    vector<char*> fields;
-    char* q = strchr(p, '\n');
-    if (q != NULL)
-      *q = '\0';
-    SplitCSVLine(p, &fields);
+  // so that we can make sure the right number of fields
+  // are present.  The fields are sliced out of astr when
+  // that is possible, so the input is not copied.
+  const char* str = astr->base();
+  const int len = CSVLength(astr);
+
+  vector<CSVField> values;
+  vector<CSVField> fields;
+  int p = 0;
+  while (p < len) {
+    const char* q = static_cast<const char*>(memchr(str + p, '\n', len - p));
+    const int line_end = (q != NULL) ? q - str : len;
+    fields.clear();
+    SplitCSVLine(str + p, line_end - p, &fields);
     for (int i = 0; i < aflds->length(); i++) {
       int field = aflds->at(i)->as_int()->val();
-      if (!SaveField(field, p, &fields, &values))
+      if (!SaveField(field, p, fields, &values)) {
+        int nfields = fields.size();
+        astr->dec_ref();
+        aflds->dec_ref();
         return proc->PrintError("splitcsv: field %d > %d max",
-                           field, static_cast<int>(fields.size()));
+                                field, nfields);
+      }
     }
-    p = (q == NULL) ? end : q+1;
+    p = line_end + 1;
   }
 
   ArrayVal* strs = Factory::NewBytesArray(proc, values.size());
+  BytesVal* empty = NULL;
   for (int i = 0; i < values.size(); i++)
-    strs->at(i) = Factory::NewBytesC(proc, values[i]);
+    strs->at(i) = NewCSVField(proc, astr, values[i], &empty);
 
-  delete[] str;
+  if (empty != NULL)
+    empty->dec_ref();
   astr->dec_ref();
   aflds->dec_ref();
   Engine::push(sp, strs);
@@ -273,57 +284,101 @@ static const char* splitcsv(Proc* proc, Val**& sp) {
 }
 
 
-// Helper to split a string of CSV values.
-// Modifies the input string by inserting nulls to terminate the values
-// and removing whitespace and quote escaping.
-static void SplitCSVLine(char* line, vector<char*>* cols) {
-  char* end_of_line = line + strlen(line);
-  char* end;
-  char* start;
-
-  for (; line < end_of_line; line++) {
+// Helper to split a line of CSV values.  Fields are separated by commas;
+// leading whitespace is skipped and, for unquoted fields, trailing
+// whitespace is dropped.  A field starting with a quote extends to the
+// next single quote, with [""] standing for ["]; anything between the
+// closing quote and the next comma is ignored.  The scans for quotes and
+// commas use memchr, which examines many bytes at a time.
+static void SplitCSVLine(const char* line, int length, vector<CSVField>* cols) {
+  int pos = 0;
+  while (pos < length) {
     // Skip leading whitespace
-    while (ascii_isspace(*line))
-      ++line;
-
-    if (*line == '"') {     // Quoted value...
-      start = ++line;
-      end = start;
-      for (; *line; line++) {
-        if (*line == '"') {
-          line++;
-          if (*line != '"')  // [""] is an escaped ["]
-            break;           // but just ["] is end of value
+    while (pos < length && ascii_isspace(line[pos]))
+      ++pos;
+
+    CSVField f;
+    f.escaped = false;
+    int end;  // position of the comma ending the field, or length
+    if (pos < length && line[pos] == '"') {  // Quoted value...
+      f.origin = ++pos;
+      f.length = length - pos;  // if there is no closing quote
+      for (;;) {
+        const char* q =
+          static_cast<const char*>(memchr(line + pos, '"', length - pos));
+        if (q == NULL) {
+          pos = length;
+          break;
+        }
+        pos = q - line + 1;
+        if (pos < length && line[pos] == '"') {
+          // [""] is an escaped ["]
+          f.escaped = true;
+          ++pos;
+        } else {
+          // but just ["] is end of value
+          f.length = q - line - f.origin;
+          break;
         }
-        *end++ = *line;
       }
       // All characters after the closing quote and before the comma
       // are ignored.
-      line = strchr(line, ',');
-      if (line == NULL)
-        line = end_of_line;
+      const char* c =
+        static_cast<const char*>(memchr(line + pos, ',', length - pos));
+      end = (c != NULL) ? c - line : length;
     } else {
-      start = line;
-      line = strchr(line, ',');
-      if (line == NULL)
-        line = end_of_line;
+      f.origin = pos;
+      const char* c =
+        static_cast<const char*>(memchr(line + pos, ',', length - pos));
+      end = (c != NULL) ? c - line : length;
       // Skip all trailing whitespace
-      for (end = line; end > start && ascii_isspace(end[-1]); --end)
-        ;
+      int e = end;
+      while (e > pos && ascii_isspace(line[e - 1]))
+        --e;
+      f.length = e - pos;
     }
-    const bool need_another_column =
-      (*line == ',') && (line == end_of_line - 1);
-    *end = '\0';
-    cols->push_back(start);
-    // If line was something like [paul,] (comma is the last character
-    // and is not proceeded by whitespace or quote) then we are about
-    // to eliminate the last column (which is empty). This would be
-    // incorrect.
-    if (need_another_column)
-      cols->push_back(end);
-
-    assert(*line == '\0' || *line == ',');
+    cols->push_back(f);
+    // If line was something like [paul,] (comma is the last character)
+    // then there is another, empty, column after the comma.
+    if (end == length - 1) {
+      CSVField empty = { end + 1, 0, false };
+      cols->push_back(empty);
+    }
+    pos = end + 1;
+  }
+}
+
+
+// Helper to make the value of a field of line found by SplitCSVLine.
+// Fields without escaped quotes are slices of line; empty fields share
+// the value *empty, which is allocated on first use.
+static BytesVal* NewCSVField(Proc* proc, BytesVal* line, const CSVField& f,
+                             BytesVal** empty) {
+  if (f.length == 0) {
+    if (*empty == NULL)
+      *empty = Factory::NewBytes(proc, 0);
+    (*empty)->inc_ref();
+    return *empty;
+  }
+  if (!f.escaped) {
+    line->inc_ref();
+    return SymbolTable::bytes_form()->NewSlice(proc, line, f.origin, f.length);
+  }
+  // Copy the field, dropping the second quote of each pair.
+  const char* p = line->base() + f.origin;
+  const char* end = p + f.length;
+  int n = 0;
+  for (const char* q = p; q < end; q++, n++)
+    if (*q == '"')
+      q++;
+  BytesVal* b = Factory::NewBytes(proc, n);
+  char* d = b->base();
+  for (; p < end; p++) {
+    *d++ = *p;
+    if (*p == '"')
+      p++;
   }
+  return b;
 }
 
 
@@ -14,14 +14,17 @@
 // ------------------------------------------------------------------------
 
 // TODO:
-// * implement user supplied cmp function.
 // * more regression tests.
 // * check for memory problems!
 
 #include <stdlib.h>
+#include <string.h>
 #include <assert.h>
+#include <pthread.h>
+#include <unistd.h>
 #include <algorithm>
 #include <functional>
+#include <vector>
 
 #include "engine/globals.h"
 #include "public/logging.h"
@@ -61,73 +64,416 @@ static int qcompare(Val* const* x, Val* const* y) {
 }
 
 
-// A binary predicate for STL compare using a level of indirection.
-class CompareIndirect : public binary_function<Val*, Val*, bool> {
+// ----------------------------------------------------------------------------
+// Sort kernels.
+//
+// Arrays are sorted as permutations of their indices.  For arrays of
+// basic types the keys are first copied out of the elements into a
+// scratch buffer next to their indices, so that comparisons do not go
+// through the Val forms: numeric keys are mapped to unsigned integers of
+// the same order and radix sorted, and string and bytes keys are merge
+// sorted, in parallel for large arrays.  All the sorts are stable, so
+// equal elements keep their relative order.
+
+// Arrays at least this long have their string keys sorted by several
+// threads.  The helper threads are started on the first such sort and
+// kept for later ones.
+static const int kParallelSortThreshold = 1 << 16;
+static const int kMaxSortThreads = 4;
+
+
+// Numeric keys.
+
+struct NumericKey {
+  uint64 key;
+  int index;
+};
+
+
+// Map values to unsigned integers with the same order.
+static inline uint64 OrderedBits(szl_int x) {
+  return static_cast<uint64>(x) ^ (1ULL << 63);
+}
+
+
+static inline uint64 OrderedBits(double x) {
+  if (x == 0.0)
+    x = 0.0;  // -0.0 compares equal to 0.0
+  uint64 bits;
+  memcpy(&bits, &x, sizeof(bits));
+  return (bits & (1ULL << 63)) ? ~bits : (bits | (1ULL << 63));
+}
+
+
+// Least significant digit first radix sort of 8-bit digits, skipping the
+// digits in which all the keys agree.
+static void RadixSortKeys(vector<NumericKey>* keys) {
+  const int n = keys->size();
+  if (n < 2)
+    return;
+  vector<int> counts(8 * 256, 0);
+  for (int i = 0; i < n; i++) {
+    uint64 key = (*keys)[i].key;
+    for (int d = 0; d < 8; d++)
+      counts[d * 256 + ((key >> (8 * d)) & 0xff)]++;
+  }
+  vector<NumericKey> buffer(n);
+  for (int d = 0; d < 8; d++) {
+    int* count = &counts[d * 256];
+    if (count[((*keys)[0].key >> (8 * d)) & 0xff] == n)
+      continue;  // all keys have the same digit
+    int offset = 0;
+    for (int b = 0; b < 256; b++) {
+      int c = count[b];
+      count[b] = offset;
+      offset += c;
+    }
+    for (int i = 0; i < n; i++) {
+      const NumericKey& k = (*keys)[i];
+      buffer[count[(k.key >> (8 * d)) & 0xff]++] = k;
+    }
+    keys->swap(buffer);
+  }
+}
+
+
+// String and bytes keys.
+
+struct StringKey {
+  const char* base;
+  int length;
+  int index;
+};
+
+
+struct StringKeyLess {
+  bool operator()(const StringKey& a, const StringKey& b) const {
+    int d = memcmp(a.base, b.base, min(a.length, b.length));
+    if (d != 0)
+      return d < 0;
+    return a.length < b.length;
+  }
+};
+
+
+struct SortRange {
+  StringKey* begin;
+  StringKey* end;
+};
+
+
+static void StableSortRange(SortRange* range) {
+  stable_sort(range->begin, range->end, StringKeyLess());
+}
+
+
+// A chunk waiting for a sort thread, and the count of unsorted chunks of
+// the sort it belongs to.
+struct SortTask {
+  SortRange* range;
+  int* pending;
+};
+
+
+// The helper threads share one queue of chunks.  Sorts from several
+// Procs may be in flight at once; each one waits for its own chunks.
+static pthread_mutex_t sort_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t sort_work = PTHREAD_COND_INITIALIZER;  // task queued
+static pthread_cond_t sort_done = PTHREAD_COND_INITIALIZER;  // task done
+static vector<SortTask>* sort_queue = NULL;
+static int sort_threads = 0;
+
+
+// Sort a queued chunk; called and returns with sort_mutex held.
+static void RunSortTask() {
+  SortTask task = sort_queue->back();
+  sort_queue->pop_back();
+  pthread_mutex_unlock(&sort_mutex);
+  StableSortRange(task.range);
+  pthread_mutex_lock(&sort_mutex);
+  if (--*task.pending == 0)
+    pthread_cond_broadcast(&sort_done);
+}
+
+
+static void* SortThread(void* arg) {
+  pthread_mutex_lock(&sort_mutex);
+  for (;;) {
+    while (sort_queue->empty())
+      pthread_cond_wait(&sort_work, &sort_mutex);
+    RunSortTask();
+  }
+  return NULL;
+}
+
+
+// Start up to nthreads - 1 helper threads, if not already done; called
+// with sort_mutex held.  If no thread can be started the sorting thread
+// sorts every chunk itself.
+static void StartSortThreads(int nthreads) {
+  if (sort_queue == NULL)
+    sort_queue = new vector<SortTask>;
+  while (sort_threads < nthreads - 1) {
+    pthread_t thread;
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    bool started = pthread_create(&thread, &attr, SortThread, NULL) == 0;
+    pthread_attr_destroy(&attr);
+    if (!started)
+      break;
+    sort_threads++;
+  }
+}
+
+
+// Sort the keys in chunks on separate threads, then merge the chunks.
+// std::inplace_merge takes from the first range on ties, so the result
+// is stable.
+static void ParallelSortKeys(vector<StringKey>* keys) {
+  const int n = keys->size();
+  int nthreads = 1;
+  if (n >= kParallelSortThreshold) {
+    long ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+    nthreads = max(1, static_cast<int>(min<long>(ncpus, kMaxSortThreads)));
+  }
+  SortRange ranges[kMaxSortThreads];
+  StringKey* base = (n > 0) ? &(*keys)[0] : NULL;
+  for (int t = 0; t < nthreads; t++) {
+    ranges[t].begin = base + static_cast<int64>(n) * t / nthreads;
+    ranges[t].end = base + static_cast<int64>(n) * (t + 1) / nthreads;
+  }
+  if (nthreads == 1) {
+    StableSortRange(&ranges[0]);
+    return;
+  }
+  // Queue all but the first chunk and sort that one on this thread.
+  // While waiting, sort any queued chunk, so the sort finishes even if
+  // the helper threads are busy or could not be started.
+  int pending = nthreads - 1;
+  pthread_mutex_lock(&sort_mutex);
+  StartSortThreads(nthreads);
+  for (int t = 1; t < nthreads; t++) {
+    SortTask task = { &ranges[t], &pending };
+    sort_queue->push_back(task);
+  }
+  pthread_cond_broadcast(&sort_work);
+  pthread_mutex_unlock(&sort_mutex);
+  StableSortRange(&ranges[0]);
+  pthread_mutex_lock(&sort_mutex);
+  while (pending > 0) {
+    if (!sort_queue->empty())
+      RunSortTask();
+    else
+      pthread_cond_wait(&sort_done, &sort_mutex);
+  }
+  pthread_mutex_unlock(&sort_mutex);
+  for (int width = 1; width < nthreads; width *= 2) {
+    for (int t = 0; t + width < nthreads; t += 2 * width) {
+      int last = min(t + 2 * width, nthreads) - 1;
+      inplace_merge(ranges[t].begin, ranges[t + width].begin, ranges[last].end,
+                    StringKeyLess());
+    }
+  }
+}
+
+
+// A binary predicate for STL compare using a level of indirection;
+// used for element types without a specialized kernel.
+class CompareIndirect : public binary_function<int, int, bool> {
  public:
   CompareIndirect(Val** array) : array_(array) { }
-  bool operator()(Val* vi, Val* vj);
+  bool operator()(int i, int j) const {
+    return qcompare(&array_[i], &array_[j]) < 0;
+  }
  private:
   Val** array_;
 };
 
 
-bool CompareIndirect::operator()(Val* vi, Val* vj)  {
-  int i;
-  int j;
-  if (TaggedInts::is_null(vi)) {
-    ShouldNotReachHere();  // checked statically
-    i =  TaggedInts::as_int(0);
+// Compute the permutation that sorts an Array: order[i] is the index in a
+// of the i'th smallest element.
+static void SortPermutation(ArrayVal* a, vector<int>* order) {
+  const int len = a->length();
+  order->resize(len);
+  if (len == 0)
+    return;
+  Type* elem_type = a->type()->as_array()->elem_type();
+  if (elem_type->is_int() || elem_type->is_uint() || elem_type->is_float() ||
+      elem_type->is_time() || elem_type->is_fingerprint() ||
+      elem_type->is_bool()) {
+    vector<NumericKey> keys(len);
+    for (int i = 0; i < len; i++) {
+      Val* v = a->at(i);
+      uint64 key;
+      if (elem_type->is_int())
+        key = OrderedBits(v->as_int()->val());
+      else if (elem_type->is_float())
+        key = OrderedBits(v->as_float()->val());
+      else if (elem_type->is_uint())
+        key = v->as_uint()->val();
+      else if (elem_type->is_time())
+        key = v->as_time()->val();
+      else if (elem_type->is_fingerprint())
+        key = v->as_fingerprint()->val();
+      else
+        key = v->as_bool()->val();
+      keys[i].key = key;
+      keys[i].index = i;
+    }
+    RadixSortKeys(&keys);
+    for (int i = 0; i < len; i++)
+      (*order)[i] = keys[i].index;
+  } else if (elem_type->is_string() || elem_type->is_bytes()) {
+    vector<StringKey> keys(len);
+    for (int i = 0; i < len; i++) {
+      Val* v = a->at(i);
+      if (elem_type->is_string()) {
+        keys[i].base = v->as_string()->base();
+        keys[i].length = v->as_string()->length();
+      } else {
+        keys[i].base = v->as_bytes()->base();
+        keys[i].length = v->as_bytes()->length();
+      }
+      keys[i].index = i;
+    }
+    ParallelSortKeys(&keys);
+    for (int i = 0; i < len; i++)
+      (*order)[i] = keys[i].index;
   } else {
-    i = TaggedInts::as_int(vi);
+    for (int i = 0; i < len; i++)
+      (*order)[i] = i;
+    stable_sort(order->begin(), order->end(), CompareIndirect(&a->at(0)));
   }
-  if (TaggedInts::is_null(vj)) {
-    ShouldNotReachHere();  // checked statically
-    j =  TaggedInts::as_int(0);
-  } else {
-    j = TaggedInts::as_int(vj);
+}
+
+
+// Calls a Sawzall comparison function on pairs of array elements.  The
+// array and the function stay in the intrinsic's argument slots, args[0]
+// and args[1], while the function runs below them on the stack; a
+// garbage collection during the call may move them, so they are loaded
+// from the slots for every call.  After the first failed call, error()
+// is set and all elements compare equal.
+class CompareClosure {
+ public:
+  CompareClosure(Proc* proc, Val** args)
+      : proc_(proc), args_(args), error_(NULL) { }
+  // Whether element i sorts before element j.
+  bool Less(int i, int j) {
+    if (error_ != NULL)
+      return false;
+    ArrayVal* a = args_[0]->as_array();
+    Val* cmp_args[2] = { a->at(i), a->at(j) };
+    Val* result;
+    error_ = proc_->CallClosure(args_[1]->as_closure(), args_, cmp_args, 2,
+                                &result);
+    if (error_ != NULL)
+      return false;
+    bool less = result->as_int()->val() < 0;
+    result->dec_ref();
+    return less;
+  }
+  const char* error() const  { return error_; }
+
+ private:
+  Proc* proc_;
+  Val** args_;
+  const char* error_;
+};
+
+
+// Bottom-up stable merge sort of the permutation order.  Unlike
+// std::stable_sort it does not need a strict weak ordering: whatever
+// the comparison function returns, the result is a permutation, only in
+// an unspecified order.  Runs that are already in order are not merged.
+static void MergeSortPermutation(vector<int>* order, CompareClosure* cmp) {
+  const int n = order->size();
+  vector<int> buffer(n);
+  int* from = &(*order)[0];
+  int* to = &buffer[0];
+  for (int width = 1; width < n && cmp->error() == NULL; width *= 2) {
+    for (int lo = 0; lo < n; lo += 2 * width) {
+      const int mid = min(lo + width, n);
+      const int hi = min(lo + 2 * width, n);
+      if (mid == hi || !cmp->Less(from[mid], from[mid - 1])) {
+        copy(from + lo, from + hi, to + lo);
+        continue;
+      }
+      int i = lo;
+      int j = mid;
+      int k = lo;
+      while (i < mid && j < hi) {
+        // take from the left run on ties, for stability
+        if (cmp->Less(from[j], from[i]))
+          to[k++] = from[j++];
+        else
+          to[k++] = from[i++];
+      }
+      copy(from + i, from + mid, to + k);
+      copy(from + j, from + hi, to + k + (mid - i));
+    }
+    swap(from, to);
   }
-  return qcompare(&array_[i], &array_[j]) < 0;
+  if (from != &(*order)[0])
+    copy(from, from + n, order->begin());
+}
+
+
+// Compute the permutation that sorts the array in args[0], using the
+// comparison function in args[1] if it is not NULL.  args points to the
+// intrinsic's arguments on the interpreter stack (see CompareClosure).
+// Returns an error message if a call of the comparison function failed,
+// NULL otherwise.
+static const char* SortPermutation(Proc* proc, Val** args,
+                                   vector<int>* order) {
+  if (args[1] == NULL) {
+    SortPermutation(args[0]->as_array(), order);
+    return NULL;
+  }
+  const int len = args[0]->as_array()->length();
+  order->resize(len);
+  for (int i = 0; i < len; i++)
+    (*order)[i] = i;
+  if (len < 2)
+    return NULL;
+  CompareClosure cmp(proc, args);
+  MergeSortPermutation(order, &cmp);
+  return cmp.error();
 }
 
 
 // Sort an Array
-static ArrayVal* QSortArray(Proc* proc, ArrayVal* a, ClosureVal* cmp) {
-  // Note: cmp is currently not used, because we can't yet reenter the
-  // interpreter from an intrinsic.  That will be fixed in a future version.
+static const char* QSortArray(Proc* proc, Val** args, ArrayVal** result) {
+  vector<int> order;
+  const char* error = SortPermutation(proc, args, &order);
+  if (error != NULL)
+    return error;
+
+  ArrayVal* a = args[0]->as_array();
   const int len = a->length();
   ArrayVal* vals = a->type()->as_array()->form()->NewVal(proc, len);
-
   for (int i = 0; i < len; ++i) {
-    vals->at(i) = a->at(i);
+    vals->at(i) = a->at(order[i]);
     vals->at(i)->inc_ref();
   }
-
-  if (len > 0)
-    qsort(&vals->at(0), len, sizeof(Val*),
-          reinterpret_cast<int(*)(const void*, const void*)>(&qcompare));
-  return vals;
+  *result = vals;
+  return NULL;
 }
 
 
 // Compute the permutation that sorts an Array.
-static ArrayVal* GradeUp(Proc* proc, ArrayVal* a, ClosureVal* cmp) {
-  // Note: cmp is currently not used, because we can't yet reenter the
-  // interpreter from an intrinsic.  That will be fixed in a future version.
-  const int len = a->length();
-  ArrayVal* indices = Factory::NewIntArray(proc, len);
-
-  // The idea is that we can qsort the array of Val*s, but
-  // we also want the sorting permutation.  So, we introduce
-  // a layer of indirection: an array of pointers to Val*s,
-  // qsort that, and then compute where the pointers moved.
+static const char* GradeUp(Proc* proc, Val** args, ArrayVal** result) {
+  vector<int> order;
+  const char* error = SortPermutation(proc, args, &order);
+  if (error != NULL)
+    return error;
 
+  const int len = order.size();
+  ArrayVal* indices = Factory::NewIntArray(proc, len);
   for (int i = 0; i < len; ++i)
-    indices->at(i) = Factory::NewInt(proc, i);
-
-  if (len > 0)
-    sort(&indices->at(0), &indices->at(0) + len, CompareIndirect(&a->at(0)));
-
-  return indices;
+    indices->at(i) = Factory::NewInt(proc, order[i]);
+  *result = indices;
+  return NULL;
 }
 
 
@@ -136,23 +482,28 @@ static const char sort_doc[] =
   "sort(array of basic_type) -- return the sorted version of an array. "
   "Only scalar values can be sorted. "
   "Values will be arranged in increasing order. "
-  "(An optional comparison function, which takes two elements and "
-  "returns int {-,0,+}, is accepted as a second argument, "
-  "but it is curently ignored.) ";
+  "An optional comparison function, which takes two elements and "
+  "returns int {-,0,+}, may be supplied as a second argument; "
+  "elements that compare equal keep their relative order. "
+  "(Comparison functions are not supported in native mode.) ";
 
-static void sort(Proc* proc, Val**& sp) {
-  ArrayVal* aval = Engine::pop_array(sp);
-  Val* v = Engine::pop(sp);
-  ClosureVal* cval = v != NULL ? v->as_closure() : NULL;
+static const char* sort(Proc* proc, Val**& sp) {
+  // The arguments are the array and the comparison function, or NULL.
   // Notice that although the szl sort function is variadic, this is not.
   // The szl compiler is responsible for supplying a NULL value for the
-  // closure if necessary.
-
-  ArrayVal* bval = QSortArray(proc, aval, cval);
+  // closure if necessary.  They stay on the stack until the sort is
+  // done (see CompareClosure).
+  ArrayVal* bval;
+  const char* error = QSortArray(proc, sp, &bval);
 
+  ArrayVal* aval = Engine::pop_array(sp);
+  Val* cval = Engine::pop(sp);
   aval->dec_ref();
   cval->dec_ref();
+  if (error != NULL)
+    return error;
   Engine::push(sp, bval);
+  return NULL;
 }
 
 
@@ -161,20 +512,24 @@ static const char sortx_doc[] =
   "sortx(array of basic_type) -- return the index vector that sorts an array. "
   "Only scalar values can be sorted. "
   "The index vector arranges array values in increasing order. "
-  "(An optional comparison function, which takes two elements and "
-  "returns int {-,0,+}, is accepted as a second argument, "
-  "but it is curently ignored.) ";
+  "An optional comparison function, which takes two elements and "
+  "returns int {-,0,+}, may be supplied as a second argument; "
+  "elements that compare equal keep their relative order. "
+  "(Comparison functions are not supported in native mode.) ";
 
-static void sortx(Proc* proc, Val**& sp) {
-  ArrayVal* aval = Engine::pop_array(sp);
-  Val* v = Engine::pop(sp);
-  ClosureVal* cval = v ? v->as_closure() : NULL;
-
-  ArrayVal* bval = GradeUp(proc, aval, cval);
+static const char* sortx(Proc* proc, Val**& sp) {
+  // The arguments stay on the stack until the sort is done (see sort).
+  ArrayVal* bval;
+  const char* error = GradeUp(proc, sp, &bval);
 
+  ArrayVal* aval = Engine::pop_array(sp);
+  Val* cval = Engine::pop(sp);
   aval->dec_ref();
   cval->dec_ref();
+  if (error != NULL)
+    return error;
   Engine::push(sp, bval);
+  return NULL;
 }
 
 
@@ -51,6 +51,10 @@
 typedef unsigned long uLong;
 
 
+DEFINE_int32(gunzip_threads, 1, "number of threads gunzip() uses for block "
+             "gzip data of 1MB or more (0 => one per CPU)");
+
+
 namespace sawzall {
 
 static const char zlibuncompress_doc[] =
@@ -111,13 +115,15 @@ static const char* zlibcompress(Proc* proc, Val**& sp) {
 
 static const char gunzip_doc[] =
   "Decompress gzip compressed data. The data must contain a valid gzip header "
-  "and footer (as in a .gz file), but data after the footer is ignored.";
+  "and footer (as in a .gz file), but data after the footer is ignored, "
+  "except that all the blocks of block gzip (BGZF) data are decompressed.";
 
 static const char* gunzip(Proc* proc, Val**& sp) {
   BytesVal* argument = Engine::pop_bytes(sp);
   string uncompressed;
   const char* error = NULL;
-  if (GunzipString(argument->u_base(), argument->length(), &uncompressed)) {
+  if (GunzipString(argument->u_base(), argument->length(), &uncompressed,
+                   FLAGS_gunzip_threads)) {
     BytesVal* result = Factory::NewBytesInit(proc, uncompressed.length(),
                                              uncompressed.c_str());
     Engine::push(sp, result);
@@ -0,0 +1,168 @@
+// Copyright 2010 Google Inc.
+// 
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+// 
+//      http://www.apache.org/licenses/LICENSE-2.0
+// 
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ------------------------------------------------------------------------
+
+// A columnar file format for protocol buffer input records.
+//
+// Most programs read only a few fields of their input proto, yet a record
+// file makes them read and skip every field of every record.
+// ColumnarInputWriter splits each record by top-level field number and
+// stores the records in row groups: for each field that occurs in a row
+// group, a column chunk holds
+//   - the number of occurrences of the field in each record, run-length
+//     encoded, and
+//   - the occurrences themselves, each as its wire-format tag and value
+//     (a nested message is kept whole), dictionary encoded if they have
+//     few distinct values and stored plainly otherwise.
+// Each chunk is compressed with deflate when that makes it smaller.  A
+// footer lists, for each row group, its number of records and the field
+// number, position, sizes and CRC-32C of each of its chunks:
+//
+//   file:    "SZLCOL1\n", column chunks, footer,
+//            footer size (4 bytes), footer CRC-32C (4 bytes), "SZLCOL1\n"
+//
+// ColumnarInputReader reads only the chunks of the selected fields (see
+// sawzall::Executable::GetReferencedInputFieldTags) and reassembles each
+// record from them.  Within a record the fields come in increasing order
+// of field number, which is the order in which protocol buffers are
+// serialized, and the occurrences of a field keep their order; with all
+// fields selected a serialized proto is returned unchanged.  A record
+// without the unselected fields converts to the same Sawzall tuple as
+// the original, as long as the program does not read those fields.
+
+#ifndef _PUBLIC_COLUMNARINPUT_H__
+#define _PUBLIC_COLUMNARINPUT_H__
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+namespace sawzall {
+
+
+class ColumnarInputWriter {
+ public:
+  // Default maximum number of records in a row group.
+  static const int kDefaultRowGroupRecords = 65536;
+
+  // Creates a writer for a new file; returns NULL and sets *error on
+  // failure.  A row group is written when it reaches row_group_records
+  // records or about 16 megabytes of data.
+  static ColumnarInputWriter* Open(const char* filename,
+                                   int row_group_records, string* error);
+
+  // Closes the file if Close() has not been called.
+  ~ColumnarInputWriter();
+
+  // Add a record, which must be a protocol buffer in wire format.
+  // Returns false, without adding it, if it is not; returns false on a
+  // write error, and for every record after one.
+  bool Write(const char* record_ptr, size_t record_size);
+
+  // Write the last row group and the footer, and close the file.  Returns
+  // false if writing any row group failed; the footer is then left out,
+  // so the file cannot be opened.  Rejected records do not count.
+  bool Close();
+
+  const string& error_message() const  { return error_message_; }
+
+ private:
+  struct Column;
+
+  ColumnarInputWriter(FILE* file, int row_group_records);
+
+  // Encode and write the buffered records.
+  bool WriteRowGroup();
+
+  FILE* file_;
+  const int row_group_records_;
+  uint64 offset_;  // offset in the file of the next byte written
+  // The buffered records, split into columns.
+  int num_records_;
+  int64 num_bytes_;
+  vector<Column*> columns_;         // sorted by field number
+  vector<pair<int, int> > fields_;  // (field number, end) of each field
+  // The descriptions of the row groups written.
+  int num_row_groups_;
+  string footer_;
+  bool failed_;    // a row group could not be encoded or written
+  string error_message_;
+};
+
+
+class ColumnarInputReader {
+ public:
+  // Opens a file written by ColumnarInputWriter; returns NULL and sets
+  // *error on failure.  Initially all fields are selected.
+  static ColumnarInputReader* Open(const char* filename, string* error);
+
+  ~ColumnarInputReader();
+
+  // Select the fields to read, by field number.  Takes effect when the
+  // next row group is read, by Read or SeekToRecord.
+  void SelectFields(const vector<int>& tags);
+  void SelectAllFields();
+
+  // Read the next record, made of the selected fields; the record stays
+  // valid until the next call.  Returns false at the end of the file or
+  // on error; error_message() is empty in the first case.
+  bool Read(const char** record_ptr, size_t* record_size);
+
+  // Positions the file so that the next Read returns the record numbered
+  // record_number, reading only the row group that holds it.  Returns
+  // false if the file has fewer records.
+  bool SeekToRecord(uint64 record_number);
+
+  // The number of the record returned by the last Read, counting from 0;
+  // -1 before the first.
+  int64 record_number() const  { return record_number_; }
+
+  // The number of records in the file.
+  uint64 num_records() const  { return num_records_; }
+
+  // The number of bytes of column chunks read so far.
+  uint64 bytes_read() const  { return bytes_read_; }
+
+  const string& error_message() const  { return error_message_; }
+
+ private:
+  struct RowGroup;
+  struct Chunk;
+
+  explicit ColumnarInputReader(FILE* file);
+
+  bool ReadFooter(string* error);
+
+  // Read and decode the selected chunks of row group i.
+  bool ReadRowGroup(int i);
+
+  FILE* file_;
+  vector<RowGroup*> row_groups_;
+  uint64 num_records_;
+  bool all_fields_;
+  vector<int> tags_;  // sorted; used if !all_fields_
+  // The current row group, its decoded chunks and the position in it.
+  int row_group_;
+  int next_record_;
+  vector<Chunk*> chunks_;
+  int64 record_number_;
+  string record_;
+  uint64 bytes_read_;
+  string error_message_;
+};
+
+
+}  // namespace sawzall
+
+#endif  // _PUBLIC_COLUMNARINPUT_H__
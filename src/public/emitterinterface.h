@@ -126,6 +126,19 @@ class Emitter {
   // b) Shorthand for
   // Begin(EMIT, 1) Begin(ELEMENT, 1) PutFloat(i) End(ELEMENT, 1) End(EMIT, 1)
   virtual void EmitFloat(double f) = 0;
+
+  // Optional encoded emits (do not use the Begin/End protocol).
+  // An emitter that stores its keys and values in the SzlEncoder format
+  // can accept complete emits encoded by the engine in one call, which
+  // avoids a virtual call per element of compound values.  If
+  // AcceptsEncodedEmits() returns true, emits to tables without a weight
+  // are delivered through EmitEncoded(); key is the encoding of the
+  // index values (empty if there are none) and value the encoding of
+  // the element, with tuple markers only around tuples that are array
+  // or map elements.
+  virtual bool AcceptsEncodedEmits() const  { return false; }
+  virtual void EmitEncoded(const char* key, int key_len,
+                           const char* value, int value_len)  { }
 };
 
 
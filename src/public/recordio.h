@@ -14,6 +14,26 @@
 // ------------------------------------------------------------------------
 
 // Simple record reader and writer.
+//
+// Two file formats are supported.  A plain record file is a sequence of
+// records, each preceded by its length as a varint.  An indexed record
+// file (version 2) groups the records into blocks:
+//
+//   file header:  "SZLREC2\n", block size (4 bytes), 4 reserved bytes,
+//                 16 byte sync marker, random for each file
+//   blocks:       sync marker, block header, payload
+//   index block:  sync marker, block header, (offset, first record) of
+//                 each record block as pairs of 8 byte integers
+//   footer:       offset of the index block (8 bytes), "SZLRIDX\n"
+//
+// A block header holds the type of the block, the stored and the raw
+// size of the payload, the number of records in the block, the number of
+// the first one, the CRC-32C of the payload and the CRC-32C of the header
+// itself; integers are little-endian.  The raw payload holds the records
+// in the plain format, and is stored compressed with deflate when that
+// makes it smaller.  The sync markers let a reader find the blocks from
+// any offset, to split a file or to skip a corrupt block; the index lets
+// it go to any record without reading the records before it.
 
 #include <stdio.h>
 #include <string>
@@ -23,44 +43,109 @@ namespace sawzall {
 
 class RecordReader {
  private:
-  RecordReader(FILE* file) : file_(file), buffer_(NULL), buffer_size_(0) { }
+  RecordReader(FILE* file)
+    : file_(file), buffer_(NULL), buffer_size_(0), record_number_(-1),
+      unread_pos_(0), offset_(0), blocks_(NULL) { }
  public:
-  ~RecordReader() {
-    if (file_ != NULL)
-      fclose(file_);
-    if (buffer_ != NULL)
-      delete [] buffer_;
-  }
+  ~RecordReader();
+  // Opens a file in either format.
   static RecordReader* Open(const char* filename);
   bool Read(char** record_ptr, size_t* record_size);
-  bool Eof() const { return feof(file_); }
+  bool Eof() const;
   const string& error_message() const { return error_message_; }
 
+  // The number of the record returned by the last Read, counting from 0;
+  // -1 before the first.  In an indexed file the numbering continues
+  // correctly after a corrupt block is skipped.
+  int64 record_number() const { return record_number_; }
+
+  // Positions the file so that the next Read returns the record numbered
+  // record_number.  Indexed files go straight to the block holding it;
+  // other files are read up to it.  If the record is in a corrupt block,
+  // the next Read returns the first record of the next good block, and
+  // record_number() says which.  Returns false if the file has fewer
+  // records, or no good block follows.
+  bool SeekToRecord(uint64 record_number);
+
+  // The following methods apply to indexed files only.
+  bool indexed() const { return blocks_ != NULL; }
+
+  // Positions the file at the first block that starts at or after offset.
+  // To split a file among readers, each reader seeks to the start of its
+  // byte range and reads records while block_offset() is before its end.
+  bool SeekToOffset(uint64 offset);
+
+  // The offset of the block holding the record returned by the last Read.
+  uint64 block_offset() const;
+
+  // The number of records in the file according to its index, or -1 if
+  // the index is missing or unreadable.
+  int64 num_records() const;
+
+  // The number of corrupt blocks skipped so far.
+  int corrupt_blocks() const;
+
  private:
+  struct Blocks;
+
+  bool ReadPlain(char** record_ptr, size_t* record_size);
+  bool ReadIndexed(char** record_ptr, size_t* record_size);
+  // Indexed files: returns the next record of the current block, if any.
+  bool NextInBlock(char** record_ptr, size_t* record_size);
+
+  // Reads up to size bytes, first those given back by Unread.
+  size_t ReadBytes(char* data, size_t size);
+  void Unread(const char* data, size_t size);
+  // Positions the file at offset, if it is seekable.
+  bool SeekFile(uint64 offset);
+
+  // Indexed files: reads the index at the end of the file; reads the next
+  // record block, skipping corrupt ones; finds the next sync marker.
+  void ReadIndex();
+  bool ReadBlock();
+  bool FindSync();
+
   FILE* file_;
   char* buffer_;
   size_t buffer_size_;
   string error_message_;
+  int64 record_number_;
+  string unread_;     // bytes to read again before those of the file
+  size_t unread_pos_;
+  uint64 offset_;     // offset in the file of the next byte read
+  Blocks* blocks_;    // NULL for a plain file
 };
 
 
 class RecordWriter {
  private:
-  RecordWriter(FILE* file) : file_(file) { }
+  RecordWriter(FILE* file) : file_(file), blocks_(NULL) { }
  public:
-  ~RecordWriter() {
-    if (file_ != NULL) {
-      fflush(file_);
-      fclose(file_);
-    }
-  }
+  ~RecordWriter();
+  // Creates a plain record file.
   static RecordWriter* Open(const char* filename);
+  // Creates an indexed record file whose blocks hold about block_size
+  // bytes of records; a larger record gets a block of its own.
+  static RecordWriter* OpenIndexed(const char* filename, int block_size);
   bool Write(const char* record_ptr, size_t record_size);
+  // Writes the last block and the index of an indexed file, and closes
+  // the file.  Returns false if anything failed.  Called by the
+  // destructor if needed.
+  bool Close();
   const string& error_message() const { return error_message_; }
 
  private:
+  struct Blocks;
+
+  bool WriteBytes(const char* data, size_t size);
+  // Indexed files: writes the pending records as a block; writes a block.
+  bool FlushBlock();
+  bool WriteBlock(int type, const string& payload, uint64 raw_size,
+                  uint64 num_records, uint64 first_record);
+
   FILE* file_;
   string error_message_;
+  Blocks* blocks_;  // NULL for a plain file
 };
 
 
@@ -51,6 +51,7 @@ class FunctionDecl;
 class Proc;
 class Process;
 class Profile;
+class SharedStatics;
 class Value;
 
 
@@ -87,6 +88,17 @@ bool Explain(const char* name);
 void PrintHtmlDocumentation();
 
 
+// ----------------------------------------------------------------------------
+// The input and key of one record, for Process::RunBatch.
+
+struct RecordSpan {
+  const char* input_ptr;
+  size_t input_size;
+  const char* key_ptr;
+  size_t key_size;
+};
+
+
 // ----------------------------------------------------------------------------
 // Static information for an output table
 
@@ -205,6 +217,9 @@ enum Mode {
   kSecure = 1 << 11,  // Disallow subprocesses and reading any files.  Use
                       // SetDisallowedReads to specify a more limited blacklist.
   kDoCalls = 1 << 12,  // support DoCalls
+  kShareStatics = 1 << 13,  // compute static variables once per Executable
+                            // and share them read-only between Processes
+                            // (in interpreted mode only)
 };
 
 // ErrorHandler defines the interface for custom error handlers.
@@ -250,6 +265,12 @@ class Executable {
   void GetReferencedTupleFieldNames(const string& tuple_name,
                                     vector<string>* field_names,
                                     bool internal_fields) const;
+  // Fill tags with the tags of the top-level fields of the input proto
+  // that are referenced in the program, in increasing order.  Returns
+  // false, leaving tags empty, if the program may look at more of an input
+  // record, e.g. because it uses "input" as bytes; then every field is
+  // needed.  A program that does not use "input" needs no fields.
+  bool GetReferencedInputFieldTags(vector<int>* tags) const;
 
   // Debugging
   void PrintSource();
@@ -281,6 +302,7 @@ class Executable {
  private:
   Proc* proc_;
   Compilation* compilation_;
+  SharedStatics* shared_statics_;      // NULL unless kShareStatics
   vector<TableInfo*>* tableinfo_;
   uint64 fingerprint_;                 // lazily set (kIllegalFprint initially).
 
@@ -386,6 +408,16 @@ class Process {
                 const char* key_ptr, size_t key_size);
   void RunOrDie() { RunOrDie(NULL, 0, NULL, 0); }
   bool RunAlreadySetup();
+  // Batch execution: runs the program on each of the n records in turn,
+  // with the same results as n calls of Run, but with the per-record
+  // setup done in a single loop inside the process.  If undef_counts is
+  // not NULL, undef_counts[i] is set to 1 if record i had an undefined
+  // value that was ignored, and to 0 otherwise.  Returns the number of
+  // records that ran successfully; if it is less than n, the run of the
+  // next record failed, error_msg() describes the error and the remaining
+  // records were not run.  The OrDie variant exits the program instead.
+  int RunBatch(const RecordSpan* records, int n, uint64* undef_counts);
+  void RunBatchOrDie(const RecordSpan* records, int n, uint64* undef_counts);
   // complete unfinished work.  (used for _line_counts presently)
   void Epilog(bool source);  // emit a copy of the source if true
 
@@ -0,0 +1,145 @@
+// Copyright 2010 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ------------------------------------------------------------------------
+
+// A columnar, compressed file format for flushed table entries.
+//
+// The output of a table is a sequence of (key, value) rows, as produced
+// by SzlEmitter::Flusher().  SzlColumnWriter gathers the rows into blocks
+// and stores each block column by column:
+//   - the keys, each delta encoded as the length of the prefix it shares
+//     with the previous key followed by the rest of the key; this works
+//     best with sorted keys (see SzlEmitter::set_flush_order()),
+//   - the number of encoded values in each row's value,
+//   - one column per value position: the i-th SzlEncoder value of every
+//     row, which for most tables holds a single field of the element.
+//     Each column is dictionary encoded if it has few distinct values,
+//     delta encoded if it holds only ints, and stored plainly otherwise.
+// The block is then zlib compressed and written as one record of a
+// sawzall::RecordWriter file.  Values that are not a sequence of
+// SzlEncoder values are stored whole.
+//
+// SzlColumnReader returns the rows in the order they were written, and can
+// hand the values to a SzlResults for reduce-side processing.
+
+#ifndef _PUBLIC_SZLCOLUMNFILE_H__
+#define _PUBLIC_SZLCOLUMNFILE_H__
+
+#include <string>
+#include <vector>
+
+namespace sawzall {
+class RecordReader;
+class RecordWriter;
+}
+
+class SzlResults;
+class SzlTabWriter;
+
+
+class SzlColumnWriter {
+ public:
+  // Default maximum number of rows in a block.
+  static const int kDefaultBlockRows = 4096;
+
+  // Creates a writer for a new file; returns NULL and sets *error on
+  // failure.  Blocks are written when they reach block_rows rows or about
+  // a megabyte of data.
+  static SzlColumnWriter* Open(const char* filename, int block_rows,
+                               string* error);
+
+  // Closes the file if Close() has not been called.
+  ~SzlColumnWriter();
+
+  // Add a row.  Returns false on a write error.
+  bool Write(const string& key, const string& value);
+
+  // Write the last block and close the file.  Returns false on a write
+  // error.
+  bool Close();
+
+  const string& error_message() const  { return error_message_; }
+
+ private:
+  SzlColumnWriter(sawzall::RecordWriter* file, int block_rows);
+
+  // Encode and write the buffered rows.
+  bool WriteBlock();
+
+  sawzall::RecordWriter* file_;
+  const int block_rows_;
+  // The buffered rows; entries beyond num_rows_ are kept for reuse.
+  int num_rows_;
+  int num_bytes_;
+  vector<string> keys_;
+  vector<string> values_;
+  // Reused encoding buffers.
+  string block_;
+  string compressed_;
+  string error_message_;
+};
+
+
+class SzlColumnReader {
+ public:
+  // Opens a file written by SzlColumnWriter; returns NULL and sets *error
+  // on failure.
+  static SzlColumnReader* Open(const char* filename, string* error);
+
+  ~SzlColumnReader();
+
+  // Read the next row.  Returns false at the end of the file or on error;
+  // error_message() is empty in the first case.
+  bool Next(string* key, string* value);
+
+  // Read the next row and parse its value into results.  Returns false at
+  // the end of the file, on error, or if the value cannot be parsed.
+  bool NextResults(string* key, SzlResults* results);
+
+  const string& error_message() const  { return error_message_; }
+
+ private:
+  explicit SzlColumnReader(sawzall::RecordReader* file);
+
+  // Read and decode the next block.
+  bool ReadBlock();
+
+  sawzall::RecordReader* file_;
+  // The rows of the current block and the position in it.
+  int num_rows_;
+  int next_row_;
+  vector<string> keys_;
+  vector<string> values_;
+  string block_;
+  string value_;
+  string error_message_;
+};
+
+
+// A SzlEmitter that writes its flushed entries to a SzlColumnWriter.
+class SzlColumnEmitter : public SzlEmitter {
+ public:
+  // The emitter takes ownership of writer, but not of output.
+  SzlColumnEmitter(const string& name, const SzlTabWriter* writer,
+                   SzlColumnWriter* output)
+      : SzlEmitter(name, writer, false), output_(output)  { }
+
+ protected:
+  virtual void WriteValue(const string& key, const string& value);
+
+ private:
+  SzlColumnWriter* output_;
+};
+
+#endif  // _PUBLIC_SZLCOLUMNFILE_H__
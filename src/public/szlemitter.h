@@ -19,11 +19,16 @@
 // key-value pairs. Keys and values are returned in the encoded format used by
 // SzlEncoder/SzlDecoder.
 
+#ifndef _PUBLIC_SZLEMITTER_H__
+#define _PUBLIC_SZLEMITTER_H__
+
 #include <utility>
 #include <string>
 #include <vector>
 
 #include "public/hash_map.h"
+#include "public/emitterinterface.h"
+#include "public/szlvalue.h"
 
 
 class SzlType;
@@ -83,15 +88,20 @@ class SzlEmitter : public sawzall::Emitter {
   void EmitInt(int64 i);
   void EmitFloat(double f);
 
+  // Encoded emits; accepted unless the table has a weight.
+  bool AcceptsEncodedEmits() const;
+  void EmitEncoded(const char* key, int key_len,
+                   const char* value, int value_len);
+
   // Allow merging in data from other emitters so that an emitter can be
   // reconstructed given the proper metadata.
-  bool Merge(const string& index, const string& val);
+  virtual bool Merge(const string& index, const string& val);
 
   // Diplays the results in the table.
-  void  DisplayResults();
+  virtual void DisplayResults();
 
   // Flush current results and clear the storage.
-  void Flusher();
+  virtual void Flusher();
 
   // Clear the table in the emitter.
   void Clear();
@@ -100,10 +110,13 @@ class SzlEmitter : public sawzall::Emitter {
   bool ErrorsDetected() const { return errors_detected_; }
 
   // Returns a count of the number of rows being displayed in the tables.
-  int GetTupleCount() const;
+  // Emits still buffered (see set_batch_size()) are not counted; call
+  // AddBatch() first for an exact count.
+  virtual int GetTupleCount() const;
 
-  // Returns a count of the memory used by the table.
-  int GetMemoryUsage() const;
+  // Returns a count of the memory used by the table, not counting
+  // buffered emits.
+  virtual int GetMemoryUsage() const;
 
   // Returns an estimate of the memory used by the table.
   int GetMemoryEstimate() const  { return memory_estimate_; }
@@ -111,6 +124,34 @@ class SzlEmitter : public sawzall::Emitter {
   // Return the name of the table.
   string name() const { return name_; }
 
+  // Set the maximum number of emits to aggregating tables that are
+  // buffered before being added to their entries.  Buffered emits are
+  // grouped by key, so each key is looked up once per batch and its
+  // elements are added with a single SzlTabEntry::AddElems call.
+  // A batch size of 1 (the default) adds each emit as it arrives.
+  virtual void set_batch_size(int batch_size);
+  int batch_size() const  { return batch_size_; }
+
+  // Add the buffered emits to their table entries.
+  virtual void AddBatch();
+
+  // The order in which Flusher() writes the table's entries.  By default
+  // (UNSORTED) entries come in hash table order.  SORTED writes them in
+  // increasing order of their encoded keys, which for scalar indices is
+  // the order of the index values, so the output of several emitters can
+  // be merged without sorting it again; DisplayResults() also uses this
+  // order.  SORTED_PREFIX_COMPRESSED also replaces each key written by
+  // Flusher() with the length of the prefix it shares with the previous
+  // key, as a varint, followed by the rest of the key.
+  enum FlushOrder { UNSORTED, SORTED, SORTED_PREFIX_COMPRESSED };
+  void set_flush_order(FlushOrder order)  { flush_order_ = order; }
+  FlushOrder flush_order() const  { return flush_order_; }
+
+  // Recovers a key written by a SORTED_PREFIX_COMPRESSED flush.  On entry
+  // *key is the previous key of the same flush (empty for the first one).
+  // Returns false if compressed is not a valid compressed key.
+  static bool ExpandKey(const string& compressed, string* key);
+
   SzlOps* weight_ops() { return &weight_ops_; }
 
  protected:
@@ -119,6 +160,16 @@ class SzlEmitter : public sawzall::Emitter {
   // to write to map output when using mapreduce.
   virtual void WriteValue(const string& key, const string& value);
 
+  // Find the table entry for a key, creating it if needed.
+  SzlTabEntry* FindOrCreateEntry(const string& key);
+
+  // Add the complete emit held in key_, value_ and weight_ to the table,
+  // batch or output.
+  void AddEmit();
+
+  // Return the table's entries sorted by key.
+  void SortedEntries(vector<SzlTabEntryMap::value_type*>* entries);
+
   // Factory for producing SzlTableEntries.
   const SzlTabWriter* writer_;
 
@@ -168,4 +219,18 @@ class SzlEmitter : public sawzall::Emitter {
   // Set to true if any of the operations that are being performed cause an
   // error.
   bool errors_detected_;
+
+  // See set_flush_order().
+  FlushOrder flush_order_;
+
+  // Emits buffered for aggregation; see set_batch_size().
+  // The first batch_len_ keys, values and (if weighted) weights are in use;
+  // the strings beyond that are kept to reuse their storage.
+  int batch_size_;
+  int batch_len_;
+  vector<string> batch_keys_;
+  vector<string> batch_values_;
+  vector<SzlValue> batch_weights_;
 };
+
+#endif  // _PUBLIC_SZLEMITTER_H__
@@ -0,0 +1,154 @@
+// Copyright 2010 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ------------------------------------------------------------------------
+
+// A table that can be shared by emitters running on several threads.
+// Each thread that executes a Sawzall Process gets its own SzlShardedEmitter
+// for the table; the emitters encode and stage their emits locally and
+// add them to the shared SzlShardedTable in batches.  The table's entries
+// are partitioned into shards by key hash, each with its own lock, so
+// threads only contend when they drain into the same shard at the same
+// time, and each key has exactly one SzlTabEntry no matter how many
+// threads emit to it.
+
+#ifndef _PUBLIC_SZLSHARDEDEMITTER_H__
+#define _PUBLIC_SZLSHARDEDEMITTER_H__
+
+#include <string>
+
+#include "public/emitterinterface.h"
+#include "public/szlemitter.h"
+
+
+class SzlType;
+class SzlTabEntry;
+class SzlTabWriter;
+
+class SzlShardedTable {
+ public:
+  // Receives the key/value pairs produced by Flusher and DisplayResults.
+  class Output {
+   public:
+    virtual ~Output()  { }
+    virtual void WriteValue(const string& key, const string& value) = 0;
+  };
+
+  // Creates a table of the given type, which must be an aggregating table,
+  // with num_shards shards.  Returns NULL and sets *error on failure.
+  static SzlShardedTable* Create(const SzlType& type, int num_shards,
+                                 string* error);
+
+  ~SzlShardedTable();
+
+  // Creates a new writer for the table's type.  Each SzlShardedEmitter
+  // has its own writer, as SzlEmitter takes ownership of its writer.
+  SzlTabWriter* NewWriter() const;
+
+  int num_shards() const  { return num_shards_; }
+
+  // Returns the shard holding the entry for key.
+  int ShardForKey(const string& key) const;
+
+  // Lock or unlock a shard.  The lock is not reentrant.
+  void LockShard(int shard);
+  void UnlockShard(int shard);
+
+  // Find the entry for key in shard, creating it if needed.
+  // REQUIRES: the shard is locked and key belongs to it.
+  SzlTabEntry* FindOrCreateEntry(int shard, const string& key);
+
+  // Account for memory added to entries of shard.
+  // REQUIRES: the shard is locked.
+  void AddMemoryEstimate(int shard, int delta);
+
+  // Merge an encoded value into the entry for key.  Thread-safe.
+  bool Merge(const string& key, const string& val);
+
+  // The following methods must not run concurrently with emitters
+  // draining into the table.
+
+  // Flush the entries to output and clear the table.
+  void Flusher(Output* output);
+
+  // Write the display form of the entries to output.
+  void DisplayResults(Output* output);
+
+  // Clear the table, deleting all entries.
+  void Clear();
+
+  // Returns the number of rows in the table.
+  int GetTupleCount() const;
+
+  // Returns the memory used by the entries in the table.
+  int GetMemoryUsage() const;
+
+  // Returns an estimate of the memory used by the table.
+  int GetMemoryEstimate() const;
+
+ private:
+  struct Shard;
+
+  SzlShardedTable(const SzlType& type, SzlTabWriter* writer, int num_shards);
+
+  SzlType* type_;
+  // Writer used to create entries; shared by all shards.
+  const SzlTabWriter* writer_;
+  const int num_shards_;
+  Shard* shards_;
+};
+
+
+// A per-thread emitter for a SzlShardedTable.  Emits are encoded and
+// staged as for a batched SzlEmitter; a full batch is grouped by shard and
+// key, and each shard's lock is taken once per batch.  The emitter itself
+// holds no table entries: the table methods of SzlEmitter act on the
+// whole shared table.  Before flushing or displaying the results, call
+// AddBatch on every emitter to drain its remaining staged emits.
+class SzlShardedEmitter : public SzlEmitter {
+ public:
+  // Default number of emits staged before draining into the table.
+  static const int kDefaultBatchSize = 256;
+
+  // The table must outlive the emitter.
+  SzlShardedEmitter(const string& name, SzlShardedTable* table);
+  virtual ~SzlShardedEmitter();
+
+  // Batch sizes below 2 are raised to 2; emits always go through the
+  // staging buffer so that they reach the shared table.
+  virtual void set_batch_size(int batch_size);
+
+  // Drain the staged emits into the shared table.
+  virtual void AddBatch();
+
+  // The following act on the shared table, after draining this emitter's
+  // staged emits.  Flusher and DisplayResults write every entry of the
+  // table through this emitter's WriteValue, in shard order whatever the
+  // flush order, and must not run concurrently with other emitters
+  // draining into the table.
+  virtual bool Merge(const string& index, const string& val);
+  virtual void DisplayResults();
+  virtual void Flusher();
+  // Emits staged by other emitters are not counted.
+  virtual int GetTupleCount() const;
+  virtual int GetMemoryUsage() const;
+
+ private:
+  // Passes the shared table's output to WriteValue.
+  class TableOutput;
+  friend class TableOutput;
+
+  SzlShardedTable* shared_;
+};
+
+#endif  // _PUBLIC_SZLSHARDEDEMITTER_H__
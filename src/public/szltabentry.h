@@ -53,6 +53,28 @@ class SzlTabEntry {
     return 0;
   }
 
+  // Add a batch of elements to this entry, in order.  Returns the total
+  // change in memory, as for AddElem.  Tables with significant per-element
+  // overhead may override this; by default the elements are added one at
+  // a time.
+  virtual int AddElems(const vector<const string*>& elems) {
+    int memory_delta = 0;
+    for (int i = 0; i < elems.size(); i++)
+      memory_delta += AddElem(*elems[i]);
+    return memory_delta;
+  }
+
+  // Add a batch of weighted elements to this entry, in order; weights[i]
+  // is the weight of elems[i].  By default the elements are added one at
+  // a time.
+  virtual int AddWeightedElems(const vector<const string*>& elems,
+                               const vector<const SzlValue*>& weights) {
+    int memory_delta = 0;
+    for (int i = 0; i < elems.size(); i++)
+      memory_delta += AddWeightedElem(*elems[i], *weights[i]);
+    return memory_delta;
+  }
+
   // Produce the encoded string that represents the data in this entry.
   // This value may be used for merge operations as it contains all information
   // needed for the merge.
@@ -0,0 +1,899 @@
+// Copyright 2010 Google Inc.
+// 
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+// 
+//      http://www.apache.org/licenses/LICENSE-2.0
+// 
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ------------------------------------------------------------------------
+
+#include <errno.h>
+#include <pthread.h>
+#include <string.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "zlib.h"
+
+#include "public/porting.h"
+#include "public/logging.h"
+#include "utilities/strutils.h"
+
+#include "utilities/blockgzip.h"
+
+
+namespace {
+
+// gzip header fields and flags.
+const int kGzipHeaderSize = 10;
+const int kGzipFooterSize = 8;
+const int kFlagHeaderCrc = 0x02;
+const int kFlagExtra = 0x04;
+const int kFlagName = 0x08;
+const int kFlagComment = 0x10;
+const int kOsUnknown = 0xff;
+
+// The header of a block: a gzip header with only an extra field, which
+// holds a single "BC" subfield giving the block size minus 1.
+const int kBlockHeaderSize = 18;
+const int kBlockExtraSize = 6;
+
+// Size of the window of deflate streams.
+const int kWindowSize = 1 << MAX_WBITS;
+
+// Size of the output buffer for inflating.
+const int kInflateBufferSize = 256 << 10;
+
+
+inline int Get16(const uint8* p) {
+  return p[0] | (p[1] << 8);
+}
+
+
+inline uint32 Get32(const uint8* p) {
+  return p[0] | (p[1] << 8) | (p[2] << 16) | (static_cast<uint32>(p[3]) << 24);
+}
+
+
+inline uint64 Get64(const uint8* p) {
+  return Get32(p) | (static_cast<uint64>(Get32(p + 4)) << 32);
+}
+
+
+inline void Put16(int v, char* p) {
+  p[0] = v & 0xff;
+  p[1] = (v >> 8) & 0xff;
+}
+
+
+inline void Put32(uint32 v, char* p) {
+  Put16(v & 0xffff, p);
+  Put16(v >> 16, p + 2);
+}
+
+
+inline void Put64(uint64 v, char* p) {
+  Put32(v & 0xffffffff, p);
+  Put32(v >> 32, p + 4);
+}
+
+
+// Runs work(arg, begin, end) on the ranges of [0, n) given by splitting it
+// in num_threads parts.  The calling thread does the first part; the others
+// go to helper threads, which are started on first use and kept, the same
+// way ParallelSortKeys keeps its threads.  The helpers are shared by all
+// callers and number at most kMaxThreads - 1 however many there are.
+struct ParallelPart {
+  void (*work)(void* arg, int begin, int end);
+  void* arg;
+  int begin;
+  int end;
+};
+
+const int kMaxThreads = 64;
+
+
+void RunPart(ParallelPart* part) {
+  part->work(part->arg, part->begin, part->end);
+}
+
+
+// A part waiting for a helper thread, and the count of unfinished parts
+// of the RunParallel call it belongs to.
+struct ParallelTask {
+  ParallelPart* part;
+  int* pending;
+};
+
+
+// The helper threads share one queue of parts.  Several calls may be in
+// flight at once; each one waits for its own parts.
+pthread_mutex_t parallel_mutex = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t parallel_work = PTHREAD_COND_INITIALIZER;  // part queued
+pthread_cond_t parallel_done = PTHREAD_COND_INITIALIZER;  // part done
+vector<ParallelTask>* parallel_queue = NULL;
+int parallel_threads = 0;
+
+
+// Runs a queued part; called and returns with parallel_mutex held.
+void RunParallelTask() {
+  ParallelTask task = parallel_queue->back();
+  parallel_queue->pop_back();
+  pthread_mutex_unlock(&parallel_mutex);
+  RunPart(task.part);
+  pthread_mutex_lock(&parallel_mutex);
+  if (--*task.pending == 0)
+    pthread_cond_broadcast(&parallel_done);
+}
+
+
+void* ParallelThread(void* arg) {
+  pthread_mutex_lock(&parallel_mutex);
+  for (;;) {
+    while (parallel_queue->empty())
+      pthread_cond_wait(&parallel_work, &parallel_mutex);
+    RunParallelTask();
+  }
+  return NULL;
+}
+
+
+// Starts up to nthreads - 1 helper threads, if not already done; called
+// with parallel_mutex held.  If no thread can be started the caller runs
+// every part itself.
+void StartParallelThreads(int nthreads) {
+  if (parallel_queue == NULL)
+    parallel_queue = new vector<ParallelTask>;
+  while (parallel_threads < nthreads - 1) {
+    pthread_t thread;
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    bool started = pthread_create(&thread, &attr, ParallelThread, NULL) == 0;
+    pthread_attr_destroy(&attr);
+    if (!started)
+      break;
+    parallel_threads++;
+  }
+}
+
+
+void RunParallel(int n, int num_threads,
+                 void (*work)(void* arg, int begin, int end), void* arg) {
+  const int nthreads = max(1, min(min(n, num_threads), kMaxThreads));
+  ParallelPart parts[kMaxThreads];
+  for (int t = 0; t < nthreads; t++) {
+    parts[t].work = work;
+    parts[t].arg = arg;
+    parts[t].begin = static_cast<int64>(n) * t / nthreads;
+    parts[t].end = static_cast<int64>(n) * (t + 1) / nthreads;
+  }
+  if (nthreads == 1) {
+    RunPart(&parts[0]);
+    return;
+  }
+  // Queue all but the first part and run that one on this thread.  While
+  // waiting, run any queued part, so the call finishes even if the helper
+  // threads are busy or could not be started.
+  int pending = nthreads - 1;
+  pthread_mutex_lock(&parallel_mutex);
+  StartParallelThreads(nthreads);
+  for (int t = 1; t < nthreads; t++) {
+    ParallelTask task = { &parts[t], &pending };
+    parallel_queue->push_back(task);
+  }
+  pthread_cond_broadcast(&parallel_work);
+  pthread_mutex_unlock(&parallel_mutex);
+  RunPart(&parts[0]);
+  pthread_mutex_lock(&parallel_mutex);
+  while (pending > 0) {
+    if (!parallel_queue->empty())
+      RunParallelTask();
+    else
+      pthread_cond_wait(&parallel_done, &parallel_mutex);
+  }
+  pthread_mutex_unlock(&parallel_mutex);
+}
+
+}  // namespace
+
+
+// ----------------------------------------------------------------------------
+// Blocks
+
+int BlockGzipBlockSize(const char* data, int size) {
+  const uint8* p = reinterpret_cast<const uint8*>(data);
+  static const uint8 kMagic[] = { 0x1f, 0x8b, Z_DEFLATED, kFlagExtra };
+  for (int i = 0; i < sizeof kMagic; i++) {
+    if (i == size)
+      return -1;
+    if (p[i] != kMagic[i])
+      return 0;
+  }
+  if (size < kGzipHeaderSize + 2)
+    return -1;
+  const int extra_end = kGzipHeaderSize + 2 + Get16(p + kGzipHeaderSize);
+  if (size < extra_end)
+    return -1;
+  // Look for the BC subfield among the subfields of the extra field.
+  for (int i = kGzipHeaderSize + 2; i + 4 <= extra_end; ) {
+    const int length = Get16(p + i + 2);
+    if (p[i] == 'B' && p[i + 1] == 'C' && length == 2 && i + 6 <= extra_end) {
+      const int block_size = Get16(p + i + 4) + 1;
+      if (block_size < extra_end + kGzipFooterSize)
+        return 0;
+      return block_size;
+    }
+    i += 4 + length;
+  }
+  return 0;
+}
+
+
+bool BlockGzipCompress(const char* data, int size, int level, string* dest) {
+  CHECK_LE(size, kBlockGzipMaxInput);
+  char block[kBlockGzipMaxBlock];
+  memset(block, 0, kBlockHeaderSize);
+  block[0] = 0x1f;
+  block[1] = 0x8b;
+  block[2] = Z_DEFLATED;
+  block[3] = kFlagExtra;
+  block[9] = kOsUnknown;
+  Put16(kBlockExtraSize, block + 10);
+  block[12] = 'B';
+  block[13] = 'C';
+  Put16(2, block + 14);
+
+  z_stream zstream;
+  memset(&zstream, 0, sizeof zstream);
+  if (deflateInit2(&zstream, level, Z_DEFLATED, -MAX_WBITS, 8,
+                   Z_DEFAULT_STRATEGY) != Z_OK)
+    return false;
+  zstream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data));
+  zstream.avail_in = size;
+  zstream.next_out = reinterpret_cast<Bytef*>(block + kBlockHeaderSize);
+  zstream.avail_out = sizeof block - kBlockHeaderSize - kGzipFooterSize;
+  int status = deflate(&zstream, Z_FINISH);
+  const int compressed_size = zstream.total_out;
+  deflateEnd(&zstream);
+  if (status != Z_STREAM_END)
+    return false;
+
+  const int block_size = kBlockHeaderSize + compressed_size + kGzipFooterSize;
+  Put16(block_size - 1, block + 16);
+  uLong crc = crc32(0, reinterpret_cast<const Bytef*>(data), size);
+  Put32(crc, block + kBlockHeaderSize + compressed_size);
+  Put32(size, block + kBlockHeaderSize + compressed_size + 4);
+  dest->append(block, block_size);
+  return true;
+}
+
+
+void BlockGzipAppendEof(string* dest) {
+  CHECK(BlockGzipCompress(NULL, 0, Z_DEFAULT_COMPRESSION, dest));
+}
+
+
+namespace {
+
+struct BlockInfo {
+  int offset;       // in the compressed data
+  int size;         // of the compressed block
+  int data_offset;  // in the output
+  int data_size;
+};
+
+
+struct InflateBlocksArgs {
+  const char* data;
+  const vector<BlockInfo>* blocks;
+  char* output;
+  vector<char>* failed;
+};
+
+
+void InflateBlocks(void* arg, int begin, int end) {
+  InflateBlocksArgs* args = static_cast<InflateBlocksArgs*>(arg);
+  z_stream zstream;
+  memset(&zstream, 0, sizeof zstream);
+  CHECK_EQ(Z_OK, inflateInit2(&zstream, -MAX_WBITS));
+  for (int i = begin; i < end; i++) {
+    const BlockInfo& block = (*args->blocks)[i];
+    const uint8* p = reinterpret_cast<const uint8*>(args->data + block.offset);
+    const int header_size = kGzipHeaderSize + 2 + Get16(p + kGzipHeaderSize);
+    // The output of an empty block still needs a valid pointer.
+    char extra;
+    Bytef* out = reinterpret_cast<Bytef*>(
+        block.data_size > 0 ? args->output + block.data_offset : &extra);
+    inflateReset(&zstream);
+    zstream.next_in = const_cast<Bytef*>(p + header_size);
+    zstream.avail_in = block.size - header_size - kGzipFooterSize;
+    zstream.next_out = out;
+    zstream.avail_out = block.data_size;
+    int status = inflate(&zstream, Z_FINISH);
+    if (status != Z_STREAM_END && zstream.avail_out == 0) {
+      // Offer one more byte, to catch blocks longer than they claim.
+      zstream.next_out = reinterpret_cast<Bytef*>(&extra);
+      zstream.avail_out = 1;
+      status = inflate(&zstream, Z_FINISH);
+    }
+    const uint8* footer = p + block.size - kGzipFooterSize;
+    if (status != Z_STREAM_END ||
+        zstream.total_out != block.data_size ||
+        crc32(0, out, block.data_size) != Get32(footer))
+      (*args->failed)[i] = true;
+  }
+  inflateEnd(&zstream);
+}
+
+}  // namespace
+
+
+int BlockGzipInflate(const char* data, int size, int num_threads,
+                     string* output, string* error) {
+  // Find the complete blocks; their sizes need no inflating.
+  vector<BlockInfo> blocks;
+  int offset = 0;
+  int data_offset = 0;
+  while (offset < size) {
+    const int block_size = BlockGzipBlockSize(data + offset, size - offset);
+    if (block_size == 0) {
+      *error = StringPrintf("not a block gzip block at offset %d", offset);
+      output->clear();
+      return -1;
+    }
+    if (block_size < 0 || block_size > size - offset)
+      break;
+    BlockInfo block;
+    block.offset = offset;
+    block.size = block_size;
+    block.data_offset = data_offset;
+    block.data_size = Get32(reinterpret_cast<const uint8*>(
+        data + offset + block_size - 4));
+    if (block.data_size > kBlockGzipMaxBlock) {
+      *error = StringPrintf("corrupt block gzip block at offset %d", offset);
+      output->clear();
+      return -1;
+    }
+    blocks.push_back(block);
+    offset += block_size;
+    data_offset += block.data_size;
+  }
+
+  output->resize(data_offset);
+  if (blocks.empty())
+    return 0;
+  vector<char> failed(blocks.size(), false);
+  InflateBlocksArgs args =
+      { data, &blocks, output->empty() ? NULL : &(*output)[0], &failed };
+  RunParallel(blocks.size(), num_threads, InflateBlocks, &args);
+  for (int i = 0; i < blocks.size(); i++) {
+    if (failed[i]) {
+      *error = StringPrintf("corrupt block gzip block at offset %d",
+                            blocks[i].offset);
+      output->clear();
+      return -1;
+    }
+  }
+  return offset;
+}
+
+
+// ----------------------------------------------------------------------------
+// BlockGzipIndex
+
+BlockGzipIndex::BlockGzipIndex() {
+  Add(0, 0);
+}
+
+
+void BlockGzipIndex::Add(uint64 compressed_offset,
+                         uint64 uncompressed_offset) {
+  Entry entry = { compressed_offset, uncompressed_offset };
+  entries_.push_back(entry);
+}
+
+
+// The file holds the number of entries and the entries, as little-endian
+// 64 bit integers; the first block, at offsets 0, 0, is left out.
+bool BlockGzipIndex::Read(const string& path, string* error) {
+  FILE* file = fopen(path.c_str(), "r");
+  if (file == NULL) {
+    *error = StringPrintf("%s: %s", path.c_str(), strerror(errno));
+    return false;
+  }
+  entries_.resize(1);
+  uint8 buffer[16];
+  bool ok = fread(buffer, 8, 1, file) == 1;
+  const uint64 count = ok ? Get64(buffer) : 0;
+  for (uint64 i = 0; ok && i < count; i++) {
+    ok = fread(buffer, 16, 1, file) == 1;
+    if (ok)
+      Add(Get64(buffer), Get64(buffer + 8));
+  }
+  fclose(file);
+  if (!ok) {
+    *error = StringPrintf("%s: truncated block gzip index", path.c_str());
+    entries_.resize(1);
+  }
+  return ok;
+}
+
+
+bool BlockGzipIndex::Write(const string& path, string* error) const {
+  string contents(8 + 16 * (entries_.size() - 1), '\0');
+  Put64(entries_.size() - 1, &contents[0]);
+  for (int i = 1; i < entries_.size(); i++) {
+    Put64(entries_[i].compressed_offset, &contents[16 * i - 8]);
+    Put64(entries_[i].uncompressed_offset, &contents[16 * i]);
+  }
+  FILE* file = fopen(path.c_str(), "w");
+  bool ok = file != NULL &&
+            fwrite(contents.data(), 1, contents.size(), file) ==
+                contents.size();
+  if (file != NULL && fclose(file) != 0)
+    ok = false;
+  if (!ok)
+    *error = StringPrintf("%s: %s", path.c_str(), strerror(errno));
+  return ok;
+}
+
+
+namespace {
+struct UncompressedOffsetLess {
+  bool operator()(uint64 offset, const BlockGzipIndex::Entry& entry) const {
+    return offset < entry.uncompressed_offset;
+  }
+};
+}  // namespace
+
+
+const BlockGzipIndex::Entry& BlockGzipIndex::Find(
+    uint64 uncompressed_offset) const {
+  vector<Entry>::const_iterator it =
+      upper_bound(entries_.begin(), entries_.end(), uncompressed_offset,
+                  UncompressedOffsetLess());
+  return *(it - 1);
+}
+
+
+// ----------------------------------------------------------------------------
+// BlockGzipWriter
+
+BlockGzipWriter::BlockGzipWriter()
+    : file_(NULL), level_(Z_DEFAULT_COMPRESSION), failed_(false),
+      compressed_offset_(0), uncompressed_offset_(0) {
+}
+
+
+bool BlockGzipWriter::Open(const string& path, const string& index_path,
+                           int level, string* error) {
+  CHECK(file_ == NULL);
+  file_ = fopen(path.c_str(), "w");
+  if (file_ == NULL) {
+    *error = StringPrintf("%s: %s", path.c_str(), strerror(errno));
+    return false;
+  }
+  index_path_ = index_path;
+  level_ = level;
+  failed_ = false;
+  input_.clear();
+  compressed_offset_ = 0;
+  uncompressed_offset_ = 0;
+  index_ = BlockGzipIndex();
+  return true;
+}
+
+
+void BlockGzipWriter::Write(const char* data, int size) {
+  while (size > 0) {
+    int n = min(size, kBlockGzipMaxInput - static_cast<int>(input_.size()));
+    input_.append(data, n);
+    data += n;
+    size -= n;
+    if (input_.size() == kBlockGzipMaxInput)
+      WriteBlock();
+  }
+}
+
+
+void BlockGzipWriter::WriteBlock() {
+  if (compressed_offset_ > 0)
+    index_.Add(compressed_offset_, uncompressed_offset_);
+  block_.clear();
+  if (!BlockGzipCompress(input_.data(), input_.size(), level_, &block_) ||
+      fwrite(block_.data(), 1, block_.size(), file_) != block_.size())
+    failed_ = true;
+  compressed_offset_ += block_.size();
+  uncompressed_offset_ += input_.size();
+  input_.clear();
+}
+
+
+bool BlockGzipWriter::Close() {
+  if (file_ == NULL)
+    return !failed_;
+  if (!input_.empty())
+    WriteBlock();
+  block_.clear();
+  BlockGzipAppendEof(&block_);
+  if (fwrite(block_.data(), 1, block_.size(), file_) != block_.size())
+    failed_ = true;
+  if (fclose(file_) != 0)
+    failed_ = true;
+  file_ = NULL;
+  string error;
+  if (!index_path_.empty() && !index_.Write(index_path_, &error))
+    failed_ = true;
+  return !failed_;
+}
+
+
+// ----------------------------------------------------------------------------
+// SpeculativeGunzip
+
+// A piece of deflate data, inflated on a thread of its own.
+struct SpeculativeGunzip::Piece {
+  Piece()
+      : data(NULL), size(0), stream(NULL), crc(0), consumed(0),
+        ok(false), ended(false), at_boundary(false)  { }
+
+  const char* data;
+  int size;
+  z_stream* stream;
+  string output;
+  uLong crc;
+  int consumed;      // at the end of the deflate stream
+  bool ok;           // inflated without error
+  bool ended;        // the deflate stream ended in the piece
+  bool at_boundary;  // the piece ended at the end of a deflate block
+};
+
+
+namespace {
+
+// Parses a gzip header; returns its size, 0 if it is incomplete, or -1 if
+// the data does not start with a gzip header.
+int ParseGzipHeader(const char* data, int size) {
+  const uint8* p = reinterpret_cast<const uint8*>(data);
+  if ((size >= 1 && p[0] != 0x1f) || (size >= 2 && p[1] != 0x8b) ||
+      (size >= 3 && p[2] != Z_DEFLATED))
+    return -1;
+  if (size < kGzipHeaderSize)
+    return 0;
+  const int flags = p[3];
+  int n = kGzipHeaderSize;
+  if ((flags & kFlagExtra) != 0) {
+    if (size < n + 2)
+      return 0;
+    n += 2 + Get16(p + n);
+  }
+  for (int flag = kFlagName; flag <= kFlagComment; flag <<= 1) {
+    if ((flags & flag) != 0) {
+      if (n >= size)
+        return 0;
+      const void* nul = memchr(data + n, '\0', size - n);
+      if (nul == NULL)
+        return 0;
+      n = static_cast<const char*>(nul) - data + 1;
+    }
+  }
+  if ((flags & kFlagHeaderCrc) != 0)
+    n += 2;
+  return n <= size ? n : 0;
+}
+
+
+// A full flush ends with an empty stored block, whose length and inverted
+// length are these bytes; the next block starts right after them.
+const char kFlushMarker[] = { 0, 0, '\xff', '\xff' };
+const int kFlushMarkerSize = 4;
+
+
+// Returns the position right after the first full flush marker in
+// data[from, size), or -1 if there is none.
+int FindFlush(const char* data, int from, int size) {
+  for (int i = from; i + kFlushMarkerSize <= size; i++) {
+    if (data[i] == 0 && memcmp(data + i, kFlushMarker, kFlushMarkerSize) == 0)
+      return i + kFlushMarkerSize;
+  }
+  return -1;
+}
+
+}  // namespace
+
+
+SpeculativeGunzip::SpeculativeGunzip(int num_threads)
+    : num_threads_(max(1, num_threads)),
+      state_(HEADER),
+      stream_(NULL),
+      crc_(0),
+      size_(0),
+      members_(0),
+      pieces_used_(0),
+      pieces_wasted_(0) {
+  stream_ = NewStream();
+}
+
+
+SpeculativeGunzip::~SpeculativeGunzip() {
+  DeleteStream(stream_);
+}
+
+
+z_stream* SpeculativeGunzip::NewStream() {
+  z_stream* stream = new z_stream;
+  memset(stream, 0, sizeof *stream);
+  CHECK_EQ(Z_OK, inflateInit2(stream, -MAX_WBITS));
+  return stream;
+}
+
+
+// A raw inflate stream accepts a dictionary at any point; it becomes the
+// most recent output in the window.
+void SpeculativeGunzip::SetWindow(z_stream* stream) {
+  const int n = min(static_cast<int>(recent_.size()), kWindowSize);
+  if (n > 0)
+    CHECK_EQ(Z_OK, inflateSetDictionary(
+        stream,
+        reinterpret_cast<const Bytef*>(recent_.data() + recent_.size() - n),
+        n));
+}
+
+
+void SpeculativeGunzip::DeleteStream(z_stream* stream) {
+  if (stream != NULL) {
+    inflateEnd(stream);
+    delete stream;
+  }
+}
+
+
+int SpeculativeGunzip::Decompress(const char* data, int size, bool at_end,
+                                  string* output, string* error) {
+  int pos = 0;
+  for (;;) {
+    switch (state_) {
+      case HEADER: {
+        if (pos == size && at_end && members_ > 0) {
+          state_ = DONE;
+          break;
+        }
+        int n = ParseGzipHeader(data + pos, size - pos);
+        if (n < 0 && members_ > 0) {
+          // Data after the last member is ignored, as gzip does.
+          state_ = DONE;
+          break;
+        }
+        if (n < 0) {
+          *error = "not in gzip format";
+          return -1;
+        }
+        if (n == 0) {
+          if (at_end) {
+            *error = "unexpected end of file";
+            return -1;
+          }
+          return pos;
+        }
+        pos += n;
+        CHECK_EQ(Z_OK, inflateReset(stream_));
+        recent_.clear();
+        crc_ = crc32(0, NULL, 0);
+        size_ = 0;
+        state_ = BODY;
+        break;
+      }
+
+      case BODY: {
+        if (pos == size) {
+          if (at_end) {
+            *error = "unexpected end of file";
+            return -1;
+          }
+          return pos;
+        }
+        int n = Body(data + pos, size - pos, output, error);
+        if (n < 0)
+          return -1;
+        pos += n;
+        break;
+      }
+
+      case TRAILER: {
+        if (size - pos < kGzipFooterSize) {
+          if (at_end) {
+            *error = "unexpected end of file";
+            return -1;
+          }
+          return pos;
+        }
+        const uint8* p = reinterpret_cast<const uint8*>(data + pos);
+        if (Get32(p) != crc_) {
+          *error = "crc error";
+          return -1;
+        }
+        if (Get32(p + 4) != (size_ & 0xffffffff)) {
+          *error = "length error";
+          return -1;
+        }
+        pos += kGzipFooterSize;
+        members_++;
+        state_ = HEADER;
+        break;
+      }
+
+      case DONE:
+        return size;
+    }
+  }
+}
+
+
+int SpeculativeGunzip::Body(const char* data, int size, string* output,
+                            string* error) {
+  // Split the data into pieces at full flush markers.  The first piece
+  // continues the current stream; the data after the last marker is left
+  // for the next call, where it starts the first piece.
+  vector<int> starts(1, 0);
+  if (num_threads_ > 1 && size >= 2 * kMinPieceSize) {
+    const int piece_size = max(kMinPieceSize, size / num_threads_);
+    int start = 0;
+    while (starts.size() <= num_threads_) {
+      start = FindFlush(data, start + piece_size - kFlushMarkerSize, size);
+      if (start < 0)
+        break;
+      starts.push_back(start);
+    }
+  }
+  if (starts.size() < 3) {
+    // Not enough pieces to inflate in parallel.
+    return Inflate(stream_, data, size, output, error);
+  }
+
+  const int num_pieces = starts.size() - 1;
+  vector<Piece> pieces(num_pieces);
+  for (int i = 0; i < num_pieces; i++) {
+    pieces[i].data = data + starts[i];
+    pieces[i].size = starts[i + 1] - starts[i];
+    pieces[i].stream = i == 0 ? stream_ : NewStream();
+  }
+  RunParallel(num_pieces, num_pieces, InflatePiece, &pieces[0]);
+
+  // The first piece continues from a known state, so it is valid, and
+  // each piece after it is if it inflated without error and the piece
+  // before ended right at its start, at the end of a block.
+  int used = 0;
+  bool at_boundary = false;
+  for (; used < num_pieces; used++) {
+    Piece* piece = &pieces[used];
+    if (used == 0 && !piece->ok) {
+      *error = stream_->msg != NULL ? stream_->msg : "corrupt data";
+      break;
+    }
+    if (used > 0 && (!at_boundary || !piece->ok || piece->ended))
+      break;
+    Append(piece->output.data(), piece->output.size(), piece->crc, output);
+    if (piece->ended)
+      break;  // only possible for the first piece
+    at_boundary = piece->at_boundary;
+  }
+  pieces_used_ += max(used - 1, 0);
+  pieces_wasted_ += num_pieces - max(used, 1);
+
+  // Continue with the stream of the last piece used, which stopped at the
+  // start of the first piece not used, giving it the window it lacks.
+  int consumed = -1;
+  if (used == 0) {
+    // Corrupt data; *error is set.
+  } else if (pieces[0].ended) {
+    state_ = TRAILER;
+    consumed = pieces[0].consumed;
+  } else {
+    if (used > 1) {
+      DeleteStream(stream_);
+      stream_ = pieces[used - 1].stream;
+      pieces[used - 1].stream = NULL;
+      SetWindow(stream_);
+    }
+    consumed = starts[used];
+    if (used < num_pieces) {
+      // Inflate the rest of the pieces serially.
+      int n = Inflate(stream_, data + consumed, starts[num_pieces] - consumed,
+                      output, error);
+      consumed = n < 0 ? -1 : consumed + n;
+    } else {
+      consumed = starts[num_pieces];
+    }
+  }
+  for (int i = 1; i < num_pieces; i++) {
+    if (pieces[i].stream != stream_)
+      DeleteStream(pieces[i].stream);
+  }
+  return consumed;
+}
+
+
+void SpeculativeGunzip::InflatePiece(void* arg, int begin, int end) {
+  Piece* pieces = static_cast<Piece*>(arg);
+  char buffer[kInflateBufferSize];
+  for (int i = begin; i < end; i++) {
+    Piece* piece = &pieces[i];
+    z_stream* stream = piece->stream;
+    stream->next_in = reinterpret_cast<Bytef*>(const_cast<char*>(piece->data));
+    stream->avail_in = piece->size;
+    piece->crc = crc32(0, NULL, 0);
+    piece->ok = true;
+    for (;;) {
+      stream->next_out = reinterpret_cast<Bytef*>(buffer);
+      stream->avail_out = sizeof buffer;
+      // Stop at the end of each block, to tell whether the piece ends at
+      // the end of one.
+      int status = inflate(stream, Z_BLOCK);
+      const int n = sizeof buffer - stream->avail_out;
+      piece->output.append(buffer, n);
+      piece->crc = crc32(piece->crc, reinterpret_cast<Bytef*>(buffer), n);
+      if (status == Z_STREAM_END) {
+        piece->ended = true;
+        piece->consumed = piece->size - stream->avail_in;
+        break;
+      }
+      if (status != Z_OK && status != Z_BUF_ERROR) {
+        piece->ok = false;
+        break;
+      }
+      if (stream->avail_in == 0 && stream->avail_out != 0)
+        break;
+    }
+    // data_type holds the number of unused bits, 64 after the last block
+    // and 128 at the end of a block.
+    piece->at_boundary = (stream->data_type & (128 | 64 | 63)) == 128;
+  }
+}
+
+
+int SpeculativeGunzip::Inflate(z_stream* stream, const char* data, int size,
+                               string* output, string* error) {
+  char buffer[kInflateBufferSize];
+  stream->next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data));
+  stream->avail_in = size;
+  for (;;) {
+    stream->next_out = reinterpret_cast<Bytef*>(buffer);
+    stream->avail_out = sizeof buffer;
+    int status = inflate(stream, Z_NO_FLUSH);
+    const int n = sizeof buffer - stream->avail_out;
+    Append(buffer, n, crc32(0, reinterpret_cast<Bytef*>(buffer), n), output);
+    if (status == Z_STREAM_END) {
+      state_ = TRAILER;
+      return size - stream->avail_in;
+    }
+    if (status != Z_OK && status != Z_BUF_ERROR) {
+      *error = stream->msg != NULL ? stream->msg : "corrupt data";
+      return -1;
+    }
+    if (stream->avail_in == 0 && stream->avail_out != 0)
+      return size;
+  }
+}
+
+
+void SpeculativeGunzip::Append(const char* data, int size, uLong crc,
+                               string* output) {
+  output->append(data, size);
+  crc_ = crc32_combine(crc_, crc, size);
+  size_ += size;
+  if (size >= kWindowSize) {
+    recent_.assign(data + size - kWindowSize, kWindowSize);
+  } else {
+    recent_.append(data, size);
+    if (recent_.size() > 2 * kWindowSize)
+      recent_.erase(0, recent_.size() - kWindowSize);
+  }
+}
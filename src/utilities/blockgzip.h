@@ -0,0 +1,207 @@
+// Copyright 2010 Google Inc.
+// 
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+// 
+//      http://www.apache.org/licenses/LICENSE-2.0
+// 
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ------------------------------------------------------------------------
+
+// Parallel gzip decompression.
+//
+// A block gzip file is a gzip file made of independent members, each
+// holding at most kBlockGzipMaxInput bytes of data and recording its own
+// compressed size in an extra field of its header.  This is the BGZF
+// format used for genomic data, so such files can be read and written by
+// bgzip too.  Any gzip reader can read them, while a block gzip reader
+// can find the blocks without inflating them and inflate them in
+// parallel.  The file ends with an empty block.  An optional index file,
+// in the format of bgzip's .gzi files, lists the compressed and
+// uncompressed offset of each block for random access.
+//
+// Ordinary gzip streams cannot in general be split, as each deflate block
+// can refer to the data of the previous ones.  Streams compressed with
+// full flushes (for instance by pigz -i) can: after a full flush, marked
+// by an empty stored block, nothing refers back.  SpeculativeGunzip finds
+// such markers and inflates the pieces between them in parallel, keeping
+// a piece only once it has been verified that the piece before it ended
+// on that very marker.
+
+#ifndef _UTILITIES_BLOCKGZIP_H__
+#define _UTILITIES_BLOCKGZIP_H__
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+#include "zlib.h"
+
+
+// The data of a block is at most kBlockGzipMaxInput bytes, so that a
+// block never exceeds kBlockGzipMaxBlock bytes even if the data does not
+// compress.
+const int kBlockGzipMaxInput = 0xff00;
+const int kBlockGzipMaxBlock = 0x10000;
+
+// Returns the size of the block starting at data, or 0 if data does not
+// start with a block gzip header; size is the number of bytes available.
+// Returns -1 if the bytes available do not hold the whole header.
+int BlockGzipBlockSize(const char* data, int size);
+
+// Compresses size bytes, at most kBlockGzipMaxInput, of data into a block,
+// appended to *dest.  level is a zlib compression level.
+bool BlockGzipCompress(const char* data, int size, int level, string* dest);
+
+// Appends the empty block that ends a block gzip file to *dest.
+void BlockGzipAppendEof(string* dest);
+
+// Inflates the complete blocks at the beginning of data[0, size) into
+// *output, replacing its contents, using up to num_threads threads.
+// Returns the number of bytes of data used, or -1 if a block is corrupt,
+// or if the data does not start with a block, in which case *output is
+// empty and *error describes the problem.
+int BlockGzipInflate(const char* data, int size, int num_threads,
+                     string* output, string* error);
+
+// Returns whether data starts with a block gzip block.
+inline bool IsBlockGzip(const char* data, int size) {
+  return BlockGzipBlockSize(data, size) > 0;
+}
+
+
+// The index of a block gzip file: the offsets of its blocks.
+class BlockGzipIndex {
+ public:
+  struct Entry {
+    uint64 compressed_offset;
+    uint64 uncompressed_offset;
+  };
+
+  BlockGzipIndex();
+
+  // Adds a block; blocks must be added in order.
+  void Add(uint64 compressed_offset, uint64 uncompressed_offset);
+
+  // Reads or writes an index file; return false and set *error on
+  // failure.
+  bool Read(const string& path, string* error);
+  bool Write(const string& path, string* error) const;
+
+  // Returns the block holding the byte at uncompressed_offset.
+  const Entry& Find(uint64 uncompressed_offset) const;
+
+  const vector<Entry>& entries() const  { return entries_; }
+
+ private:
+  vector<Entry> entries_;  // always starts with the first block, at 0, 0
+};
+
+
+// Writes a block gzip file and, optionally, its index.
+class BlockGzipWriter {
+ public:
+  BlockGzipWriter();
+  ~BlockGzipWriter()  { Close(); }
+
+  // Creates the file at path; if index_path is not empty, Close writes
+  // the index there.  level is a zlib compression level.  Returns false
+  // and sets *error on failure.
+  bool Open(const string& path, const string& index_path, int level,
+            string* error);
+
+  // Appends data to the file.
+  void Write(const char* data, int size);
+  void Write(const string& data)  { Write(data.data(), data.size()); }
+
+  // Writes the last block, the end of file marker and the index, and
+  // closes the file.  Returns false if anything failed.
+  bool Close();
+
+  const BlockGzipIndex& index() const  { return index_; }
+
+ private:
+  void WriteBlock();
+
+  FILE* file_;
+  string index_path_;
+  int level_;
+  bool failed_;
+  string input_;  // data of the current block
+  string block_;  // compressed block
+  uint64 compressed_offset_;
+  uint64 uncompressed_offset_;
+  BlockGzipIndex index_;
+};
+
+
+// Decompresses gzip data, which may be a sequence of gzip members, as it
+// arrives, inflating pieces of it in parallel where full flushes allow.
+class SpeculativeGunzip {
+ public:
+  // Pieces shorter than this are not worth a thread.
+  static const int kMinPieceSize = 64 << 10;
+
+  explicit SpeculativeGunzip(int num_threads);
+  ~SpeculativeGunzip();
+
+  // Decompresses data[0, size), appending the output to *output, and
+  // returns the number of bytes of data consumed; the caller passes the
+  // rest of the data again in the next call, followed by more data.
+  // at_end tells that no more data follows.  Returns -1 and sets *error
+  // if the data is not valid gzip data.
+  int Decompress(const char* data, int size, bool at_end, string* output,
+                 string* error);
+
+  // Whether the end of the last member has been reached.
+  bool done() const  { return state_ == DONE; }
+
+  // Statistics: the number of pieces inflated in parallel and used, and
+  // the number that had to be inflated again serially.
+  int64 pieces_used() const  { return pieces_used_; }
+  int64 pieces_wasted() const  { return pieces_wasted_; }
+
+ private:
+  enum State { HEADER, BODY, TRAILER, DONE };
+  struct Piece;
+
+  // Decompresses the deflate data of a member.
+  int Body(const char* data, int size, string* output, string* error);
+
+  // Inflates data[0, size) with stream, appending the output; returns the
+  // number of bytes consumed, which is less than size only at the end of
+  // the deflate stream, or -1 on error.
+  int Inflate(z_stream* stream, const char* data, int size, string* output,
+              string* error);
+
+  // Appends data inflated by any stream to *output, updating the check
+  // values of the member and the recent output.
+  void Append(const char* data, int size, uLong crc, string* output);
+
+  // Creates and deletes raw inflate streams.
+  static z_stream* NewStream();
+  static void DeleteStream(z_stream* stream);
+
+  // Makes the recent output the window of stream.
+  void SetWindow(z_stream* stream);
+
+  // Inflates pieces[begin, end), where pieces points to Piece objects.
+  static void InflatePiece(void* pieces, int begin, int end);
+
+  const int num_threads_;
+  State state_;
+  z_stream* stream_;  // raw inflate stream of the current member
+  uLong crc_;         // check values of the current member
+  uLong size_;
+  string recent_;     // the last output, at least the window size
+  int64 members_;     // number of members decompressed
+  int64 pieces_used_;
+  int64 pieces_wasted_;
+};
+
+#endif  // _UTILITIES_BLOCKGZIP_H__
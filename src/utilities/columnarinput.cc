@@ -0,0 +1,779 @@
+// Copyright 2010 Google Inc.
+// 
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+// 
+//      http://www.apache.org/licenses/LICENSE-2.0
+// 
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ------------------------------------------------------------------------
+
+// Implementation of the ColumnarInputWriter and ColumnarInputReader
+// classes; see columnarinput.h for the file layout.
+//
+// The footer holds, all numbers being varints:
+//   number of row groups
+//   for each row group: number of records, number of chunks, and
+//     for each chunk: field number, offset, stored size, raw size,
+//     compression (kUncompressed or kDeflated), CRC-32C of the stored bytes
+// A raw column chunk holds, all counts and lengths being varints:
+//   number of runs of occurrence counts; for each: length, count
+//   encoding byte, number of occurrences
+//   kPlain:      for each occurrence: length, bytes
+//   kDictionary: number of entries, each as length and bytes; then the
+//                number of runs of indices, and for each: length, index
+
+#include <stdio.h>
+#include <errno.h>
+#include <string.h>
+#include <sys/types.h>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#include "zlib.h"
+
+#include "public/hash_map.h"
+
+#include "public/porting.h"
+#include "public/logging.h"
+#include "public/varint.h"
+#include "public/columnarinput.h"
+
+#include "utilities/crc32c.h"
+
+
+namespace sawzall {
+
+
+namespace {
+
+const char kMagic[] = "SZLCOL1\n";
+const int kMagicSize = 8;
+const int kTrailerSize = 4 + 4 + kMagicSize;
+
+// Row groups are also written when their records reach this size.
+const int kMaxRowGroupBytes = 16 << 20;
+
+// Limit on the size of a chunk or of the footer, to reject corrupt
+// sizes early.
+const uint64 kMaxChunkSize = 1 << 30;
+
+// Chunk compression.
+enum { kUncompressed = 0, kDeflated = 1 };
+
+// Occurrence encodings.
+enum { kPlain = 0, kDictionary = 1 };
+
+// Wire types of protocol buffer fields.
+enum {
+  kVarint = 0, kFixed64 = 1, kLengthDelimited = 2, kStartGroup = 3,
+  kEndGroup = 4, kFixed32 = 5
+};
+
+// Group nesting deeper than this is rejected, as protobuf does.
+const int kMaxGroupDepth = 64;
+
+// An occurrence of a field: its tag and value in wire format.
+typedef pair<const char*, int> Item;
+
+
+uint32 Get32(const char* p) {
+  const uint8* u = reinterpret_cast<const uint8*>(p);
+  return u[0] | (u[1] << 8) | (u[2] << 16) | (static_cast<uint32>(u[3]) << 24);
+}
+
+
+void Put32(uint32 v, char* p) {
+  for (int i = 0; i < 4; i++)
+    p[i] = (v >> (8 * i)) & 0xff;
+}
+
+
+void PutVarint(uint64 v, string* s) {
+  char buf[kMaxUnsignedVarint64Length];
+  char* end = EncodeUnsignedVarint64(buf, v);
+  s->append(buf, end - buf);
+}
+
+
+// Reads a varint from [*p, end); returns false if it does not fit.
+bool GetVarint(const char** p, const char* end, uint64* v) {
+  if (end - *p >= kMaxUnsignedVarint64Length) {
+    const char* next = DecodeUnsignedVarint64(*p, v);
+    if (next == NULL)
+      return false;
+    *p = next;
+    return true;
+  }
+  // Near the end, decode from a copy so that a truncated varint cannot
+  // run past end.
+  char buf[kMaxUnsignedVarint64Length];
+  const int len = min<int64>(end - *p, sizeof(buf));
+  if (len <= 0)
+    return false;
+  memset(buf, 0, sizeof(buf));
+  memcpy(buf, *p, len);
+  const char* next = DecodeUnsignedVarint64(buf, v);
+  if (next == NULL || next - buf > len)
+    return false;
+  *p += next - buf;
+  return true;
+}
+
+
+// Reads a varint that must not exceed limit.
+bool GetBounded(const char** p, const char* end, uint64 limit, uint64* v) {
+  return GetVarint(p, end, v) && *v <= limit;
+}
+
+
+// Skips the value of a field of the given wire type and field number at
+// *p, including the fields of a group up to its end tag.
+bool SkipValue(const char** p, const char* end, int wire_type,
+               uint64 field, int depth) {
+  uint64 v;
+  switch (wire_type) {
+    case kVarint:
+      return GetVarint(p, end, &v);
+    case kFixed64:
+      if (end - *p < 8)
+        return false;
+      *p += 8;
+      return true;
+    case kLengthDelimited:
+      if (!GetVarint(p, end, &v) || v > end - *p)
+        return false;
+      *p += v;
+      return true;
+    case kStartGroup:
+      if (depth >= kMaxGroupDepth)
+        return false;
+      for (;;) {
+        uint64 key;
+        if (!GetVarint(p, end, &key) || (key >> 3) == 0)
+          return false;
+        if ((key & 7) == kEndGroup)
+          return (key >> 3) == field;
+        if (!SkipValue(p, end, key & 7, key >> 3, depth + 1))
+          return false;
+      }
+    case kFixed32:
+      if (end - *p < 4)
+        return false;
+      *p += 4;
+      return true;
+    default:
+      return false;
+  }
+}
+
+
+// Splits a protocol buffer in wire format into its top-level fields,
+// setting *fields to the (field number, end offset) of each.  Returns
+// false if record is not a protocol buffer.
+bool SplitRecord(const char* record, size_t size,
+                 vector<pair<int, int> >* fields) {
+  fields->clear();
+  const char* p = record;
+  const char* end = record + size;
+  while (p < end) {
+    uint64 key;
+    if (!GetVarint(&p, end, &key))
+      return false;
+    const uint64 field = key >> 3;
+    if (field == 0 || field > kint32max ||
+        !SkipValue(&p, end, key & 7, field, 0))
+      return false;
+    fields->push_back(make_pair(static_cast<int>(field),
+                                static_cast<int>(p - record)));
+  }
+  return true;
+}
+
+
+// Appends the run-length encoding of values to *s.
+void PutRuns(const vector<uint32>& values, string* s) {
+  int num_runs = 0;
+  for (int i = 0; i < values.size(); i++) {
+    if (i == 0 || values[i] != values[i - 1])
+      num_runs++;
+  }
+  PutVarint(num_runs, s);
+  for (int i = 0; i < values.size(); ) {
+    int j = i + 1;
+    while (j < values.size() && values[j] == values[i])
+      j++;
+    PutVarint(j - i, s);
+    PutVarint(values[i], s);
+    i = j;
+  }
+}
+
+
+// Reads n run-length encoded values, each at most limit, into *values.
+bool GetRuns(const char** p, const char* end, uint64 n, uint64 limit,
+             vector<uint32>* values) {
+  values->clear();
+  uint64 num_runs;
+  if (!GetBounded(p, end, n, &num_runs))
+    return false;
+  for (int i = 0; i < num_runs; i++) {
+    uint64 length, value;
+    if (!GetBounded(p, end, n - values->size(), &length) ||
+        !GetBounded(p, end, limit, &value))
+      return false;
+    values->insert(values->end(), length, value);
+  }
+  return values->size() == n;
+}
+
+
+// Reads a length followed by that many bytes.
+bool GetItem(const char** p, const char* end, Item* item) {
+  uint64 len;
+  if (!GetVarint(p, end, &len) || len > end - *p)
+    return false;
+  *item = Item(*p, len);
+  *p += len;
+  return true;
+}
+
+
+// Appends the encoding of the occurrences of a field to *s, choosing the
+// encoding that suits them.
+void EncodeItems(const string& data, const vector<int>& sizes, string* s) {
+  const int n = sizes.size();
+  vector<Item> items(n);
+  const char* p = data.data();
+  for (int i = 0; i < n; i++) {
+    items[i] = Item(p, sizes[i]);
+    p += sizes[i];
+  }
+
+  // Dictionary encoding pays off if each distinct item occurs at least
+  // twice on average.
+  hash_map<string, int> dict;
+  vector<uint32> indices(n);
+  vector<const Item*> entries;
+  for (int i = 0; i < n && entries.size() * 2 <= n; i++) {
+    string item(items[i].first, items[i].second);
+    pair<hash_map<string, int>::iterator, bool> ins =
+        dict.insert(make_pair(item, entries.size()));
+    if (ins.second)
+      entries.push_back(&items[i]);
+    indices[i] = ins.first->second;
+  }
+  if (entries.size() * 2 <= n) {
+    s->push_back(kDictionary);
+    PutVarint(n, s);
+    PutVarint(entries.size(), s);
+    for (int i = 0; i < entries.size(); i++) {
+      PutVarint(entries[i]->second, s);
+      s->append(entries[i]->first, entries[i]->second);
+    }
+    PutRuns(indices, s);
+    return;
+  }
+
+  s->push_back(kPlain);
+  PutVarint(n, s);
+  for (int i = 0; i < n; i++) {
+    PutVarint(items[i].second, s);
+    s->append(items[i].first, items[i].second);
+  }
+}
+
+
+// Deflates a chunk; returns false if that does not make it smaller.
+bool Deflate(const string& raw, string* stored) {
+  z_stream zstream;
+  memset(&zstream, 0, sizeof zstream);
+  if (deflateInit2(&zstream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -MAX_WBITS,
+                   8, Z_DEFAULT_STRATEGY) != Z_OK)
+    return false;
+  // Anything larger than the raw chunk is of no use.
+  stored->resize(raw.size());
+  zstream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(raw.data()));
+  zstream.avail_in = raw.size();
+  char empty;
+  zstream.next_out = reinterpret_cast<Bytef*>(
+      raw.empty() ? &empty : &(*stored)[0]);
+  zstream.avail_out = stored->size();
+  int status = deflate(&zstream, Z_FINISH);
+  stored->resize(zstream.total_out);
+  deflateEnd(&zstream);
+  return status == Z_STREAM_END && stored->size() < raw.size();
+}
+
+
+// Inflates a chunk of known size; returns false if it is corrupt.
+bool Inflate(const string& stored, uint64 raw_size, string* raw) {
+  raw->resize(raw_size);
+  z_stream zstream;
+  memset(&zstream, 0, sizeof zstream);
+  if (inflateInit2(&zstream, -MAX_WBITS) != Z_OK)
+    return false;
+  zstream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(stored.data()));
+  zstream.avail_in = stored.size();
+  char empty;
+  zstream.next_out =
+      reinterpret_cast<Bytef*>(raw_size > 0 ? &(*raw)[0] : &empty);
+  zstream.avail_out = raw_size;
+  int status = inflate(&zstream, Z_FINISH);
+  inflateEnd(&zstream);
+  return status == Z_STREAM_END && zstream.avail_out == 0 &&
+         zstream.avail_in == 0;
+}
+
+
+string ErrnoMessage() {
+  // Not strerror_r, whose GNU version need not fill in the buffer.
+  return strerror(errno);
+}
+
+}  // namespace
+
+
+// ----------------------------------------------------------------------------
+// ColumnarInputWriter
+
+// The occurrences of a field in the buffered records.
+struct ColumnarInputWriter::Column {
+  explicit Column(int tag) : tag(tag)  { }
+
+  // Orders columns by field number.
+  static bool TagLess(const Column* column, int tag) {
+    return column->tag < tag;
+  }
+
+  int tag;
+  vector<uint32> counts;  // for each record; missing at the end means 0
+  string data;            // the occurrences, back to back
+  vector<int> sizes;
+};
+
+
+ColumnarInputWriter* ColumnarInputWriter::Open(const char* filename,
+                                               int row_group_records,
+                                               string* error) {
+  FILE* file = fopen(filename, "w");
+  if (file == NULL) {
+    *error = string("can't create ") + filename + ": " + ErrnoMessage();
+    return NULL;
+  }
+  if (fwrite(kMagic, 1, kMagicSize, file) != kMagicSize) {
+    *error = string("can't write ") + filename + ": " + ErrnoMessage();
+    fclose(file);
+    return NULL;
+  }
+  return new ColumnarInputWriter(file, max(row_group_records, 1));
+}
+
+
+ColumnarInputWriter::ColumnarInputWriter(FILE* file, int row_group_records)
+    : file_(file),
+      row_group_records_(row_group_records),
+      offset_(kMagicSize),
+      num_records_(0),
+      num_bytes_(0),
+      num_row_groups_(0),
+      failed_(false) {
+}
+
+
+ColumnarInputWriter::~ColumnarInputWriter() {
+  if (file_ != NULL)
+    Close();
+  for (int i = 0; i < columns_.size(); i++)
+    delete columns_[i];
+}
+
+
+bool ColumnarInputWriter::Write(const char* record_ptr, size_t record_size) {
+  CHECK(file_ != NULL) << "write to a closed ColumnarInputWriter";
+  if (failed_)
+    return false;
+  if (record_size > kint32max ||
+      !SplitRecord(record_ptr, record_size, &fields_)) {
+    error_message_ = "record is not a protocol buffer";
+    return false;
+  }
+  int start = 0;
+  for (int i = 0; i < fields_.size(); i++) {
+    const int tag = fields_[i].first;
+    const int end = fields_[i].second;
+    vector<Column*>::iterator it =
+        lower_bound(columns_.begin(), columns_.end(), tag, Column::TagLess);
+    if (it == columns_.end() || (*it)->tag != tag)
+      it = columns_.insert(it, new Column(tag));
+    Column* column = *it;
+    if (column->counts.size() <= num_records_)
+      column->counts.resize(num_records_ + 1, 0);
+    column->counts[num_records_]++;
+    column->data.append(record_ptr + start, end - start);
+    column->sizes.push_back(end - start);
+    start = end;
+  }
+  num_records_++;
+  num_bytes_ += record_size;
+  if (num_records_ == row_group_records_ || num_bytes_ >= kMaxRowGroupBytes)
+    return WriteRowGroup();
+  return true;
+}
+
+
+bool ColumnarInputWriter::Close() {
+  if (file_ == NULL)
+    return !failed_;
+  bool ok = !failed_ && WriteRowGroup();
+  if (ok) {
+    string footer;
+    PutVarint(num_row_groups_, &footer);
+    footer.append(footer_);
+    char trailer[kTrailerSize];
+    Put32(footer.size(), trailer);
+    Put32(Crc32c(0, footer.data(), footer.size()), trailer + 4);
+    memcpy(trailer + 8, kMagic, kMagicSize);
+    if (fwrite(footer.data(), 1, footer.size(), file_) != footer.size() ||
+        fwrite(trailer, 1, kTrailerSize, file_) != kTrailerSize) {
+      error_message_ = ErrnoMessage();
+      ok = false;
+    }
+  }
+  if (fclose(file_) != 0 && ok) {
+    error_message_ = ErrnoMessage();
+    ok = false;
+  }
+  file_ = NULL;
+  failed_ = !ok;
+  return ok;
+}
+
+
+bool ColumnarInputWriter::WriteRowGroup() {
+  if (num_records_ == 0)
+    return true;
+  PutVarint(num_records_, &footer_);
+  PutVarint(columns_.size(), &footer_);
+  string raw;
+  string deflated;
+  bool ok = true;
+  for (int i = 0; i < columns_.size() && ok; i++) {
+    Column* column = columns_[i];
+    column->counts.resize(num_records_, 0);
+    raw.clear();
+    PutRuns(column->counts, &raw);
+    EncodeItems(column->data, column->sizes, &raw);
+    const bool compressed = Deflate(raw, &deflated);
+    const string& stored = compressed ? deflated : raw;
+    PutVarint(column->tag, &footer_);
+    PutVarint(offset_, &footer_);
+    PutVarint(stored.size(), &footer_);
+    PutVarint(raw.size(), &footer_);
+    PutVarint(compressed ? kDeflated : kUncompressed, &footer_);
+    PutVarint(Crc32c(0, stored.data(), stored.size()), &footer_);
+    if (raw.size() > kMaxChunkSize) {
+      error_message_ = "column chunk too large";
+      ok = false;
+    } else if (fwrite(stored.data(), 1, stored.size(), file_) !=
+               stored.size()) {
+      error_message_ = ErrnoMessage();
+      ok = false;
+    }
+    offset_ += stored.size();
+  }
+  for (int i = 0; i < columns_.size(); i++)
+    delete columns_[i];
+  columns_.clear();
+  num_row_groups_++;
+  num_records_ = 0;
+  num_bytes_ = 0;
+  if (!ok)
+    failed_ = true;
+  return ok;
+}
+
+
+// ----------------------------------------------------------------------------
+// ColumnarInputReader
+
+// A column chunk as described by the footer.
+struct ChunkInfo {
+  int tag;
+  uint64 offset;
+  uint64 stored_size;
+  uint64 raw_size;
+  int compression;
+  uint32 crc;
+};
+
+
+struct ColumnarInputReader::RowGroup {
+  uint64 first_record;
+  int num_records;
+  vector<ChunkInfo> chunks;
+};
+
+
+// A decoded column chunk.
+struct ColumnarInputReader::Chunk {
+  string raw;
+  vector<uint32> counts;  // for each record of the row group
+  vector<Item> items;     // pointing into raw
+  int next_item;
+};
+
+
+ColumnarInputReader* ColumnarInputReader::Open(const char* filename,
+                                               string* error) {
+  FILE* file = fopen(filename, "r");
+  if (file == NULL) {
+    *error = string("can't open ") + filename + ": " + ErrnoMessage();
+    return NULL;
+  }
+  ColumnarInputReader* reader = new ColumnarInputReader(file);
+  if (!reader->ReadFooter(error)) {
+    *error = string(filename) + ": " + *error;
+    delete reader;
+    return NULL;
+  }
+  return reader;
+}
+
+
+ColumnarInputReader::ColumnarInputReader(FILE* file)
+    : file_(file),
+      num_records_(0),
+      all_fields_(true),
+      row_group_(-1),
+      next_record_(0),
+      record_number_(-1),
+      bytes_read_(0) {
+}
+
+
+ColumnarInputReader::~ColumnarInputReader() {
+  for (int i = 0; i < row_groups_.size(); i++)
+    delete row_groups_[i];
+  for (int i = 0; i < chunks_.size(); i++)
+    delete chunks_[i];
+  fclose(file_);
+}
+
+
+bool ColumnarInputReader::ReadFooter(string* error) {
+  char magic[kMagicSize];
+  char trailer[kTrailerSize];
+  if (fread(magic, 1, kMagicSize, file_) != kMagicSize ||
+      memcmp(magic, kMagic, kMagicSize) != 0 ||
+      fseeko(file_, -kTrailerSize, SEEK_END) != 0 ||
+      fread(trailer, 1, kTrailerSize, file_) != kTrailerSize ||
+      memcmp(trailer + 8, kMagic, kMagicSize) != 0) {
+    *error = "not a columnar input file";
+    return false;
+  }
+  const int64 footer_end = ftello(file_) - kTrailerSize;
+  const uint32 footer_size = Get32(trailer);
+  if (footer_end < kMagicSize || footer_size > footer_end - kMagicSize) {
+    *error = "corrupt footer";
+    return false;
+  }
+  string footer(footer_size, '\0');
+  if (fseeko(file_, footer_end - footer_size, SEEK_SET) != 0 ||
+      fread(&footer[0], 1, footer_size, file_) != footer_size ||
+      Crc32c(0, footer.data(), footer.size()) != Get32(trailer + 4)) {
+    *error = "corrupt footer";
+    return false;
+  }
+
+  // The chunks lie between the header and the footer.
+  const uint64 chunks_end = footer_end - footer_size;
+  const char* p = footer.data();
+  const char* end = p + footer.size();
+  uint64 num_row_groups;
+  bool ok = GetBounded(&p, end, end - p, &num_row_groups);
+  for (int i = 0; i < num_row_groups && ok; i++) {
+    RowGroup* group = new RowGroup;
+    row_groups_.push_back(group);
+    group->first_record = num_records_;
+    uint64 num_records, num_chunks;
+    ok = GetBounded(&p, end, kint32max, &num_records) && num_records > 0 &&
+         GetBounded(&p, end, end - p, &num_chunks);
+    group->num_records = num_records;
+    num_records_ += num_records;
+    for (int j = 0; j < num_chunks && ok; j++) {
+      ChunkInfo c;
+      uint64 tag, compression, crc;
+      ok = GetBounded(&p, end, kint32max, &tag) &&
+           GetBounded(&p, end, chunks_end, &c.offset) &&
+           GetBounded(&p, end, chunks_end - c.offset, &c.stored_size) &&
+           GetBounded(&p, end, kMaxChunkSize, &c.raw_size) &&
+           GetBounded(&p, end, kDeflated, &compression) &&
+           GetBounded(&p, end, kuint32max, &crc) &&
+           c.offset >= kMagicSize &&
+           (j == 0 || tag > group->chunks.back().tag);
+      c.tag = tag;
+      c.compression = compression;
+      c.crc = crc;
+      group->chunks.push_back(c);
+    }
+  }
+  if (!ok || p != end) {
+    *error = "corrupt footer";
+    return false;
+  }
+  return true;
+}
+
+
+void ColumnarInputReader::SelectFields(const vector<int>& tags) {
+  all_fields_ = false;
+  tags_ = tags;
+  sort(tags_.begin(), tags_.end());
+}
+
+
+void ColumnarInputReader::SelectAllFields() {
+  all_fields_ = true;
+  tags_.clear();
+}
+
+
+bool ColumnarInputReader::ReadRowGroup(int i) {
+  for (int j = 0; j < chunks_.size(); j++)
+    delete chunks_[j];
+  chunks_.clear();
+  row_group_ = i;
+  next_record_ = 0;
+  const RowGroup* group = row_groups_[i];
+  const uint64 n = group->num_records;
+  string stored;
+  for (int j = 0; j < group->chunks.size(); j++) {
+    const ChunkInfo& c = group->chunks[j];
+    if (!all_fields_ && !binary_search(tags_.begin(), tags_.end(), c.tag))
+      continue;
+    Chunk* chunk = new Chunk;
+    chunks_.push_back(chunk);
+    chunk->next_item = 0;
+
+    // Read and check the stored bytes, and uncompress them.
+    stored.resize(c.stored_size);
+    if (fseeko(file_, c.offset, SEEK_SET) != 0 ||
+        (c.stored_size > 0 &&
+         fread(&stored[0], 1, c.stored_size, file_) != c.stored_size)) {
+      error_message_ = ferror(file_) ? ErrnoMessage() : "truncated file";
+      return false;
+    }
+    bytes_read_ += c.stored_size;
+    if (Crc32c(0, stored.data(), stored.size()) != c.crc) {
+      error_message_ = "corrupt column chunk";
+      return false;
+    }
+    if (c.compression == kDeflated) {
+      if (!Inflate(stored, c.raw_size, &chunk->raw)) {
+        error_message_ = "corrupt column chunk";
+        return false;
+      }
+    } else if (c.raw_size == c.stored_size) {
+      chunk->raw.swap(stored);
+    } else {
+      error_message_ = "corrupt column chunk";
+      return false;
+    }
+
+    // Decode the occurrence counts and the occurrences.
+    const char* p = chunk->raw.data();
+    const char* end = p + chunk->raw.size();
+    uint64 total = 0;
+    bool ok = GetRuns(&p, end, n, kint32max, &chunk->counts);
+    for (int k = 0; k < chunk->counts.size(); k++)
+      total += chunk->counts[k];
+    const int encoding = (ok && p < end) ? *p++ : -1;
+    uint64 num_items;
+    ok = ok && GetBounded(&p, end, end - p, &num_items) && num_items == total;
+    if (ok && encoding == kPlain) {
+      chunk->items.resize(num_items);
+      for (int k = 0; k < num_items && ok; k++)
+        ok = GetItem(&p, end, &chunk->items[k]);
+    } else if (ok && encoding == kDictionary) {
+      uint64 num_entries;
+      vector<Item> entries;
+      vector<uint32> indices;
+      ok = GetBounded(&p, end, end - p, &num_entries);
+      if (ok)
+        entries.resize(num_entries);
+      for (int k = 0; k < num_entries && ok; k++)
+        ok = GetItem(&p, end, &entries[k]);
+      ok = ok && num_entries > 0 &&
+           GetRuns(&p, end, num_items, num_entries - 1, &indices);
+      if (ok) {
+        chunk->items.resize(num_items);
+        for (int k = 0; k < num_items; k++)
+          chunk->items[k] = entries[indices[k]];
+      }
+    } else {
+      ok = false;
+    }
+    if (!ok || p != end) {
+      error_message_ = "corrupt column chunk";
+      return false;
+    }
+  }
+  return true;
+}
+
+
+bool ColumnarInputReader::Read(const char** record_ptr, size_t* record_size) {
+  if (!error_message_.empty())
+    return false;
+  while (row_group_ < 0 ||
+         next_record_ == row_groups_[row_group_]->num_records) {
+    if (row_group_ + 1 >= row_groups_.size())
+      return false;
+    if (!ReadRowGroup(row_group_ + 1))
+      return false;
+  }
+
+  // Reassemble the record from its fields, in order of field number.
+  record_.clear();
+  for (int i = 0; i < chunks_.size(); i++) {
+    Chunk* chunk = chunks_[i];
+    for (int j = chunk->counts[next_record_]; j > 0; j--) {
+      const Item& item = chunk->items[chunk->next_item++];
+      record_.append(item.first, item.second);
+    }
+  }
+  record_number_ = row_groups_[row_group_]->first_record + next_record_;
+  next_record_++;
+  *record_ptr = record_.data();
+  *record_size = record_.size();
+  return true;
+}
+
+
+bool ColumnarInputReader::SeekToRecord(uint64 record_number) {
+  if (record_number >= num_records_)
+    return false;
+  int i = row_groups_.size() - 1;
+  while (row_groups_[i]->first_record > record_number)
+    i--;
+  if (!ReadRowGroup(i))
+    return false;
+  // Skip the occurrences of the records before it.
+  next_record_ = record_number - row_groups_[i]->first_record;
+  for (int j = 0; j < chunks_.size(); j++) {
+    Chunk* chunk = chunks_[j];
+    for (int k = 0; k < next_record_; k++)
+      chunk->next_item += chunk->counts[k];
+  }
+  return true;
+}
+
+
+}  // namespace sawzall
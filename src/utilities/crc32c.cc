@@ -0,0 +1,100 @@
+// Copyright 2010 Google Inc.
+// 
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+// 
+//      http://www.apache.org/licenses/LICENSE-2.0
+// 
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ------------------------------------------------------------------------
+
+#include <string.h>
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <cpuid.h>
+#endif
+
+#include "public/porting.h"
+
+#include "utilities/crc32c.h"
+
+
+namespace {
+
+// The reversed Castagnoli polynomial.
+const uint32 kPolynomial = 0x82f63b78;
+
+class Crc32cTable {
+ public:
+  Crc32cTable() {
+    for (int i = 0; i < 256; i++) {
+      uint32 crc = i;
+      for (int bit = 0; bit < 8; bit++)
+        crc = (crc >> 1) ^ (kPolynomial & -(crc & 1));
+      table_[i] = crc;
+    }
+#if defined(__x86_64__) && defined(__GNUC__)
+    unsigned int eax, ebx, ecx, edx;
+    accelerated_ = __get_cpuid(1, &eax, &ebx, &ecx, &edx) &&
+                   (ecx & bit_SSE4_2) != 0;
+#else
+    accelerated_ = false;
+#endif
+  }
+
+  uint32 operator[](int i) const  { return table_[i]; }
+  bool accelerated() const  { return accelerated_; }
+
+ private:
+  uint32 table_[256];
+  bool accelerated_;
+};
+
+const Crc32cTable table;
+
+
+uint32 Crc32cSoftware(uint32 crc, const uint8* p, size_t size) {
+  for (size_t i = 0; i < size; i++)
+    crc = (crc >> 8) ^ table[(crc ^ p[i]) & 0xff];
+  return crc;
+}
+
+
+#if defined(__x86_64__) && defined(__GNUC__)
+// The instruction is emitted directly, so that no special compiler flags
+// are needed; it is only executed if the processor has it.
+uint32 Crc32cHardware(uint32 crc, const uint8* p, size_t size) {
+  uint64 crc64 = crc;
+  for (; size >= 8; p += 8, size -= 8) {
+    uint64 word;
+    memcpy(&word, p, sizeof word);
+    __asm__("crc32q %1, %0" : "+r"(crc64) : "rm"(word));
+  }
+  crc = crc64;
+  for (; size > 0; p++, size--)
+    __asm__("crc32b %1, %0" : "+r"(crc) : "rm"(*p));
+  return crc;
+}
+#endif
+
+}  // namespace
+
+
+uint32 Crc32c(uint32 crc, const char* data, size_t size) {
+  const uint8* p = reinterpret_cast<const uint8*>(data);
+  crc = ~crc;
+#if defined(__x86_64__) && defined(__GNUC__)
+  if (table.accelerated())
+    return ~Crc32cHardware(crc, p, size);
+#endif
+  return ~Crc32cSoftware(crc, p, size);
+}
+
+
+bool Crc32cIsAccelerated() {
+  return table.accelerated();
+}
@@ -0,0 +1,33 @@
+// Copyright 2010 Google Inc.
+// 
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+// 
+//      http://www.apache.org/licenses/LICENSE-2.0
+// 
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ------------------------------------------------------------------------
+
+// CRC-32C (Castagnoli), the checksum used by iSCSI, ext4 and many record
+// formats.  It is computed with the SSE 4.2 crc32 instruction when the
+// processor has it, and with a table otherwise.
+
+#ifndef _UTILITIES_CRC32C_H__
+#define _UTILITIES_CRC32C_H__
+
+#include <stddef.h>
+
+
+// Returns the CRC-32C of data[0, size) continuing from crc, which is 0
+// for the start of the data.
+uint32 Crc32c(uint32 crc, const char* data, size_t size);
+
+// Returns whether Crc32c uses the crc32 instruction.
+bool Crc32cIsAccelerated();
+
+#endif  // _UTILITIES_CRC32C_H__
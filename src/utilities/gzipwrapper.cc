@@ -13,6 +13,7 @@
 // limitations under the License.
 // ------------------------------------------------------------------------
 
+#include <unistd.h>
 #include <algorithm>
 #include <string>
 
@@ -23,10 +24,14 @@
 
 #include "utilities/gzipwrapper.h"
 #include "utilities/lzw.h"
+#include "utilities/blockgzip.h"
 
 
 const int kBufferSize = 4092;
 
+// Block gzip data at least this large may be inflated on several threads.
+const int kParallelInflateThreshold = 1 << 20;
+
 // magic numbers
 
 namespace GZipParams {
@@ -75,6 +80,8 @@ namespace CompressParams {
 
 static bool DoGZipUncompress(const unsigned char* source, int source_len,
                              string* dest);
+static bool DoBlockGZipUncompress(const unsigned char* source, int source_len,
+                                  string* dest, int num_threads);
 static bool DoZlibUncompress(const unsigned char* source, int source_len,
                              string* dest);
 static bool DoLZWUncompress(const unsigned char* source, int source_len,
@@ -83,11 +90,17 @@ static bool DoGZipOrZlibUncompress(const unsigned char* source, int source_len,
                                    string* dest, bool zlib);
 
 
-bool GunzipString(const unsigned char* source, int source_len, string* dest) {
+bool GunzipString(const unsigned char* source, int source_len, string* dest,
+                  int num_threads) {
   // check for gzip archive
   if (source_len >= GZipParams::MAGIC_SIZE &&
-      memcmp(source, GZipParams::magic, GZipParams::MAGIC_SIZE) == 0)
+      memcmp(source, GZipParams::magic, GZipParams::MAGIC_SIZE) == 0) {
+    // A block gzip file is a sequence of gzip members; inflate them all.
+    if (IsBlockGzip(reinterpret_cast<const char*>(source), source_len) &&
+        DoBlockGZipUncompress(source, source_len, dest, num_threads))
+      return true;
     return DoGZipUncompress(source, source_len, dest);
+  }
 
   // not gzip, LZW?
   if (source_len >= CompressParams::MAGIC_SIZE &&
@@ -116,8 +129,11 @@ static bool DoGZipUncompress(const unsigned char* source, int source_len,
   if ((flags[3] & GZipParams::EXTRA_FIELD) != 0) {  // skip the extra field
     if (source_len < 2)
       return false;
-    source += 2;
-    source_len -= 2;
+    const int extra_len = 2 + (source[0] | (source[1] << 8));
+    if (source_len < extra_len)
+      return false;
+    source += extra_len;
+    source_len -= extra_len;
   }
 
   if ((flags[3] & GZipParams::ORIG_NAME) != 0) {  // skip the original file name
@@ -146,6 +162,21 @@ static bool DoGZipUncompress(const unsigned char* source, int source_len,
   return DoGZipOrZlibUncompress(source, source_len, dest, false);
 }
 
+static bool DoBlockGZipUncompress(const unsigned char* source, int source_len,
+                                  string* dest, int num_threads) {
+  if (source_len < kParallelInflateThreshold)
+    num_threads = 1;
+  else if (num_threads <= 0)
+    num_threads = max(1L, sysconf(_SC_NPROCESSORS_ONLN));
+  string output;
+  string error;
+  if (BlockGzipInflate(reinterpret_cast<const char*>(source), source_len,
+                       num_threads, &output, &error) != source_len)
+    return false;
+  dest->append(output);
+  return true;
+}
+
 static bool DoZlibUncompress(const unsigned char* source, int source_len,
                              string* dest) {
   // Process the header but do not skip it, then use common code.
@@ -22,7 +22,10 @@ using namespace std;
 
 // Compression levels are 0 (none) to 9 (best); pass -1 for the default.
 
-bool GunzipString(const unsigned char* source, int source_len, string* dest);
+// Block gzip (BGZF) data of 1MB or more is inflated on up to num_threads
+// threads; 0 means one per CPU.
+bool GunzipString(const unsigned char* source, int source_len, string* dest,
+                  int num_threads = 1);
 
 // Returns true if successful. If there was an error, returns false and
 // leaves "*uncompressed" in an indeterminate state.
@@ -0,0 +1,130 @@
+// Copyright 2010 Google Inc.
+// 
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+// 
+//      http://www.apache.org/licenses/LICENSE-2.0
+// 
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ------------------------------------------------------------------------
+
+#include <string.h>
+#include <string>
+#include <vector>
+
+#include "public/porting.h"
+#include "public/logging.h"
+
+#include "utilities/literalset.h"
+
+
+LiteralSet::LiteralSet()
+  : compiled_(false),
+    num_classes_(0) {
+}
+
+
+int LiteralSet::Add(const string& literal) {
+  CHECK(!literal.empty()) << "empty literal added to set";
+  literals_.push_back(literal);
+  compiled_ = false;
+  return literals_.size() - 1;
+}
+
+
+void LiteralSet::Compile() {
+  if (compiled_)
+    return;
+  compiled_ = true;
+
+  // Number the bytes that occur in some literal; class 0 is for the rest.
+  memset(byte_class_, 0, sizeof(byte_class_));
+  num_classes_ = 1;
+  for (int i = 0; i < literals_.size(); i++) {
+    const string& literal = literals_[i];
+    for (int j = 0; j < literal.size(); j++) {
+      unsigned char b = literal[j];
+      if (byte_class_[b] == 0)
+        byte_class_[b] = num_classes_++;
+    }
+  }
+
+  // Build the trie of the literals; -1 marks a missing transition.
+  next_.assign(num_classes_, -1);
+  vector<vector<int> > ends(1);  // literals ending at each state
+  for (int i = 0; i < literals_.size(); i++) {
+    const string& literal = literals_[i];
+    int state = 0;
+    for (int j = 0; j < literal.size(); j++) {
+      int c = byte_class_[static_cast<unsigned char>(literal[j])];
+      if (next_[state * num_classes_ + c] < 0) {
+        next_[state * num_classes_ + c] = ends.size();
+        next_.resize(next_.size() + num_classes_, -1);
+        ends.resize(ends.size() + 1);
+      }
+      state = next_[state * num_classes_ + c];
+    }
+    ends[state].push_back(i);
+  }
+  const int num_states = ends.size();
+
+  // Fill in the failure transitions breadth first, so that the row of a
+  // state's failure state is complete before the state is visited, and
+  // collect the outputs: a state recognizes its own literals and those of
+  // its failure state.
+  vector<int> fail(num_states, 0);
+  vector<vector<int> > outputs(num_states);
+  vector<int> queue;
+  queue.push_back(0);
+  for (int q = 0; q < queue.size(); q++) {
+    const int state = queue[q];
+    outputs[state] = ends[state];
+    if (state != 0) {
+      const vector<int>& inherited = outputs[fail[state]];
+      outputs[state].insert(outputs[state].end(),
+                            inherited.begin(), inherited.end());
+    }
+    int* row = &next_[state * num_classes_];
+    const int* fail_row = &next_[fail[state] * num_classes_];
+    for (int c = 0; c < num_classes_; c++) {
+      if (row[c] < 0) {
+        row[c] = (state == 0) ? 0 : fail_row[c];
+      } else {
+        fail[row[c]] = (state == 0) ? 0 : fail_row[c];
+        queue.push_back(row[c]);
+      }
+    }
+  }
+
+  out_start_.resize(num_states + 1);
+  out_.clear();
+  for (int s = 0; s < num_states; s++) {
+    out_start_[s] = out_.size();
+    out_.insert(out_.end(), outputs[s].begin(), outputs[s].end());
+  }
+  out_start_[num_states] = out_.size();
+}
+
+
+void LiteralSet::Search(const char* s, int n, vector<bool>* found) const {
+  CHECK(compiled_) << "literal set searched before it was compiled";
+  found->assign(literals_.size(), false);
+  int remaining = literals_.size();
+  const unsigned char* p = reinterpret_cast<const unsigned char*>(s);
+  const unsigned char* end = p + n;
+  int state = 0;
+  while (p < end && remaining > 0) {
+    state = next_[state * num_classes_ + byte_class_[*p++]];
+    for (int i = out_start_[state]; i < out_start_[state + 1]; i++) {
+      if (!(*found)[out_[i]]) {
+        (*found)[out_[i]] = true;
+        remaining--;
+      }
+    }
+  }
+}
@@ -0,0 +1,64 @@
+// Copyright 2010 Google Inc.
+// 
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+// 
+//      http://www.apache.org/licenses/LICENSE-2.0
+// 
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ------------------------------------------------------------------------
+
+#ifndef _UTILITIES_LITERALSET_H__
+#define _UTILITIES_LITERALSET_H__
+
+// A set of byte string literals that can all be searched for in a single
+// pass over a string, using an Aho-Corasick automaton.  The automaton is
+// stored as a DFA over byte classes: bytes that occur in no literal share
+// one class, so the tables stay small for typical sets of words or URL
+// fragments.
+
+#include <string>
+#include <vector>
+
+
+class LiteralSet {
+ public:
+  LiteralSet();
+
+  // Adds a literal, which must not be empty, and returns its index.
+  // The automaton must be rebuilt before the next search.
+  int Add(const string& literal);
+
+  int size() const  { return literals_.size(); }
+
+  // Builds the automaton, if literals were added since the last call.
+  void Compile();
+
+  // Sets (*found)[i] to whether literal i occurs in s[0..n).  Compile()
+  // must have been called; searches do not change the set, so several
+  // threads may search at once.
+  void Search(const char* s, int n, vector<bool>* found) const;
+
+ private:
+  vector<string> literals_;
+  bool compiled_;
+
+  // Class of each byte value; 0 for bytes that occur in no literal.
+  int byte_class_[256];
+  int num_classes_;
+
+  // Transition table: next_[state * num_classes_ + class].
+  vector<int> next_;
+
+  // The literals recognized on entering state s are
+  // out_[out_start_[s] .. out_start_[s + 1]).
+  vector<int> out_start_;
+  vector<int> out_;
+};
+
+#endif  // _UTILITIES_LITERALSET_H__
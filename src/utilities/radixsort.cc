@@ -0,0 +1,120 @@
+// Copyright 2010 Google Inc.
+// 
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+// 
+//      http://www.apache.org/licenses/LICENSE-2.0
+// 
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ------------------------------------------------------------------------
+
+#include <string.h>
+#include <algorithm>
+#include <vector>
+
+#include "public/porting.h"
+
+#include "utilities/radixsort.h"
+
+
+namespace {
+
+// Buckets smaller than this are finished with an insertion sort.
+const int kInsertionSortThreshold = 32;
+
+// Number of buckets: one per byte value, plus bucket 0 for keys that
+// end at the current depth.
+const int kNumBuckets = 257;
+
+
+// Compares the keys of a and b, both known to agree on their first
+// depth bytes.
+inline bool LessFrom(const RadixSortElement& a, const RadixSortElement& b,
+                     int depth) {
+  const int a_len = a.length - depth;
+  const int b_len = b.length - depth;
+  const int c = memcmp(a.key + depth, b.key + depth, min(a_len, b_len));
+  return c < 0 || (c == 0 && a_len < b_len);
+}
+
+
+void InsertionSort(RadixSortElement* elements, int n, int depth) {
+  for (int i = 1; i < n; i++) {
+    RadixSortElement e = elements[i];
+    int j = i;
+    for (; j > 0 && LessFrom(e, elements[j - 1], depth); j--)
+      elements[j] = elements[j - 1];
+    elements[j] = e;
+  }
+}
+
+
+// Sorts elements[0..n), whose keys agree on their first depth bytes.
+// The byte of each key at the current depth is read once into digits,
+// so the distribution passes do not touch the keys themselves; temp and
+// digits have room for n entries.
+void MSDSort(RadixSortElement* elements, RadixSortElement* temp,
+             uint16* digits, int n, int depth) {
+  for (;;) {
+    if (n <= kInsertionSortThreshold) {
+      InsertionSort(elements, n, depth);
+      return;
+    }
+
+    int count[kNumBuckets];
+    memset(count, 0, sizeof(count));
+    for (int i = 0; i < n; i++) {
+      const RadixSortElement& e = elements[i];
+      const uint16 d = depth < e.length ?
+          static_cast<unsigned char>(e.key[depth]) + 1 : 0;
+      digits[i] = d;
+      count[d]++;
+    }
+
+    // Encoded keys often share long prefixes (e.g. type tags); skip a
+    // byte without moving anything if all the keys agree on it.
+    if (count[digits[0]] == n) {
+      if (digits[0] == 0)
+        return;  // all keys are equal
+      depth++;
+      continue;
+    }
+
+    int start[kNumBuckets];
+    int pos = 0;
+    for (int b = 0; b < kNumBuckets; b++) {
+      start[b] = pos;
+      pos += count[b];
+    }
+    int next[kNumBuckets];
+    memcpy(next, start, sizeof(next));
+    for (int i = 0; i < n; i++)
+      temp[next[digits[i]]++] = elements[i];
+    memcpy(elements, temp, n * sizeof(*elements));
+
+    // Keys in bucket 0 have ended and are all equal.
+    for (int b = 1; b < kNumBuckets; b++) {
+      if (count[b] > 1)
+        MSDSort(elements + start[b], temp, digits, count[b], depth + 1);
+    }
+    return;
+  }
+}
+
+}  // namespace
+
+
+void RadixSort(RadixSortElement* elements, int n) {
+  if (n <= kInsertionSortThreshold) {
+    InsertionSort(elements, n, 0);
+    return;
+  }
+  vector<RadixSortElement> temp(n);
+  vector<uint16> digits(n);
+  MSDSort(elements, &temp[0], &digits[0], n, 0);
+}
@@ -0,0 +1,36 @@
+// Copyright 2010 Google Inc.
+// 
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+// 
+//      http://www.apache.org/licenses/LICENSE-2.0
+// 
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ------------------------------------------------------------------------
+
+#ifndef _UTILITIES_RADIXSORT_H__
+#define _UTILITIES_RADIXSORT_H__
+
+// A most-significant-digit-first radix sort for byte string keys, such as
+// the order-preserving key encodings produced by SzlEncoder.
+
+
+// An element to be sorted: a key and a value that is carried along with it.
+struct RadixSortElement {
+  const char* key;
+  int length;
+  void* value;
+};
+
+
+// Sorts elements[0..n) by key in increasing unsigned byte order; a key
+// sorts before its extensions.  This is the order of memcmp and of
+// std::string comparison.  The sort is not stable.
+void RadixSort(RadixSortElement* elements, int n);
+
+#endif  // _UTILITIES_RADIXSORT_H__
@@ -15,29 +15,274 @@
 
 // Simple record reader and writer.
 
+#include <assert.h>
 #include <stdio.h>
 #include <errno.h>
 #include <string.h>
+#include <sys/types.h>
 #include <string>
+#include <vector>
+#include <algorithm>
+
+#include "zlib.h"
 
 #include "public/porting.h"
 #include "public/recordio.h"
 #include "public/varint.h"
 
+#include "utilities/crc32c.h"
+#include "utilities/random_base.h"
+#include "utilities/mt_random.h"
+
 
 namespace sawzall {
 
 
+namespace {
+
+// The layout of indexed files; see recordio.h.
+const char kFileMagic[] = "SZLREC2\n";
+const char kFooterMagic[] = "SZLRIDX\n";
+const int kMagicSize = 8;
+const int kSyncSize = 16;
+const int kFileHeaderSize = kMagicSize + 4 + 4 + kSyncSize;
+const int kBlockHeaderSize = 32;
+const int kFooterSize = 8 + kMagicSize;
+const int kIndexEntrySize = 16;
+
+// Block types.
+const int kRecordBlock = 1;
+const int kDeflatedRecordBlock = 2;
+const int kIndexBlock = 3;
+
+// Limit on the payload of a block, to reject corrupt sizes early.
+const uint32 kMaxPayloadSize = 1 << 30;
+
+
+uint32 Get32(const char* p) {
+  const uint8* u = reinterpret_cast<const uint8*>(p);
+  return u[0] | (u[1] << 8) | (u[2] << 16) | (static_cast<uint32>(u[3]) << 24);
+}
+
+
+uint64 Get64(const char* p) {
+  return Get32(p) | (static_cast<uint64>(Get32(p + 4)) << 32);
+}
+
+
+void Put32(uint32 v, char* p) {
+  for (int i = 0; i < 4; i++)
+    p[i] = (v >> (8 * i)) & 0xff;
+}
+
+
+void Put64(uint64 v, char* p) {
+  Put32(v & 0xffffffff, p);
+  Put32(v >> 32, p + 4);
+}
+
+
+// The fields of a block header.
+struct BlockHeader {
+  uint32 type;
+  uint32 stored_size;
+  uint32 raw_size;
+  uint32 num_records;
+  uint64 first_record;
+  uint32 payload_crc;
+};
+
+
+void EncodeBlockHeader(const BlockHeader& header, char* p) {
+  Put32(header.type, p);
+  Put32(header.stored_size, p + 4);
+  Put32(header.raw_size, p + 8);
+  Put32(header.num_records, p + 12);
+  Put64(header.first_record, p + 16);
+  Put32(header.payload_crc, p + 24);
+  Put32(Crc32c(0, p, 28), p + 28);
+}
+
+
+// Returns false if the header is corrupt.
+bool DecodeBlockHeader(const char* p, BlockHeader* header) {
+  if (Crc32c(0, p, 28) != Get32(p + 28))
+    return false;
+  header->type = Get32(p);
+  header->stored_size = Get32(p + 4);
+  header->raw_size = Get32(p + 8);
+  header->num_records = Get32(p + 12);
+  header->first_record = Get64(p + 16);
+  header->payload_crc = Get32(p + 24);
+  return header->type >= kRecordBlock && header->type <= kIndexBlock &&
+         header->stored_size <= kMaxPayloadSize &&
+         header->raw_size <= kMaxPayloadSize;
+}
+
+
+// Inflates a block payload of known size; returns false if it is corrupt.
+bool InflatePayload(const string& stored, uint32 raw_size, string* raw) {
+  raw->resize(raw_size);
+  z_stream zstream;
+  memset(&zstream, 0, sizeof zstream);
+  if (inflateInit2(&zstream, -MAX_WBITS) != Z_OK)
+    return false;
+  zstream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(stored.data()));
+  zstream.avail_in = stored.size();
+  char empty;
+  zstream.next_out =
+      reinterpret_cast<Bytef*>(raw_size > 0 ? &(*raw)[0] : &empty);
+  zstream.avail_out = raw_size;
+  int status = inflate(&zstream, Z_FINISH);
+  inflateEnd(&zstream);
+  return status == Z_STREAM_END && zstream.avail_out == 0 &&
+         zstream.avail_in == 0;
+}
+
+
+// Deflates a block payload; returns false if that does not make it smaller.
+bool DeflatePayload(const string& raw, string* stored) {
+  z_stream zstream;
+  memset(&zstream, 0, sizeof zstream);
+  if (deflateInit2(&zstream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -MAX_WBITS,
+                   8, Z_DEFAULT_STRATEGY) != Z_OK)
+    return false;
+  // Anything larger than the raw payload is of no use.
+  stored->resize(raw.size());
+  zstream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(raw.data()));
+  zstream.avail_in = raw.size();
+  char empty;
+  zstream.next_out = reinterpret_cast<Bytef*>(
+      raw.empty() ? &empty : &(*stored)[0]);
+  zstream.avail_out = stored->size();
+  int status = deflate(&zstream, Z_FINISH);
+  stored->resize(zstream.total_out);
+  deflateEnd(&zstream);
+  return status == Z_STREAM_END && stored->size() < raw.size();
+}
+
+
+string ErrnoMessage() {
+  // Not strerror_r, whose GNU version need not fill in the buffer.
+  return strerror(errno);
+}
+
+}  // namespace
+
+
+// ----------------------------------------------------------------------------
+// RecordReader
+
+struct RecordReader::Blocks {
+  Blocks() : next(NULL), end(NULL), next_record(0), block_offset(0),
+             num_records(-1), corrupt_blocks(0), at_end(false)  { }
+
+  struct IndexEntry {
+    uint64 offset;
+    uint64 first_record;
+  };
+
+  char sync[kSyncSize];
+  string stored;            // payload of the current block as stored
+  string raw;               // its records
+  const char* next;         // the next record in raw
+  const char* end;
+  uint64 next_record;       // number of the next record
+  uint64 block_offset;      // offset of the current block
+  vector<IndexEntry> index;
+  int64 num_records;        // from the index
+  int corrupt_blocks;
+  bool at_end;              // the index block or the end was reached
+};
+
+
+RecordReader::~RecordReader() {
+  if (file_ != NULL)
+    fclose(file_);
+  if (buffer_ != NULL)
+    delete [] buffer_;
+  delete blocks_;
+}
+
+
 RecordReader* RecordReader::Open(const char* filename) {
   FILE* file = fopen(filename, "r");
-  if (file != NULL)
-    return new RecordReader(file);
-  else
+  if (file == NULL)
     return NULL;
+  RecordReader* reader = new RecordReader(file);
+  char header[kFileHeaderSize];
+  size_t n = reader->ReadBytes(header, kMagicSize);
+  if (n == kMagicSize && memcmp(header, kFileMagic, kMagicSize) == 0 &&
+      reader->ReadBytes(header + kMagicSize, kFileHeaderSize - kMagicSize) ==
+          kFileHeaderSize - kMagicSize) {
+    reader->blocks_ = new Blocks;
+    memcpy(reader->blocks_->sync, header + kFileHeaderSize - kSyncSize,
+           kSyncSize);
+    reader->ReadIndex();
+  } else {
+    // A plain file, which has no header.
+    reader->Unread(header, n);
+    reader->offset_ = 0;
+  }
+  return reader;
+}
+
+
+bool RecordReader::Eof() const {
+  if (blocks_ != NULL && blocks_->at_end && blocks_->next == blocks_->end)
+    return true;
+  return unread_pos_ == unread_.size() && feof(file_);
+}
+
+
+size_t RecordReader::ReadBytes(char* data, size_t size) {
+  if (size == 1 && unread_pos_ == unread_.size()) {
+    // The common case of reading a plain file's record lengths.
+    int c = getc(file_);
+    if (c == EOF)
+      return 0;
+    *data = c;
+    offset_++;
+    return 1;
+  }
+  size_t n = min(size, unread_.size() - unread_pos_);
+  memcpy(data, unread_.data() + unread_pos_, n);
+  unread_pos_ += n;
+  if (n < size)
+    n += fread(data + n, 1, size - n, file_);
+  offset_ += n;
+  return n;
+}
+
+
+void RecordReader::Unread(const char* data, size_t size) {
+  unread_ = string(data, size) + unread_.substr(unread_pos_);
+  unread_pos_ = 0;
+  offset_ -= size;
+}
+
+
+bool RecordReader::SeekFile(uint64 offset) {
+  if (fseeko(file_, offset, SEEK_SET) != 0)
+    return false;
+  unread_.clear();
+  unread_pos_ = 0;
+  offset_ = offset;
+  return true;
 }
 
 
 bool RecordReader::Read(char** record_ptr, size_t* record_size) {
+  if (blocks_ != NULL)
+    return ReadIndexed(record_ptr, record_size);
+  if (!ReadPlain(record_ptr, record_size))
+    return false;
+  record_number_++;
+  return true;
+}
+
+
+bool RecordReader::ReadPlain(char** record_ptr, size_t* record_size) {
   char prefix[kMaxUnsignedVarint64Length];
   char* prefix_end = prefix + sizeof(prefix);
   char* end = prefix;
@@ -47,13 +292,12 @@ bool RecordReader::Read(char** record_ptr, size_t* record_size) {
       error_message_ = "Corrupt record length";
       return false;
     }
-    next = fgetc(file_);
-    if (next == EOF) {
+    if (ReadBytes(end, 1) == 0) {
       if (end != prefix)
         error_message_ = "Corrupt record length at EOF";
       return false;
     }
-    *end++ = next;
+    next = static_cast<uint8>(*end++);
   } while (next >= 128);
   uint64 size;
   DecodeUnsignedVarint64(prefix, &size);
@@ -68,19 +312,271 @@ bool RecordReader::Read(char** record_ptr, size_t* record_size) {
   }
   *record_ptr = buffer_;
   *record_size = size;
-  if (fread(buffer_, 1, size, file_) == size)
+  if (ReadBytes(buffer_, size) == size)
     return true;
   if (feof(file_)) {
     error_message_ = "EOF in the middle of a record";
     return false;
   }
-  char buffer[1024];
-  strerror_r(errno, buffer, sizeof(buffer));
-  error_message_ = buffer;
+  error_message_ = ErrnoMessage();
+  return false;
+}
+
+
+bool RecordReader::ReadIndexed(char** record_ptr, size_t* record_size) {
+  for (;;) {
+    if (NextInBlock(record_ptr, record_size)) {
+      record_number_ = blocks_->next_record - 1;
+      return true;
+    }
+    if (!ReadBlock())
+      return false;
+  }
+}
+
+
+bool RecordReader::NextInBlock(char** record_ptr, size_t* record_size) {
+  Blocks* b = blocks_;
+  if (b->next >= b->end)
+    return false;
+  uint64 size;
+  const char* data = DecodeUnsignedVarint64(b->next, &size);
+  if (data <= b->end && size <= b->end - data) {
+    *record_ptr = const_cast<char*>(data);
+    *record_size = size;
+    b->next = data + size;
+    b->next_record++;
+    return true;
+  }
+  // The block passed its check but its records are garbled.
+  b->corrupt_blocks++;
+  b->next = b->end;
   return false;
 }
 
 
+bool RecordReader::ReadBlock() {
+  Blocks* b = blocks_;
+  b->next = b->end = NULL;
+  while (!b->at_end) {
+    const uint64 block_offset = offset_;
+    char header[kSyncSize + kBlockHeaderSize];
+    const size_t header_size = ReadBytes(header, sizeof header);
+    if (header_size == 0) {
+      if (ferror(file_)) {
+        error_message_ = ErrnoMessage();
+        return false;
+      }
+      b->at_end = true;
+      break;
+    }
+    BlockHeader h;
+    bool ok = header_size == sizeof header &&
+              memcmp(header, b->sync, kSyncSize) == 0 &&
+              DecodeBlockHeader(header + kSyncSize, &h);
+    if (ok && h.type == kIndexBlock) {
+      b->at_end = true;
+      break;
+    }
+    if (ok) {
+      b->stored.resize(h.stored_size);
+      const size_t payload_size =
+          h.stored_size > 0 ? ReadBytes(&b->stored[0], h.stored_size) : 0;
+      ok = payload_size == h.stored_size &&
+           Crc32c(0, b->stored.data(), payload_size) == h.payload_crc;
+      if (ok && h.type == kDeflatedRecordBlock) {
+        ok = InflatePayload(b->stored, h.raw_size, &b->raw);
+      } else if (ok) {
+        ok = h.raw_size == h.stored_size;
+        if (ok)
+          b->raw.swap(b->stored);
+      }
+      if (ok) {
+        b->next = b->raw.data();
+        b->end = b->next + b->raw.size();
+        b->next_record = h.first_record;
+        b->block_offset = block_offset;
+        return true;
+      }
+      // The next block may start inside the payload that was read.
+      Unread(b->stored.data(), payload_size);
+    }
+    // Look for the next block after the start of the corrupt one.
+    b->corrupt_blocks++;
+    Unread(header + 1, header_size - 1);
+    if (!FindSync())
+      b->at_end = true;
+  }
+  if (b->corrupt_blocks > 0) {
+    char message[64];
+    snprintf(message, sizeof message, "Skipped %d corrupt blocks",
+             b->corrupt_blocks);
+    error_message_ = message;
+  }
+  return false;
+}
+
+
+bool RecordReader::FindSync() {
+  Blocks* b = blocks_;
+  char window[kSyncSize];
+  size_t n = ReadBytes(window, kSyncSize);
+  if (n < kSyncSize)
+    return false;
+  // window is circular: its oldest byte is at pos.
+  for (size_t pos = 0; ; pos = (pos + 1) % kSyncSize) {
+    if (window[pos] == b->sync[0]) {
+      char candidate[kSyncSize];
+      memcpy(candidate, window + pos, kSyncSize - pos);
+      memcpy(candidate + kSyncSize - pos, window, pos);
+      if (memcmp(candidate, b->sync, kSyncSize) == 0) {
+        Unread(candidate, kSyncSize);
+        return true;
+      }
+    }
+    if (ReadBytes(&window[pos], 1) == 0)
+      return false;
+  }
+}
+
+
+void RecordReader::ReadIndex() {
+  Blocks* b = blocks_;
+  const uint64 start = offset_;
+  char footer[kFooterSize];
+  char header[kSyncSize + kBlockHeaderSize];
+  BlockHeader h;
+  string payload;
+  bool ok = fseeko(file_, -kFooterSize, SEEK_END) == 0 &&
+            fread(footer, 1, kFooterSize, file_) == kFooterSize &&
+            memcmp(footer + 8, kFooterMagic, kMagicSize) == 0 &&
+            fseeko(file_, Get64(footer), SEEK_SET) == 0 &&
+            fread(header, 1, sizeof header, file_) == sizeof header &&
+            memcmp(header, b->sync, kSyncSize) == 0 &&
+            DecodeBlockHeader(header + kSyncSize, &h) &&
+            h.type == kIndexBlock &&
+            h.stored_size == h.raw_size &&
+            h.stored_size % kIndexEntrySize == 0;
+  if (ok) {
+    payload.resize(h.stored_size);
+    ok = (h.stored_size == 0 ||
+          fread(&payload[0], 1, h.stored_size, file_) == h.stored_size) &&
+         Crc32c(0, payload.data(), payload.size()) == h.payload_crc;
+  }
+  if (ok) {
+    for (int i = 0; i < payload.size(); i += kIndexEntrySize) {
+      Blocks::IndexEntry entry;
+      entry.offset = Get64(payload.data() + i);
+      entry.first_record = Get64(payload.data() + i + 8);
+      b->index.push_back(entry);
+    }
+    b->num_records = h.first_record;
+  }
+  // Return to the first block; a file that cannot seek was not moved.
+  if (!SeekFile(start))
+    clearerr(file_);
+}
+
+
+bool RecordReader::SeekToRecord(uint64 record_number) {
+  char* record_ptr;
+  size_t record_size;
+  Blocks* b = blocks_;
+  if (b == NULL) {
+    // Read up to the record.
+    while (record_number_ + 1 < static_cast<int64>(record_number))
+      if (!Read(&record_ptr, &record_size))
+        return false;
+    return record_number_ + 1 == static_cast<int64>(record_number);
+  }
+  if (b->num_records >= 0 && !b->index.empty()) {
+    if (record_number >= b->num_records)
+      return false;
+    // The last block whose first record is not after record_number.
+    int lo = 0;
+    int hi = b->index.size();
+    while (hi - lo > 1) {
+      int mid = (lo + hi) / 2;
+      if (b->index[mid].first_record <= record_number)
+        lo = mid;
+      else
+        hi = mid;
+    }
+    if (SeekFile(b->index[lo].offset)) {
+      b->next = b->end = NULL;
+      b->next_record = b->index[lo].first_record;
+      b->at_end = false;
+    }
+  }
+  if (b->next_record > record_number)
+    return false;
+  // Skip the records before it.  If it is in a corrupt block, ReadBlock
+  // moves on to the next good block, which starts after it.
+  for (;;) {
+    if (b->next >= b->end) {
+      if (!ReadBlock())
+        return false;
+    } else if (b->next_record < record_number) {
+      NextInBlock(&record_ptr, &record_size);
+    } else {
+      break;
+    }
+  }
+  record_number_ = static_cast<int64>(b->next_record) - 1;
+  return true;
+}
+
+
+bool RecordReader::SeekToOffset(uint64 offset) {
+  if (blocks_ == NULL)
+    return false;
+  if (!SeekFile(max<uint64>(offset, kFileHeaderSize)))
+    return false;
+  blocks_->next = blocks_->end = NULL;
+  blocks_->at_end = !FindSync();
+  return !blocks_->at_end;
+}
+
+
+uint64 RecordReader::block_offset() const {
+  return blocks_ != NULL ? blocks_->block_offset : 0;
+}
+
+
+int64 RecordReader::num_records() const {
+  return blocks_ != NULL ? blocks_->num_records : -1;
+}
+
+
+int RecordReader::corrupt_blocks() const {
+  return blocks_ != NULL ? blocks_->corrupt_blocks : 0;
+}
+
+
+// ----------------------------------------------------------------------------
+// RecordWriter
+
+struct RecordWriter::Blocks {
+  Blocks() : block_size(0), num_records(0), first_record(0), offset(0),
+             closed(false)  { }
+
+  char sync[kSyncSize];
+  int block_size;
+  string records;        // pending records
+  uint64 num_records;    // in records
+  uint64 first_record;   // number of the first pending record
+  uint64 offset;         // of the next block
+  string index;          // encoded index entries
+  bool closed;
+};
+
+
+RecordWriter::~RecordWriter() {
+  Close();
+  delete blocks_;
+}
+
+
 RecordWriter* RecordWriter::Open(const char* filename) {
   FILE* file = fopen(filename, "w");
   if (file != NULL)
@@ -90,18 +586,127 @@ RecordWriter* RecordWriter::Open(const char* filename) {
 }
 
 
+RecordWriter* RecordWriter::OpenIndexed(const char* filename,
+                                        int block_size) {
+  FILE* file = fopen(filename, "w");
+  if (file == NULL)
+    return NULL;
+  RecordWriter* writer = new RecordWriter(file);
+  Blocks* b = writer->blocks_ = new Blocks;
+  b->block_size = block_size;
+  MTRandom random;
+  for (int i = 0; i < kSyncSize; i += 4)
+    Put32(random.Rand32(), b->sync + i);
+  char header[kFileHeaderSize];
+  memcpy(header, kFileMagic, kMagicSize);
+  Put32(block_size, header + kMagicSize);
+  Put32(0, header + kMagicSize + 4);
+  memcpy(header + kMagicSize + 8, b->sync, kSyncSize);
+  if (!writer->WriteBytes(header, sizeof header)) {
+    delete writer;
+    return NULL;
+  }
+  b->offset = kFileHeaderSize;
+  return writer;
+}
+
+
+bool RecordWriter::WriteBytes(const char* data, size_t size) {
+  if (fwrite(data, 1, size, file_) == size)
+    return true;
+  error_message_ = ErrnoMessage();
+  return false;
+}
+
+
 bool RecordWriter::Write(const char* record_ptr, size_t record_size) {
   char prefix[kMaxUnsignedVarint64Length];
   char* end = EncodeUnsignedVarint64(prefix, record_size);
   int prefix_size = end - prefix;
-  if (fwrite(prefix, 1, prefix_size, file_) != prefix_size)
-    return false;
-  if (fwrite(record_ptr, 1, record_size, file_) == record_size)
+  if (blocks_ != NULL) {
+    Blocks* b = blocks_;
+    b->records.append(prefix, prefix_size);
+    b->records.append(record_ptr, record_size);
+    b->num_records++;
+    if (b->records.size() >= b->block_size)
+      return FlushBlock();
     return true;
-  char buffer[1024];
-  strerror_r(errno, buffer, sizeof(buffer));
-  error_message_ = buffer;
-  return false;
+  }
+  return WriteBytes(prefix, prefix_size) &&
+         WriteBytes(record_ptr, record_size);
+}
+
+
+bool RecordWriter::FlushBlock() {
+  Blocks* b = blocks_;
+  if (b->num_records == 0)
+    return true;
+  if (b->records.size() > kMaxPayloadSize) {
+    error_message_ = "Record too large";
+    return false;
+  }
+  char entry[kIndexEntrySize];
+  Put64(b->offset, entry);
+  Put64(b->first_record, entry + 8);
+  b->index.append(entry, sizeof entry);
+  string deflated;
+  bool ok;
+  if (DeflatePayload(b->records, &deflated))
+    ok = WriteBlock(kDeflatedRecordBlock, deflated, b->records.size(),
+                    b->num_records, b->first_record);
+  else
+    ok = WriteBlock(kRecordBlock, b->records, b->records.size(),
+                    b->num_records, b->first_record);
+  b->first_record += b->num_records;
+  b->num_records = 0;
+  b->records.clear();
+  return ok;
+}
+
+
+bool RecordWriter::WriteBlock(int type, const string& payload,
+                              uint64 raw_size, uint64 num_records,
+                              uint64 first_record) {
+  Blocks* b = blocks_;
+  char header[kSyncSize + kBlockHeaderSize];
+  memcpy(header, b->sync, kSyncSize);
+  BlockHeader h;
+  h.type = type;
+  h.stored_size = payload.size();
+  h.raw_size = raw_size;
+  h.num_records = num_records;
+  h.first_record = first_record;
+  h.payload_crc = Crc32c(0, payload.data(), payload.size());
+  EncodeBlockHeader(h, header + kSyncSize);
+  b->offset += sizeof header + payload.size();
+  return WriteBytes(header, sizeof header) &&
+         WriteBytes(payload.data(), payload.size());
+}
+
+
+bool RecordWriter::Close() {
+  if (file_ == NULL)
+    return error_message_.empty();
+  bool ok = true;
+  if (blocks_ != NULL) {
+    // The index block records the total number of records as the number
+    // of its first record.
+    Blocks* b = blocks_;
+    ok = FlushBlock();
+    const uint64 index_offset = b->offset;
+    ok = WriteBlock(kIndexBlock, b->index, b->index.size(), 0,
+                    b->first_record) && ok;
+    char footer[kFooterSize];
+    Put64(index_offset, footer);
+    memcpy(footer + 8, kFooterMagic, kMagicSize);
+    ok = WriteBytes(footer, sizeof footer) && ok;
+  }
+  if (fclose(file_) != 0 && ok) {
+    error_message_ = ErrnoMessage();
+    ok = false;
+  }
+  file_ = NULL;
+  return ok;
 }
 
 
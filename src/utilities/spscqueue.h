@@ -0,0 +1,106 @@
+// Copyright 2010 Google Inc.
+// 
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+// 
+//      http://www.apache.org/licenses/LICENSE-2.0
+// 
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ------------------------------------------------------------------------
+
+// A bounded, lock-free queue for exactly one producer thread and one
+// consumer thread.  The producer only writes tail_ and the consumer only
+// writes head_, so neither side ever takes a lock; a memory barrier
+// orders each slot access with the index update that publishes it.
+
+#ifndef _UTILITIES_SPSCQUEUE_H__
+#define _UTILITIES_SPSCQUEUE_H__
+
+#include <sched.h>
+#include <unistd.h>
+
+
+template <class T>
+class SPSCQueue {
+ public:
+  // Creates a queue that holds at most capacity elements.
+  explicit SPSCQueue(int capacity)
+      : size_(capacity + 1), slots_(new T[capacity + 1]), head_(0), tail_(0) {
+  }
+  ~SPSCQueue()  { delete[] slots_; }
+
+  // Producer: appends value; returns false if the queue is full.
+  bool TryPush(const T& value) {
+    const int tail = tail_;
+    const int next = Next(tail);
+    if (next == Load(&head_))
+      return false;
+    slots_[tail] = value;
+    Store(&tail_, next);
+    return true;
+  }
+
+  // Consumer: removes the oldest element into *value; returns false if
+  // the queue is empty.
+  bool TryPop(T* value) {
+    const int head = head_;
+    if (head == Load(&tail_))
+      return false;
+    *value = slots_[head];
+    Store(&head_, Next(head));
+    return true;
+  }
+
+  // Blocking variants; they back off while the queue is full or empty.
+  void Push(const T& value) {
+    for (int attempts = 0; !TryPush(value); attempts++)
+      Wait(attempts);
+  }
+  void Pop(T* value) {
+    for (int attempts = 0; !TryPop(value); attempts++)
+      Wait(attempts);
+  }
+
+  // Waits a little before the next attempt: first by yielding the
+  // processor, then, if the other side stays busy, by sleeping.
+  static void Wait(int attempts) {
+    if (attempts < kYields)
+      sched_yield();
+    else
+      usleep(kSleepMicros);
+  }
+
+ private:
+  static const int kYields = 100;
+  static const int kSleepMicros = 50;
+
+  int Next(int i) const  { return i + 1 == size_ ? 0 : i + 1; }
+
+  // Reads an index written by the other thread before the slot access
+  // that depends on it.
+  static int Load(volatile int* index) {
+    int i = *index;
+    __sync_synchronize();
+    return i;
+  }
+
+  // Publishes an index after the slot access that precedes it.
+  static void Store(volatile int* index, int i) {
+    __sync_synchronize();
+    *index = i;
+  }
+
+  const int size_;
+  T* slots_;
+  // Keep the indices written by the two threads on separate cache lines.
+  volatile int head_;
+  char pad_[64];
+  volatile int tail_;
+};
+
+#endif  // _UTILITIES_SPSCQUEUE_H__
@@ -692,27 +692,124 @@ DualString::~DualString() {
 
 // Wrappers for regular expressions.
 
+// A compiled pattern and its study data (NULL if not studied, or if study
+// found nothing to speed up matching); the study data holds the JIT code.
+struct CompiledRegexp {
+  pcre* re;
+  pcre_extra* extra;
+};
+
+
+#ifdef PCRE_STUDY_JIT_COMPILE
+static const int kStudyOptions = PCRE_STUDY_JIT_COMPILE;
+// The JIT stack starts small and grows on demand up to this size.
+static const int kJitStackStart = 32 * 1024;
+static const int kJitStackMax = 1024 * 1024;
+
+// A compiled pattern may be shared by several threads (constant regexps
+// are compiled once per executable), so its study data is never changed
+// after compilation.  Instead JIT code asks for its stack through a
+// callback that returns the stack of the match running on this thread,
+// or NULL for the machine stack.
+static __thread pcre_jit_stack* current_jit_stack = NULL;
+
+static pcre_jit_stack* CurrentJitStack(void* unused) {
+  return current_jit_stack;
+}
+#else
+static const int kStudyOptions = 0;
+#endif
+
+
 // Compile pattern.  Return value is an opaque void* so client
 // knows nothing of underlying library.  NULL return indicates
 // error; *errbufp will hold error string.
 
 // Pattern is NUL-terminated UTF-8
-void* CompileRegexp(const char* pattern8, const char** errbufp) {
+void* CompileRegexp(const char* pattern8, const char** errbufp, bool study) {
   int eoffset;
   pcre* re = pcre_compile(pattern8, PCRE_UTF8, errbufp, &eoffset, NULL);
-  return static_cast<void*>(re);
+  if (re == NULL)
+    return NULL;
+  CompiledRegexp* compiled = new CompiledRegexp;
+  compiled->re = re;
+  compiled->extra = NULL;
+  if (study) {
+    // A study error only means we match without its help.
+    const char* study_error;
+    compiled->extra = pcre_study(re, kStudyOptions, &study_error);
+#ifdef PCRE_STUDY_JIT_COMPILE
+    if (compiled->extra != NULL &&
+        (compiled->extra->flags & PCRE_EXTRA_EXECUTABLE_JIT) != 0)
+      pcre_assign_jit_stack(compiled->extra, CurrentJitStack, NULL);
+#endif
+  }
+  return static_cast<void*>(compiled);
+}
+
+
+RegexpScratch::RegexpScratch()
+  : jit_stack_(NULL),
+    ovector_(NULL),
+    ovector_size_(0) {
+}
+
+
+RegexpScratch::~RegexpScratch() {
+#ifdef PCRE_STUDY_JIT_COMPILE
+  if (jit_stack_ != NULL)
+    pcre_jit_stack_free(static_cast<pcre_jit_stack*>(jit_stack_));
+#endif
+  delete [] ovector_;
+}
+
+
+void* RegexpScratch::jit_stack() {
+#ifdef PCRE_STUDY_JIT_COMPILE
+  if (jit_stack_ == NULL)
+    jit_stack_ = pcre_jit_stack_alloc(kJitStackStart, kJitStackMax);
+#endif
+  return jit_stack_;
+}
+
+
+int* RegexpScratch::ovector(int n) {
+  if (n > ovector_size_) {
+    delete [] ovector_;
+    ovector_size_ = n;
+    ovector_ = new int[n];
+  }
+  return ovector_;
+}
+
+
+// Returns the study data to pass to pcre_exec(), pointing JIT code run
+// on this thread at the stack in scratch, or at the machine stack if
+// scratch is NULL.  The study data itself is not modified.
+static pcre_extra* PrepareExtra(CompiledRegexp* compiled,
+                                RegexpScratch* scratch) {
+#ifdef PCRE_STUDY_JIT_COMPILE
+  if (compiled->extra != NULL &&
+      (compiled->extra->flags & PCRE_EXTRA_EXECUTABLE_JIT) != 0) {
+    current_jit_stack = NULL;
+    if (scratch != NULL)
+      current_jit_stack = static_cast<pcre_jit_stack*>(scratch->jit_stack());
+  }
+#endif
+  return compiled->extra;
 }
 
 
 // Execute expression given compiled regexp.
 // Return value is 1 if we have matches, 0 if we don't have matches,
 // and < 0 if we have an error (the the result is the pcre_exec() error code).
-int SimpleExecRegexp(void* compiled_pattern, const char* utf8, int utf8_len) {
+int SimpleExecRegexp(void* compiled_pattern, const char* utf8, int utf8_len,
+                     RegexpScratch* scratch) {
   CHECK(compiled_pattern != NULL);
-  pcre* re = static_cast<pcre*>(compiled_pattern);
+  CompiledRegexp* compiled = static_cast<CompiledRegexp*>(compiled_pattern);
   // do the matching
-  int nvec = pcre_exec(re,         // compiled pattern
-                       NULL,       // we did not study the pattern
+  int nvec = pcre_exec(compiled->re,  // compiled pattern
+                       PrepareExtra(compiled, scratch),  // study data
                        utf8,       // UTF-8 encoded string
                        utf8_len,   // number of bytes in string
                        0,          // beginning byte offset
@@ -731,45 +828,58 @@ int SimpleExecRegexp(void* compiled_pattern, const char* utf8, int utf8_len) {
 // Return value is number of elements >= 0 of matches[] array filled in;
 // result is pcre_exec() error code if < 0.
 int DualExecRegexp(void* compiled_pattern, DualString* dual,
-                   int offsets[], int byte_offsets[], int noffsets) {
+                   int offsets[], int byte_offsets[], int noffsets,
+                   RegexpScratch* scratch) {
   assert(compiled_pattern != NULL);
   int nvec;
+  // PCRE rounds this down to a multiple of 3, so make it large enough
   const int kNvec = 2 + (noffsets * 3) / 2;
-  int* vec = new int[kNvec];
-  pcre* re = static_cast<pcre*>(compiled_pattern);
+  // Avoid allocation if possible.
+  const int kStackNvec = 32;
+  int stack_vec[kStackNvec];
+  int* vec = stack_vec;
+  if (scratch != NULL)
+    vec = scratch->ovector(kNvec);
+  else if (kNvec > kStackNvec)
+    vec = new int[kNvec];
+  CompiledRegexp* compiled = static_cast<CompiledRegexp*>(compiled_pattern);
   // do the matching
-  // PCRE rounds this down to a multiple of 3, so make it large enough
-  nvec = pcre_exec(re,               // compiled pattern
-                   NULL,             // we did not study the pattern
+  nvec = pcre_exec(compiled->re,     // compiled pattern
+                   PrepareExtra(compiled, scratch),  // study data
                    dual->utf8(),     // UTF-8 encoded string
                    dual->num_utf8(), // number of bytes in string
                    0,                // beginning byte offset
                    PCRE_NO_UTF8_CHECK,  // options
                    vec,              // vector of byte pos pairs
                    kNvec);           // length of vector
-  if (nvec == PCRE_ERROR_NOMATCH) {  // has value -1 !
-    delete [] vec;
-    return 0;
+  if (nvec >= 0) {
+    nvec *= 2;  // convert #matches to #elements in array
+    if (nvec > noffsets)
+      nvec = noffsets;
+    // convert byte positions back into rune positions.  Fix -1s in vec
+    dual->ConvertPositions(offsets, vec, nvec);
+    // copy byte offsets back to user.
+    memmove(byte_offsets, vec, nvec * sizeof vec[0]);
+  } else if (nvec == PCRE_ERROR_NOMATCH) {  // has value -1 !
+    nvec = 0;
   }
-  if (nvec < 0) {
+  if (vec != stack_vec && scratch == NULL)
     delete [] vec;
-    return nvec;
-  }
-  nvec *= 2;  // convert #matches to #elements in array
-  if (nvec > noffsets)
-    nvec = noffsets;
-  // convert byte positions back into rune positions.  Fix -1s in vec
-  dual->ConvertPositions(offsets, vec, nvec);
-  // copy byte offsets back to user.
-  memmove(byte_offsets, vec, nvec * sizeof vec[0]);
-  delete [] vec;
   return nvec;
 }
 
 
 void FreeRegexp(void* pattern) {
-  pcre* re = static_cast<pcre*>(pattern);
-  (*pcre_free)(re);
+  CompiledRegexp* compiled = static_cast<CompiledRegexp*>(pattern);
+  if (compiled->extra != NULL) {
+#ifdef PCRE_STUDY_JIT_COMPILE
+    pcre_free_study(compiled->extra);
+#else
+    (*pcre_free)(compiled->extra);
+#endif
+  }
+  (*pcre_free)(compiled->re);
+  delete compiled;
 }
 
 
@@ -113,17 +113,45 @@ class DualString {
 
 // Support for regular expressions.
 // Compiled pattern is returned as an opaque void*, hiding underlying library.
+// Unless 'study' is false, the pattern is also studied and, where the
+// library supports it, JIT compiled; this costs more than a single match,
+// so patterns used only once should not be studied.
 // 'pattern' must be NUL-terminated.
-void* CompileRegexp(const char* pattern, const char** errbufp);
+void* CompileRegexp(const char* pattern, const char** errbufp,
+                    bool study = true);
+
+// Space reused across matches: the stack for JIT compiled patterns and
+// the match vector.  It must not be used by two threads at once; each
+// Proc has its own (see Proc::regexp_scratch()).
+class RegexpScratch {
+ public:
+  RegexpScratch();
+  ~RegexpScratch();
+
+  // Returns the JIT stack, allocating it on first use.
+  void* jit_stack();
+
+  // Returns a match vector with room for at least n ints.
+  int* ovector(int n);
+
+ private:
+  void* jit_stack_;
+  int* ovector_;
+  int ovector_size_;
+};
 
 // Match pattern against the compiled RE, returning vector of match
 // positions. matches[0,1] is match of whole string; match[2,3]
 // is match of first parenthesized subexpression, etc.
+// If scratch is NULL, the match uses the machine stack and a temporary
+// match vector.
 int DualExecRegexp(void* compiled_pattern, DualString *dual,
-                   int matches[], int byte_matches[], int nmatches);
+                   int matches[], int byte_matches[], int nmatches,
+                   RegexpScratch* scratch = NULL);
 
 // Like ExecRegexp, but only checks for presence of a match.
-int SimpleExecRegexp(void* compiled_pattern, const char* utf8, int nutf8);
+int SimpleExecRegexp(void* compiled_pattern, const char* utf8, int nutf8,
+                     RegexpScratch* scratch = NULL);
 
 // Free compiled regular expression.
 void FreeRegexp(void* pattern);
@@ -14,10 +14,16 @@
 // ------------------------------------------------------------------------
 
 #include <stdio.h>
+#include <math.h>
 #include <time.h>
+#include <string.h>
+#include <string>
+#include <vector>
 
 #include "unicode/utypes.h"
 #include "unicode/timezone.h"
+#include "unicode/basictz.h"
+#include "unicode/tztrans.h"
 #include "unicode/udat.h"
 #include "unicode/ustring.h"
 
@@ -29,7 +35,9 @@
 #include "utilities/timeutils.h"
 
 
+using icu::BasicTimeZone;
 using icu::TimeZone;
+using icu::TimeZoneTransition;
 using icu::UnicodeString;
 
 
@@ -74,6 +82,32 @@ const int kMillisecPerSec = 1000;
 // ===========================================================================
 
 
+// Returns a new ICU TimeZone for an Olson identifier, or NULL if the
+// identifier is not recognized.
+
+static TimeZone* CreateTimeZone(const char* id) {
+  // TODO: check whether we will ever need non-ASCII identifiers
+  // (and if we do, convert our UTF-8 to a UChar string first.)
+  TimeZone* timezone = TimeZone::createTimeZone(id);
+  CHECK(timezone != NULL);
+  // ICU does not directly say if the id was found, but we can deduce it.
+  if (timezone->getRawOffset() == 0 && strcasecmp(id, "GMT") != 0) {
+    // getID() returns "GMT" iff "id" is "GMT" or is not recognized.
+    UnicodeString id_string;
+    timezone->getID(id_string);
+    if (id_string.length() == 3) {
+      const UChar* id = id_string.getBuffer();
+      if (id[0] == 'G' && id[1] == 'M' && id[2] == 'T') {
+        // the id is "GMT" so the identifier was not found
+        delete timezone;
+        timezone = NULL;
+      }
+    }
+  }
+  return timezone;
+}
+
+
 // Get ICU TimeZone objects through a class to simplify managing a cache
 // and dealing with deletion of non-cached instances.
 
@@ -106,24 +140,7 @@ CachedTimeZone::CachedTimeZone(const char* id) {
     }
     timezone_ = default_timezone_;
   } else {
-    // TODO: check whether we will ever need non-ASCII identifiers
-    // (and if we do, convert our UTF-8 to a UChar string first.)
-    timezone_ = TimeZone::createTimeZone(id);
-    CHECK(timezone_ != NULL);
-    // ICU does not directly say if the id was found, but we can deduce it.
-    if (timezone_->getRawOffset() == 0 && strcasecmp(id, "GMT") != 0) {
-      // getID() returns "GMT" iff "id" is "GMT" or is not recognized.
-      UnicodeString id_string;
-      timezone_->getID(id_string);
-      if (id_string.length() == 3) {
-        const UChar* id = id_string.getBuffer();
-        if (id[0] == 'G' && id[1] == 'M' && id[2] == 'T') {
-          // the id is "GMT" so the identifier was not found
-          delete timezone_;
-          timezone_ = NULL;
-        }
-      }
-    }
+    timezone_ = CreateTimeZone(id);
   }
 }
 
@@ -247,24 +264,14 @@ bool SzlTimeToLocalTime(uint64 t, const char* tzid,
 }
 
 
-bool LocalTimeToSzlTime(const struct tm& tm, int microsec, const char* tzid,
-                        bool from_string, uint64* t) {
-  int offset;                // time zone offset in seconds
-  int isdst = tm.tm_isdst;   // only used for ambiguous hour at end of DST
-  const char* olson_id;
-  const char* rfc_std_id;    // RFC822 id for standard time this time zone
-  const char* rfc_dst_id;    // RFC822 id for DST this time zone
-  const char* rfc_olson_id;  // Olson id for this RFC822 id
-  int rfc_isdst;             // whether DST according to RFC822 identifier
-  assert(tzid != NULL);
-
+// Convert local time to (double) ms since the epoch, as if it were UTC.
+static bool LocalTimeToUDate(const struct tm& tm, UDate* udate) {
   // Convert time to an epoch-based value.  We use mkgmtime() but we cannot
   // represent local time near the ends of the time_t UTC range when local
   // time does not fit in the time_t range.  We handle that by adjusting
   // the time by one year for 1969 and 2038 and then adjusting back, relying
   // on the fact that 1969, 1970, 2037 and 2038 are not leap years.
   struct tm adjusted_tm = tm;
-  UDate udate;
   int range_adjust = 0;
   if (adjusted_tm.tm_year == 69) {
     adjusted_tm.tm_year = 70;
@@ -276,48 +283,15 @@ bool LocalTimeToSzlTime(const struct tm& tm, int microsec, const char* tzid,
   time_t adjusted_time = mkgmtime(&adjusted_tm);
   if (adjusted_time == static_cast<time_t>(-1))
     return false;
-  // (double) ms since the epoch, local time
-  udate = (static_cast<UDate>(adjusted_time) + range_adjust) * kMillisecPerSec;
-
-  // Check for default and RFC822 identifiers.
-  if (tzid[0] == '\0') {
-    olson_id = CachedTimeZone::kDefaultOlsonId;
-  } else if (zone2tm(tzid, &offset, &rfc_isdst, &rfc_std_id, &rfc_dst_id,
-                     &rfc_olson_id)) {
-    if (rfc_olson_id == NULL) {
-      // [A-IK-Z] or GMT, no DST; just use the offset
-      udate -= offset * kMillisecPerSec;
-      *t = static_cast<uint64>(udate) * kMicrosecPerMillisec + microsec;
-      return true;
-    } else if (rfc_isdst == 0 || rfc_isdst == 1) {
-      // PST/PDT/MST/MDT/CST/CDT/EST/EDT.
-      if (from_string) {
-        // We continue to honor incorrect DST-ness for compatibility.
-        udate -= offset * kMillisecPerSec;
-        *t = static_cast<uint64>(udate) * kMicrosecPerMillisec + microsec;
-        return true;
-      } else {
-        // Use ICU, but remember that we specified expected DST-ness.
-        olson_id = rfc_olson_id;
-        isdst = rfc_isdst;
-      }
-    } else {
-      // PST8PDT/MST7MDT/CST6CDT/EST5EDT.
-      // Use ICU, but no preference on DST-ness.
-      olson_id = rfc_olson_id;
-    }
-  } else {
-    // Must be an Olson time, use ICU.
-    // We leave isdst unchanged which works well for some
-    // intrinsics (e.g. trunctominute) and could be surprising for others.
-    olson_id = tzid;
-  }
+  *udate = (static_cast<UDate>(adjusted_time) + range_adjust) * kMillisecPerSec;
+  return true;
+}
 
 
-  CachedTimeZone cached_timezone(olson_id);
-  TimeZone* timezone = cached_timezone.timezone();
-  if (timezone == NULL)
-    return false;
+// Convert local time, as (double) ms since the epoch, to a time value
+// using an ICU time zone.  isdst is 1 if an ambiguous local time is DST.
+static bool IcuLocalTimeToSzlTime(const TimeZone* timezone, UDate udate,
+                                  int isdst, int microsec, uint64* t) {
   int32_t raw_offset_ms;
   int32_t dst_offset_ms;
   UErrorCode error_code = U_ZERO_ERROR;
@@ -379,6 +353,65 @@ bool LocalTimeToSzlTime(const struct tm& tm, int microsec, const char* tzid,
 }
 
 
+bool LocalTimeToSzlTime(const struct tm& tm, int microsec, const char* tzid,
+                        bool from_string, uint64* t) {
+  int offset;                // time zone offset in seconds
+  int isdst = tm.tm_isdst;   // only used for ambiguous hour at end of DST
+  const char* olson_id;
+  const char* rfc_std_id;    // RFC822 id for standard time this time zone
+  const char* rfc_dst_id;    // RFC822 id for DST this time zone
+  const char* rfc_olson_id;  // Olson id for this RFC822 id
+  int rfc_isdst;             // whether DST according to RFC822 identifier
+  assert(tzid != NULL);
+
+  // (double) ms since the epoch, local time
+  UDate udate;
+  if (!LocalTimeToUDate(tm, &udate))
+    return false;
+
+  // Check for default and RFC822 identifiers.
+  if (tzid[0] == '\0') {
+    olson_id = CachedTimeZone::kDefaultOlsonId;
+  } else if (zone2tm(tzid, &offset, &rfc_isdst, &rfc_std_id, &rfc_dst_id,
+                     &rfc_olson_id)) {
+    if (rfc_olson_id == NULL) {
+      // [A-IK-Z] or GMT, no DST; just use the offset
+      udate -= offset * kMillisecPerSec;
+      *t = static_cast<uint64>(udate) * kMicrosecPerMillisec + microsec;
+      return true;
+    } else if (rfc_isdst == 0 || rfc_isdst == 1) {
+      // PST/PDT/MST/MDT/CST/CDT/EST/EDT.
+      if (from_string) {
+        // We continue to honor incorrect DST-ness for compatibility.
+        udate -= offset * kMillisecPerSec;
+        *t = static_cast<uint64>(udate) * kMicrosecPerMillisec + microsec;
+        return true;
+      } else {
+        // Use ICU, but remember that we specified expected DST-ness.
+        olson_id = rfc_olson_id;
+        isdst = rfc_isdst;
+      }
+    } else {
+      // PST8PDT/MST7MDT/CST6CDT/EST5EDT.
+      // Use ICU, but no preference on DST-ness.
+      olson_id = rfc_olson_id;
+    }
+  } else {
+    // Must be an Olson time, use ICU.
+    // We leave isdst unchanged which works well for some
+    // intrinsics (e.g. trunctominute) and could be surprising for others.
+    olson_id = tzid;
+  }
+
+
+  CachedTimeZone cached_timezone(olson_id);
+  TimeZone* timezone = cached_timezone.timezone();
+  if (timezone == NULL)
+    return false;
+  return IcuLocalTimeToSzlTime(timezone, udate, isdst, microsec, t);
+}
+
+
 // convert uint64 to C string
 bool SzlTime2Str(uint64 szlt, const char* tz,
                  char (*buf)[kMaxTimeStringLen + 1]) {
@@ -420,4 +453,251 @@ bool date2uint64(const char* date, const char* tz, uint64* timep) {
 }
 
 
+
+// Fill in *tm from seconds since the epoch; the date is computed directly
+// from the day count, in the proleptic Gregorian calendar.
+void SecondsToCivilTime(int64 seconds, struct tm* tm) {
+  // Days before the first of each month, in a non-leap year.
+  static const int kDaysBeforeMonth[12] =
+    {0, 31, 59, 90, 120, 151, 181, 212, 243, 273, 304, 334};
+  const int kSecondsPerDay = 24 * 60 * 60;
+
+  memset(tm, 0, sizeof(*tm));
+  int64 days = seconds / kSecondsPerDay;
+  int secs = seconds % kSecondsPerDay;
+  if (secs < 0) {
+    secs += kSecondsPerDay;
+    days--;
+  }
+  tm->tm_hour = secs / 3600;
+  tm->tm_min = (secs / 60) % 60;
+  tm->tm_sec = secs % 60;
+  tm->tm_wday = (days + 4) % 7;  // 1970-01-01 was a Thursday
+  if (tm->tm_wday < 0)
+    tm->tm_wday += 7;
+
+  // Count from 0000-03-01 so that leap days end each 4, 100 and 400 year
+  // cycle; an era is 400 years, or 146097 days.
+  days += 719468;
+  const int64 era = (days >= 0 ? days : days - 146096) / 146097;
+  const int day_of_era = days - era * 146097;
+  const int year_of_era = (day_of_era - day_of_era / 1460 +
+                           day_of_era / 36524 - day_of_era / 146096) / 365;
+  const int day_of_year = day_of_era - (365 * year_of_era + year_of_era / 4 -
+                                        year_of_era / 100);
+  const int shifted_month = (5 * day_of_year + 2) / 153;  // March is 0
+  const int month = (shifted_month < 10) ? shifted_month + 2
+                                         : shifted_month - 10;
+  const int64 year = year_of_era + era * 400 + (month < 2 ? 1 : 0);
+  tm->tm_mday = day_of_year - (153 * shifted_month + 2) / 5 + 1;
+  tm->tm_mon = month;
+  tm->tm_year = year - 1900;
+  const bool leap = (year % 4 == 0) && (year % 100 != 0 || year % 400 == 0);
+  tm->tm_yday = kDaysBeforeMonth[month] + tm->tm_mday - 1 +
+                ((leap && month >= 2) ? 1 : 0);
+}
+
+
+// ===========================================================================
+
+
+// An interval of time, in seconds since the epoch, with a constant offset.
+struct TimeZoneCache::Interval {
+  int64 start;   // first second of the interval
+  int64 end;     // first second after the interval
+  int offset;    // seconds to add to UTC to get local time
+  int isdst;
+};
+
+
+// A resolved time zone identifier.
+struct TimeZoneCache::Zone {
+  Zone() : valid(false), timezone(NULL), basic(NULL), offset(0),
+           isdst(-1), last(0)  { }
+  ~Zone()  { delete timezone; }
+
+  string id;
+  bool valid;              // whether the identifier was recognized
+  TimeZone* timezone;      // NULL for fixed offset time zones
+  const BasicTimeZone* basic;  // timezone, if it can report transitions
+  int offset;              // offset of a fixed offset time zone
+  int isdst;               // DST-ness implied by the identifier, or -1
+  vector<Interval> intervals;  // sorted by start, not overlapping
+  int last;                // index of the interval last used
+};
+
+
+TimeZoneCache::TimeZoneCache()
+  : last_zone_(NULL) {
+}
+
+
+TimeZoneCache::~TimeZoneCache() {
+  Clear();
+}
+
+
+void TimeZoneCache::Clear() {
+  for (int i = 0; i < zones_.size(); i++)
+    delete zones_[i];
+  zones_.clear();
+  last_zone_ = NULL;
+}
+
+
+// Resolves the identifier as SzlTimeToLocalTime and LocalTimeToSzlTime do.
+TimeZoneCache::Zone* TimeZoneCache::Lookup(const char* tz) {
+  if (last_zone_ != NULL && strcmp(last_zone_->id.c_str(), tz) == 0)
+    return last_zone_;
+  for (int i = 0; i < zones_.size(); i++) {
+    if (strcmp(zones_[i]->id.c_str(), tz) == 0) {
+      last_zone_ = zones_[i];
+      return last_zone_;
+    }
+  }
+
+  if (zones_.size() >= kMaxZones)
+    Clear();
+  Zone* zone = new Zone;
+  zone->id = tz;
+  const char* olson_id;
+  int offset;
+  int rfc_isdst;
+  const char* rfc_std_id;
+  const char* rfc_dst_id;
+  const char* rfc_olson_id;
+  if (tz[0] == '\0') {
+    olson_id = CachedTimeZone::kDefaultOlsonId;
+  } else if (zone2tm(tz, &offset, &rfc_isdst, &rfc_std_id, &rfc_dst_id,
+                     &rfc_olson_id)) {
+    olson_id = rfc_olson_id;
+    if (rfc_olson_id == NULL) {
+      zone->valid = true;
+      zone->offset = offset;
+    } else if (rfc_isdst == 0 || rfc_isdst == 1) {
+      zone->isdst = rfc_isdst;
+    }
+  } else {
+    olson_id = tz;
+  }
+  if (olson_id != NULL) {
+    zone->timezone = CreateTimeZone(olson_id);
+    zone->valid = (zone->timezone != NULL);
+    zone->basic = dynamic_cast<const BasicTimeZone*>(zone->timezone);
+  }
+  zones_.push_back(zone);
+  last_zone_ = zone;
+  return zone;
+}
+
+
+// Finds the offset of an ICU time zone, asking ICU for it and for the
+// surrounding transitions only if no interval seen so far covers the time.
+void TimeZoneCache::GetOffset(Zone* zone, int64 seconds,
+                              int* offset, int* isdst) {
+  vector<Interval>& intervals = zone->intervals;
+  if (zone->last < intervals.size()) {
+    const Interval& interval = intervals[zone->last];
+    if (interval.start <= seconds && seconds < interval.end) {
+      *offset = interval.offset;
+      *isdst = interval.isdst;
+      return;
+    }
+  }
+  // Find the first interval starting after seconds.
+  int lo = 0;
+  int hi = intervals.size();
+  while (lo < hi) {
+    int mid = (lo + hi) / 2;
+    if (intervals[mid].start <= seconds)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  if (lo > 0 && seconds < intervals[lo - 1].end) {
+    zone->last = lo - 1;
+    *offset = intervals[lo - 1].offset;
+    *isdst = intervals[lo - 1].isdst;
+    return;
+  }
+
+  // (double) ms since the epoch, in UTC
+  UDate udate = static_cast<UDate>(seconds) * kMillisecPerSec;
+  int32_t raw_offset_ms;
+  int32_t dst_offset_ms;
+  UErrorCode error_code = U_ZERO_ERROR;
+  zone->timezone->getOffset(udate, false, raw_offset_ms, dst_offset_ms,
+                            error_code);
+  assert(error_code == U_ZERO_ERROR);
+  *offset = (raw_offset_ms + dst_offset_ms) / kMillisecPerSec;
+  *isdst = (dst_offset_ms != 0);
+  if (zone->basic == NULL)
+    return;  // cannot tell how long the offset lasts
+
+  Interval interval;
+  interval.offset = *offset;
+  interval.isdst = *isdst;
+  interval.start = kint64min;
+  interval.end = kint64max;
+  TimeZoneTransition transition;
+  if (zone->basic->getPreviousTransition(udate, true, transition))
+    interval.start = static_cast<int64>(
+        ceil(transition.getTime() / kMillisecPerSec));
+  if (zone->basic->getNextTransition(udate, false, transition))
+    interval.end = static_cast<int64>(
+        ceil(transition.getTime() / kMillisecPerSec));
+  if (interval.start > seconds || interval.end <= seconds)
+    return;  // transition within the second; do not cache
+  if (intervals.size() >= kMaxIntervals) {
+    intervals.clear();
+    lo = 0;
+  }
+  intervals.insert(intervals.begin() + lo, interval);
+  zone->last = lo;
+}
+
+
+bool TimeZoneCache::ToLocalTime(uint64 t, const char* tz, struct tm* tm,
+                                int* microsec) {
+  CHECK(tz != NULL);
+  if ((t / kMicrosecPerSec) > kint32max)
+    return false;
+  int64 seconds = t / kMicrosecPerSec;
+  Zone* zone = Lookup(tz);
+  if (!zone->valid)
+    return false;
+  int offset;
+  int isdst;
+  if (zone->timezone == NULL) {
+    offset = zone->offset;
+    isdst = 0;
+  } else {
+    GetOffset(zone, seconds, &offset, &isdst);
+  }
+  if (microsec != NULL)
+    *microsec = t % kMicrosecPerSec;
+  SecondsToCivilTime(seconds + offset, tm);
+  tm->tm_isdst = isdst;  // needed for round trip of ambiguous local time
+  return true;
+}
+
+
+bool TimeZoneCache::ToSzlTime(const struct tm& tm, int microsec,
+                              const char* tz, uint64* t) {
+  assert(tz != NULL);
+  UDate udate;
+  if (!LocalTimeToUDate(tm, &udate))
+    return false;
+  Zone* zone = Lookup(tz);
+  if (!zone->valid)
+    return false;
+  if (zone->timezone == NULL) {
+    udate -= zone->offset * kMillisecPerSec;
+    *t = static_cast<uint64>(udate) * kMicrosecPerMillisec + microsec;
+    return true;
+  }
+  int isdst = (zone->isdst >= 0) ? zone->isdst : tm.tm_isdst;
+  return IcuLocalTimeToSzlTime(zone->timezone, udate, isdst, microsec, t);
+}
+
 }  // namespace sawzall
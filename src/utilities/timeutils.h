@@ -13,6 +13,9 @@
 // limitations under the License.
 // ------------------------------------------------------------------------
 
+#include <string>
+#include <vector>
+
 #include "utilities/strtotm.h"
 
 namespace sawzall {
@@ -41,4 +44,47 @@ bool SzlTime2Str(uint64 szlt, const char* tz,
 bool date2uint64(const char* date, const char* tz, uint64* timep);
 
 
+// Fill in the date and time fields of *tm, including tm_wday and tm_yday,
+// from a count of seconds since the epoch, as gmtime_r() does; the other
+// fields are cleared.
+void SecondsToCivilTime(int64 seconds, struct tm* tm);
+
+
+// A cache of the time zones used by one thread, such as the time intrinsics
+// of one Proc; it takes no locks.  It keeps each time zone identifier it
+// has seen resolved to a fixed offset or to an ICU time zone and, for ICU
+// time zones, the intervals between DST transitions that converted times
+// have fallen in, so that most conversions need no call to ICU.
+
+class TimeZoneCache {
+ public:
+  TimeZoneCache();
+  ~TimeZoneCache();
+
+  // Same as SzlTimeToLocalTime(t, tz, tm, microsec, NULL), except that the
+  // fields of *tm that gmtime_r() sets but does not document are cleared.
+  bool ToLocalTime(uint64 t, const char* tz, struct tm* tm, int* microsec);
+
+  // Same as LocalTimeToSzlTime(tm, microsec, tz, false, t).
+  bool ToSzlTime(const struct tm& tm, int microsec, const char* tz,
+                 uint64* t);
+
+ private:
+  struct Interval;
+  struct Zone;
+
+  // Limits on the size of the cache; when one is reached the cache is
+  // emptied.
+  static const int kMaxZones = 64;
+  static const int kMaxIntervals = 1024;
+
+  Zone* Lookup(const char* tz);
+  void GetOffset(Zone* zone, int64 seconds, int* offset, int* isdst);
+  void Clear();
+
+  vector<Zone*> zones_;
+  Zone* last_zone_;  // the zone last looked up
+};
+
+
 }  // end namespace sawzall